@@ -0,0 +1,50 @@
+#include "AlertThrottle.h"
+
+AlertThrottle::AlertThrottle()
+	: lastEmission_(boost::posix_time::not_a_date_time)
+{}
+
+bool AlertThrottle::shouldEmit(const boost::posix_time::ptime& time, const std::list<AnCommon::Object>& objects, int intervalSeconds) {
+	std::vector<cv::Rect> rects;
+	rects.reserve(objects.size());
+	for (std::list<AnCommon::Object>::const_iterator i = objects.begin(); i != objects.end(); ++i) {
+		rects.push_back(i->getRect());
+	}
+	bool objectsChanged = !allMatched(rects, objects_) || !allMatched(objects_, rects);
+	objects_.swap(rects);
+	return shouldEmit(time, intervalSeconds, objectsChanged);
+}
+
+bool AlertThrottle::shouldEmit(const boost::posix_time::ptime& time, int intervalSeconds) {
+	return shouldEmit(time, intervalSeconds, false);
+}
+
+bool AlertThrottle::shouldEmit(const boost::posix_time::ptime& time, int intervalSeconds, bool objectsChanged) {
+	if (intervalSeconds <= 0 || time.is_special() || lastEmission_.is_special() || objectsChanged
+		// время кадров могло пойти назад (переподключение камеры)
+		|| time < lastEmission_
+		|| time - lastEmission_ >= boost::posix_time::seconds(intervalSeconds)
+	) {
+		lastEmission_ = time;
+		return true;
+	}
+	return false;
+}
+
+bool AlertThrottle::allMatched(const std::vector<cv::Rect>& rects, const std::vector<cv::Rect>& others) {
+	for (size_t i = 0; i < rects.size(); i++) {
+		bool matched = false;
+		for (size_t j = 0; j < others.size() && !matched; j++) {
+			matched = (rects[i] & others[j]).area() > 0;
+		}
+		if (!matched) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void AlertThrottle::clear() {
+	lastEmission_ = boost::posix_time::not_a_date_time;
+	objects_.clear();
+}
@@ -0,0 +1,74 @@
+#ifndef AlertThrottle_h_
+#define AlertThrottle_h_
+
+#include <list>
+#include <vector>
+#include <boost/date_time.hpp>
+#include "AnCommon.h"
+
+/**
+ * Решает, на каких кадрах детектор сообщает результат.
+ *
+ * Состояние хранится для каждого объекта: объект кадра сопоставляется с объектами предыдущего кадра
+ * по пересечению обрамляющих прямоугольников (как в ResultStream). Результат сообщается сразу, если появился
+ * объект, не пересекающийся ни с одним прежним, или исчез прежний объект, поэтому тревога по новому объекту
+ * не подавляется тем, что другой объект уже стоит. Пока объекты те же, результат сообщается не чаще одного раза
+ * за интервал alertTime_, и все изменения, накопившиеся за интервал, попадают в один отчёт. На остальных кадрах
+ * детектор продолжает обновлять своё состояние, но не строит и не сериализует результат.
+ */
+class AlertThrottle {
+
+public:
+
+	/**
+	 * Создаёт объект, который сообщит результат первого же кадра.
+	 */
+	AlertThrottle();
+
+	/**
+	 * Решает, нужно ли сообщить результат кадра, и, если нужно, запоминает время сообщения.
+	 *
+	 * @param time время кадра.
+	 * @param objects объекты кадра.
+	 * @param intervalSeconds интервал между сообщениями в секундах, при неположительном значении сообщается каждый кадр.
+	 * @return true - результат кадра нужно построить и сообщить.
+	 */
+	bool shouldEmit(const boost::posix_time::ptime& time, const std::list<AnCommon::Object>& objects, int intervalSeconds);
+
+	/**
+	 * То же, что shouldEmit() с объектами предыдущего кадра: кадр пропущен, и объекты не пересчитывались.
+	 */
+	bool shouldEmit(const boost::posix_time::ptime& time, int intervalSeconds);
+
+	/**
+	 * Забывает время последнего сообщения и объекты, следующий кадр будет сообщён.
+	 */
+	void clear();
+
+private:
+
+	/**
+	 * Время последнего сообщённого кадра.
+	 */
+	boost::posix_time::ptime lastEmission_;
+
+	/**
+	 * Обрамляющие прямоугольники объектов последнего кадра.
+	 */
+	std::vector<cv::Rect> objects_;
+
+	/**
+	 * Решает по времени кадра и изменению объектов.
+	 *
+	 * @param objectsChanged объект появился или исчез.
+	 */
+	bool shouldEmit(const boost::posix_time::ptime& time, int intervalSeconds, bool objectsChanged);
+
+	/**
+	 * Показывает, что каждый прямоугольник @a rects пересекается хотя бы с одним из @a others.
+	 */
+	static bool allMatched(const std::vector<cv::Rect>& rects, const std::vector<cv::Rect>& others);
+
+};
+
+#endif // AlertThrottle_h_
@@ -1,4 +1,6 @@
 #include "AnCommon.h"
+#include "RleMask.h"
+#include <boost/thread/tss.hpp>
 #include <logging/logging.hpp>
 
 namespace AnCommon {
@@ -8,12 +10,34 @@ int& frameMinification() {
 	return value;
 }
 
+/**
+ * Дополнительное уменьшение кадров текущего потока, если оно задано.
+ */
+static boost::thread_specific_ptr<int> threadMinification;
+
+int getFrameMinification() {
+	int* extra = threadMinification.get();
+	return extra ? frameMinification() * *extra : frameMinification();
+}
+
+ScopedFrameMinification::ScopedFrameMinification(int factor) {
+	if (!threadMinification.get()) {
+		threadMinification.reset(new int(1));
+	}
+	previous_ = *threadMinification;
+	*threadMinification = previous_ * factor;
+}
+
+ScopedFrameMinification::~ScopedFrameMinification() {
+	*threadMinification = previous_;
+}
+
 int getMaxBlockWidth() {
-	return 20 / frameMinification();
+	return 20 / getFrameMinification();
 }
 
 int getMaxBlockHeight() {
-	return 20 / frameMinification();
+	return 20 / getFrameMinification();
 }
 	
 float getAverageChanelValueInRect(const cv::Mat& image, int x, int y, int sizeX, int sizeY, int channel) {
@@ -70,6 +94,14 @@ int countNonZeroPixelsInMaskRange(const cv::Mat& mask, int x, int y, int width,
 	return result;
 }
 
+int countNonZeroPixelsInMaskRange(const BitMask& mask, int x, int y, int width, int height) {
+	int left = std::max(x, 0);
+	int top = std::max(y, 0);
+	int right = std::min(x + width, mask.size().width - 1);
+	int bottom = std::min(y + height, mask.size().height - 1);
+	return mask.countNonZero(cv::Rect(left, top, right - left + 1, bottom - top + 1));
+}
+
 int findNumWhitePixels(
 	cv::Mat& img,
 	CvPoint left_top,
@@ -194,31 +226,42 @@ cv::Mat getBitMap(const cv::Mat& mask, const cv::Size& blockSize, int pixelsThre
 	return result;
 }
 
-std::string getXMLBitMap(const cv::Mat& mask, cv::Size blockSize) {
-	std::stringstream result;
-	result << "<blockSize>";
-	{
-		result << "<w>" << blockSize.width * AnCommon::frameMinification() << "</w>";
-		result << "<h>" << blockSize.height * AnCommon::frameMinification() << "</h>";
-	}
-	result << "</blockSize>";
-
-	result << "<data>";
-	result << "\n";
-
-	for (int y = 0; y < mask.size().height; y++) {
-		result << "<line>";
-		for (int x = 0; x < mask.size().width; x++) {
-			if (mask.ptr(y)[x]) {
-				result << "1";
-			} else {
-				result << "0";
-			}
+cv::Mat getBitMap(const BitMask& mask, const cv::Size& blockSize, int pixelsThresholdPercent) {
+	u_int8_t zero = 0;
+	cv::Mat result = cv::Mat(cv::Size(mask.size().width / blockSize.width, mask.size().height / blockSize.height), CV_8U, zero);
+	cv::Size truncatedSize(result.size().width * blockSize.width, result.size().height * blockSize.height);
+	
+	for (int y = 0, blockY = 0; y < truncatedSize.height; y += blockSize.height, blockY++) {
+		for (int x = 0, blockX = 0; x < truncatedSize.width; x += blockSize.width, blockX++) {
+			result.ptr(blockY)[blockX] = AnCommon::countNonZeroPixelsInMaskRange(mask, x, y, blockSize.width, blockSize.height) > pixelsThresholdPercent * blockSize.area() / 100;
 		}
-		result << "</line>";
 	}
-	result << "</data>";
 	
+	return result;
+}
+
+std::string getXMLBitMap(const cv::Mat& mask, cv::Size blockSize) {
+	// карта почти целиком из нулей, поэтому строки собираются по сериям, а не посимвольно
+	return getXMLBitMap(RleMask(mask), blockSize);
+}
+
+std::string getXMLObject(const Object& object, cv::Size blockSize) {
+	cv::Rect rect = object.getRect();
+	std::stringstream result;
+	result << "<object>";
+	result << "<id>";
+	result << object.getId();
+	result << "</id>";
+	result << "<points>";
+	result << rect.x * blockSize.width * getFrameMinification();
+	result << ",";
+	result << rect.y * blockSize.height * getFrameMinification();
+	result << ",";
+	result << (rect.x + rect.width ) * blockSize.width * getFrameMinification();
+	result << ",";
+	result << (rect.y + rect.height) * blockSize.height * getFrameMinification();
+	result << "</points>";
+	result << "</object>";
 	return result.str();
 }
 
@@ -227,24 +270,12 @@ std::string getXMLObjectList(std::list<Object> objects, cv::Size blockSize, int
 	result << "<objects>";
 	for (std::list<Object>::iterator i = objects.begin(); i != objects.end(); i++) {
 		cv::Rect rect = i->getRect();
-		int area = blockSize.area() * rect.area() * frameMinification();
+		// площадь в пикселях анализируемого кадра, как и пороги, которые детекторы считают от его размера
+		int area = blockSize.area() * rect.area();
 		LOG4CXX_TRACE(logger(), "Object's area = " << area);
 		if (minObjectArea <= area && area <= maxObjectArea) {
 			LOG4CXX_TRACE(logger(), "Area is in valid range, object #" << i->getId());
-			result << "<object>";
-			result << "<id>";
-			result << i->getId();
-			result << "</id>";
-			result << "<points>";
-			result << rect.x * blockSize.width * frameMinification();
-			result << ",";
-			result << rect.y * blockSize.height * frameMinification();
-			result << ",";
-			result << (rect.x + rect.width ) * blockSize.width * frameMinification();
-			result << ",";
-			result << (rect.y + rect.height) * blockSize.height * frameMinification();
-			result << "</points>";
-			result << "</object>";	
+			result << getXMLObject(*i, blockSize);
 		}
 	}
 	result << "</objects>";
@@ -11,12 +11,14 @@
 
 #include <map>
 #include <boost/date_time.hpp>
+#include <boost/utility.hpp>
 #include <exception>
 #include <list>
 #include <set>
 #include <time.h>
 #include <logging/logging.hpp>
 #include "Object.h"
+#include "BitMask.h"
 #include "Errors.h"
 
 /**
@@ -82,11 +84,80 @@ typedef std::vector< std::vector<cv::Point> > Contours;
  * @}
  */
 
+/**
+ * Горизонтальная серия ненулевых пикселей маски (элемент кодирования длинами серий).
+ */
+struct Span {
+	
+	/**
+	 * Строка, в которой лежит серия.
+	 */
+	int y;
+	
+	/**
+	 * Первый столбец серии.
+	 */
+	int x;
+	
+	/**
+	 * Длина серии в пикселях.
+	 */
+	int length;
+	
+	/**
+	 * Создаёт серию по строке, первому столбцу и длине.
+	 */
+	Span(int y_, int x_, int length_)
+		: y(y_)
+		, x(x_)
+		, length(length_) {};
+};
+
+/**
+ * Список серий, упорядоченный по строкам, а внутри строки -- по столбцам.
+ */
+typedef std::vector<Span> Spans;
+
 /**
  * Коэффициент линейного уменьшения, которое применяется к каждому пришедшему на обработку кадру.
  */
 int& frameMinification();
 
+/**
+ * Коэффициент уменьшения кадров, анализируемых в текущем потоке: frameMinification() с учётом
+ * дополнительного уменьшения ScopedFrameMinification. Размеры в результатах пересчитываются по нему.
+ */
+int getFrameMinification();
+
+/**
+ * Дополнительно уменьшает коэффициент кадров, анализируемых в текущем потоке, на время жизни объекта
+ * (например, исполнитель уменьшает кадры перегруженного потока камеры, см. DegradationPolicy).
+ */
+class ScopedFrameMinification
+	: boost::noncopyable
+{
+
+public:
+
+	/**
+	 * @param factor во сколько раз кадры уменьшены дополнительно.
+	 */
+	explicit ScopedFrameMinification(int factor);
+
+	/**
+	 * Восстанавливает прежнее уменьшение.
+	 */
+	~ScopedFrameMinification();
+
+private:
+
+	/**
+	 * Дополнительное уменьшение до создания объекта.
+	 */
+	int previous_;
+
+};
+
 /**
  * Верхнее ограничение на размер блока, @see getSizeInBlocks().
  * 
@@ -130,8 +201,8 @@ cv::Size getSizeInBlocks(const cv::Mat& src);
  * 
  * @param mask входная маска, 1 - объект, 0 - не объект.
  * @param approxLevel параметр алгоритма Дугласа-Пейкера.
- * @param minObjectArea минимальная площадь объекта.
- * @param maxObjectArea максимальная площадь объекта.
+ * @param minObjectArea минимальная площадь объекта в пикселях анализируемого (уменьшенного) кадра.
+ * @param maxObjectArea максимальная площадь объекта в пикселях анализируемого (уменьшенного) кадра.
  * @return список объектов.
  */
 std::list<Object> createObjectList(const cv::Mat& mask, double approxLevel, int minObjectArea = std::numeric_limits<int>().min(), int maxObjectArea = std::numeric_limits<int>().max());
@@ -146,6 +217,11 @@ std::list<Object> createObjectList(const cv::Mat& mask, double approxLevel, int
  */
 cv::Mat getBitMap(const cv::Mat& mask, const cv::Size& blockSize, int pixelsThresholdPercent);
 
+/**
+ * То же, что и getBitMap() для cv::Mat, но подсчёт пикселей в блоке выполняется по словам упакованной маски.
+ */
+cv::Mat getBitMap(const BitMask& mask, const cv::Size& blockSize, int pixelsThresholdPercent);
+
 /**
  * Преобразует битовую карту в строку формате в xml.
  *
@@ -155,6 +231,15 @@ cv::Mat getBitMap(const cv::Mat& mask, const cv::Size& blockSize, int pixelsThre
  */
 std::string getXMLBitMap(const cv::Mat& mask, cv::Size blockSize);
 
+/**
+ * Преобразует объект в элемент <object> формата xml.
+ *
+ * @param object объект, обрамляющий прямоугольник задан в блоках.
+ * @param blockSize размер блока в пикселях.
+ * @return строка в формате xml.
+ */
+std::string getXMLObject(const Object& object, cv::Size blockSize);
+
 /**
  * Преобразует список объектов в строку формате в xml. 
  * 
@@ -171,6 +256,11 @@ std::string getXMLObjectList(std::list<Object> objects, cv::Size blockSize, int
  */
 int countNonZeroPixelsInMaskRange(const cv::Mat& mask, int x, int y, int width, int height);
 
+/**
+ * Подсчитать количество ненулевых элементов в прямоугольнике упакованной маски, границы обрабатываются так же, как для cv::Mat.
+ */
+int countNonZeroPixelsInMaskRange(const BitMask& mask, int x, int y, int width, int height);
+
 /**
  * Находит количество белых(значение которых равно 255) пикселей в прямоугольной области, заданным левой верхней и правой нижней вершинами.
  *
@@ -0,0 +1,251 @@
+#include "BitMask.h"
+#include <algorithm>
+#include <boost/bind.hpp>
+#include "Errors.h"
+#include "WorkStealingPool.h"
+
+namespace AnCommon {
+
+/**
+ * Наименьшее количество слов в полосе строк, обрабатываемой одной задачей пула.
+ */
+static const int BAND_WORDS = 8192;
+
+BitMask::BitMask()
+	: width_(0)
+	, height_(0)
+	, wordsPerRow_(0)
+{}
+
+BitMask::BitMask(const cv::Size& size)
+	: width_(0)
+	, height_(0)
+	, wordsPerRow_(0)
+{
+	resize(size);
+}
+
+void BitMask::resize(const cv::Size& size) {
+	width_ = size.width;
+	height_ = size.height;
+	wordsPerRow_ = (width_ + BITS_PER_WORD - 1) / BITS_PER_WORD;
+	words_.assign(static_cast<size_t>(wordsPerRow_) * height_, 0);
+}
+
+BitMask BitMask::fromMat(const cv::Mat& mask) {
+	BitMask result;
+	result.assign(mask);
+	return result;
+}
+
+void BitMask::assign(const cv::Mat& mask) {
+	if (mask.type() != CV_8UC1) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": mask");
+	}
+
+	if (mask.size() != size()) {
+		resize(mask.size());
+	}
+
+	for (int y = 0; y < height_; y++) {
+		const uchar* src = mask.ptr(y);
+		Word* dst = row(y);
+		for (int k = 0, x = 0; k < wordsPerRow_; k++) {
+			Word word = 0;
+			int end = std::min(x + BITS_PER_WORD, width_);
+			for (int bit = 0; x < end; x++, bit++) {
+				word |= static_cast<Word>(src[x] != 0) << bit;
+			}
+			dst[k] = word;
+		}
+	}
+}
+
+cv::Mat BitMask::toMat(uchar value) const {
+	u_int8_t zero = 0;
+	cv::Mat result(size(), CV_8U, zero);
+	for (int y = 0; y < height_; y++) {
+		const Word* src = row(y);
+		uchar* dst = result.ptr(y);
+		for (int k = 0; k < wordsPerRow_; k++) {
+			Word word = src[k];
+			while (word) {
+				int bit = __builtin_ctzll(word);
+				dst[k * BITS_PER_WORD + bit] = value;
+				word &= word - 1;
+			}
+		}
+	}
+	return result;
+}
+
+cv::Size BitMask::size() const {
+	return cv::Size(width_, height_);
+}
+
+int BitMask::width() const {
+	return width_;
+}
+
+int BitMask::height() const {
+	return height_;
+}
+
+bool BitMask::empty() const {
+	return width_ == 0 || height_ == 0;
+}
+
+int BitMask::wordsPerRow() const {
+	return wordsPerRow_;
+}
+
+BitMask::Word* BitMask::row(int y) {
+	return &words_[static_cast<size_t>(y) * wordsPerRow_];
+}
+
+const BitMask::Word* BitMask::row(int y) const {
+	return &words_[static_cast<size_t>(y) * wordsPerRow_];
+}
+
+bool BitMask::get(int x, int y) const {
+	return (row(y)[x / BITS_PER_WORD] >> (x % BITS_PER_WORD)) & 1;
+}
+
+void BitMask::set(int x, int y, bool value) {
+	Word bit = static_cast<Word>(1) << (x % BITS_PER_WORD);
+	Word& word = row(y)[x / BITS_PER_WORD];
+	if (value) {
+		word |= bit;
+	} else {
+		word &= ~bit;
+	}
+}
+
+void BitMask::clear() {
+	std::fill(words_.begin(), words_.end(), 0);
+}
+
+int BitMask::countNonZero() const {
+	int result = 0;
+	for (size_t i = 0; i < words_.size(); i++) {
+		result += __builtin_popcountll(words_[i]);
+	}
+	return result;
+}
+
+int BitMask::countNonZero(const cv::Rect& rect) const {
+	if (rect.width <= 0 || rect.height <= 0) {
+		return 0;
+	}
+
+	int firstWord = rect.x / BITS_PER_WORD;
+	int lastWord = (rect.x + rect.width - 1) / BITS_PER_WORD;
+	Word firstMask = ~static_cast<Word>(0) << (rect.x % BITS_PER_WORD);
+	int lastBits = (rect.x + rect.width) % BITS_PER_WORD;
+	Word lastMask = lastBits ? (static_cast<Word>(1) << lastBits) - 1 : ~static_cast<Word>(0);
+	if (firstWord == lastWord) {
+		firstMask &= lastMask;
+	}
+
+	int result = 0;
+	for (int y = rect.y; y < rect.y + rect.height; y++) {
+		const Word* words = row(y);
+		result += __builtin_popcountll(words[firstWord] & firstMask);
+		if (firstWord != lastWord) {
+			for (int k = firstWord + 1; k < lastWord; k++) {
+				result += __builtin_popcountll(words[k]);
+			}
+			result += __builtin_popcountll(words[lastWord] & lastMask);
+		}
+	}
+	return result;
+}
+
+BitMask::Word BitMask::lastWordMask() const {
+	int bits = width_ % BITS_PER_WORD;
+	return bits ? (static_cast<Word>(1) << bits) - 1 : ~static_cast<Word>(0);
+}
+
+void BitMask::morphologyStep(bool isErode) {
+	if (empty()) {
+		return;
+	}
+
+	buf_.resize(words_.size());
+
+	// большие маски обрабатываются полосами строк в общем пуле, маленькие -- в вызывающем потоке
+	WorkStealingPool& pool = WorkStealingPool::getDefault();
+	int bandRows = std::max(1, BAND_WORDS / wordsPerRow_);
+	pool.parallelFor(0, height_, bandRows, boost::bind(&BitMask::morphologyRowsHorizontal, this, isErode, _1, _2));
+	pool.parallelFor(0, height_, bandRows, boost::bind(&BitMask::morphologyRowsVertical, this, isErode, _1, _2));
+}
+
+void BitMask::morphologyRowsHorizontal(bool isErode, int rowBegin, int rowEnd) {
+	// значение пикселей за границей изображения
+	const Word outside = isErode ? ~static_cast<Word>(0) : 0;
+	const Word lastMask = lastWordMask();
+	const int n = wordsPerRow_;
+
+	// каждый пиксель объединяется с левым и правым соседом
+	for (int y = rowBegin; y < rowEnd; y++) {
+		const Word* src = row(y);
+		Word* dst = &buf_[static_cast<size_t>(y) * n];
+		Word prev = outside;
+		Word cur = n == 1 ? (src[0] | (outside & ~lastMask)) : src[0];
+		for (int k = 0; k < n; k++) {
+			Word next = outside;
+			if (k + 1 < n) {
+				next = k + 1 == n - 1 ? (src[k + 1] | (outside & ~lastMask)) : src[k + 1];
+			}
+			Word left = (cur << 1) | (prev >> (BITS_PER_WORD - 1));
+			Word right = (cur >> 1) | (next << (BITS_PER_WORD - 1));
+			dst[k] = isErode ? (cur & left & right) : (cur | left | right);
+			prev = cur;
+			cur = next;
+		}
+	}
+}
+
+void BitMask::morphologyRowsVertical(bool isErode, int rowBegin, int rowEnd) {
+	const Word outside = isErode ? ~static_cast<Word>(0) : 0;
+	const Word lastMask = lastWordMask();
+	const int n = wordsPerRow_;
+
+	// каждая строка объединяется с верхней и нижней строкой горизонтального прохода
+	for (int y = rowBegin; y < rowEnd; y++) {
+		const Word* up = y > 0 ? &buf_[static_cast<size_t>(y - 1) * n] : 0;
+		const Word* mid = &buf_[static_cast<size_t>(y) * n];
+		const Word* down = y + 1 < height_ ? &buf_[static_cast<size_t>(y + 1) * n] : 0;
+		Word* dst = row(y);
+		for (int k = 0; k < n; k++) {
+			Word u = up ? up[k] : outside;
+			Word d = down ? down[k] : outside;
+			dst[k] = isErode ? (u & mid[k] & d) : (u | mid[k] | d);
+		}
+		dst[n - 1] &= lastMask;
+	}
+}
+
+void BitMask::erode(int iterations) {
+	for (int i = 0; i < iterations; i++) {
+		morphologyStep(true);
+	}
+}
+
+void BitMask::dilate(int iterations) {
+	for (int i = 0; i < iterations; i++) {
+		morphologyStep(false);
+	}
+}
+
+void BitMask::open(int iterations) {
+	erode(iterations);
+	dilate(iterations);
+}
+
+void BitMask::close(int iterations) {
+	dilate(iterations);
+	erode(iterations);
+}
+
+} // namespace AnCommon
@@ -0,0 +1,206 @@
+#ifndef BitMask_h_
+#define BitMask_h_
+
+#include <opencv/cv.h>
+#include <opencv/cv.hpp>
+#include <vector>
+#include <stdint.h>
+
+namespace AnCommon {
+
+/**
+ * Бинарная маска, упакованная по 64 пикселя в машинное слово.
+ *
+ * Бит с номером i слова k строки y соответствует пикселю (k * 64 + i, y).
+ * Биты за правой границей изображения в последнем слове строки всегда равны нулю.
+ */
+class BitMask {
+
+public:
+
+	/**
+	 * Тип машинного слова.
+	 */
+	typedef uint64_t Word;
+
+	/**
+	 * Количество пикселей в одном слове.
+	 */
+	static const int BITS_PER_WORD = 64;
+
+	/**
+	 * Создаёт пустую маску.
+	 */
+	BitMask();
+
+	/**
+	 * Создаёт маску заданного размера, заполненную нулями.
+	 *
+	 * @param size размер маски в пикселях.
+	 */
+	explicit BitMask(const cv::Size& size);
+
+	/**
+	 * Создаёт маску по одноканальной 8-битной матрице, ненулевые элементы становятся единицами.
+	 *
+	 * @param mask исходная маска.
+	 * @return упакованная маска.
+	 */
+	static BitMask fromMat(const cv::Mat& mask);
+
+	/**
+	 * Перезаполняет маску по одноканальной 8-битной матрице, не перевыделяя память при совпадении размеров.
+	 *
+	 * @param mask исходная маска.
+	 */
+	void assign(const cv::Mat& mask);
+
+	/**
+	 * Распаковывает маску в одноканальную 8-битную матрицу.
+	 *
+	 * @param value значение, которым отмечаются единичные пиксели (обычно 1 или 255).
+	 * @return распакованная маска.
+	 */
+	cv::Mat toMat(uchar value = 1) const;
+
+	/**
+	 * Размер маски в пикселях.
+	 *
+	 * @{
+	 */
+	cv::Size size() const;
+
+	int width() const;
+
+	int height() const;
+	/**
+	 * @}
+	 */
+
+	/**
+	 * Показывает, что маска не содержит ни одного пикселя.
+	 */
+	bool empty() const;
+
+	/**
+	 * Количество слов, отводимое на одну строку.
+	 */
+	int wordsPerRow() const;
+
+	/**
+	 * Указатель на первое слово строки @a y.
+	 *
+	 * @{
+	 */
+	Word* row(int y);
+
+	const Word* row(int y) const;
+	/**
+	 * @}
+	 */
+
+	/**
+	 * Возвращает значение пикселя.
+	 */
+	bool get(int x, int y) const;
+
+	/**
+	 * Устанавливает значение пикселя.
+	 */
+	void set(int x, int y, bool value);
+
+	/**
+	 * Обнуляет все пиксели маски.
+	 */
+	void clear();
+
+	/**
+	 * Количество единичных пикселей во всей маске.
+	 */
+	int countNonZero() const;
+
+	/**
+	 * Количество единичных пикселей в прямоугольнике, который должен лежать внутри маски.
+	 *
+	 * @param rect прямоугольник.
+	 */
+	int countNonZero(const cv::Rect& rect) const;
+
+	/**
+	 * Морфологические операции с квадратным ядром 3x3, повторяющие cv::erode, cv::dilate и cv::morphologyEx
+	 * с ядром по умолчанию (в том числе обработку границ: при эрозии пиксели за границей считаются единичными,
+	 * при наращивании -- нулевыми).
+	 *
+	 * @param iterations количество повторений.
+	 * @{
+	 */
+	void erode(int iterations = 1);
+
+	void dilate(int iterations = 1);
+
+	void open(int iterations = 1);
+
+	void close(int iterations = 1);
+	/**
+	 * @}
+	 */
+
+private:
+
+	/**
+	 * Ширина маски в пикселях.
+	 */
+	int width_;
+
+	/**
+	 * Высота маски в пикселях.
+	 */
+	int height_;
+
+	/**
+	 * Количество слов на строку.
+	 */
+	int wordsPerRow_;
+
+	/**
+	 * Слова маски, строка за строкой.
+	 */
+	std::vector<Word> words_;
+
+	/**
+	 * Буфер строк для морфологических операций.
+	 */
+	std::vector<Word> buf_;
+
+	/**
+	 * Маска значащих битов последнего слова строки.
+	 */
+	Word lastWordMask() const;
+
+	/**
+	 * Один шаг эрозии или наращивания.
+	 *
+	 * @param isErode true - эрозия, false - наращивание.
+	 */
+	void morphologyStep(bool isErode);
+
+	/**
+	 * Горизонтальный проход шага морфологии по строкам [rowBegin, rowEnd): из маски в буфер.
+	 */
+	void morphologyRowsHorizontal(bool isErode, int rowBegin, int rowEnd);
+
+	/**
+	 * Вертикальный проход шага морфологии по строкам [rowBegin, rowEnd): из буфера в маску.
+	 */
+	void morphologyRowsVertical(bool isErode, int rowBegin, int rowEnd);
+
+	/**
+	 * Изменяет размер маски, содержимое не сохраняется.
+	 */
+	void resize(const cv::Size& size);
+
+};
+
+} // namespace AnCommon
+
+#endif // BitMask_h_
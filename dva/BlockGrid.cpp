@@ -0,0 +1,90 @@
+#include "BlockGrid.h"
+#include <algorithm>
+
+const int64_t BlockGrid::NO_TIME = 0;
+
+BlockGrid::BlockGrid()
+	: isDirty_(true)
+{}
+
+int64_t BlockGrid::toTicks(const boost::posix_time::ptime& time) {
+	static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+	return (time - epoch).total_microseconds();
+}
+
+void BlockGrid::resize(const cv::Size& size) {
+	if (size == size_) {
+		return;
+	}
+	size_ = size;
+	size_t count = static_cast<size_t>(size_.area());
+	isObject_.assign(count, 0);
+	isStanding_.assign(count, 0);
+	appearTime_.assign(count, NO_TIME);
+	dirtyBlocks_.assign(count, 1);
+	isDirty_ = true;
+}
+
+cv::Size BlockGrid::size() const {
+	return size_;
+}
+
+uchar* BlockGrid::isObject() {
+	return isObject_.empty() ? 0 : &isObject_[0];
+}
+
+void BlockGrid::updateStanding(int64_t now, int64_t supervisionTicks) {
+	const size_t count = isObject_.size();
+	const uchar* object = count ? &isObject_[0] : 0;
+	uchar* standing = count ? &isStanding_[0] : 0;
+	int64_t* appear = count ? &appearTime_[0] : 0;
+	uchar* dirty = count ? &dirtyBlocks_[0] : 0;
+	uchar anyChanged = 0;
+
+	// Без ветвлений: блок без объекта обнуляется, стоящим блок становится лишь при уже известном времени появления.
+	for (size_t i = 0; i < count; i++) {
+		int64_t objectMask = -static_cast<int64_t>(object[i] != 0);
+		int64_t t = appear[i];
+		uchar wasSeen = t != NO_TIME;
+		uchar expired = now - t > supervisionTicks;
+		uchar newStanding = object[i] & (standing[i] | (wasSeen & expired));
+		uchar changed = newStanding ^ standing[i];
+		dirty[i] |= changed;
+		anyChanged |= changed;
+		standing[i] = newStanding;
+		appear[i] = objectMask & (wasSeen ? t : now);
+	}
+	isDirty_ = isDirty_ || anyChanged;
+}
+
+bool BlockGrid::hasStanding() const {
+	return std::find(isStanding_.begin(), isStanding_.end(), 1) != isStanding_.end();
+}
+
+bool BlockGrid::isDirty() const {
+	return isDirty_;
+}
+
+const uchar* BlockGrid::getDirtyBlocks() const {
+	return dirtyBlocks_.empty() ? 0 : &dirtyBlocks_[0];
+}
+
+void BlockGrid::clearDirty() {
+	std::fill(dirtyBlocks_.begin(), dirtyBlocks_.end(), 0);
+	isDirty_ = false;
+}
+
+cv::Mat BlockGrid::getStandingMask() const {
+	if (isStanding_.empty()) {
+		return cv::Mat(size_, CV_8U);
+	}
+	return cv::Mat(size_, CV_8U, const_cast<uchar*>(&isStanding_[0]));
+}
+
+void BlockGrid::clear() {
+	std::fill(isObject_.begin(), isObject_.end(), 0);
+	std::fill(isStanding_.begin(), isStanding_.end(), 0);
+	std::fill(appearTime_.begin(), appearTime_.end(), NO_TIME);
+	std::fill(dirtyBlocks_.begin(), dirtyBlocks_.end(), 1);
+	isDirty_ = true;
+}
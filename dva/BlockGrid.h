@@ -0,0 +1,126 @@
+#ifndef BlockGrid_h_
+#define BlockGrid_h_
+
+#include <opencv/cv.h>
+#include <opencv/cxcore.hpp>
+#include <boost/date_time.hpp>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * Состояние блоков, на которые делится изображение, хранящееся по полям (структура массивов).
+ *
+ * Флаги хранятся по байту на блок, строка за строкой, поэтому маска стоящих блоков
+ * отдаётся как заголовок cv::Mat без копирования, а проверка времени выполняется одним проходом без ветвлений.
+ */
+class BlockGrid {
+
+public:
+
+	/**
+	 * Время появления для блоков без объекта.
+	 */
+	static const int64_t NO_TIME;
+
+	/**
+	 * Создаёт пустую сетку.
+	 */
+	BlockGrid();
+
+	/**
+	 * Переводит время кадра в тики (микросекунды от начала эпохи), в которых хранится время появления.
+	 */
+	static int64_t toTicks(const boost::posix_time::ptime& time);
+
+	/**
+	 * Изменяет размер сетки; при изменении размера вся история сбрасывается.
+	 *
+	 * @param size размер сетки в блоках.
+	 */
+	void resize(const cv::Size& size);
+
+	/**
+	 * Размер сетки в блоках.
+	 */
+	cv::Size size() const;
+
+	/**
+	 * Флаги наличия объекта в блоках (0 или 1), заполняются детектором перед updateStanding().
+	 */
+	uchar* isObject();
+
+	/**
+	 * Отмечает стоящими блоки, в которых объект присутствует дольше @a supervisionTicks,
+	 * и сбрасывает историю блоков без объекта.
+	 *
+	 * @param now время текущего кадра в тиках.
+	 * @param supervisionTicks время, после которого объект считается стоящим, в тиках.
+	 */
+	void updateStanding(int64_t now, int64_t supervisionTicks);
+
+	/**
+	 * Маска стоящих блоков (0 или 1), ссылающаяся на данные сетки и действительная до следующего изменения сетки.
+	 */
+	cv::Mat getStandingMask() const;
+	
+	/**
+	 * Показывает, есть ли хотя бы один стоящий блок.
+	 */
+	bool hasStanding() const;
+	
+	/**
+	 * Показывает, изменился ли признак стоящего блока хотя бы у одного блока со времени последнего clearDirty().
+	 * После resize() и clear() сетка считается изменившейся целиком.
+	 */
+	bool isDirty() const;
+	
+	/**
+	 * Маска блоков (0 или 1), у которых признак стоящего блока изменился со времени последнего clearDirty().
+	 */
+	const uchar* getDirtyBlocks() const;
+	
+	/**
+	 * Сбрасывает отметки изменившихся блоков; вызывается после того, как результат по сетке построен.
+	 */
+	void clearDirty();
+
+	/**
+	 * Сбрасывает историю всех блоков.
+	 */
+	void clear();
+
+private:
+
+	/**
+	 * Размер сетки.
+	 */
+	cv::Size size_;
+
+	/**
+	 * Наличие объекта в блоке.
+	 */
+	std::vector<uchar> isObject_;
+
+	/**
+	 * Объект в блоке стоит дольше заданного времени.
+	 */
+	std::vector<uchar> isStanding_;
+
+	/**
+	 * Время появления объекта в блоке в тиках, NO_TIME если объекта нет.
+	 */
+	std::vector<int64_t> appearTime_;
+	
+	/**
+	 * Признак стоящего блока изменился со времени последнего clearDirty().
+	 */
+	std::vector<uchar> dirtyBlocks_;
+	
+	/**
+	 * Хотя бы один элемент @a dirtyBlocks_ отличен от нуля.
+	 */
+	bool isDirty_;
+
+};
+
+#endif // BlockGrid_h_
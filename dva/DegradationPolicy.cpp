@@ -0,0 +1,94 @@
+#include "DegradationPolicy.h"
+#include <algorithm>
+#include "System.h"
+#include <utils/maputils.hpp>
+
+const int DegradationPolicy::DegradationPolicySettings::MAX_LATENCY = 0;
+const bool DegradationPolicy::DegradationPolicySettings::DEGRADE_LAST = false;
+const int DegradationPolicy::DegradationPolicySettings::DEGRADED_MINIFICATION = 2;
+const bool DegradationPolicy::DegradationPolicySettings::MINIFIABLE = true;
+const int DegradationPolicy::DegradationPolicySettings::DEGRADED_FRAME_STEP = 3;
+
+DegradationPolicy::DegradationPolicySettings::DegradationPolicySettings()
+	: maxLatency_(MAX_LATENCY)
+	, degradeLast_(DEGRADE_LAST)
+	, degradedMinification_(DEGRADED_MINIFICATION)
+	, minifiable_(MINIFIABLE)
+	, degradedFrameStep_(DEGRADED_FRAME_STEP)
+{}
+
+DegradationPolicy::DegradationPolicySettings::DegradationPolicySettings(int maxLatency, bool degradeLast, int degradedMinification, bool minifiable, int degradedFrameStep)
+	: maxLatency_(maxLatency)
+	, degradeLast_(degradeLast)
+	, degradedMinification_(degradedMinification)
+	, minifiable_(minifiable)
+	, degradedFrameStep_(degradedFrameStep)
+{}
+
+DegradationPolicy::DegradationPolicy()
+{}
+
+DegradationPolicy::DegradationPolicy(const DegradationPolicySettings& settings)
+	: settings_(settings)
+{}
+
+const DegradationPolicy::DegradationPolicySettings& DegradationPolicy::getSettings() const {
+	return settings_;
+}
+
+void DegradationPolicy::setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings) {
+	try {
+
+		std::string lexCastError = errors::ERR_05_SETTINGS_CAN_NOT_BE_APPLIED_INCORRECT_PARAMETER;
+		std::string error = errors::ERR_06_SETTINGS_CAN_NOT_BE_APPLIED_PARAMETER_NOT_FOUND;
+
+		{
+			std::string paramName = "maxLatency";
+			if (settings.count(paramName)) {
+				settings_.maxLatency_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "degradeLast";
+			if (settings.count(paramName)) {
+				settings_.degradeLast_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "degradedMinification";
+			if (settings.count(paramName)) {
+				settings_.degradedMinification_ = std::max(1, System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName));
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "minifiable";
+			if (settings.count(paramName)) {
+				settings_.minifiable_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "degradedFrameStep";
+			if (settings.count(paramName)) {
+				settings_.degradedFrameStep_ = std::max(1, System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName));
+				usedSettings.insert(paramName);
+			}
+		}
+
+	} catch (std::string& err) {
+		errors::throwException(err);
+	} catch (...) {
+		errors::throwException(errors::ERR_04_SETTINGS_CAN_NOT_BE_APPLIED);
+	}
+}
+
+void DegradationPolicy::getSettings(xml::Request::Params &settings) {
+	settings["maxLatency"] = boost::lexical_cast<std::string>(settings_.maxLatency_);
+	settings["degradeLast"] = boost::lexical_cast<std::string>(settings_.degradeLast_);
+	settings["degradedMinification"] = boost::lexical_cast<std::string>(settings_.degradedMinification_);
+	settings["minifiable"] = boost::lexical_cast<std::string>(settings_.minifiable_);
+	settings["degradedFrameStep"] = boost::lexical_cast<std::string>(settings_.degradedFrameStep_);
+}
@@ -0,0 +1,143 @@
+#ifndef DegradationPolicy_h_
+#define DegradationPolicy_h_
+
+#include <networking/ExchangeTypes.hpp>
+#include "AnCommon.h"
+
+/**
+ * Поведение потока камеры при перегрузке исполнителя (DetectorExecutor).
+ *
+ * При положительном maxLatency_ каждый кадр должен быть проанализирован не позже maxLatency_ после его
+ * отправления (imageTime), иначе он устаревает; по умолчанию срока нет и кадры не пропускаются.
+ * Если кадры не успевают, исполнитель снижает нагрузку ступенями (Level): сначала перестаёт сообщать кадры,
+ * результат которых лишь повторяет прежний, затем уменьшает кадры в degradedMinification_ раз, затем анализирует
+ * только каждый degradedFrameStep_-й кадр. Потоки без minifiable_ (детекторы с моделью фона или историей блоков,
+ * которые перестраиваются при смене размера кадра) ступень MINIFY пропускают. Потоки детекторов с degradeLast_ (детекторы дыма и огня) начинают
+ * деградировать только после того, как все остальные потоки дошли до последней ступени, и восстанавливаются первыми.
+ */
+class DegradationPolicy {
+
+public:
+
+	/**
+	 * Ступени деградации, каждая включает предыдущие.
+	 */
+	enum Level {
+		/**
+		 * Кадры анализируются полностью.
+		 */
+		NONE = 0,
+		/**
+		 * Кадры, на которых детектор только повторно сериализовал бы прежний результат, не сообщаются.
+		 */
+		SKIP_SERIALIZATION_ONLY = 1,
+		/**
+		 * Кадры дополнительно уменьшаются в degradedMinification_ раз, если поток minifiable_.
+		 */
+		MINIFY = 2,
+		/**
+		 * Анализируется только каждый degradedFrameStep_-й кадр.
+		 */
+		FRAME_STEP = 3
+	};
+
+	/**
+	 * Класс настроек(параметров) политики.
+	 */
+	class DegradationPolicySettings {
+
+	public:
+
+		/**
+		 * Значения по умолчанию соответствующих полей.
+		 *
+		 * @{
+		 */
+		static const int MAX_LATENCY;
+		static const bool DEGRADE_LAST;
+		static const bool MINIFIABLE;
+		static const int DEGRADED_MINIFICATION;
+		static const int DEGRADED_FRAME_STEP;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Наибольшая задержка анализа кадра после его отправления в миллисекундах, неположительное значение -- без срока.
+		 */
+		int maxLatency_;
+
+		/**
+		 * Поток деградирует последним (детекторы, отвечающие за безопасность).
+		 */
+		bool degradeLast_;
+
+		/**
+		 * Дополнительное уменьшение кадров на ступени MINIFY, 1 -- ступень ничего не меняет.
+		 */
+		int degradedMinification_;
+
+		/**
+		 * Кадры потока можно уменьшать на ступени MINIFY; false для детекторов, модель которых зависит от размера кадра.
+		 */
+		bool minifiable_;
+
+		/**
+		 * Анализируется каждый такой кадр на ступени FRAME_STEP, 1 -- ступень ничего не меняет.
+		 */
+		int degradedFrameStep_;
+
+		/**
+		 * Создаёт объект класса с параметрами по умолчанию.
+		 */
+		DegradationPolicySettings();
+
+		/**
+		 * Создаёт объект класса с заданными параметрами.
+		 *
+		 * @param описание параметров смотри у описания соответствующих полей класса.
+		 */
+		DegradationPolicySettings(int maxLatency, bool degradeLast, int degradedMinification, bool minifiable, int degradedFrameStep);
+
+	};
+
+	/**
+	 * Создаёт политику с настройками по умолчанию.
+	 */
+	DegradationPolicy();
+
+	/**
+	 * Создаёт политику с заданными настройками.
+	 */
+	DegradationPolicy(const DegradationPolicySettings& settings);
+
+	/**
+	 * Возвращает настройки политики.
+	 */
+	const DegradationPolicySettings& getSettings() const;
+
+	/**
+	 * Устанавливает настройки(параметры) политики. Все параметры необязательны.
+	 *
+	 * @param settings параметры(настройки) политики.
+	 * @param usedSettings множество используемых настроек.
+	 */
+	void setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings);
+
+	/**
+	 * Возвращает настройки(параметры) политики.
+	 *
+	 * @param settings параметры(настройки) политики.
+	 */
+	void getSettings(xml::Request::Params &settings);
+
+private:
+
+	/**
+	 * Настройки политики.
+	 */
+	DegradationPolicySettings settings_;
+
+};
+
+#endif // DegradationPolicy_h_
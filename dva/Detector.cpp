@@ -1,7 +1,24 @@
 #include "Detector.h"
+#include "DetectorExecutor.h"
+#include <limits>
+
+Detector::Result::Result()
+	: failed(false)
+	, dropped(false)
+{
+}
+
+Detector::PendingResult::PendingResult()
+	: kind(NONE)
+	, minObjectArea(std::numeric_limits<int>::min())
+	, maxObjectArea(std::numeric_limits<int>::max())
+{
+}
 
 Detector::Detector()
 	: on_(false)
+	, skipSerializationOnlyFrames_(false)
+	, executor_(0)
 {
 }
 
@@ -13,6 +30,36 @@ void Detector::off() {
 	on_ = false;
 }
 
+void Detector::executeBatch(const cv::Mat* images, const boost::posix_time::ptime* imageTimes, size_t count, std::vector<std::string>& results) {
+	results.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		execute(images[i], imageTimes[i], results[i]);
+	}
+}
+
+cv::Mat Detector::prepare(const cv::Mat&) {
+	return cv::Mat();
+}
+
+void Detector::executePrepared(const cv::Mat& image, const cv::Mat& prepared, const boost::posix_time::ptime& imageTime, std::string& resultingXml) {
+	PendingResult pending;
+	detectPrepared(image, prepared, imageTime, pending);
+	serialize(pending, resultingXml);
+}
+
+void Detector::detectPrepared(const cv::Mat& image, const cv::Mat&, const boost::posix_time::ptime& imageTime, PendingResult& pending) {
+	execute(image, imageTime, pending.xml);
+	pending.kind = pending.xml.empty() ? PendingResult::NONE : PendingResult::READY;
+}
+
+void Detector::serialize(PendingResult& pending, std::string& resultingXml) {
+	if (pending.kind == PendingResult::READY) {
+		resultingXml.swap(pending.xml);
+	} else {
+		resultingXml.clear();
+	}
+}
+
 bool Detector::state() {
 	return on_;
 }
@@ -20,3 +67,31 @@ bool Detector::state() {
 xml::Request::Params Detector::getSettings() {
 	return xml::Request::Params();
 }
+
+bool Detector::executeAsync(const cv::Mat& image, const boost::posix_time::ptime& imageTime, const ResultCallback& callback) {
+	return executeAsync(image, imageTime, callback, DetectorExecutor::getDefault());
+}
+
+bool Detector::executeAsync(const cv::Mat& image, const boost::posix_time::ptime& imageTime, const ResultCallback& callback, DetectorExecutor& executor) {
+	if (executor_ != &executor) {
+		// кадры детектора анализирует один исполнитель: кадры прежнего исполнителя дорабатываются до перехода,
+		// иначе они анализировались бы одновременно с новыми и не по порядку, а waitAsync() их бы не дожидался
+		waitAsync();
+		executor_ = &executor;
+	}
+	return executor.submit(shared_from_this(), image, imageTime, callback);
+}
+
+void Detector::waitAsync() {
+	if (executor_) {
+		executor_->wait(*this);
+	}
+}
+
+const DegradationPolicy& Detector::getDegradationPolicy() {
+	return degradationPolicy_;
+}
+
+void Detector::setSkipSerializationOnlyFrames(bool skip) {
+	skipSerializationOnlyFrames_ = skip;
+}
@@ -3,16 +3,25 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <list>
 #include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
 #include <boost/date_time.hpp>
 #include <opencv/cxcore.h>
 #include <opencv/cxcore.hpp>
 #include <networking/ExchangeTypes.hpp>
+#include "DegradationPolicy.h"
+#include "Object.h"
+
+class DetectorExecutor;
 
 /**
  * Базовый класс для детекторов видеоаналитики.
  */
 class Detector
+	: public boost::enable_shared_from_this<Detector>
 {
 protected:
 
@@ -21,12 +30,124 @@ protected:
 	 */
 	bool on_;
 	
+	/**
+	 * Поведение потока детектора при перегрузке исполнителя, детекторы задают свои значения по умолчанию
+	 * и разбирают параметры политики в setSettings().
+	 */
+	DegradationPolicy degradationPolicy_;
+	
+	/**
+	 * Кадры, на которых детектор только повторно сериализовал бы прежний результат, не сообщаются
+	 * (ступень DegradationPolicy::SKIP_SERIALIZATION_ONLY).
+	 */
+	bool skipSerializationOnlyFrames_;
+	
 public:
 	/**
 	 * Определение типа "умного" указателя на детектор.
 	 */
 	typedef boost::shared_ptr<Detector> SharedPtr;
 
+	/**
+	 * Результат анализа кадра, поставленного в очередь executeAsync().
+	 */
+	struct Result {
+
+		/**
+		 * Время отправления кадра.
+		 */
+		boost::posix_time::ptime imageTime;
+
+		/**
+		 * Результат работы детектора, как у execute().
+		 */
+		std::string resultingXml;
+
+		/**
+		 * Анализ завершился ошибкой, результата нет.
+		 */
+		bool failed;
+
+		/**
+		 * Описание ошибки.
+		 */
+		std::string error;
+		
+		/**
+		 * Кадр не анализировался: устарел или пропущен при перегрузке исполнителя; результата нет.
+		 */
+		bool dropped;
+
+		Result();
+
+	};
+
+	/**
+	 * Результат анализа кадра, ещё не сериализованный в xml (см. detectPrepared() и serialize()).
+	 */
+	struct PendingResult {
+
+		/**
+		 * Как формируется xml результата.
+		 */
+		enum Kind {
+
+			/**
+			 * Результат на кадре не сообщается, xml пуст.
+			 */
+			NONE,
+
+			/**
+			 * Xml уже сформирован при анализе (@a xml), например описание ошибки.
+			 */
+			READY,
+
+			/**
+			 * Xml формируется ResultStream::build() по @a objects и @a mask.
+			 */
+			BUILD,
+
+			/**
+			 * Объекты и битовая карта не изменились, xml формируется ResultStream::buildUnchanged().
+			 */
+			BUILD_UNCHANGED
+
+		};
+
+		Kind kind;
+
+		/**
+		 * Готовый результат для READY.
+		 */
+		std::string xml;
+
+		/**
+		 * Аргументы ResultStream::build() для BUILD.
+		 *
+		 * @{
+		 */
+		std::list<AnCommon::Object> objects;
+
+		cv::Mat mask;
+
+		cv::Size blockSize;
+
+		int minObjectArea;
+
+		int maxObjectArea;
+		/**
+		 * @}
+		 */
+
+		PendingResult();
+
+	};
+
+	/**
+	 * Обработчик результата executeAsync(), вызывается в потоке исполнителя.
+	 */
+	typedef boost::function<void (const Result&)> ResultCallback;
+
 	/**
 	 * Инициализирует детектор по умолчанию.
 	 */
@@ -40,13 +161,75 @@ public:
 	/**
 	 * Основная функция детектора, анализирует текущий кадр.
 	 * 
+	 * Детекторы с параметром alertTime сообщают результат не на каждом кадре: сразу при появлении или исчезновении
+	 * объекта, а пока объекты те же -- не чаще одного раза за alertTime секунд (см. AlertThrottle). На остальных
+	 * кадрах @a resultingXml пуст, и действующим остаётся последний непустой результат. Чтобы получать результат
+	 * каждого кадра, как раньше, достаточно задать alertTime равным 0.
+	 * 
 	 * @param image текущий кадр.
 	 * @param imageTime время отправления кадра.
-	 * @param resultingXml результат работы детектора.
+	 * @param resultingXml результат работы детектора; пустая строка, если на этом кадре результат не сообщается.
 	 * @throw std::string описание ошибки.
 	 */
 	virtual void execute(const cv::Mat& image, const boost::posix_time::ptime& imageTime, std::string& resultingXml) = 0;
 
+	/**
+	 * Анализирует последовательность кадров, например при повторном анализе архива; результат тот же, что у вызовов execute()
+	 * для каждого кадра по порядку. Детекторы переопределяют функцию, чтобы один раз на пакет выполнять подготовку
+	 * и проверки размеров буферов и заранее выполнять не зависящие от предыдущих кадров этапы.
+	 * 
+	 * @param images кадры.
+	 * @param imageTimes время отправления кадров.
+	 * @param count количество кадров.
+	 * @param results сюда помещаются результаты кадров (размер становится равным @a count); строки переиспользуются
+	 *        между вызовами, поэтому один и тот же вектор стоит передавать во все пакеты.
+	 * @throw std::string описание ошибки.
+	 */
+	virtual void executeBatch(const cv::Mat* images, const boost::posix_time::ptime* imageTimes, size_t count, std::vector<std::string>& results);
+
+	/**
+	 * Выполняет этапы анализа кадра, не зависящие от предыдущих кадров (например, преобразование цвета), для executePrepared().
+	 * Может вызываться в другом потоке одновременно с execute() и executePrepared() предыдущих кадров,
+	 * но не одновременно с setSettings(), on() и off().
+	 * 
+	 * @param image кадр.
+	 * @return подготовленные данные кадра; пустая матрица, если детектор ничего не подготавливает.
+	 */
+	virtual cv::Mat prepare(const cv::Mat& image);
+
+	/**
+	 * То же, что execute(), но с данными, подготовленными prepare() для этого кадра: detectPrepared(), затем serialize().
+	 * 
+	 * @param image кадр.
+	 * @param prepared результат prepare(), может быть пустым.
+	 * @param imageTime время отправления кадра.
+	 * @param resultingXml результат работы детектора.
+	 * @throw std::string описание ошибки.
+	 */
+	void executePrepared(const cv::Mat& image, const cv::Mat& prepared, const boost::posix_time::ptime& imageTime, std::string& resultingXml);
+
+	/**
+	 * Анализирует кадр с данными, подготовленными prepare(), но не сериализует результат: это делает serialize(),
+	 * которую конвейер (StreamPipeline) вызывает в другом потоке, пока детектор анализирует следующий кадр.
+	 * По умолчанию вызывает execute(), и xml формируется сразу.
+	 * 
+	 * @param image кадр.
+	 * @param prepared результат prepare(), может быть пустым.
+	 * @param imageTime время отправления кадра.
+	 * @param pending сюда помещается результат анализа.
+	 * @throw std::string описание ошибки.
+	 */
+	virtual void detectPrepared(const cv::Mat& image, const cv::Mat& prepared, const boost::posix_time::ptime& imageTime, PendingResult& pending);
+
+	/**
+	 * Формирует xml результата detectPrepared(). Вызывается для кадров в порядке их анализа, может выполняться
+	 * одновременно с detectPrepared() следующих кадров, но не одновременно с setSettings(), on() и off().
+	 * 
+	 * @param pending результат анализа кадра, его данные могут забираться.
+	 * @param resultingXml результат работы детектора, как у execute().
+	 */
+	virtual void serialize(PendingResult& pending, std::string& resultingXml);
+
 	/**
 	 * Возвращает тип детектора.
 	 * 
@@ -87,6 +270,57 @@ public:
 	 * @return настройки детектора в виде структуры @a xml::Request::Params. 
 	 */
 	virtual xml::Request::Params getSettings();
+
+	/**
+	 * Ставит кадр в очередь анализа общего исполнителя (DetectorExecutor::getDefault()) и сразу возвращает управление.
+	 * 
+	 * @see executeAsync(const cv::Mat&, const boost::posix_time::ptime&, const ResultCallback&, DetectorExecutor&)
+	 */
+	bool executeAsync(const cv::Mat& image, const boost::posix_time::ptime& imageTime, const ResultCallback& callback);
+
+	/**
+	 * Ставит кадр в очередь анализа исполнителя и сразу возвращает управление.
+	 * 
+	 * Кадры одного детектора анализируются по одному в порядке постановки, поэтому состояние, зависящее от предыдущих кадров,
+	 * видит их по порядку. Детектор должен принадлежать Detector::SharedPtr: он удерживается до окончания анализа.
+	 * Перед setSettings(), off() и удалением детектора нужно дождаться анализа поставленных кадров (waitAsync()).
+	 * Детектор закреплён за исполнителем своего последнего вызова: при вызове с другим исполнителем сначала
+	 * дожидается анализа кадров, поставленных прежнему, поэтому такой вызов нельзя делать из обработчика результата.
+	 * Исполнитель должен существовать, пока детектор пользуется executeAsync() и waitAsync().
+	 * При перегрузке исполнитель пропускает устаревшие кадры (Result::dropped) и деградирует поток детектора
+	 * по его политике (getDegradationPolicy()).
+	 * 
+	 * @param image текущий кадр, копируется.
+	 * @param imageTime время отправления кадра.
+	 * @param callback обработчик результата.
+	 * @param executor исполнитель.
+	 * @return false, если очередь исполнителя заполнена; кадр отброшен, обработчик не вызывается.
+	 */
+	bool executeAsync(const cv::Mat& image, const boost::posix_time::ptime& imageTime, const ResultCallback& callback, DetectorExecutor& executor);
+
+	/**
+	 * Дожидается анализа всех кадров, поставленных executeAsync(). Нельзя вызывать из обработчика результата этого детектора.
+	 */
+	void waitAsync();
+	
+	/**
+	 * Возвращает поведение потока детектора при перегрузке исполнителя.
+	 */
+	virtual const DegradationPolicy& getDegradationPolicy();
+	
+	/**
+	 * Включает или выключает пропуск кадров, на которых детектор только повторно сериализовал бы прежний результат.
+	 * Вызывается исполнителем между анализом кадров.
+	 */
+	virtual void setSkipSerializationOnlyFrames(bool skip);
+
+private:
+
+	/**
+	 * Исполнитель, за которым закреплён детектор: только у него могут быть неразобранные кадры детектора;
+	 * 0, если executeAsync() не вызывался.
+	 */
+	DetectorExecutor* executor_;
 };
 
 #endif // Detector_h_
@@ -0,0 +1,359 @@
+#include "DetectorExecutor.h"
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <logging/logging.hpp>
+#include "AnCommon.h"
+
+const int DetectorExecutor::DetectorExecutorSettings::THREAD_COUNT = 0;
+const int DetectorExecutor::DetectorExecutorSettings::MAX_QUEUED_FRAMES = 64;
+const int DetectorExecutor::DetectorExecutorSettings::MAX_QUEUED_FRAMES_PER_DETECTOR = 4;
+const int DetectorExecutor::DetectorExecutorSettings::DEGRADATION_HOLD = 2000;
+const int DetectorExecutor::DetectorExecutorSettings::RECOVERY_TIME = 10000;
+
+DetectorExecutor::DetectorExecutorSettings::DetectorExecutorSettings()
+	: threadCount_(THREAD_COUNT)
+	, maxQueuedFrames_(MAX_QUEUED_FRAMES)
+	, maxQueuedFramesPerDetector_(MAX_QUEUED_FRAMES_PER_DETECTOR)
+	, degradationHold_(DEGRADATION_HOLD)
+	, recoveryTime_(RECOVERY_TIME)
+{}
+
+DetectorExecutor::DetectorQueue::DetectorQueue()
+	: running(false)
+	, level(DegradationPolicy::NONE)
+	, frameCounter(0)
+	, delay(boost::posix_time::not_a_date_time)
+{}
+
+DetectorExecutor::DetectorExecutor(const DetectorExecutorSettings& settings)
+	: settings_(settings)
+	, pool_(0)
+	, queuedFrames_(0)
+	, rejectedFrames_(0)
+	, droppedFrames_(0)
+	, runningDetectors_(0)
+	, lastOverload_(boost::posix_time::min_date_time)
+	, lastLevelChange_(boost::posix_time::min_date_time)
+{
+	if (settings_.threadCount_ > 0) {
+		WorkStealingPool::WorkStealingPoolSettings poolSettings;
+		poolSettings.threadCount_ = settings_.threadCount_;
+		ownPool_.reset(new WorkStealingPool(poolSettings));
+		pool_ = ownPool_.get();
+	} else {
+		pool_ = &WorkStealingPool::getDefault();
+	}
+	LOG_INFO("DetectorExecutor: " << pool_->getThreadCount() << " threads, " << settings_.maxQueuedFrames_ << " queued frames");
+}
+
+DetectorExecutor::~DetectorExecutor() {
+	// задачи пула ссылаются на исполнитель
+	wait();
+}
+
+DetectorExecutor& DetectorExecutor::getDefault() {
+	static DetectorExecutor executor;
+	return executor;
+}
+
+bool DetectorExecutor::submit(Detector::SharedPtr detector, const cv::Mat& image, const boost::posix_time::ptime& imageTime, const Detector::ResultCallback& callback) {
+	Task task;
+	task.detector = detector;
+	task.imageTime = imageTime;
+	task.callback = callback;
+	// копирование до захвата мьютекса, чтобы не задерживать потоки исполнителя
+	image.copyTo(task.image);
+	DegradationPolicy::DegradationPolicySettings policy = detector->getDegradationPolicy().getSettings();
+	std::string type = detector->getType();
+
+	boost::mutex::scoped_lock lock(mutex_);
+	DetectorQueue& queue = queues_[detector.get()];
+	if (queue.detector.expired()) {
+		// новый детектор или детектор, созданный по адресу удалённого
+		queue = DetectorQueue();
+		queue.detector = detector;
+	}
+	queue.policy = policy;
+	queue.type = type;
+
+	if (queuedFrames_ >= settings_.maxQueuedFrames_ || static_cast<int>(queue.tasks.size()) >= settings_.maxQueuedFramesPerDetector_) {
+		rejectedFrames_++;
+		if (!queue.running && queue.level == DegradationPolicy::NONE) {
+			queues_.erase(detector.get());
+		}
+		return false;
+	}
+
+	task.deadline = boost::posix_time::pos_infin;
+	if (policy.maxLatency_ > 0 && !imageTime.is_special()) {
+		// часы источника кадров могут отличаться от часов исполнителя, поэтому срок отсчитывается от обычной
+		// задержки кадров потока: она сразу уменьшается до наименьшей и медленно растёт, если задержка выросла надолго
+		boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+		boost::posix_time::time_duration delay = now - imageTime;
+		if (queue.delay.is_special() || delay < queue.delay) {
+			queue.delay = delay;
+		} else {
+			queue.delay += (delay - queue.delay) / 100;
+		}
+		task.deadline = imageTime + queue.delay + boost::posix_time::milliseconds(policy.maxLatency_);
+	}
+
+	queue.tasks.push_back(task);
+	queuedFrames_++;
+	if (!queue.running) {
+		queue.running = true;
+		runningDetectors_++;
+		schedule(detector.get(), queue);
+	}
+	return true;
+}
+
+void DetectorExecutor::wait(const Detector& detector) {
+	boost::mutex::scoped_lock lock(mutex_);
+	for (;;) {
+		std::map<const Detector*, DetectorQueue>::iterator i = queues_.find(&detector);
+		if (i == queues_.end() || !i->second.running) {
+			break;
+		}
+		taskDone_.wait(lock);
+	}
+}
+
+void DetectorExecutor::wait() {
+	boost::mutex::scoped_lock lock(mutex_);
+	while (runningDetectors_ > 0) {
+		taskDone_.wait(lock);
+	}
+}
+
+int DetectorExecutor::getQueuedFrames() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return queuedFrames_;
+}
+
+int DetectorExecutor::getRejectedFrames() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return rejectedFrames_;
+}
+
+int DetectorExecutor::getDroppedFrames() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return droppedFrames_;
+}
+
+DegradationPolicy::Level DetectorExecutor::getDegradationLevel(const Detector& detector) {
+	boost::mutex::scoped_lock lock(mutex_);
+	std::map<const Detector*, DetectorQueue>::iterator i = queues_.find(&detector);
+	return i == queues_.end() ? DegradationPolicy::NONE : i->second.level;
+}
+
+int DetectorExecutor::getThreadCount() const {
+	return pool_->getThreadCount();
+}
+
+void DetectorExecutor::schedule(const Detector* key, DetectorQueue& queue) {
+	ready_.insert(std::make_pair(queue.tasks.front().deadline, key));
+	pool_->submit(boost::bind(&DetectorExecutor::dispatch, this));
+}
+
+void DetectorExecutor::dispatch() {
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	// задач dispatch() в пуле столько же, сколько элементов в ready_, поэтому ready_ не пуст
+	const Detector* key = ready_.begin()->second;
+	ready_.erase(ready_.begin());
+
+	std::vector<Task> dropped;
+	Task task;
+	bool analyse = true;
+	DegradationPolicy::Level level;
+	int minification = 1;
+	{
+		DetectorQueue& queue = queues_[key];
+		boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+		// последний кадр анализируется и после срока, чтобы результат потока не устаревал бесконечно
+		while (queue.tasks.size() > 1 && queue.tasks.front().deadline < now) {
+			dropped.push_back(Task());
+			std::swap(dropped.back(), queue.tasks.front());
+			queue.tasks.pop_front();
+			queuedFrames_--;
+		}
+		std::swap(task, queue.tasks.front());
+		queue.tasks.pop_front();
+		queuedFrames_--;
+
+		level = queue.level;
+		if (level >= DegradationPolicy::FRAME_STEP) {
+			analyse = queue.frameCounter++ % queue.policy.degradedFrameStep_ == 0;
+		}
+		if (level >= DegradationPolicy::MINIFY && queue.policy.minifiable_) {
+			minification = queue.policy.degradedMinification_;
+		}
+	}
+	bool stale = !dropped.empty();
+	if (!analyse) {
+		dropped.push_back(Task());
+		std::swap(dropped.back(), task);
+	}
+	droppedFrames_ += static_cast<int>(dropped.size());
+
+	lock.unlock();
+	// пропущенные кадры старше анализируемого, их результаты сообщаются раньше
+	for (size_t i = 0; i < dropped.size(); i++) {
+		reportDropped(dropped[i]);
+	}
+	if (analyse) {
+		task.detector->setSkipSerializationOnlyFrames(level >= DegradationPolicy::SKIP_SERIALIZATION_ONLY);
+		execute(task, minification);
+	}
+	lock.lock();
+
+	boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+	control(key, stale || (analyse && task.deadline < now), now);
+
+	DetectorQueue& queue = queues_[key];
+	if (queue.tasks.empty()) {
+		queue.running = false;
+		runningDetectors_--;
+		if (queue.level == DegradationPolicy::NONE) {
+			queues_.erase(key);
+		}
+	} else {
+		schedule(key, queue);
+	}
+	taskDone_.notify_all();
+
+	// последняя ссылка на детектор может освободиться здесь, его удаление не должно выполняться под мьютексом;
+	// после снятия мьютекса исполнитель может быть уже удалён
+	lock.unlock();
+	task = Task();
+	dropped.clear();
+}
+
+void DetectorExecutor::control(const Detector* key, bool overloaded, const boost::posix_time::ptime& now) {
+	if (overloaded) {
+		lastOverload_ = now;
+		if (now - lastLevelChange_ >= boost::posix_time::milliseconds(settings_.degradationHold_) && degrade(key)) {
+			lastLevelChange_ = now;
+		}
+	} else if (now - lastOverload_ >= boost::posix_time::milliseconds(settings_.recoveryTime_) 
+			&& now - lastLevelChange_ >= boost::posix_time::milliseconds(settings_.recoveryTime_) && restore()) {
+		lastLevelChange_ = now;
+	}
+}
+
+bool DetectorExecutor::degrade(const Detector* late) {
+	std::map<const Detector*, DetectorQueue>::iterator best = queues_.end();
+	for (std::map<const Detector*, DetectorQueue>::iterator i = queues_.begin(); i != queues_.end(); ) {
+		DetectorQueue& queue = i->second;
+		if (queue.detector.expired()) {
+			// у анализируемого детектора есть ссылка в задаче, поэтому удалённый детектор не выполняется
+			queues_.erase(i++);
+			continue;
+		}
+		if (queue.level < DegradationPolicy::FRAME_STEP && (best == queues_.end() 
+				|| std::make_pair(queue.policy.degradeLast_, queue.level) < std::make_pair(best->second.policy.degradeLast_, best->second.level))) {
+			best = i;
+		}
+		++i;
+	}
+	// деградирует опоздавший поток; другой поток -- только если опоздавший уже на последней ступени
+	// или он с degradeLast_, а деградировать ещё могут потоки без него
+	std::map<const Detector*, DetectorQueue>::iterator i = queues_.find(late);
+	if (i != queues_.end() && i->second.level < DegradationPolicy::FRAME_STEP 
+			&& (!i->second.policy.degradeLast_ || best->second.policy.degradeLast_)) {
+		best = i;
+	}
+	if (best == queues_.end()) {
+		return false;
+	}
+
+	DetectorQueue& queue = best->second;
+	queue.level = static_cast<DegradationPolicy::Level>(queue.level + 1);
+	if (queue.level == DegradationPolicy::MINIFY && !queue.policy.minifiable_) {
+		// без уменьшения кадров ступень MINIFY не снижает нагрузку
+		queue.level = DegradationPolicy::FRAME_STEP;
+	}
+	queue.frameCounter = 0;
+	LOG_WARN("DetectorExecutor: frames are late, " << queue.type << " degraded to level " << queue.level);
+	return true;
+}
+
+bool DetectorExecutor::restore() {
+	std::map<const Detector*, DetectorQueue>::iterator best = queues_.end();
+	for (std::map<const Detector*, DetectorQueue>::iterator i = queues_.begin(); i != queues_.end(); ) {
+		DetectorQueue& queue = i->second;
+		if (queue.detector.expired()) {
+			queues_.erase(i++);
+			continue;
+		}
+		if (queue.level > DegradationPolicy::NONE && (best == queues_.end() 
+				|| std::make_pair(queue.policy.degradeLast_, queue.level) > std::make_pair(best->second.policy.degradeLast_, best->second.level))) {
+			best = i;
+		}
+		++i;
+	}
+	if (best == queues_.end()) {
+		return false;
+	}
+
+	DetectorQueue& queue = best->second;
+	queue.level = static_cast<DegradationPolicy::Level>(queue.level - 1);
+	if (queue.level == DegradationPolicy::MINIFY && !queue.policy.minifiable_) {
+		queue.level = DegradationPolicy::SKIP_SERIALIZATION_ONLY;
+	}
+	LOG_INFO("DetectorExecutor: " << queue.type << " restored to level " << queue.level);
+	if (queue.level == DegradationPolicy::NONE && !queue.running) {
+		queues_.erase(best);
+	}
+	return true;
+}
+
+void DetectorExecutor::execute(Task& task, int minification) {
+	Detector::Result result;
+	result.imageTime = task.imageTime;
+	try {
+		if (minification > 1) {
+			// кадр уменьшается только для этого потока, координаты результата масштабируются обратно
+			cv::Mat image;
+			cv::resize(task.image, image, cv::Size(task.image.cols / minification, task.image.rows / minification), 0, 0, cv::INTER_AREA);
+			AnCommon::ScopedFrameMinification scope(minification);
+			task.detector->execute(image, task.imageTime, result.resultingXml);
+		} else {
+			task.detector->execute(task.image, task.imageTime, result.resultingXml);
+		}
+	} catch (std::string& error) {
+		result.failed = true;
+		result.error = error;
+	} catch (...) {
+		result.failed = true;
+		result.error = "unknown error";
+	}
+
+	if (result.failed) {
+		LOG_ERROR("DetectorExecutor: " << task.detector->getType() << " failed: " << result.error);
+	}
+	if (task.callback) {
+		try {
+			task.callback(result);
+		} catch (...) {
+			LOG_ERROR("DetectorExecutor: result callback of " << task.detector->getType() << " failed");
+		}
+	}
+	task.image.release();
+}
+
+void DetectorExecutor::reportDropped(Task& task) {
+	task.image.release();
+	if (!task.callback) {
+		return;
+	}
+	Detector::Result result;
+	result.imageTime = task.imageTime;
+	result.dropped = true;
+	try {
+		task.callback(result);
+	} catch (...) {
+		LOG_ERROR("DetectorExecutor: result callback of " << task.detector->getType() << " failed");
+	}
+}
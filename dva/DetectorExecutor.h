@@ -0,0 +1,334 @@
+#ifndef DetectorExecutor_h_
+#define DetectorExecutor_h_
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+#include "Detector.h"
+#include "WorkStealingPool.h"
+
+/**
+ * Исполнитель асинхронного анализа кадров (Detector::executeAsync()) в пуле потоков (WorkStealingPool).
+ *
+ * У каждого детектора своя очередь кадров; одновременно анализируется не больше одного кадра детектора, 
+ * и результаты одного детектора сообщаются в порядке постановки кадров. Разные детекторы анализируются параллельно.
+ * Количество ожидающих кадров ограничено, лишние кадры отвергаются, а не накапливаются.
+ *
+ * У каждого кадра есть срок анализа: время отправления плюс обычная задержка доставки кадров потока плюс
+ * DegradationPolicySettings::maxLatency_ детектора. Из готовых детекторов первым анализируется тот,
+ * у чьего кадра срок раньше (earliest deadline first). Устаревший кадр, за которым в очереди есть более новый,
+ * не анализируется: обработчик получает результат с Detector::Result::dropped. Если кадры устаревают,
+ * исполнитель понижает ступень деградации (DegradationPolicy::Level) опоздавшего потока не чаще degradationHold_,
+ * а после recoveryTime_ без устаревших кадров повышает её обратно.
+ *
+ * По умолчанию кадры анализируются в общем пуле, в котором детекторы также обрабатывают части кадра,
+ * поэтому потоков камер и параллельных частей кадров вместе не больше, чем ядер.
+ */
+class DetectorExecutor
+	: boost::noncopyable
+{
+
+public:
+
+	/**
+	 * Класс настроек исполнителя.
+	 */
+	class DetectorExecutorSettings {
+
+	public:
+
+		/**
+		 * Значения по умолчанию соответствующих полей.
+		 *
+		 * @{
+		 */
+		static const int THREAD_COUNT;
+		static const int MAX_QUEUED_FRAMES;
+		static const int MAX_QUEUED_FRAMES_PER_DETECTOR;
+		static const int DEGRADATION_HOLD;
+		static const int RECOVERY_TIME;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Количество потоков собственного пула исполнителя, 0 -- общий пул (WorkStealingPool::getDefault()).
+		 */
+		int threadCount_;
+
+		/**
+		 * Наибольшее количество ожидающих анализа кадров всех детекторов.
+		 */
+		int maxQueuedFrames_;
+
+		/**
+		 * Наибольшее количество ожидающих анализа кадров одного детектора, чтобы медленный детектор не занимал всю очередь.
+		 */
+		int maxQueuedFramesPerDetector_;
+
+		/**
+		 * Наименьший промежуток между понижениями ступени деградации в миллисекундах: после смены размера кадра
+		 * детекторам нужно время, чтобы заново построить модели.
+		 */
+		int degradationHold_;
+
+		/**
+		 * Время без устаревших кадров в миллисекундах, после которого ступень деградации повышается на одну.
+		 */
+		int recoveryTime_;
+
+		/**
+		 * Создаёт объект класса с параметрами по умолчанию.
+		 */
+		DetectorExecutorSettings();
+
+	};
+
+	/**
+	 * Создаёт исполнитель, при необходимости запускает собственный пул.
+	 */
+	DetectorExecutor(const DetectorExecutorSettings& settings = DetectorExecutorSettings());
+
+	/**
+	 * Дожидается анализа поставленных кадров.
+	 */
+	~DetectorExecutor();
+
+	/**
+	 * Возвращает общий исполнитель с настройками по умолчанию.
+	 */
+	static DetectorExecutor& getDefault();
+
+	/**
+	 * Ставит кадр в очередь детектора.
+	 *
+	 * @param detector детектор, удерживается до окончания анализа.
+	 * @param image кадр, копируется.
+	 * @param imageTime время отправления кадра.
+	 * @param callback обработчик результата, вызывается в потоке пула, в том числе для пропущенных кадров.
+	 * @return false, если очередь заполнена; обработчик не вызывается.
+	 */
+	bool submit(Detector::SharedPtr detector, const cv::Mat& image, const boost::posix_time::ptime& imageTime, const Detector::ResultCallback& callback);
+
+	/**
+	 * Дожидается анализа всех поставленных кадров детектора.
+	 */
+	void wait(const Detector& detector);
+
+	/**
+	 * Дожидается анализа всех поставленных кадров.
+	 */
+	void wait();
+
+	/**
+	 * Количество ожидающих анализа кадров.
+	 */
+	int getQueuedFrames();
+
+	/**
+	 * Количество отвергнутых кадров.
+	 */
+	int getRejectedFrames();
+
+	/**
+	 * Количество кадров, пропущенных без анализа: устаревших или на ступени DegradationPolicy::FRAME_STEP.
+	 */
+	int getDroppedFrames();
+
+	/**
+	 * Текущая ступень деградации потока детектора.
+	 */
+	DegradationPolicy::Level getDegradationLevel(const Detector& detector);
+
+	/**
+	 * Количество потоков пула.
+	 */
+	int getThreadCount() const;
+
+private:
+
+	/**
+	 * Кадр, ожидающий анализа.
+	 */
+	struct Task {
+
+		Detector::SharedPtr detector;
+
+		cv::Mat image;
+
+		boost::posix_time::ptime imageTime;
+
+		Detector::ResultCallback callback;
+
+		/**
+		 * Срок анализа кадра по часам исполнителя.
+		 */
+		boost::posix_time::ptime deadline;
+
+	};
+
+	/**
+	 * Очередь кадров и состояние потока детектора. Пока поток деградирован, состояние хранится и без кадров.
+	 */
+	struct DetectorQueue {
+
+		std::deque<Task> tasks;
+
+		/**
+		 * Анализ кадров детектора поставлен в пул или выполняется.
+		 */
+		bool running;
+
+		/**
+		 * Детектор; по нему отличается новый детектор, созданный по адресу удалённого.
+		 */
+		boost::weak_ptr<Detector> detector;
+
+		/**
+		 * Тип детектора для журнала.
+		 */
+		std::string type;
+
+		/**
+		 * Политика деградации детектора на момент постановки последнего кадра.
+		 */
+		DegradationPolicy::DegradationPolicySettings policy;
+
+		/**
+		 * Текущая ступень деградации.
+		 */
+		DegradationPolicy::Level level;
+
+		/**
+		 * Счётчик кадров для ступени DegradationPolicy::FRAME_STEP.
+		 */
+		int frameCounter;
+
+		/**
+		 * Обычная задержка между отправлением кадра и его постановкой в очередь.
+		 */
+		boost::posix_time::time_duration delay;
+
+		DetectorQueue();
+
+	};
+
+	/**
+	 * Настройки исполнителя.
+	 */
+	DetectorExecutorSettings settings_;
+
+	/**
+	 * Собственный пул, если задано threadCount_.
+	 */
+	boost::scoped_ptr<WorkStealingPool> ownPool_;
+
+	/**
+	 * Пул, в котором анализируются кадры.
+	 */
+	WorkStealingPool* pool_;
+
+	/**
+	 * Очереди детекторов, у которых есть ожидающие или анализируемые кадры, и деградированных детекторов.
+	 */
+	std::map<const Detector*, DetectorQueue> queues_;
+
+	/**
+	 * Детекторы, готовые к анализу, по сроку первого кадра; на каждый элемент в пул поставлена задача dispatch().
+	 */
+	std::multimap<boost::posix_time::ptime, const Detector*> ready_;
+
+	/**
+	 * Защищает очереди и счётчики.
+	 */
+	boost::mutex mutex_;
+
+	/**
+	 * Сигнализирует об окончании анализа кадра.
+	 */
+	boost::condition_variable taskDone_;
+
+	/**
+	 * Количество ожидающих кадров.
+	 */
+	int queuedFrames_;
+
+	/**
+	 * Количество отвергнутых кадров.
+	 */
+	int rejectedFrames_;
+
+	/**
+	 * Количество пропущенных кадров.
+	 */
+	int droppedFrames_;
+
+	/**
+	 * Количество детекторов, анализ кадров которых поставлен в пул или выполняется.
+	 */
+	int runningDetectors_;
+
+	/**
+	 * Время последнего устаревшего кадра.
+	 */
+	boost::posix_time::ptime lastOverload_;
+
+	/**
+	 * Время последней смены ступени деградации.
+	 */
+	boost::posix_time::ptime lastLevelChange_;
+
+	/**
+	 * Ставит детектор с непустой очередью в ready_ и задачу dispatch() в пул.
+	 */
+	void schedule(const Detector* key, DetectorQueue& queue);
+
+	/**
+	 * Задача пула: берёт детектор с самым ранним сроком, пропускает его устаревшие кадры, анализирует кадр
+	 * с учётом ступени деградации и снова ставит детектор в ready_, если очередь не пуста.
+	 */
+	void dispatch();
+
+	/**
+	 * Меняет ступени деградации по итогу анализа кадра, вызывается под мьютексом.
+	 *
+	 * @param key детектор, кадр которого проанализирован.
+	 * @param overloaded кадр проанализирован после срока или пропущены устаревшие кадры.
+	 */
+	void control(const Detector* key, bool overloaded, const boost::posix_time::ptime& now);
+
+	/**
+	 * Понижает ступень одного потока: опоздавшего, а если он уже на последней ступени или он с degradeLast_
+	 * при деградирующих ещё потоках без degradeLast_ -- потока без degradeLast_ с наименьшей ступенью.
+	 * Поток без minifiable_ переходит через ступень MINIFY сразу на FRAME_STEP.
+	 *
+	 * @param late детектор, кадр которого устарел.
+	 * @return false, если все потоки уже на последней ступени.
+	 */
+	bool degrade(const Detector* late);
+
+	/**
+	 * Повышает ступень одного потока: сначала потоков с degradeLast_, затем с наибольшей ступенью.
+	 * Поток без minifiable_ переходит через ступень MINIFY сразу на SKIP_SERIALIZATION_ONLY.
+	 *
+	 * @return false, если деградированных потоков нет.
+	 */
+	bool restore();
+
+	/**
+	 * Анализирует кадр, при @a minification > 1 уменьшенный, и вызывает обработчик результата.
+	 */
+	static void execute(Task& task, int minification);
+
+	/**
+	 * Сообщает обработчику, что кадр пропущен.
+	 */
+	static void reportDropped(Task& task);
+
+};
+
+#endif // DetectorExecutor_h_
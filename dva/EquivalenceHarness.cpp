@@ -0,0 +1,374 @@
+#include "EquivalenceHarness.h"
+#include <cstdlib>
+#include <cstdio>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <logging/logging.hpp>
+#include "AnCommon.h"
+
+const double EquivalenceHarness::EquivalenceHarnessSettings::MAX_PIXEL_DIFF_PERCENT = 0;
+const int EquivalenceHarness::EquivalenceHarnessSettings::MAX_OBJECT_COUNT_DIFF = 0;
+const int EquivalenceHarness::EquivalenceHarnessSettings::MAX_OBJECT_SHIFT = 0;
+const int EquivalenceHarness::EquivalenceHarnessSettings::MAX_BITMAP_DIFF_BLOCKS = 0;
+const int EquivalenceHarness::EquivalenceHarnessSettings::BITMAP_THRESHOLD_PERCENT = 50;
+const int EquivalenceHarness::EquivalenceHarnessSettings::MAX_REPROS = 1;
+const bool EquivalenceHarness::EquivalenceHarnessSettings::COMPARE_XML = true;
+const int EquivalenceHarness::EquivalenceHarnessSettings::BATCH_SIZE = 8;
+
+EquivalenceHarness::EquivalenceHarnessSettings::EquivalenceHarnessSettings()
+	: maxPixelDiffPercent_(MAX_PIXEL_DIFF_PERCENT)
+	, maxObjectCountDiff_(MAX_OBJECT_COUNT_DIFF)
+	, maxObjectShift_(MAX_OBJECT_SHIFT)
+	, maxBitmapDiffBlocks_(MAX_BITMAP_DIFF_BLOCKS)
+	, blockSize_(16, 16)
+	, bitmapThresholdPercent_(BITMAP_THRESHOLD_PERCENT)
+	, maxRepros_(MAX_REPROS)
+	, compareXml_(COMPARE_XML)
+	, batchSize_(BATCH_SIZE)
+{
+}
+
+EquivalenceHarness::FrameDiff::FrameDiff()
+	: frame(-1)
+	, pixelDiffPercent(0)
+	, referenceObjects(0)
+	, candidateObjects(0)
+	, objectShift(0)
+	, bitmapDiffBlocks(0)
+	, xmlDiffers(false)
+	, divergent(false)
+{
+}
+
+EquivalenceHarness::Report::Report()
+	: frames(0)
+	, divergentFrames(0)
+	, firstDivergentFrame(-1)
+	, xmlDiffFrames(0)
+{
+}
+
+bool EquivalenceHarness::Report::isEquivalent() const {
+	return divergentFrames == 0;
+}
+
+EquivalenceHarness::EquivalenceHarness(const EquivalenceHarnessSettings& settings)
+	: settings_(settings)
+	, savedRepros_(0)
+{
+}
+
+namespace {
+
+/**
+ * Наибольшее смещение сторон прямоугольников.
+ */
+int rectShift(const cv::Rect& a, const cv::Rect& b) {
+	int shift = std::max(std::abs(a.x - b.x), std::abs(a.y - b.y));
+	shift = std::max(shift, std::abs(a.br().x - b.br().x));
+	return std::max(shift, std::abs(a.br().y - b.br().y));
+}
+
+/**
+ * Сопоставляет каждому объекту эталона ближайший свободный объект кандидата и возвращает наибольшее смещение пары.
+ * Объекты без пары учитываются разницей количества.
+ */
+int matchObjects(const std::list<AnCommon::Object>& reference, const std::list<AnCommon::Object>& candidate) {
+	std::vector<cv::Rect> free;
+	for (std::list<AnCommon::Object>::const_iterator it = candidate.begin(); it != candidate.end(); ++it) {
+		free.push_back(it->getRect());
+	}
+	
+	int worst = 0;
+	for (std::list<AnCommon::Object>::const_iterator it = reference.begin(); it != reference.end() && !free.empty(); ++it) {
+		cv::Rect rect = it->getRect();
+		size_t best = 0;
+		int bestShift = rectShift(rect, free[0]);
+		for (size_t i = 1; i < free.size(); i++) {
+			int shift = rectShift(rect, free[i]);
+			if (shift < bestShift) {
+				best = i;
+				bestShift = shift;
+			}
+		}
+		worst = std::max(worst, bestShift);
+		free.erase(free.begin() + best);
+	}
+	
+	return worst;
+}
+
+/**
+ * Объекты xml-результата детектора (элементы <object>, см. AnCommon::getXMLObject()); прямоугольники в пикселях.
+ */
+std::list<AnCommon::Object> parseXmlObjects(const std::string& xml) {
+	std::list<AnCommon::Object> objects;
+	for (size_t begin = xml.find("<object>"); begin != std::string::npos; begin = xml.find("<object>", begin + 1)) {
+		size_t end = xml.find("</object>", begin);
+		std::string object = xml.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+		int id = 0;
+		size_t idPos = object.find("<id>");
+		if (idPos != std::string::npos) {
+			id = std::atoi(object.c_str() + idPos + 4);
+		}
+		size_t pointsPos = object.find("<points>");
+		int x1, y1, x2, y2;
+		if (pointsPos != std::string::npos && std::sscanf(object.c_str() + pointsPos + 8, "%d,%d,%d,%d", &x1, &y1, &x2, &y2) == 4) {
+			objects.push_back(AnCommon::Object(id, cv::Rect(x1, y1, x2 - x1, y2 - y1)));
+		}
+	}
+	return objects;
+}
+
+/**
+ * Строки битовой карты xml-результата детектора (элементы <line>, см. AnCommon::getXMLBitMap()).
+ */
+std::vector<std::string> parseXmlBitMap(const std::string& xml) {
+	std::vector<std::string> lines;
+	for (size_t begin = xml.find("<line>"); begin != std::string::npos; begin = xml.find("<line>", begin + 1)) {
+		size_t end = xml.find("</line>", begin);
+		if (end == std::string::npos) {
+			break;
+		}
+		lines.push_back(xml.substr(begin + 6, end - begin - 6));
+	}
+	return lines;
+}
+
+/**
+ * Количество различающихся блоков двух битовых карт; блоки, которых нет в одной из карт, считаются различающимися.
+ */
+int countBitMapDiff(const std::vector<std::string>& reference, const std::vector<std::string>& candidate) {
+	int diff = 0;
+	for (size_t y = 0; y < std::max(reference.size(), candidate.size()); y++) {
+		const std::string empty;
+		const std::string& referenceLine = y < reference.size() ? reference[y] : empty;
+		const std::string& candidateLine = y < candidate.size() ? candidate[y] : empty;
+		for (size_t x = 0; x < std::max(referenceLine.size(), candidateLine.size()); x++) {
+			if (x >= referenceLine.size() || x >= candidateLine.size() || referenceLine[x] != candidateLine[x]) {
+				diff++;
+			}
+		}
+	}
+	return diff;
+}
+
+}
+
+EquivalenceHarness::FrameDiff EquivalenceHarness::compare(int frameIndex, const cv::Mat& frame, const cv::Mat& reference, const cv::Mat& candidate) {
+	FrameDiff result;
+	result.frame = frameIndex;
+	
+	if (reference.size() != candidate.size()) {
+		LOG_WARN("EquivalenceHarness: frame " << frameIndex << ": mask sizes differ");
+		result.pixelDiffPercent = 100;
+		result.divergent = true;
+	} else {
+		cv::Mat referenceMask = reference != 0;
+		cv::Mat candidateMask = candidate != 0;
+		cv::Mat diff = referenceMask != candidateMask;
+		
+		if (!referenceMask.empty()) {
+			result.pixelDiffPercent = 100.0 * cv::countNonZero(diff) / referenceMask.size().area();
+		}
+		
+		std::list<AnCommon::Object> referenceObjects = AnCommon::createObjectList(referenceMask, AnCommon::STANDARD_APPROX_LEVEL);
+		std::list<AnCommon::Object> candidateObjects = AnCommon::createObjectList(candidateMask, AnCommon::STANDARD_APPROX_LEVEL);
+		result.referenceObjects = static_cast<int>(referenceObjects.size());
+		result.candidateObjects = static_cast<int>(candidateObjects.size());
+		result.objectShift = matchObjects(referenceObjects, candidateObjects);
+		
+		cv::Mat referenceBitMap = AnCommon::getBitMap(referenceMask, settings_.blockSize_, settings_.bitmapThresholdPercent_);
+		cv::Mat candidateBitMap = AnCommon::getBitMap(candidateMask, settings_.blockSize_, settings_.bitmapThresholdPercent_);
+		result.bitmapDiffBlocks = referenceBitMap.empty() ? 0 : cv::countNonZero(referenceBitMap != candidateBitMap);
+		
+		result.divergent = result.pixelDiffPercent > settings_.maxPixelDiffPercent_
+			|| std::abs(result.referenceObjects - result.candidateObjects) > settings_.maxObjectCountDiff_
+			|| result.objectShift > settings_.maxObjectShift_
+			|| result.bitmapDiffBlocks > settings_.maxBitmapDiffBlocks_;
+		
+		if (result.divergent) {
+			saveRepro(frameIndex, frame, referenceMask, candidateMask, diff);
+		}
+	}
+	
+	account(result);
+	
+	return result;
+}
+
+const EquivalenceHarness::Report& EquivalenceHarness::run(Algorithm& reference, Algorithm& candidate, FrameSource& frames) {
+	cv::Mat frame;
+	for (int index = 0; frames.read(frame); index++) {
+		// Алгоритм может вернуть ссылку на свой буфер, поэтому маска эталона копируется до вызова кандидата.
+		cv::Mat referenceMask = reference.detect(frame).clone();
+		cv::Mat candidateMask = candidate.detect(frame);
+		compare(index, frame, referenceMask, candidateMask);
+	}
+	
+	return report_;
+}
+
+const EquivalenceHarness::Report& EquivalenceHarness::run(ImageFilter& reference, ImageFilter& candidate, FrameSource& masks) {
+	cv::Mat mask;
+	for (int index = 0; masks.read(mask); index++) {
+		// Фильтры изменяют входное изображение, поэтому каждый получает свою копию.
+		cv::Mat referenceInput = mask.clone();
+		cv::Mat referenceMask = reference(referenceInput).clone();
+		cv::Mat candidateInput = mask.clone();
+		cv::Mat candidateMask = candidate(candidateInput);
+		compare(index, mask, referenceMask, candidateMask);
+	}
+	
+	return report_;
+}
+
+const EquivalenceHarness::Report& EquivalenceHarness::run(Detector& reference, Detector& candidate, DetectorPath candidatePath, FrameSource& frames, double fps) {
+	size_t batchSize = candidatePath == BATCH ? static_cast<size_t>(std::max(settings_.batchSize_, 1)) : 1;
+	const boost::posix_time::ptime start(boost::gregorian::date(2000, boost::gregorian::Jan, 1));
+	
+	std::vector<cv::Mat> images;
+	std::vector<boost::posix_time::ptime> imageTimes;
+	std::vector<std::string> referenceResults;
+	std::vector<std::string> candidateResults;
+	cv::Mat frame;
+	int index = 0;
+	for (bool more = true; more; ) {
+		more = frames.read(frame);
+		if (more) {
+			// источник может переиспользовать буфер кадра, а пакет кандидата держит кадры до своего анализа
+			images.push_back(frame.clone());
+			imageTimes.push_back(start + boost::posix_time::microseconds(static_cast<long>(index * 1000000.0 / fps)));
+			referenceResults.push_back(std::string());
+			reference.execute(images.back(), imageTimes.back(), referenceResults.back());
+			index++;
+		}
+		if (images.empty() || (more && images.size() < batchSize)) {
+			continue;
+		}
+		
+		if (candidatePath == BATCH) {
+			candidate.executeBatch(&images[0], &imageTimes[0], images.size(), candidateResults);
+		} else {
+			candidateResults.resize(images.size());
+			for (size_t i = 0; i < images.size(); i++) {
+				if (candidatePath == PREPARED) {
+					candidate.executePrepared(images[i], candidate.prepare(images[i]), imageTimes[i], candidateResults[i]);
+				} else {
+					candidate.execute(images[i], imageTimes[i], candidateResults[i]);
+				}
+			}
+		}
+		
+		int first = index - static_cast<int>(images.size());
+		for (size_t i = 0; i < images.size(); i++) {
+			compareResults(first + static_cast<int>(i), images[i], referenceResults[i], candidateResults[i]);
+		}
+		images.clear();
+		imageTimes.clear();
+		referenceResults.clear();
+	}
+	
+	return report_;
+}
+
+EquivalenceHarness::FrameDiff EquivalenceHarness::compareResults(int frameIndex, const cv::Mat& frame, const std::string& referenceXml, const std::string& candidateXml) {
+	FrameDiff result;
+	result.frame = frameIndex;
+	
+	std::list<AnCommon::Object> referenceObjects = parseXmlObjects(referenceXml);
+	std::list<AnCommon::Object> candidateObjects = parseXmlObjects(candidateXml);
+	result.referenceObjects = static_cast<int>(referenceObjects.size());
+	result.candidateObjects = static_cast<int>(candidateObjects.size());
+	result.objectShift = matchObjects(referenceObjects, candidateObjects);
+	result.bitmapDiffBlocks = countBitMapDiff(parseXmlBitMap(referenceXml), parseXmlBitMap(candidateXml));
+	result.xmlDiffers = referenceXml != candidateXml;
+	
+	result.divergent = (settings_.compareXml_ && result.xmlDiffers)
+		|| std::abs(result.referenceObjects - result.candidateObjects) > settings_.maxObjectCountDiff_
+		|| result.objectShift > settings_.maxObjectShift_
+		|| result.bitmapDiffBlocks > settings_.maxBitmapDiffBlocks_;
+	
+	if (result.divergent) {
+		saveRepro(frameIndex, frame, referenceXml, candidateXml);
+	}
+	account(result);
+	
+	return result;
+}
+
+void EquivalenceHarness::account(const FrameDiff& result) {
+	report_.frames++;
+	report_.worst.pixelDiffPercent = std::max(report_.worst.pixelDiffPercent, result.pixelDiffPercent);
+	report_.worst.objectShift = std::max(report_.worst.objectShift, result.objectShift);
+	report_.worst.bitmapDiffBlocks = std::max(report_.worst.bitmapDiffBlocks, result.bitmapDiffBlocks);
+	if (std::abs(result.referenceObjects - result.candidateObjects) > std::abs(report_.worst.referenceObjects - report_.worst.candidateObjects)) {
+		report_.worst.referenceObjects = result.referenceObjects;
+		report_.worst.candidateObjects = result.candidateObjects;
+	}
+	if (result.xmlDiffers) {
+		report_.xmlDiffFrames++;
+		report_.worst.xmlDiffers = true;
+	}
+	
+	if (result.divergent) {
+		report_.divergentFrames++;
+		if (report_.firstDivergentFrame < 0) {
+			report_.firstDivergentFrame = result.frame;
+			report_.worst.frame = result.frame;
+			report_.worst.divergent = true;
+		}
+		LOG_WARN("EquivalenceHarness: frame " << result.frame << " diverges: " << result.pixelDiffPercent << "% pixels, objects "
+			<< result.referenceObjects << "/" << result.candidateObjects << ", shift " << result.objectShift
+			<< ", blocks " << result.bitmapDiffBlocks << (result.xmlDiffers ? ", xml differs" : ""));
+	}
+}
+
+const EquivalenceHarness::Report& EquivalenceHarness::getReport() const {
+	return report_;
+}
+
+void EquivalenceHarness::clear() {
+	report_ = Report();
+	savedRepros_ = 0;
+}
+
+void EquivalenceHarness::saveRepro(int frameIndex, const cv::Mat& frame, const cv::Mat& reference, const cv::Mat& candidate, const cv::Mat& diff) {
+	if (settings_.reproDir_.empty() || savedRepros_ >= settings_.maxRepros_) {
+		return;
+	}
+	savedRepros_++;
+	
+	std::ostringstream prefix;
+	prefix << settings_.reproDir_ << "/frame_" << std::setw(6) << std::setfill('0') << frameIndex;
+	
+	if (!frame.empty()) {
+		cv::imwrite(prefix.str() + ".png", frame);
+	}
+	cv::imwrite(prefix.str() + "_reference.png", reference);
+	cv::imwrite(prefix.str() + "_candidate.png", candidate);
+	cv::imwrite(prefix.str() + "_diff.png", diff);
+	LOG_INFO("EquivalenceHarness: repro of frame " << frameIndex << " saved to " << prefix.str() << "*.png");
+}
+
+void EquivalenceHarness::saveRepro(int frameIndex, const cv::Mat& frame, const std::string& referenceXml, const std::string& candidateXml) {
+	if (settings_.reproDir_.empty() || savedRepros_ >= settings_.maxRepros_) {
+		return;
+	}
+	savedRepros_++;
+	
+	std::ostringstream prefix;
+	prefix << settings_.reproDir_ << "/frame_" << std::setw(6) << std::setfill('0') << frameIndex;
+	
+	if (!frame.empty()) {
+		cv::imwrite(prefix.str() + ".png", frame);
+	}
+	std::ofstream reference((prefix.str() + "_reference.xml").c_str());
+	reference << referenceXml << std::endl;
+	std::ofstream candidate((prefix.str() + "_candidate.xml").c_str());
+	candidate << candidateXml << std::endl;
+	LOG_INFO("EquivalenceHarness: repro of frame " << frameIndex << " saved to " << prefix.str() << "*");
+}
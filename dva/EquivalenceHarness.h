@@ -0,0 +1,320 @@
+#ifndef EquivalenceHarness_h_
+#define EquivalenceHarness_h_
+
+#include <string>
+#include <opencv/cv.h>
+#include "Algorithm.h"
+#include "ImageFilter.h"
+#include "FrameSource.h"
+#include "Detector.h"
+
+/**
+ * Проверка равнозначности оптимизированной реализации эталонной.
+ *
+ * Эталон и кандидат обрабатывают одни и те же кадры; их маски сравниваются покадрово попиксельно,
+ * по спискам объектов (AnCommon::createObjectList) и по битовым картам блоков (AnCommon::getBitMap)
+ * с заданными допусками. У детекторов сравниваются их xml-результаты: списки объектов и битовые карты,
+ * разобранные из xml, и сами строки. При расхождении кадр и обе маски (оба результата) сохраняются
+ * для воспроизведения.
+ *
+ * Допуски задаются для каждой пары отдельно: точные оптимизации проверяются с допусками по умолчанию,
+ * приближённые (например, разреженный режим FireDetectOnDynamicAlgorithm) -- со своими.
+ */
+class EquivalenceHarness {
+
+public:
+
+	/**
+	 * Класс настроек проверки.
+	 */
+	class EquivalenceHarnessSettings {
+
+	public:
+
+		/**
+		 * Значения по умолчанию соответствующих полей.
+		 *
+		 * @{
+		 */
+		static const double MAX_PIXEL_DIFF_PERCENT;
+		static const int MAX_OBJECT_COUNT_DIFF;
+		static const int MAX_OBJECT_SHIFT;
+		static const int MAX_BITMAP_DIFF_BLOCKS;
+		static const int BITMAP_THRESHOLD_PERCENT;
+		static const int MAX_REPROS;
+		static const bool COMPARE_XML;
+		static const int BATCH_SIZE;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Допустимая доля различающихся пикселей маски, в процентах от площади кадра.
+		 */
+		double maxPixelDiffPercent_;
+
+		/**
+		 * Допустимая разница количества объектов.
+		 */
+		int maxObjectCountDiff_;
+
+		/**
+		 * Допустимое смещение сторон прямоугольника объекта (пикселей).
+		 */
+		int maxObjectShift_;
+
+		/**
+		 * Допустимое количество различающихся блоков битовой карты.
+		 */
+		int maxBitmapDiffBlocks_;
+
+		/**
+		 * Размер блока битовой карты.
+		 */
+		cv::Size blockSize_;
+
+		/**
+		 * Заполненность блока (в процентах), с которой он отмечается в битовой карте.
+		 */
+		int bitmapThresholdPercent_;
+
+		/**
+		 * Каталог для кадров расхождений; пустая строка -- не сохранять.
+		 */
+		std::string reproDir_;
+
+		/**
+		 * Наибольшее количество сохраняемых расхождений (первые по порядку).
+		 */
+		int maxRepros_;
+
+		/**
+		 * Результаты детекторов должны совпадать побайтно; иначе xml сравнивается только по объектам и битовой карте.
+		 */
+		bool compareXml_;
+
+		/**
+		 * Количество кадров в пакете кандидата при проверке Detector::executeBatch().
+		 */
+		int batchSize_;
+
+		/**
+		 * Создаёт объект класса с параметрами по умолчанию: точное совпадение.
+		 */
+		EquivalenceHarnessSettings();
+
+	};
+
+	/**
+	 * Способ, которым кадры подаются детектору-кандидату; эталон всегда анализирует кадры через Detector::execute().
+	 */
+	enum DetectorPath {
+
+		/**
+		 * Detector::execute() по кадру.
+		 */
+		EXECUTE,
+
+		/**
+		 * Detector::prepare(), затем Detector::executePrepared().
+		 */
+		PREPARED,
+
+		/**
+		 * Detector::executeBatch() пакетами по batchSize_ кадров.
+		 */
+		BATCH
+
+	};
+
+	/**
+	 * Результат сравнения одного кадра.
+	 */
+	struct FrameDiff {
+
+		/**
+		 * Номер кадра.
+		 */
+		int frame;
+
+		/**
+		 * Доля различающихся пикселей (%).
+		 */
+		double pixelDiffPercent;
+
+		/**
+		 * Количество объектов у эталона и кандидата.
+		 *
+		 * @{
+		 */
+		int referenceObjects;
+
+		int candidateObjects;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Наибольшее смещение сопоставленных объектов (пикселей).
+		 */
+		int objectShift;
+
+		/**
+		 * Количество различающихся блоков битовой карты.
+		 */
+		int bitmapDiffBlocks;
+
+		/**
+		 * Xml-результаты детекторов различаются.
+		 */
+		bool xmlDiffers;
+
+		/**
+		 * Кадр выходит за допуски.
+		 */
+		bool divergent;
+
+		FrameDiff();
+
+	};
+
+	/**
+	 * Итог сравнения последовательности.
+	 */
+	struct Report {
+
+		/**
+		 * Количество сравненных кадров.
+		 */
+		int frames;
+
+		/**
+		 * Количество кадров, вышедших за допуски.
+		 */
+		int divergentFrames;
+
+		/**
+		 * Номер первого такого кадра, -1 если расхождений нет.
+		 */
+		int firstDivergentFrame;
+
+		/**
+		 * Количество кадров, на которых xml-результаты детекторов различаются.
+		 */
+		int xmlDiffFrames;
+
+		/**
+		 * Наибольшие отклонения по всем кадрам.
+		 */
+		FrameDiff worst;
+
+		Report();
+
+		/**
+		 * Показывает, что реализации равнозначны в пределах допусков.
+		 */
+		bool isEquivalent() const;
+
+	};
+
+	/**
+	 * Создаёт проверку с заданными допусками.
+	 */
+	EquivalenceHarness(const EquivalenceHarnessSettings& settings = EquivalenceHarnessSettings());
+
+	/**
+	 * Прогоняет кадры через два алгоритма и сравнивает их маски.
+	 *
+	 * @param reference эталонный алгоритм.
+	 * @param candidate проверяемый алгоритм.
+	 * @param frames кадры.
+	 * @return итог, накопленный с последнего clear().
+	 */
+	const Report& run(Algorithm& reference, Algorithm& candidate, FrameSource& frames);
+
+	/**
+	 * Прогоняет маски через два фильтра (каждый получает свою копию) и сравнивает результаты.
+	 *
+	 * @param masks исходные маски CV_8U.
+	 * @return итог, накопленный с последнего clear().
+	 */
+	const Report& run(ImageFilter& reference, ImageFilter& candidate, FrameSource& masks);
+
+	/**
+	 * Прогоняет кадры через два детектора и сравнивает их xml-результаты. Время кадров отсчитывается
+	 * от постоянной даты по частоте кадров, поэтому прогон повторяем. Детекторы должны быть настроены и включены.
+	 *
+	 * @param reference эталонный детектор, анализирует кадры через execute().
+	 * @param candidate проверяемый детектор.
+	 * @param candidatePath способ анализа кадров кандидатом.
+	 * @param frames кадры.
+	 * @param fps частота кадров.
+	 * @return итог, накопленный с последнего clear().
+	 */
+	const Report& run(Detector& reference, Detector& candidate, DetectorPath candidatePath, FrameSource& frames, double fps);
+
+	/**
+	 * Сравнивает маски одного кадра и учитывает результат в итоге.
+	 *
+	 * @param frameIndex номер кадра.
+	 * @param frame кадр, сохраняемый при расхождении.
+	 * @param reference маска эталона.
+	 * @param candidate маска кандидата.
+	 */
+	FrameDiff compare(int frameIndex, const cv::Mat& frame, const cv::Mat& reference, const cv::Mat& candidate);
+
+	/**
+	 * Сравнивает xml-результаты детекторов на одном кадре и учитывает результат в итоге.
+	 *
+	 * @param frameIndex номер кадра.
+	 * @param frame кадр, сохраняемый при расхождении.
+	 * @param referenceXml результат эталона.
+	 * @param candidateXml результат кандидата.
+	 */
+	FrameDiff compareResults(int frameIndex, const cv::Mat& frame, const std::string& referenceXml, const std::string& candidateXml);
+
+	/**
+	 * Итог сравнения.
+	 */
+	const Report& getReport() const;
+
+	/**
+	 * Начинает новый итог.
+	 */
+	void clear();
+
+private:
+
+	/**
+	 * Допуски.
+	 */
+	EquivalenceHarnessSettings settings_;
+
+	/**
+	 * Итог.
+	 */
+	Report report_;
+
+	/**
+	 * Количество сохранённых расхождений.
+	 */
+	int savedRepros_;
+
+	/**
+	 * Сохраняет кадр, обе маски и их разность в reproDir_.
+	 */
+	void saveRepro(int frameIndex, const cv::Mat& frame, const cv::Mat& reference, const cv::Mat& candidate, const cv::Mat& diff);
+
+	/**
+	 * Сохраняет кадр и оба xml-результата в reproDir_.
+	 */
+	void saveRepro(int frameIndex, const cv::Mat& frame, const std::string& referenceXml, const std::string& candidateXml);
+
+	/**
+	 * Учитывает результат сравнения кадра в итоге.
+	 */
+	void account(const FrameDiff& result);
+
+};
+
+#endif // EquivalenceHarness_h_
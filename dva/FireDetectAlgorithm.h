@@ -24,6 +24,20 @@ public:
 	 */
 	virtual cv::Mat detect(const cv::Mat& img) = 0;
 	
+	/**
+	 * Показывает, можно ли не вызывать detect() на кадрах, почти не отличающихся от последнего обработанного.
+	 * 
+	 * @return true - кадр можно пропустить, вызвав вместо detect() ageSkippedFrame().
+	 */
+	virtual bool isSkippable() {
+		return false;
+	}
+	
+	/**
+	 * Обновляет состояние алгоритма на пропущенном кадре так, как если бы кадр не изменился.
+	 */
+	virtual void ageSkippedFrame() {}
+	
 };
 
 #endif // FireDetectAlgorithm_h_
\ No newline at end of file
@@ -5,6 +5,14 @@ const std::string FireDetectOnColorAlgorithm::FIRE_DETECT_ON_COLOR_ALGORITHM = "
 std::string FireDetectOnColorAlgorithm::getType() {
 	return FIRE_DETECT_ON_COLOR_ALGORITHM;
 }
+
+void FireDetectOnColorAlgorithm::setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings) {
+	roi_.setSettings(settings, usedSettings);
+}
+
+void FireDetectOnColorAlgorithm::getSettings(xml::Request::Params &settings) {
+	roi_.getSettings(settings);
+}
 	
 bool FireDetectOnColorAlgorithm::pixelIsForeground(const cv::Mat &img, int x, int y) {
 
@@ -51,10 +59,12 @@ cv::Mat FireDetectOnColorAlgorithm::detect(const cv::Mat& img) {
 	int foregroundPixelCount = 0;
 	cv::Mat result(img);
 	result.setTo(cv::Scalar(CV_RGB(0,0,0)));
+	roi_.prepare(img.size());
+	const cv::Mat& roiMask = roi_.getPixelMask();
 	for (int y = 0; y < img.size().height; y++) {
-		for (int x = 0; x < img.size().width; x++) {
+		for (int x = roi_.getRowBegin(y); x < roi_.getRowEnd(y); x++) {
 			uchar& maskItem = result.ptr(y)[x];
-			maskItem = pixelIsForeground(img, x, y);
+			maskItem = (roiMask.empty() || roiMask.ptr(y)[x]) && pixelIsForeground(img, x, y);
 			foregroundPixelCount += maskItem;
 		}
 	}
@@ -2,6 +2,7 @@
 #define FireDetectOnColorAlgorithm_h_
 
 #include "FireDetectAlgorithm.h"
+#include "RegionOfInterest.h"
 #include <string>
 
 /**
@@ -38,14 +39,14 @@ public:
 	 * @param settings параметры(настройки) алгоритма.
 	 * @param usedSettings множество используемых настроек.
 	 */
-	virtual void setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings) {};
+	virtual void setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings);
 	
 	/**
 	 * Возвращает настройки(параметры) алгоритма.
 	 * 
 	 * @param settings параметры(настройки) алгоритма.
 	 */
-	virtual void getSettings(xml::Request::Params &settings) {};
+	virtual void getSettings(xml::Request::Params &settings);
 	
 	/**
 	 * Возвращает тип алгоритма.
@@ -66,6 +67,11 @@ private:
 	 */
 	static const size_t CHANNELS = 3;
 	
+	/**
+	 * Область кадра, за которой следит алгоритм.
+	 */
+	RegionOfInterest roi_;
+	
 	/**
 	 * Определяет имеет ли пиксель огненный цвет.
 	 *
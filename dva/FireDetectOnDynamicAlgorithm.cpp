@@ -1,9 +1,18 @@
 #include "FireDetectOnDynamicAlgorithm.h"
 #include <algorithm>
+#include <numeric>
 #include <logging/logging.hpp>
 #include "AnCommon.h"
 #include "System.h"
 #include <utils/maputils.hpp>
+#include <boost/bind.hpp>
+#include "WorkStealingPool.h"
+#include "RectMerger.h"
+
+/**
+ * Наименьшая высота полосы строк, обрабатываемой одной задачей пула.
+ */
+static const int BAND_ROWS = 32;
 
 const std::string FireDetectOnDynamicAlgorithm::FIRE_DETECT_ON_DYNAMIC = "FIRE_DETECT_ON_DYNAMIC";
 
@@ -12,6 +21,9 @@ const int FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings::FI
 const double FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings::SLIDING_AVG_ALPHA = 0.01;
 const double FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings::MIN_FOREGROUND_PIXELS_PERCENT = 0.1;
 const int FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings::FOREGROUND_TO_FIRE_MAX_RATIO = 100;
+const bool FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings::SPARSE_MODE = false;
+const int FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings::ROI_PADDING = 8;
+const int FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings::BACKGROUND_SUBSAMPLE_STEP = 4;
 
 FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings::FireDetectOnDynamicAlgorithmSettings() 
 	: minFireDelta_(MIN_FIRE_DELTA)
@@ -19,6 +31,9 @@ FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings::FireDetectOn
 	, slidingAvgAlpha_(SLIDING_AVG_ALPHA)
 	, minForegroundPixelsPercent_(MIN_FOREGROUND_PIXELS_PERCENT)
 	, foregroundToFireMaxRatio_(FOREGROUND_TO_FIRE_MAX_RATIO)  
+	, sparseMode_(SPARSE_MODE)
+	, roiPadding_(ROI_PADDING)
+	, backgroundSubsampleStep_(BACKGROUND_SUBSAMPLE_STEP)
 {}
 		
 FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings::FireDetectOnDynamicAlgorithmSettings(
@@ -26,18 +41,25 @@ FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings::FireDetectOn
 																		int firedPixelsThresholdPercent,
 																		double slidingAvgAlpha,
 																		double minForegroundPixelsPercent,
-																		int foregroundToFireMaxRatio) 
+																		int foregroundToFireMaxRatio,
+																		bool sparseMode,
+																		int roiPadding,
+																		int backgroundSubsampleStep) 
 	: minFireDelta_(minFireDelta)
 	, firedPixelsThresholdPercent_(firedPixelsThresholdPercent)
 	, slidingAvgAlpha_(slidingAvgAlpha)
 	, minForegroundPixelsPercent_(minForegroundPixelsPercent)
 	, foregroundToFireMaxRatio_(foregroundToFireMaxRatio)
+	, sparseMode_(sparseMode)
+	, roiPadding_(roiPadding)
+	, backgroundSubsampleStep_(backgroundSubsampleStep)
 {}
 	
 FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithm() 
 	: totalBgAvg_(CHANNELS)
 	, foregroundPixelCount_(0)
 	, firedPixelCount_(0)
+	, resultMaskIsSparse_(false)
 {}
 	
 FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithm(const FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings& settings)
@@ -45,6 +67,7 @@ FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithm(const FireDetectOnDyn
 	, totalBgAvg_(CHANNELS)
 	, foregroundPixelCount_(0)
 	, firedPixelCount_(0)
+	, resultMaskIsSparse_(false)
 {}
 
 std::string FireDetectOnDynamicAlgorithm::getType() {
@@ -92,16 +115,37 @@ bool FireDetectOnDynamicAlgorithm::pixelIsForeground(int x, int y) {
 	return isFire;
 }
 
+bool FireDetectOnDynamicAlgorithm::isInsideRoi(int x, int y) {
+	return roi_.getPixelMask().empty() || roi_.getPixelMask().ptr(y)[x] != 0;
+}
+
 void FireDetectOnDynamicAlgorithm::fillForegroundMask() {
-	foregroundPixelCount_ = 0;
-	for (int y = 0; y < currentFrameBGR_.size().height; y++) {
-		for (int x = 0; x < currentFrameBGR_.size().width; x++) {
-			uchar& maskItem = foregroundMask_.ptr(y)[x];
-			maskItem = pixelIsForeground(x, y);
-			foregroundPixelCount_ += maskItem;
+	int height = currentFrameBGR_.size().height;
+	// количество пикселей считается по строкам, чтобы полосы не делили общий счётчик
+	std::vector<int> rowCounts(height);
+	WorkStealingPool::getDefault().parallelFor(0, height, BAND_ROWS,
+		boost::bind(&FireDetectOnDynamicAlgorithm::fillForegroundMaskRows, this, &rowCounts, _1, _2));
+	foregroundPixelCount_ = std::accumulate(rowCounts.begin(), rowCounts.end(), 0);
+	LOG_TRACE("Foreground pixels: " << foregroundPixelCount_);
+}
+
+void FireDetectOnDynamicAlgorithm::fillForegroundMaskRows(std::vector<int>* rowCounts, int rowBegin, int rowEnd) {
+	int width = currentFrameBGR_.size().width;
+	for (int y = rowBegin; y < rowEnd; y++) {
+		uchar* mask = foregroundMask_.ptr(y);
+		int begin = roi_.getRowBegin(y);
+		int end = roi_.getRowEnd(y);
+		// вне области пиксели не считаются огненными и не проверяются
+		std::fill(mask, mask + begin, 0);
+		std::fill(mask + std::max(begin, end), mask + width, 0);
+		int count = 0;
+		for (int x = begin; x < end; x++) {
+			uchar& maskItem = mask[x];
+			maskItem = isInsideRoi(x, y) && pixelIsForeground(x, y);
+			count += maskItem;
 		}
+		(*rowCounts)[y] = count;
 	}
-	LOG_TRACE("Foreground pixels: " << foregroundPixelCount_);
 }
 
 void FireDetectOnDynamicAlgorithm::updateSlidingAvg(int x, int y) {
@@ -116,21 +160,177 @@ void FireDetectOnDynamicAlgorithm::updateAverages() {
 		totalBgAvg_[i] = 0.0;
 	}
 	
+	WorkStealingPool::getDefault().parallelFor(0, currentFrameBGR_.size().height, BAND_ROWS,
+		boost::bind(&FireDetectOnDynamicAlgorithm::updateSlidingAvgRows, this, _1, _2));
+	
+	// суммы накапливаются одним проходом в прежнем порядке, чтобы результат не зависел от деления на полосы
+	int backgroundPixelCount = 0;
 	for (int y = 0; y < currentFrameBGR_.size().height; y++) {
-		for (int x = 0; x < currentFrameBGR_.size().width; x++) {
+		for (int x = roi_.getRowBegin(y); x < roi_.getRowEnd(y); x++) {
+			if (!isInsideRoi(x, y)) {
+				continue;
+			}
+			if (foregroundMask_.ptr(y)[x] == 0) {
+				for (size_t i = 0; i < CHANNELS; i++) {
+					totalBgAvg_[i] += reinterpret_cast<float*>(slidingAvg_.ptr(y))[x * CHANNELS + i];
+				}
+				backgroundPixelCount++;
+			}
+		}
+	}
+	
+	// вся область может оказаться переднеплановой
+	if (backgroundPixelCount != 0) {
+		for (size_t i = 0; i < CHANNELS; i++) {
+			totalBgAvg_[i] /= backgroundPixelCount;
+		}
+	}
+}
+
+void FireDetectOnDynamicAlgorithm::updateSlidingAvgRows(int rowBegin, int rowEnd) {
+	for (int y = rowBegin; y < rowEnd; y++) {
+		for (int x = roi_.getRowBegin(y); x < roi_.getRowEnd(y); x++) {
+			if (isInsideRoi(x, y)) {
+				updateSlidingAvg(x, y);
+			}
+		}
+	}
+}
+
+void FireDetectOnDynamicAlgorithm::updateAveragesSparse() {
+	for (size_t i = 0; i < CHANNELS; i++) {
+		totalBgAvg_[i] = 0.0;
+	}
+	
+	int step = std::max(1, settings_.backgroundSubsampleStep_);
+	int sampledPixelCount = 0;
+	for (int y = 0; y < currentFrameBGR_.size().height; y += step) {
+		// узлы сетки остаются кратными шагу и внутри области
+		int begin = (roi_.getRowBegin(y) + step - 1) / step * step;
+		for (int x = begin; x < roi_.getRowEnd(y); x += step) {
+			if (!isInsideRoi(x, y)) {
+				continue;
+			}
 			updateSlidingAvg(x, y);
 			if (foregroundMask_.ptr(y)[x] == 0) {
 				for (size_t i = 0; i < CHANNELS; i++) {
 					totalBgAvg_[i] += reinterpret_cast<float*>(slidingAvg_.ptr(y))[x * CHANNELS + i];
 				}
+				sampledPixelCount++;
 			}
 		}
 	}
 	
-	int backgroundPixelCount = currentFrameBGR_.size().area() - foregroundPixelCount_;
+	if (sampledPixelCount != 0) {
+		for (size_t i = 0; i < CHANNELS; i++) {
+			totalBgAvg_[i] /= sampledPixelCount;
+		}
+	}
+	
+	if (candidateRois_.empty()) {
+		return;
+	}
+	int top = candidateRois_[0].y;
+	int bottom = candidateRois_[0].y + candidateRois_[0].height;
+	for (size_t r = 1; r < candidateRois_.size(); r++) {
+		top = std::min(top, candidateRois_[r].y);
+		bottom = std::max(bottom, candidateRois_[r].y + candidateRois_[r].height);
+	}
+	
+	// Узлы сетки уже обновлены выше, второй раз их пересчитывать нельзя.
+	// Области кандидатов расширены и могут выходить за область анализа, пиксели вне неё не обновляются.
+	std::vector<std::pair<int, int> > tracked;
+	for (int y = top; y < bottom; y++) {
+		bool gridRow = y % step == 0;
+		bool trackedReady = false;
+		for (size_t r = 0; r < candidateRois_.size(); r++) {
+			const cv::Rect& roi = candidateRois_[r];
+			if (y < roi.y || roi.y + roi.height <= y) {
+				continue;
+			}
+			int begin = std::max(roi.x, roi_.getRowBegin(y));
+			int end = std::min(roi.x + roi.width, roi_.getRowEnd(y));
+			if (begin >= end) {
+				continue;
+			}
+			if (!trackedReady) {
+				tracked = getTrackedRanges(y);
+				trackedReady = true;
+			}
+			size_t range = 0;
+			for (int x = begin; x < end; x++) {
+				if ((gridRow && x % step == 0) || !isInsideRoi(x, y)) {
+					continue;
+				}
+				while (range < tracked.size() && tracked[range].second <= x) {
+					range++;
+				}
+				if (range == tracked.size() || x < tracked[range].first) {
+					resetSlidingAvg(x, y, step);
+				}
+				updateSlidingAvg(x, y);
+			}
+		}
+	}
+}
+
+std::vector<std::pair<int, int> > FireDetectOnDynamicAlgorithm::getTrackedRanges(int y) {
+	std::vector<std::pair<int, int> > ranges;
+	for (size_t r = 0; r < prevCandidateRois_.size(); r++) {
+		const cv::Rect& roi = prevCandidateRois_[r];
+		if (roi.y <= y && y < roi.y + roi.height) {
+			ranges.push_back(std::make_pair(roi.x, roi.x + roi.width));
+		}
+	}
+	// области предыдущего кадра не пересекаются, поэтому отрезки строки тоже
+	std::sort(ranges.begin(), ranges.end());
+	return ranges;
+}
+
+void FireDetectOnDynamicAlgorithm::resetSlidingAvg(int x, int y, int step) {
+	int gridX = x / step * step;
+	int gridY = y / step * step;
+	bool gridNodeTracked = gridX >= roi_.getRowBegin(gridY) && gridX < roi_.getRowEnd(gridY) && isInsideRoi(gridX, gridY);
+	float* avg = reinterpret_cast<float*>(slidingAvg_.ptr(y)) + x * CHANNELS;
+	const float* gridAvg = reinterpret_cast<float*>(slidingAvg_.ptr(gridY)) + gridX * CHANNELS;
 	for (size_t i = 0; i < CHANNELS; i++) {
-		totalBgAvg_[i] /= backgroundPixelCount;
+		avg[i] = gridNodeTracked ? gridAvg[i] : static_cast<float>(totalBgAvg_[i]);
+	}
+}
+
+void FireDetectOnDynamicAlgorithm::findCandidateRois() {
+	// скользящие средние вне областей предыдущего кадра не обновлялись, см. resetSlidingAvg()
+	prevCandidateRois_.swap(candidateRois_);
+	candidateRois_.clear();
+	if (foregroundPixelCount_ == 0) {
+		return;
+	}
+	
+	// cv::findContours портит входную матрицу.
+	cv::Mat buf = foregroundMask_.clone();
+	AnCommon::Contours contours;
+	cv::findContours(buf, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+	
+	cv::Rect frameRect(cv::Point(0, 0), currentFrameBGR_.size());
+	int padding = std::max(0, settings_.roiPadding_);
+	std::list<AnCommon::Object> rects;
+	for (size_t i = 0; i < contours.size(); i++) {
+		cv::Rect rect = cv::boundingRect(cv::Mat(contours[i], false));
+		rect.x -= padding;
+		rect.y -= padding;
+		rect.width += 2 * padding;
+		rect.height += 2 * padding;
+		rects.push_back(AnCommon::Object(static_cast<int>(i), rect & frameRect));
+	}
+	
+	// Прямоугольники не должны пересекаться, иначе пиксели будут обновляться дважды.
+	RectMerger::Rect bounds = { 0, 0, frameRect.width - 1, frameRect.height - 1 };
+	RectMerger merger(bounds);
+	const std::list<AnCommon::Object>& mergedRects = merger.getMergedRects(rects, 0);
+	for (std::list<AnCommon::Object>::const_iterator i = mergedRects.begin(); i != mergedRects.end(); ++i) {
+		candidateRois_.push_back(i->getRect() & frameRect);
 	}
+	LOG_TRACE("Candidate regions: " << candidateRois_.size());
 }
 
 void FireDetectOnDynamicAlgorithm::recreateMatrixIfNeeded(cv::Mat& m, int type, cv::Scalar initialValue) {
@@ -139,29 +339,99 @@ void FireDetectOnDynamicAlgorithm::recreateMatrixIfNeeded(cv::Mat& m, int type,
 	}
 }
 
+double FireDetectOnDynamicAlgorithm::getFireDelta(int x, int y) {
+	double delta = 0.0;
+	for (size_t i = 0; i < CHANNELS; i++) {
+		delta += std::max(reinterpret_cast<float*>(slidingAvg_.ptr(y))[x * CHANNELS + i] - totalBgAvg_[i], 0.0);
+	}
+	return delta / CHANNELS;
+}
+
 void FireDetectOnDynamicAlgorithm::fillPerPixelResultMask() {
-	firedPixelCount_ = 0;
-	float avgDelta = 0.0;
-	for (int y = 0; y < currentFrameBGR_.size().height; y++) {
-		for (int x = 0; x < currentFrameBGR_.size().width; x++) {
-			uchar& result = perPixelResultMask_.ptr(y)[x];
+	resultSpans_.clear();
+	resultMaskIsSparse_ = false;
+	int height = currentFrameBGR_.size().height;
+	std::vector<int> rowCounts(height);
+	std::vector<float> rowDeltas(height);
+	WorkStealingPool::getDefault().parallelFor(0, height, BAND_ROWS,
+		boost::bind(&FireDetectOnDynamicAlgorithm::fillPerPixelResultMaskRows, this, &rowCounts, &rowDeltas, _1, _2));
+	firedPixelCount_ = std::accumulate(rowCounts.begin(), rowCounts.end(), 0);
+	float avgDelta = std::accumulate(rowDeltas.begin(), rowDeltas.end(), 0.0f);
+	LOG_TRACE("Average background fluctuations = (" << totalBgAvg_[0] << ", " << totalBgAvg_[1] << ", " << totalBgAvg_[2] << ")");
+	LOG_TRACE("Average delta for foreground pixels = " << avgDelta / foregroundPixelCount_);
+	LOG_TRACE("Fired pixels: " << firedPixelCount_);
+}
+
+void FireDetectOnDynamicAlgorithm::fillPerPixelResultMaskRows(std::vector<int>* rowCounts, std::vector<float>* rowDeltas, int rowBegin, int rowEnd) {
+	int width = currentFrameBGR_.size().width;
+	for (int y = rowBegin; y < rowEnd; y++) {
+		int firedPixelCount = 0;
+		float avgDelta = 0.0;
+		uchar* resultRow = perPixelResultMask_.ptr(y);
+		int begin = roi_.getRowBegin(y);
+		int end = roi_.getRowEnd(y);
+		std::fill(resultRow, resultRow + begin, 0);
+		std::fill(resultRow + std::max(begin, end), resultRow + width, 0);
+		for (int x = begin; x < end; x++) {
+			uchar& result = resultRow[x];
 			result = 0;
 			if (foregroundMask_.ptr(y)[x] == 1) {
-				double delta = 0.0;
-				for (size_t i = 0; i < CHANNELS; i++) {
-					delta += std::max(reinterpret_cast<float*>(slidingAvg_.ptr(y))[x * CHANNELS + i] - totalBgAvg_[i], 0.0);
-				}
-				avgDelta += delta / CHANNELS;
-				if (delta / CHANNELS > settings_.minFireDelta_) {
+				double delta = getFireDelta(x, y);
+				avgDelta += delta;
+				if (delta > settings_.minFireDelta_) {
 					result = 1;
+					firedPixelCount++;
+				}
+			}
+		}
+		(*rowCounts)[y] = firedPixelCount;
+		(*rowDeltas)[y] = avgDelta;
+	}
+}
+
+void FireDetectOnDynamicAlgorithm::fillPerPixelResultMaskSparse() {
+	firedPixelCount_ = 0;
+	
+	if (resultMaskIsSparse_) {
+		for (size_t i = 0; i < resultSpans_.size(); i++) {
+			const AnCommon::Span& span = resultSpans_[i];
+			std::fill_n(perPixelResultMask_.ptr(span.y) + span.x, span.length, 0);
+		}
+	} else {
+		perPixelResultMask_.setTo(cv::Scalar(CV_RGB(0,0,0)));
+		resultMaskIsSparse_ = true;
+	}
+	resultSpans_.clear();
+	
+	for (size_t r = 0; r < candidateRois_.size(); r++) {
+		const cv::Rect& roi = candidateRois_[r];
+		for (int y = roi.y; y < roi.y + roi.height; y++) {
+			uchar* result = perPixelResultMask_.ptr(y);
+			const uchar* foreground = foregroundMask_.ptr(y);
+			int spanStart = -1;
+			for (int x = roi.x; x < roi.x + roi.width; x++) {
+				bool fired = foreground[x] == 1 && getFireDelta(x, y) > settings_.minFireDelta_;
+				if (fired) {
+					result[x] = 1;
 					firedPixelCount_++;
+					if (spanStart < 0) {
+						spanStart = x;
+					}
+				} else if (spanStart >= 0) {
+					resultSpans_.push_back(AnCommon::Span(y, spanStart, x - spanStart));
+					spanStart = -1;
 				}
 			}
+			if (spanStart >= 0) {
+				resultSpans_.push_back(AnCommon::Span(y, spanStart, roi.x + roi.width - spanStart));
+			}
 		}
 	}
-	LOG_TRACE("Average background fluctuations = (" << totalBgAvg_[0] << ", " << totalBgAvg_[1] << ", " << totalBgAvg_[2] << ")");
-	LOG_TRACE("Average delta for foreground pixels = " << avgDelta / foregroundPixelCount_);
-	LOG_TRACE("Fired pixels: " << firedPixelCount_);
+	LOG_TRACE("Fired pixels: " << firedPixelCount_ << " in " << resultSpans_.size() << " spans");
+}
+
+const AnCommon::Spans& FireDetectOnDynamicAlgorithm::getResultSpans() const {
+	return resultSpans_;
 }
 
 cv::Mat FireDetectOnDynamicAlgorithm::detect(const cv::Mat& img) {
@@ -181,19 +451,37 @@ cv::Mat FireDetectOnDynamicAlgorithm::detect(const cv::Mat& img) {
 		cv::cvtColor(currentFrameBGR_, currentFrameYCrCb_, CV_BGR2YCrCb);
 
 		LOG_TRACE("Recreating internal matrices");
+		if (perPixelResultMask_.size() != currentFrameBGR_.size()) {
+			resultSpans_.clear();
+			resultMaskIsSparse_ = false;
+			candidateRois_.clear();
+		}
 		recreateMatrixIfNeeded(slidingAvg_, CV_32FC3, CV_RGB(0, 0, 0));
 		recreateMatrixIfNeeded(foregroundMask_, CV_8UC1, CV_RGB(0, 0, 0));
 		recreateMatrixIfNeeded(perPixelResultMask_, CV_8UC1, CV_RGB(0, 0, 0));
+		roi_.prepare(currentFrameBGR_.size());
 
 		LOG_TRACE("fillForegroundMask");
 		fillForegroundMask();
 
-		LOG_TRACE("Updating averages");
-		updateAverages();
+		if (settings_.sparseMode_) {
+			LOG_TRACE("findCandidateRois");
+			findCandidateRois();
+			
+			LOG_TRACE("Updating averages in candidate regions");
+			updateAveragesSparse();
+		} else {
+			LOG_TRACE("Updating averages");
+			updateAverages();
+		}
 
 		if (foregroundPixelCount_ >= settings_.minForegroundPixelsPercent_) {
 			LOG_TRACE("Filling per pixel results");
-			fillPerPixelResultMask();
+			if (settings_.sparseMode_) {
+				fillPerPixelResultMaskSparse();
+			} else {
+				fillPerPixelResultMask();
+			}
 
 			if (firedPixelCount_ != 0 && foregroundPixelCount_ / firedPixelCount_ <= settings_.foregroundToFireMaxRatio_) {
 				LOG_TRACE("Return result");
@@ -215,6 +503,68 @@ cv::Mat FireDetectOnDynamicAlgorithm::detect(const cv::Mat& img) {
 	return perPixelResultMask_;
 }
 
+bool FireDetectOnDynamicAlgorithm::isSkippable() {
+	return true;
+}
+
+void FireDetectOnDynamicAlgorithm::ageSkippedFrame() {
+	double decay = 1.0 - settings_.slidingAvgAlpha_;
+	if (!slidingAvg_.empty()) {
+		slidingAvg_ *= decay;
+	}
+	for (size_t i = 0; i < CHANNELS; i++) {
+		totalBgAvg_[i] *= decay;
+	}
+}
+
+std::string FireDetectOnDynamicAlgorithm::getSnapshotType() {
+	return getType();
+}
+
+u_int32_t FireDetectOnDynamicAlgorithm::getSnapshotVersion() {
+	return 1;
+}
+
+u_int64_t FireDetectOnDynamicAlgorithm::getSnapshotFingerprint(const cv::Size& frameSize) {
+	// скользящие средние зависят только от коэффициента сглаживания, остальные настройки -- пороги детектирования
+	return SnapshotFingerprint().add(frameSize).add(settings_.slidingAvgAlpha_).get();
+}
+
+bool FireDetectOnDynamicAlgorithm::hasSnapshotState() {
+	return !slidingAvg_.empty() && prevImg_.size() == slidingAvg_.size();
+}
+
+void FireDetectOnDynamicAlgorithm::saveSnapshot(SnapshotWriter& writer) {
+	for (size_t i = 0; i < CHANNELS; i++) {
+		writer.write(totalBgAvg_[i]);
+	}
+	writer.writeMat(slidingAvg_);
+	writer.writeMat(prevImg_);
+}
+
+void FireDetectOnDynamicAlgorithm::restoreSnapshot(SnapshotReader& reader) {
+	std::vector<double> totalBgAvg(CHANNELS);
+	for (size_t i = 0; i < CHANNELS; i++) {
+		reader.read(totalBgAvg[i]);
+	}
+	// матрицы ссылаются на данные снимка, поэтому копируются
+	cv::Mat slidingAvg = reader.readMat();
+	cv::Mat prevImg = reader.readMat();
+	if (slidingAvg.type() != CV_32FC3 || slidingAvg.size() != prevImg.size()) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": snapshot");
+	}
+	slidingAvg.copyTo(slidingAvg_);
+	prevImg.copyTo(prevImg_);
+	totalBgAvg_.swap(totalBgAvg);
+	// области и серии относятся к кадрам до восстановления: их пиксели не должны считаться отслеживаемыми,
+	// а маска результата при следующем кадре обнуляется целиком
+	candidateRois_.clear();
+	prevCandidateRois_.clear();
+	resultSpans_.clear();
+	resultMaskIsSparse_ = false;
+	LOG_DEBUG("FireDetectOnDynamic: restored sliding averages " << slidingAvg_.cols << "x" << slidingAvg_.rows);
+}
+
 void FireDetectOnDynamicAlgorithm::setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings) {
 	try { 
 		
@@ -241,6 +591,29 @@ void FireDetectOnDynamicAlgorithm::setSettings(const xml::Request::Params &setti
 			settings_.minFireDelta_ = System::throwingLexCast<std::string, double>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
 			usedSettings.insert(paramName);
 		}
+		roi_.setSettings(settings, usedSettings);
+		// параметры разреженного режима необязательны, их отсутствие оставляет текущие значения
+		{
+			std::string paramName = "sparseMode";
+			if (settings.count(paramName)) {
+				settings_.sparseMode_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "roiPadding";
+			if (settings.count(paramName)) {
+				settings_.roiPadding_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "backgroundSubsampleStep";
+			if (settings.count(paramName)) {
+				settings_.backgroundSubsampleStep_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
 	
 	} catch (std::string& err) {
 		errors::throwException(err);
@@ -255,6 +628,10 @@ void FireDetectOnDynamicAlgorithm::getSettings(xml::Request::Params &settings) {
 	settings["slidingAvgAlpha"] = boost::lexical_cast<std::string>(settings_.slidingAvgAlpha_);
 	settings["minForegroundPixelsPercent"] = boost::lexical_cast<std::string>(settings_.minForegroundPixelsPercent_);
 	settings["foregroundToFireMaxRatio"] = boost::lexical_cast<std::string>(settings_.foregroundToFireMaxRatio_);
+	roi_.getSettings(settings);
+	settings["sparseMode"] = boost::lexical_cast<std::string>(settings_.sparseMode_);
+	settings["roiPadding"] = boost::lexical_cast<std::string>(settings_.roiPadding_);
+	settings["backgroundSubsampleStep"] = boost::lexical_cast<std::string>(settings_.backgroundSubsampleStep_);
 }
 	
 void FireDetectOnDynamicAlgorithm::setSettings(const FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings &settings) {
@@ -274,5 +651,9 @@ void FireDetectOnDynamicAlgorithm::clear() {
 	foregroundPixelCount_ = 0;
 	firedPixelCount_ = 0;
 	perPixelResultMask_.setTo(cv::Scalar(CV_RGB(0,0,0)));
+	candidateRois_.clear();
+	prevCandidateRois_.clear();
+	resultSpans_.clear();
+	resultMaskIsSparse_ = false;
 	prevImg_.setTo(cv::Scalar(CV_RGB(0,0,0)));
 }
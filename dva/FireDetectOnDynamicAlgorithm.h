@@ -2,12 +2,15 @@
 #define FireDetectOnDynamicAlgorithm_h_
 
 #include "FireDetectAlgorithm.h"
+#include "RegionOfInterest.h"
+#include "Snapshot.h"
 
 /**
  * Класс алгоритма детектирования огня по динамике.
  */
 class FireDetectOnDynamicAlgorithm 
 : public FireDetectAlgorithm
+, public Snapshotable
 {
 public:
 	
@@ -33,6 +36,9 @@ public:
 		static const double SLIDING_AVG_ALPHA;
 		static const double MIN_FOREGROUND_PIXELS_PERCENT;
 		static const int FOREGROUND_TO_FIRE_MAX_RATIO;
+		static const bool SPARSE_MODE;
+		static const int ROI_PADDING;
+		static const int BACKGROUND_SUBSAMPLE_STEP;
 		/**
 		 * @}
 		 */
@@ -62,6 +68,21 @@ public:
 		 */
 		int foregroundToFireMaxRatio_;
 		
+		/**
+		 * Разреженный режим: динамика пикселей считается только в окрестностях областей огненного цвета.
+		 */
+		bool sparseMode_;
+		
+		/**
+		 * Отступ (в пикселях), на который расширяются обрамляющие прямоугольники областей-кандидатов в разреженном режиме.
+		 */
+		int roiPadding_;
+		
+		/**
+		 * Шаг прореживания (по обеим осям) при подсчёте фоновой статистики в разреженном режиме.
+		 */
+		int backgroundSubsampleStep_;
+		
 		/**
 		 * Создаёт объект класса с значениями по умолчанию.
 		 */
@@ -77,7 +98,10 @@ public:
 						int firedPixelsThresholdPercent,
 						double slidingAvgAlpha,
 						double minForegroundPixelsPercent,
-						int foregroundToFireMaxRatio);
+						int foregroundToFireMaxRatio,
+						bool sparseMode = SPARSE_MODE,
+						int roiPadding = ROI_PADDING,
+						int backgroundSubsampleStep = BACKGROUND_SUBSAMPLE_STEP);
 		
 	};
 	
@@ -130,12 +154,49 @@ public:
 	 */
 	FireDetectOnDynamicAlgorithmSettings getSettings();
 	
+	/**
+	 * Возвращает попиксельный результат последнего кадра в виде серий.
+	 * 
+	 * @return серии огненных пикселей, заполняется только в разреженном режиме.
+	 */
+	const AnCommon::Spans& getResultSpans() const;
+	
 	/**
 	 * Возвращает тип алгоритма.
 	 * 
 	 * @return тип алгоритма.
 	 */
 	virtual std::string getType();
+	
+	/**
+	 * Алгоритм можно пропускать на неизменившихся кадрах.
+	 */
+	virtual bool isSkippable();
+	
+	/**
+	 * Затухание скользящих средних: на неизменившемся кадре изменение интенсивностей равно нулю.
+	 */
+	virtual void ageSkippedFrame();
+
+	/**
+	 * Сохранение и восстановление состояния алгоритма, см. Snapshotable.
+	 *
+	 * @{
+	 */
+	virtual std::string getSnapshotType();
+
+	virtual u_int32_t getSnapshotVersion();
+
+	virtual u_int64_t getSnapshotFingerprint(const cv::Size& frameSize);
+
+	virtual bool hasSnapshotState();
+
+	virtual void saveSnapshot(SnapshotWriter& writer);
+
+	virtual void restoreSnapshot(SnapshotReader& reader);
+	/**
+	 * @}
+	 */
 
 	/**
 	 * Очищает все поля, связанные с работой алгоритма.
@@ -153,10 +214,30 @@ private:
 	bool pixelIsForeground(int x, int y);
 	
 	/**
-	 * Заполняет маску переднеплановых пикселей(пикселей огненого цвета).
+	 * Заполняет маску переднеплановых пикселей(пикселей огненого цвета) внутри области @a roi_.
 	 */
 	void fillForegroundMask();
 	
+	/**
+	 * Заполняет маску переднеплановых пикселей в строках [rowBegin, rowEnd).
+	 * 
+	 * @param rowCounts сюда помещается количество переднеплановых пикселей каждой строки.
+	 */
+	void fillForegroundMaskRows(std::vector<int>* rowCounts, int rowBegin, int rowEnd);
+	
+	/**
+	 * Проверяет, лежит ли пиксель внутри области @a roi_.
+	 * 
+	 * @param x абсцисса пикселя.
+	 * @param y ордината пикселя.
+	 */
+	bool isInsideRoi(int x, int y);
+	
+	/**
+	 * Область кадра, за которой следит алгоритм.
+	 */
+	RegionOfInterest roi_;
+	
 	/**
 	 * Настройки алгоритма.
 	 */
@@ -217,11 +298,52 @@ private:
 	 */
 	cv::Mat prevImg_;
 	
+	/**
+	 * Расширенные и объединённые обрамляющие прямоугольники областей огненного цвета (разреженный режим).
+	 */
+	std::vector<cv::Rect> candidateRois_;
+	
+	/**
+	 * Области-кандидаты предыдущего кадра: только в них скользящие средние обновлялись на каждом кадре.
+	 */
+	std::vector<cv::Rect> prevCandidateRois_;
+	
+	/**
+	 * Серии огненных пикселей, из которых собрана @a perPixelResultMask_ в разреженном режиме.
+	 */
+	AnCommon::Spans resultSpans_;
+	
+	/**
+	 * Показывает, что ненулевые элементы @a perPixelResultMask_ описываются @a resultSpans_.
+	 */
+	bool resultMaskIsSparse_;
+	
 	/**
 	 * Заполнить @a perPixelResultMask_ по динамике изменений интенсивностей.
 	 */
 	void fillPerPixelResultMask();
 	
+	/**
+	 * Заполняет @a perPixelResultMask_ в строках [rowBegin, rowEnd).
+	 * 
+	 * @param rowCounts сюда помещается количество огненных пикселей каждой строки.
+	 * @param rowDeltas сюда помещается сумма превышений скользящих средних переднеплановых пикселей каждой строки.
+	 */
+	void fillPerPixelResultMaskRows(std::vector<int>* rowCounts, std::vector<float>* rowDeltas, int rowBegin, int rowEnd);
+	
+	/**
+	 * Заполнить @a perPixelResultMask_ только внутри @a candidateRois_, обнуляя лишь серии предыдущего кадра.
+	 */
+	void fillPerPixelResultMaskSparse();
+	
+	/**
+	 * Возвращает превышение скользящего среднего пикселя над фоновым, осреднённое по каналам.
+	 * 
+	 * @param x абсцисса пикселя. 
+	 * @param y ордината пикселя.
+	 */
+	double getFireDelta(int x, int y);
+	
 	/**
 	 * Пересчёт скользящих средних изменения интенсивностей для одного пикселя.
 	 * 
@@ -235,6 +357,35 @@ private:
 	 */
 	void updateAverages();
 	
+	/**
+	 * Пересчёт скользящих средних в строках [rowBegin, rowEnd).
+	 */
+	void updateSlidingAvgRows(int rowBegin, int rowEnd);
+	
+	/**
+	 * Пересчёт скользящих средних внутри @a candidateRois_ и в узлах прореженной сетки;
+	 * фоновая статистика считается только по узлам сетки.
+	 */
+	void updateAveragesSparse();
+	
+	/**
+	 * Возвращает отрезки [begin, end) строки @a y, входившие в области-кандидаты предыдущего кадра, по возрастанию.
+	 */
+	std::vector<std::pair<int, int> > getTrackedRanges(int y);
+	
+	/**
+	 * Заменяет устаревшие скользящие средние пикселя, вошедшего в область-кандидат, значениями ближайшего узла
+	 * прореженной сетки (они обновляются на каждом кадре), а если узел вне области -- средними по фону.
+	 * 
+	 * @param step шаг прореженной сетки.
+	 */
+	void resetSlidingAvg(int x, int y, int step);
+	
+	/**
+	 * Находит @a candidateRois_ по маске переднеплановых пикселей, пересекающиеся прямоугольники объединяются RectMerger.
+	 */
+	void findCandidateRois();
+	
 	/**
 	 * Пересоздать матрицу и инициализировать нулями, если её размер отличается от размера текущего кадра.
 	 * 
@@ -0,0 +1,14 @@
+#include "FrameSource.h"
+#include "Errors.h"
+
+VideoFileFrameSource::VideoFileFrameSource(const std::string& path)
+	: capture_(path)
+{
+	if (!capture_.isOpened()) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": " + path);
+	}
+}
+
+bool VideoFileFrameSource::read(cv::Mat& frame) {
+	return capture_.read(frame) && !frame.empty();
+}
@@ -0,0 +1,59 @@
+#ifndef FrameSource_h_
+#define FrameSource_h_
+
+#include <string>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <boost/shared_ptr.hpp>
+
+/**
+ * Последовательность кадров для обработки вне реального времени (например, обучения по записи).
+ */
+class FrameSource {
+
+public:
+
+	typedef boost::shared_ptr<FrameSource> SharedPtr;
+
+	virtual ~FrameSource() {}
+
+	/**
+	 * Читает следующий кадр.
+	 *
+	 * @param frame сюда помещается кадр; он может ссылаться на внутренний буфер источника и
+	 *        оставаться действительным только до следующего вызова.
+	 * @return false, если кадры кончились.
+	 */
+	virtual bool read(cv::Mat& frame) = 0;
+
+};
+
+/**
+ * Кадры видеофайла.
+ */
+class VideoFileFrameSource
+	: public FrameSource
+{
+
+public:
+
+	/**
+	 * Открывает видеофайл.
+	 *
+	 * @param path путь к файлу.
+	 * @throw std::string если файл не открывается.
+	 */
+	VideoFileFrameSource(const std::string& path);
+
+	virtual bool read(cv::Mat& frame);
+
+private:
+
+	/**
+	 * Декодер видеофайла.
+	 */
+	cv::VideoCapture capture_;
+
+};
+
+#endif // FrameSource_h_
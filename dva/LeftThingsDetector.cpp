@@ -6,22 +6,79 @@
 #include <logging/logging.hpp>
 #include <utils/macros.hpp>
 #include "AnCommon.h"
+#include "RleMask.h"
 #include "RectMerger.h"
 #include <algorithm>
 #include "CodeBookAlgorithm.h"
 #include "CodeBookAlgorithmV1.h"
+#include "TiledCodeBookAlgorithm.h"
+#include "Mog2Algorithm.h"
+#include "FrameSource.h"
+
+/**
+ * Подаёт фоновой модели части кадров записи так же, как findStandingObjects() при работе детектора.
+ */
+class LeftThingsDetector::ModelFrameSource
+	: public FrameSource
+{
+
+public:
+
+	ModelFrameSource(LeftThingsDetector& detector, FrameSource& frames)
+		: detector_(detector)
+		, frames_(frames)
+	{}
+
+	virtual bool read(cv::Mat& frame) {
+		cv::Mat image;
+		if (!frames_.read(image)) {
+			return false;
+		}
+		if (image.size() != frameSize_) {
+			frameSize_ = image.size();
+			CvSize blocks = AnCommon::getSizeInBlocks(image);
+			detector_.blockSize_.width = frameSize_.width / blocks.width;
+			detector_.blockSize_.height = frameSize_.height / blocks.height;
+			detector_.roi_.prepare(frameSize_, detector_.blockSize_);
+			detector_.updateModelRect(frameSize_);
+		}
+		frame = detector_.getModelFrame(image);
+		return !frame.empty();
+	}
+
+private:
+
+	LeftThingsDetector& detector_;
+
+	FrameSource& frames_;
+
+	/**
+	 * Размер кадров, для которого посчитана часть кадра модели.
+	 */
+	cv::Size frameSize_;
+
+};
 
 const std::string LeftThingsDetector::LEFT_THINGS_DETECTOR = "LEFT_THINGS_DETECTOR";
 
 LeftThingsDetector::LeftThingsDetector()
 	: backgroundSeparationAlgorithm_(new CodeBookAlgorithm())
-{}
+	, snapshotRestorePending_(false)
+	, standingChanged_(false)
+	, resultBuilt_(false)
+{
+	// модель фона, сетка блоков и таймеры оставленных вещей строятся под размер кадра и сбросились бы при его смене
+	DegradationPolicy::DegradationPolicySettings policy;
+	policy.minifiable_ = false;
+	degradationPolicy_ = DegradationPolicy(policy);
+}
 
 void LeftThingsDetector::on() {
 	LOG_INFO("LeftThingsDetector::on");
 	Detector::on();
 	LOG_INFO(" setActivationTime() ");
 	setActivationTime();
+	snapshotRestorePending_ = true;
 }
 
 void LeftThingsDetector::setSettings(xml::Request::Params params) {
@@ -90,9 +147,30 @@ void LeftThingsDetector::setSettings(xml::Request::Params params) {
 			usedSettings.insert(paramName);
 		}
 
+		// новый алгоритм строится и настраивается в стороне и заменяет прежний, только если все настройки приняты
+		BackgroundSeparationAlgorithm::SharedPtr algorithm = backgroundSeparationAlgorithm_;
+		{
+			std::string paramName = "backgroundAlgorithm";
+			if (params.count(paramName)) {
+				std::string type = MapUtils::value(params, paramName, error + paramName);
+				if (type != algorithm->getType()) {
+					algorithm = createBackgroundSeparationAlgorithm(type);
+				}
+				usedSettings.insert(paramName);
+			}
+		}
+
+		snapshotStore_.setSettings(params, algorithm->getType(), dynamic_cast<Snapshotable*>(algorithm.get()), usedSettings);
+		std::string previousRoi = roi_.getPolygon();
+		roi_.setSettings(params, usedSettings);
+		resultStream_.setSettings(params, usedSettings);
+		resultBuilt_ = false;
+		alertThrottle_.clear();
+		degradationPolicy_.setSettings(params, usedSettings);
+
 		AnCommon::StrSet usedSettings1;
 		// параметры для детектора отделения объектов от фона
-		backgroundSeparationAlgorithm_->setSettings(params, usedSettings1);
+		algorithm->setSettings(params, usedSettings1);
 
 		AnCommon::StrSet intersec;
 		std::set_intersection(usedSettings.begin(), usedSettings.end(), usedSettings1.begin(), usedSettings1.end(),std::inserter(intersec, intersec.begin()));
@@ -104,7 +182,24 @@ void LeftThingsDetector::setSettings(xml::Request::Params params) {
 			for(AnCommon::StrSet::iterator i = intersec.begin(); i != intersec.end(); i++) {
 				intersecParams += *i;
 			}
-			throw std::string(std::string(errors::ERR_17_IDENTICAL_PARAMETERS_IN_DETECTOR)  + " in LeftThingsDetector and " + backgroundSeparationAlgorithm_->getType());
+			throw std::string(std::string(errors::ERR_17_IDENTICAL_PARAMETERS_IN_DETECTOR)  + " in LeftThingsDetector and " + algorithm->getType());
+		}
+
+		bool algorithmChanged = algorithm != backgroundSeparationAlgorithm_;
+		if (algorithmChanged) {
+			LOG_INFO("Background separation algorithm changed to " << algorithm->getType());
+			backgroundSeparationAlgorithm_ = algorithm;
+		}
+		// модель строится по прямоугольнику области анализа: при смене области размер её кадров меняется
+		bool roiChanged = roi_.getPolygon() != previousRoi;
+		if (algorithmChanged || roiChanged) {
+			if (mode_ == AnCommon::CLASSIFICATION) {
+				// модель нового алгоритма или новой области не обучена: классифицировать с ней нельзя
+				LOG_INFO("Background model is relearned after the " << (algorithmChanged ? "algorithm" : "region of interest") << " change");
+				setActivationTime();
+			}
+			// у нового алгоритма или новой области может быть свой снимок
+			snapshotRestorePending_ = true;
 		}
 
 	} catch (std::string& err) {
@@ -131,6 +226,11 @@ xml::Request::Params LeftThingsDetector::getSettings() {
 	set["startingLearningPercent"] = boost::lexical_cast<std::string>(settings_.startingLearningPercent_);
 	set["morphology"] = boost::lexical_cast<std::string>(settings_.useMorphology_);
 	set["connectedComp"] = boost::lexical_cast<std::string>(settings_.useConnectedComp_);
+	set["backgroundAlgorithm"] = backgroundSeparationAlgorithm_->getType();
+	snapshotStore_.getSettings(set);
+	roi_.getSettings(set);
+	resultStream_.getSettings(set);
+	degradationPolicy_.getSettings(set);
 
 	// параметры для детектирования оставленных вещей
 	LOG_INFO("backgroundSeparationAlgorithm_->getSettings");
@@ -141,25 +241,63 @@ xml::Request::Params LeftThingsDetector::getSettings() {
 }
 
 void LeftThingsDetector::execute(const cv::Mat& image, const boost::posix_time::ptime& imageTime, std::string& resultingXml) {
-	LOG_INFO("LeftThingsDetector::execute");
+	PendingResult pending;
+	detectPrepared(image, cv::Mat(), imageTime, pending);
+	serialize(pending, resultingXml);
+}
+
+void LeftThingsDetector::detectPrepared(const cv::Mat& image, const cv::Mat&, const boost::posix_time::ptime& imageTime, PendingResult& pending) {
+	LOG_TRACE("LeftThingsDetector::execute");
 	
+	pending.kind = PendingResult::NONE;
 	try {
 
-		std::string dataDetector = findStandingObjects(image, imageTime);
-		resultingXml = "<leftThings>" + dataDetector + "</leftThings>";
+		if (!findStandingObjects(image, imageTime, pending)) {
+			// кадр не сообщается: ни результат, ни журнал не формируются
+			pending.kind = PendingResult::NONE;
+			return;
+		}
+		if (pending.kind == PendingResult::NONE) {
+			pending.kind = PendingResult::READY;
+			pending.xml = "<leftThings></leftThings>";
+		}
 
 
 	} catch (std::string &error) {
-		resultingXml = "<leftThings><error>" + error + "</error></leftThings>";
+		pending.kind = PendingResult::READY;
+		pending.xml = "<leftThings><error>" + error + "</error></leftThings>";
 	} catch (...) {
-		resultingXml = "<leftThings><error> undetifier error </error></leftThings>";
+		pending.kind = PendingResult::READY;
+		pending.xml = "<leftThings><error> undetifier error </error></leftThings>";
 	}
 	
 	LOG_INFO("LeftThingsDetector::execute end");
 }
 
+void LeftThingsDetector::serialize(PendingResult& pending, std::string& resultingXml) {
+	try {
+		if (pending.kind == PendingResult::BUILD) {
+			resultingXml = "<leftThings>" + resultStream_.build(pending.objects, pending.mask, pending.blockSize, pending.minObjectArea, pending.maxObjectArea) 
+				+ "</leftThings>";
+		} else if (pending.kind == PendingResult::BUILD_UNCHANGED) {
+			resultingXml = "<leftThings>" + resultStream_.buildUnchanged() + "</leftThings>";
+		} else {
+			Detector::serialize(pending, resultingXml);
+		}
+	} catch (std::string &error) {
+		resultingXml = "<leftThings><error>" + error + "</error></leftThings>";
+	} catch (...) {
+		resultingXml = "<leftThings><error> undetifier error </error></leftThings>";
+	}
+}
+
 void LeftThingsDetector::off() {
 	LOG_INFO("LeftThingsDetector::off");
+	// обученная модель переживает выключение детектора
+	if (mode_ == AnCommon::CLASSIFICATION && !curFrame_.empty()) {
+		snapshotStore_.saveNow(getSnapshotableModel(), modelRect_.size());
+	}
+	snapshotStore_.wait();
 	clear();
 	Detector::off();
 }
@@ -168,9 +306,37 @@ std::string LeftThingsDetector::getType() {
 	return LEFT_THINGS_DETECTOR;
 }
 
-std::string LeftThingsDetector::findStandingObjects(const cv::Mat& image, const boost::posix_time::ptime& date_time) {
+bool LeftThingsDetector::findStandingObjects(const cv::Mat& image, const boost::posix_time::ptime& date_time, PendingResult& pending) {
 	BEGIN_FUNCTION 
 
+	LOG_INFO("AnCommon::getSizeInBlocks");
+	CvSize blocks = AnCommon::getSizeInBlocks(image);
+	blockSize_.width = image.size().width / blocks.width;
+	blockSize_.height = image.size().height / blocks.height;
+	roi_.prepare(image.size(), blockSize_);
+	updateModelRect(image.size());
+	cv::Mat modelFrame = getModelFrame(image);
+
+	if (snapshotRestorePending_) {
+		snapshotRestorePending_ = false;
+		if (mode_ == AnCommon::LEARNING && !modelFrame.empty() && snapshotStore_.isEnabled()) {
+			if (snapshotStore_.restore(getSnapshotableModel(), modelFrame.size(), date_time)) {
+				LOG_INFO("Background model restored from snapshot, skipping learning");
+				// задержка обучения задаётся при обучении, которое здесь пропускается; без неё оставленный
+				// предмет стал бы фоном сразу же
+				backgroundSeparationAlgorithm_->setLearningDelaySeconds(static_cast<int>(1.1 * settings_.maxSupervisionTime_));
+				mode_ = AnCommon::CLASSIFICATION;
+				// модель уже обучена, сбрасывать её при смене режима не нужно
+				prevMode_ = AnCommon::CLASSIFICATION;
+				activationTime_ = boost::posix_time::not_a_date_time;
+				settings_.startingLearningPercent_ = 100;
+			} else {
+				// модель могла восстановиться частично
+				backgroundSeparationAlgorithm_->reset();
+			}
+		}
+	}
+
 	if (activationTime_ != boost::posix_time::not_a_date_time) { 
 		if (mode_ == AnCommon::CLASSIFICATION || 
 			(boost::posix_time::microsec_clock::local_time() - activationTime_).total_milliseconds() > (settings_.startingLearningTime_ * 1000) 
@@ -185,7 +351,7 @@ std::string LeftThingsDetector::findStandingObjects(const cv::Mat& image, const
 		}
 	}
 	
-	std::string result;
+	bool emit = true;
 	
 	LOG_INFO(" if (prevMode_ != mode_) ");
 	if (prevMode_ != mode_) {
@@ -205,19 +371,20 @@ std::string LeftThingsDetector::findStandingObjects(const cv::Mat& image, const
 		backgroundSeparationAlgorithm_->setLearningDelaySeconds(static_cast<int>(delayForCodebookAlg));
 		
 		LOG_INFO("codeBookAlgorithm_.learn");
-		backgroundSeparationAlgorithm_->learn(image);
+		if (!modelFrame.empty()) {
+			backgroundSeparationAlgorithm_->learn(modelFrame);
+		}
 		
 		LOG_INFO("codeBookAlgorithm_.detect end");
 		
+		emit = alertThrottle_.shouldEmit(date_time, std::list<AnCommon::Object>(), settings_.alertTime_);
+		
 	} else if (mode_ == AnCommon::CLASSIFICATION) {
 
 		LOG_INFO("Left things CLASSIFICATION");
 
 		curFrame_ = image;
 
-		LOG_INFO("AnCommon::getSizeInBlocks");
-		CvSize blocks = AnCommon::getSizeInBlocks(image);
-
 		settings_.numBlockWidth_ = blocks.width;
 		settings_.numBlockHeight_ = blocks.height;
 
@@ -227,117 +394,156 @@ std::string LeftThingsDetector::findStandingObjects(const cv::Mat& image, const
 		LOG_DEBUG("settings_.max_supervision_time_1 = " << settings_.maxSupervisionTime_);
 
 		// При измененившемся размере очередного кадра вся предыдущая история
-		size_t newBlockCount = settings_.numBlockWidth_ * settings_.numBlockHeight_;
-		if (objectsBlocks_.size() != newBlockCount) {
-			objectsBlocks_ = std::vector<Block>(newBlockCount);
-		}
+		objectsBlocks_.resize(cv::Size(settings_.numBlockWidth_, settings_.numBlockHeight_));
 
-		blockSize_.width = image.size().width / blocks.width;
-		blockSize_.height = image.size().height / blocks.height;
-
-		subFoneFrame_ = backgroundSeparationAlgorithm_->detect(curFrame_);
+		subFoneFrame_ = detectForeground(modelFrame, image.size());
+		// маска упаковывается один раз, морфология и подсчёт блоков идут по словам
+		subFoneBitMask_.assign(subFoneFrame_);
 
 		// выполняется постобработка сегментированного изображения фильтром, который выбрал пользователь
 		if (settings_.useMorphology_) {
-			morphologyFilter_(subFoneFrame_);
+			morphologyFilter_(subFoneBitMask_);
 		}
 		
 		if (settings_.useConnectedComp_) {
+			// фильтр связных областей работает только с cv::Mat
+			subFoneFrame_ = subFoneBitMask_.toMat(255);
 			connectedComponentsFilter_(subFoneFrame_);
+			subFoneBitMask_.assign(subFoneFrame_);
 		}
-			
-		cv::Mat img = subFoneFrame_;
 		
 		LOG_DEBUG("detectBlocksWithObject");
-		detectBlocksWithObject(img, objectsBlocks_);
+		detectBlocksWithObject(subFoneBitMask_, objectsBlocks_);
 		
 		LOG_DEBUG("detectStandingBlocks");
 		detectStandingBlocks(objectsBlocks_, date_time);
 		
-		LOG_DEBUG("generateResultMatrix");
-		cv::Mat mask = generateResultMatrix(objectsBlocks_);
+		// Пока множество стоящих блоков не меняется, список объектов и XML остаются прежними
+		if (objectsBlocks_.isDirty() || cachedFrameSize_ != image.size()) {
+			LOG_DEBUG("generateResultMatrix");
+			standingMask_ = generateResultMatrix(objectsBlocks_).clone();
+			
+			// Объединение близких прямоугольников
+			std::list<AnCommon::Object> rects = AnCommon::createObjectList(AnCommon::RleMask(standingMask_));
+			RectMerger::Rect bounds = { 0, 0, standingMask_.size().width - 1, standingMask_.size().height - 1 };
+			RectMerger merger(bounds);
+			standingObjects_ = merger.getMergedRects(rects, settings_.maxMergingGapPercent_ * standingMask_.size().width / 100);
+
+			cachedFrameSize_ = image.size();
+			objectsBlocks_.clearDirty();
+			standingChanged_ = true;
+		}
+		
+		emit = alertThrottle_.shouldEmit(date_time, standingObjects_, settings_.alertTime_);
 		
-		// Объединение близких прямоугольников
-		std::list<AnCommon::Object> rects = AnCommon::createObjectList(mask, AnCommon::STANDARD_APPROX_LEVEL);
-		RectMerger::Rect bounds = { 0, 0, mask.size().width - 1, mask.size().height - 1 };
-		RectMerger merger(bounds);
-		const std::list<AnCommon::Object>& mergedRects = merger.getMergedRects(rects, settings_.maxMergingGapPercent_ * mask.size().width / 100);
-
-		LOG_DEBUG("getXMLBitMap");
-		std::string bitMapStr = AnCommon::getXMLBitMap(mask, blockSize_);
-
-		LOG_DEBUG("getXMLObjectList");
-		result = AnCommon::getXMLObjectList(mergedRects, blockSize_, static_cast<int>(settings_.minObjectArea_ * image.size().area() / 100), 
-														static_cast<int>(settings_.maxObjectArea_ * image.size().area() / 100));
-		result += bitMapStr;
+		if (!emit) {
+			// изменения стоящих объектов накапливаются до следующего сообщения
+		} else if (!standingChanged_ && resultBuilt_) {
+			if (skipSerializationOnlyFrames_) {
+				// исполнитель перегружен: кадр лишь повторил бы прежний результат
+				emit = false;
+			} else {
+				LOG_TRACE("standing blocks unchanged, reusing result");
+				pending.kind = PendingResult::BUILD_UNCHANGED;
+			}
+		} else {
+			LOG_DEBUG("build result");
+			// маска стоящих блоков при изменении заменяется новой, поэтому serialize() может читать её позже
+			pending.kind = PendingResult::BUILD;
+			pending.objects = standingObjects_;
+			pending.mask = standingMask_;
+			pending.blockSize = blockSize_;
+			pending.minObjectArea = static_cast<int>(settings_.minObjectArea_ * image.size().area() / 100);
+			pending.maxObjectArea = static_cast<int>(settings_.maxObjectArea_ * image.size().area() / 100);
+			standingChanged_ = false;
+			resultBuilt_ = true;
+		}
+
+		snapshotStore_.save(getSnapshotableModel(), modelFrame.size(), date_time);
 	}
 
 	prevMode_ = mode_;
 	
 	LOG_DEBUG("returning from findStandingObjects");
 	
-	return result;
+	return emit;
 	
 	END_FUNCTION
 }
 
-void LeftThingsDetector::detectBlocksWithObject(cv::Mat& img, std::vector<Block>& objectsBlocks) {
+void LeftThingsDetector::detectBlocksWithObject(const AnCommon::BitMask& img, BlockGrid& objectsBlocks) {
+	// заполненность блоков считается popcount по словам
+	uchar* isObject = objectsBlocks.isObject();
 	int i = 0;
-	for(int y = 0; y < img.size().height; y += blockSize_.height ) {
-		for(int x = 0; x < img.size().width; x += blockSize_.width, i++) {
-			objectsBlocks[i].isObject_ = isObjectBlock(img, x, y, std::min(blockSize_.width, img.size().width - x), std::min(blockSize_.height, img.size().height - y));
+	for(int y = 0, blockY = 0; y < img.size().height; y += blockSize_.height, blockY++) {
+		for(int x = 0, blockX = 0; x < img.size().width; x += blockSize_.width, blockX++, i++) {
+			if (!roi_.isBlockActive(blockX, blockY)) {
+				isObject[i] = false;
+				continue;
+			}
+			isObject[i] = isObjectBlock(img, x, y, std::min(blockSize_.width, img.size().width - x), std::min(blockSize_.height, img.size().height - y));
 		}
 	}
 }
 
+void LeftThingsDetector::updateModelRect(const cv::Size& frameSize) {
+	cv::Rect frameRect(cv::Point(0, 0), frameSize);
+	if (roi_.isFullFrame()) {
+		modelRect_ = frameRect;
+		return;
+	}
+	// прямоугольник выравнивается по блокам, чтобы блоки на его границе считались по всем своим пикселям
+	cv::Rect rect = roi_.getBoundingRect();
+	int left = rect.x / blockSize_.width * blockSize_.width;
+	int top = rect.y / blockSize_.height * blockSize_.height;
+	int right = (rect.x + rect.width + blockSize_.width - 1) / blockSize_.width * blockSize_.width;
+	int bottom = (rect.y + rect.height + blockSize_.height - 1) / blockSize_.height * blockSize_.height;
+	modelRect_ = rect.area() ? cv::Rect(left, top, right - left, bottom - top) & frameRect : cv::Rect();
+}
+
+cv::Mat LeftThingsDetector::getModelFrame(const cv::Mat& image) {
+	if (modelRect_.size() == image.size()) {
+		return image;
+	}
+	if (modelRect_.area() == 0) {
+		return cv::Mat();
+	}
+	// алгоритмы фона требуют непрерывную матрицу
+	return image(modelRect_).clone();
+}
+
+cv::Mat LeftThingsDetector::detectForeground(const cv::Mat& modelFrame, const cv::Size& frameSize) {
+	if (modelRect_.size() == frameSize) {
+		return backgroundSeparationAlgorithm_->detect(modelFrame);
+	}
+	u_int8_t zero = 0;
+	cv::Mat mask(frameSize, CV_8UC1, zero);
+	if (!modelFrame.empty()) {
+		backgroundSeparationAlgorithm_->detect(modelFrame).copyTo(mask(modelRect_));
+	}
+	return mask;
+}
+
 bool LeftThingsDetector::isObjectBlock(
-									cv::Mat& img,
+									const AnCommon::BitMask& img,
 									int blockX,
 									int blockY,
 									int blockWidth,
 									int blockHeight) {
 
-	long int counter = 0;
-	for(int y = blockY; y < blockY + blockHeight; y++ ) {
-		CV_Assert(y >= 0 && y < img.size().height);
-		uchar* ptr = (uchar*) (img.row(y).ptr());
-		for(int x = blockX; x < blockX + blockWidth; x++) {
-			if (ptr[x] != 0) {
-				++counter;
-			}
-		}
-	}
+	CV_Assert(blockY >= 0 && blockY + blockHeight <= img.size().height);
+	long int counter = img.countNonZero(cv::Rect(blockX, blockY, blockWidth, blockHeight));
 
 	return (counter > blockWidth * blockHeight * 0.95);
 }
 
-void LeftThingsDetector::detectStandingBlocks(std::vector<Block>& objectsBlocks, const boost::posix_time::ptime& dateTime) {
-	for(size_t i = 0; i < objectsBlocks.size(); i++) {
-		if (objectsBlocks[i].isObject_) {
-			if (objectsBlocks[i].appearTime_ == boost::posix_time::ptime()) {
-				objectsBlocks[i].appearTime_ = dateTime;
-			} else if (dateTime > objectsBlocks[i].appearTime_ + boost::posix_time::seconds(settings_.maxSupervisionTime_)) {
-				objectsBlocks[i].isStanding_ = true;
-			}
-		} else {
-			objectsBlocks[i] = Block();
-		}
-	}
+void LeftThingsDetector::detectStandingBlocks(BlockGrid& objectsBlocks, const boost::posix_time::ptime& dateTime) {
+	objectsBlocks.updateStanding(BlockGrid::toTicks(dateTime), boost::posix_time::seconds(settings_.maxSupervisionTime_).total_microseconds());
 }
 
-cv::Mat LeftThingsDetector::generateResultMatrix(const std::vector<Block>& objectsBlocks) {
+cv::Mat LeftThingsDetector::generateResultMatrix(const BlockGrid& objectsBlocks) {
 	BEGIN_FUNCTION
-	u_int8_t zero = 0;
-	cv::Mat resultMask = cv::Mat(cv::Size(settings_.numBlockWidth_, settings_.numBlockHeight_), CV_8U, zero);
-	
-	for (int y = 0; y < resultMask.size().height; y++) {
-		for (int x = 0; x < resultMask.size().width; x++) {
-			int index = y * settings_.numBlockWidth_ + x;
-			resultMask.ptr(y)[x] = objectsBlocks[index].isStanding_;
-		}
-	}
-	
-	return resultMask;
+	return objectsBlocks.getStandingMask();
 	END_FUNCTION
 }
 
@@ -346,6 +552,55 @@ void LeftThingsDetector::clear() {
 	prevMode_ = AnCommon::IDLE;
 	mode_ = AnCommon::IDLE;
 	settings_ = LeftThingsDetectorSettings();
+	resultStream_.clear();
+	resultBuilt_ = false;
+	alertThrottle_.clear();
+	standingObjects_.clear();
+	standingMask_.release();
+	standingChanged_ = false;
+	cachedFrameSize_ = cv::Size();
+	// путь и интервал снимков -- конфигурация, а не состояние: снимок должен восстановиться при следующем on()
+	snapshotStore_.clear();
+	snapshotRestorePending_ = false;
+}
+
+BackgroundSeparationAlgorithm::SharedPtr LeftThingsDetector::createBackgroundSeparationAlgorithm(const std::string& type) {
+	if (type == TiledCodeBookAlgorithm::TILED_CODE_BOOK_ALGORITHM) {
+		return BackgroundSeparationAlgorithm::SharedPtr(new TiledCodeBookAlgorithm());
+	}
+	if (type == Mog2Algorithm::MOG2_ALGORITHM) {
+		return BackgroundSeparationAlgorithm::SharedPtr(new Mog2Algorithm());
+	}
+	BackgroundSeparationAlgorithm::SharedPtr codeBookAlgorithm(new CodeBookAlgorithm());
+	if (type == codeBookAlgorithm->getType()) {
+		return codeBookAlgorithm;
+	}
+	errors::throwException(errors::ERR_05_SETTINGS_CAN_NOT_BE_APPLIED_INCORRECT_PARAMETER + "backgroundAlgorithm");
+	return BackgroundSeparationAlgorithm::SharedPtr();
+}
+
+size_t LeftThingsDetector::learnFromRecording(FrameSource& frames) {
+	TiledCodeBookAlgorithm* model = dynamic_cast<TiledCodeBookAlgorithm*>(backgroundSeparationAlgorithm_.get());
+	if (!model) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": backgroundAlgorithm");
+	}
+	if (!snapshotStore_.isEnabled()) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": snapshotPath");
+	}
+	model->clear();
+	ModelFrameSource modelFrames(*this, frames);
+	size_t learned = model->learnBulk(modelFrames);
+	if (learned == 0) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": frames");
+	}
+	// снимок снимается с той же частью кадра, с которой его будет восстанавливать findStandingObjects()
+	snapshotStore_.saveNow(model, modelRect_.size());
+	LOG_INFO("Background model learned from " << learned << " frames and saved to snapshot");
+	return learned;
+}
+
+Snapshotable* LeftThingsDetector::getSnapshotableModel() {
+	return dynamic_cast<Snapshotable*>(backgroundSeparationAlgorithm_.get());
 }
 
 void LeftThingsDetector::setActivationTime() {
@@ -3,12 +3,18 @@
 
 #include "Detector.h"
 #include "LeftThingsDetectorSettings.h"
-#include "Block.h"
+#include "BlockGrid.h"
 #include "LeftThings.h"
 #include "MorphologyFilter.h"
 #include "ConnectedComponentsFilter.h"
+#include "RegionOfInterest.h"
+#include "ResultStream.h"
+#include "AlertThrottle.h"
+#include "Snapshot.h"
 #include "BackgroundSeparationAlgorithm.h"
 
+class FrameSource;
+
 /**
  * Класс реализующий детектор оставленных вещей.
  */
@@ -48,6 +54,18 @@ public:
 	 */
 	virtual void execute(const cv::Mat& image, const boost::posix_time::ptime& imageTime, std::string& resultingXml);
 	
+	/**
+	 * @see Detector::detectPrepared()
+	 */
+	virtual void detectPrepared(const cv::Mat& image, const cv::Mat& prepared, const boost::posix_time::ptime& imageTime, PendingResult& pending);
+	
+	/**
+	 * Формирует xml результата потоком результатов (ResultStream).
+	 * 
+	 * @see Detector::serialize()
+	 */
+	virtual void serialize(PendingResult& pending, std::string& resultingXml);
+	
 	/**
  	 * Возвращает тип детектора.
 	 * 
@@ -76,7 +94,27 @@ public:
 	 */
 	void clear();
 	
+	/**
+	 * Обучает фоновую модель по записи (например, с новой камеры) и сохраняет её снимок в snapshotPath, чтобы
+	 * включённый затем с теми же настройками детектор сразу начал классификацию.
+	 * Модели подаётся та же часть кадров, что и при работе детектора (см. getModelFrame()).
+	 * 
+	 * @param frames источник кадров CV_8UC3.
+	 * @return количество обученных кадров.
+	 * @throw std::string если snapshotPath не задан, фоновая модель не обучается по записи
+	 *        (нужен TILED_CODE_BOOK_ALGORITHM) или в источнике нет кадров.
+	 */
+	size_t learnFromRecording(FrameSource& frames);
+	
 private:
+	
+	/**
+	 * Источник частей кадров, которые подаются фоновой модели, см. learnFromRecording().
+	 */
+	class ModelFrameSource;
+	
+	friend class ModelFrameSource;
+
 	/**
 	 * Текущее состояние детектора.
 	 */
@@ -100,7 +138,7 @@ private:
 	/**
 	 * Хранит информацию о блоках, на которые делится изображение.
 	 */
-	std::vector<Block> objectsBlocks_;
+	BlockGrid objectsBlocks_;
 
 	/**
 	 * Время включения детектора.
@@ -110,22 +148,48 @@ private:
 	/**
 	 * Детектирует блоки с объектами.
 	 *
-	 * @param img изобржение, которое нужно разделить наблоки.
+	 * @param img упакованная маска, которую нужно разделить на блоки.
 	 * @param objects_blocks структура, для хранения иформации о блоках.
 	 */
-	void detectBlocksWithObject(cv::Mat& img, std::vector<Block>& objects_blocks);
+	void detectBlocksWithObject(const AnCommon::BitMask& img, BlockGrid& objectsBlocks);
+
+	/**
+	 * Часть кадра, которую обрабатывает фоновая модель: обрамляющий прямоугольник области, выровненный по блокам.
+	 * Пиксели вне её модель не видит; при изменении области меняется размер кадров модели, и она обучается заново.
+	 */
+	cv::Rect modelRect_;
+
+	/**
+	 * Пересчитывает @a modelRect_ по области и размеру блока.
+	 *
+	 * @param frameSize размер кадра.
+	 */
+	void updateModelRect(const cv::Size& frameSize);
+
+	/**
+	 * Возвращает часть кадра @a modelRect_ в непрерывной матрице, пустую матрицу если область вне кадра.
+	 */
+	cv::Mat getModelFrame(const cv::Mat& image);
+
+	/**
+	 * Отделяет объекты от фона в части кадра @a modelFrame и возвращает маску размером во весь кадр.
+	 *
+	 * @param modelFrame часть кадра, см. getModelFrame().
+	 * @param frameSize размер кадра.
+	 */
+	cv::Mat detectForeground(const cv::Mat& modelFrame, const cv::Size& frameSize);
 
 	/**
 	 * Определяет находится ли в блоке объект.
 	 *
-	 * @param img изображние на котором находится блок.
+	 * @param img упакованная маска объектов, на которой находится блок.
 	 * @param x абсцисса левого верхнего угла блока.
 	 * @param y ордината левого верхнего угла блока.
 	 * @param block_width ширина блока.
 	 * @param block_height высота блока.
 	 * @return true - в блоке есть объект, false - в блоке объекта нет.
 	 */
-	bool isObjectBlock(cv::Mat& img, int x, int y, int blockWidth, int blockHeight);
+	bool isObjectBlock(const AnCommon::BitMask& img, int x, int y, int blockWidth, int blockHeight);
 
 	/**
 	 * Детектирует те блоки, в которых объект присутствует больше
@@ -134,16 +198,16 @@ private:
 	 * @param objects_blocks структура, для хранения иформации о блоках.
 	 * @param date_time время текущего кадра.
 	 */
-	void detectStandingBlocks(std::vector<Block>& objectsBlocks,
+	void detectStandingBlocks(BlockGrid& objectsBlocks,
 							  const boost::posix_time::ptime& date_time);
 
 	/**
 	 * Генерирует матрицу для поиска контуров объектов.
 	 * 
 	 * @param objects_blocks структура, хранящая иформацию о блоках.
-	 * @return матрицу принадлежности блоков объектам.
+	 * @return матрицу принадлежности блоков объектам, ссылающуюся на данные @a objectsBlocks.
 	 */ 
-	cv::Mat generateResultMatrix(const std::vector<Block>& objectsBlocks);
+	cv::Mat generateResultMatrix(const BlockGrid& objectsBlocks);
 
 	/**
 	 * Детектирует неподжвижные объекты.
@@ -176,8 +240,11 @@ private:
 	 *
 	 * @param image текущий кадр.
 	 * @param frame_update_time время отправления кадра с камеры.
+	 * @param pending объекты и битовая карта для результата, заполняются только если результат нужно сообщить;
+	 *        вид результата остаётся PendingResult::NONE, если сообщать нужно пустой результат.
+	 * @return true - результат кадра нужно сообщить, false - кадр не сообщается (см. alertTime_).
 	 */
-	std::string findStandingObjects(const cv::Mat& image, const boost::posix_time::ptime& frameUpdateTime);
+	bool findStandingObjects(const cv::Mat& image, const boost::posix_time::ptime& frameUpdateTime, PendingResult& pending);
 
 	/**
 	 * Находит стоящие неподвижно втечении некоторого времени предметы (время задаёться в настройках).
@@ -202,6 +269,77 @@ private:
 	 */
 	cv::Mat subFoneFrame_;
 	
+	/**
+	 * Упакованная разность фона и кадра, по которой считается заполненность блоков.
+	 */
+	AnCommon::BitMask subFoneBitMask_;
+	
+	/**
+	 * Область кадра, за которой следит детектор.
+	 */
+	RegionOfInterest roi_;
+	
+	/**
+	 * Поток результатов. Пока множество стоящих блоков не меняется, результат не пересчитывается.
+	 */
+	ResultStream resultStream_;
+	
+	/**
+	 * Ограничивает частоту сообщений интервалом alertTime_.
+	 */
+	AlertThrottle alertThrottle_;
+	
+	/**
+	 * Снимок фоновой модели.
+	 */
+	SnapshotStore snapshotStore_;
+	
+	/**
+	 * Детектор включён, но попытки восстановить фоновую модель из снимка ещё не было.
+	 * Восстановление откладывается до первого кадра, чтобы к нему были применены настройки.
+	 */
+	bool snapshotRestorePending_;
+	
+	/**
+	 * Создаёт алгоритм отделения объектов от фона по его типу (параметр backgroundAlgorithm).
+	 *
+	 * @param type тип алгоритма, см. getType() алгоритмов.
+	 * @throw std::string если тип неизвестен.
+	 */
+	static BackgroundSeparationAlgorithm::SharedPtr createBackgroundSeparationAlgorithm(const std::string& type);
+	
+	/**
+	 * Возвращает фоновую модель как Snapshotable, 0 если она не поддерживает снимки.
+	 */
+	Snapshotable* getSnapshotableModel();
+	
+	/**
+	 * Размер кадра, для которого построены @a standingObjects_.
+	 */
+	cv::Size cachedFrameSize_;
+	
+	/**
+	 * Объекты, составленные из стоящих блоков; пересчитываются только при изменении множества стоящих блоков.
+	 */
+	std::list<AnCommon::Object> standingObjects_;
+	
+	/**
+	 * Матрица принадлежности блоков объектам, по которой построены @a standingObjects_.
+	 */
+	cv::Mat standingMask_;
+	
+	/**
+	 * Объекты изменились после последнего построенного результата.
+	 */
+	bool standingChanged_;
+	
+	/**
+	 * После clear() или смены настроек потока результатов уже заказан полный результат (PendingResult::BUILD),
+	 * и повторять его можно через PendingResult::BUILD_UNCHANGED. Хранится отдельно от ResultStream::hasResult():
+	 * сериализация может выполняться позже анализа и в другом потоке.
+	 */
+	bool resultBuilt_;
+	
 	/**
 	 * Фильтр морфологического преобразования.
 	 */
@@ -0,0 +1,207 @@
+#include "Mog2Algorithm.h"
+#include <cmath>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <logging/logging.hpp>
+#include "System.h"
+#include <utils/maputils.hpp>
+
+namespace {
+
+/**
+ * Частота кадров, которая предполагается до первой оценки.
+ */
+const double DEFAULT_FRAME_PERIOD = 1e6 / 25;
+
+/**
+ * Вес нового измерения в оценке периода кадров.
+ */
+const double FRAME_PERIOD_ALPHA = 0.05;
+
+} // namespace
+
+const std::string Mog2Algorithm::MOG2_ALGORITHM = "MOG2_ALGORITHM";
+
+const int Mog2Algorithm::Mog2AlgorithmSettings::HISTORY = 500;
+const double Mog2Algorithm::Mog2AlgorithmSettings::VAR_THRESHOLD = 16;
+const bool Mog2Algorithm::Mog2AlgorithmSettings::DETECT_SHADOWS = true;
+const double Mog2Algorithm::Mog2AlgorithmSettings::LEARNING_RATE = -1;
+const double Mog2Algorithm::Mog2AlgorithmSettings::SCALE = 1;
+
+Mog2Algorithm::Mog2AlgorithmSettings::Mog2AlgorithmSettings()
+	: history_(HISTORY)
+	, varThreshold_(VAR_THRESHOLD)
+	, detectShadows_(DETECT_SHADOWS)
+	, learningRate_(LEARNING_RATE)
+	, scale_(SCALE)
+{}
+
+Mog2Algorithm::Mog2AlgorithmSettings::Mog2AlgorithmSettings(int history, double varThreshold, bool detectShadows, double learningRate, double scale)
+	: history_(history)
+	, varThreshold_(varThreshold)
+	, detectShadows_(detectShadows)
+	, learningRate_(learningRate)
+	, scale_(scale)
+{}
+
+Mog2Algorithm::Mog2Algorithm()
+	: learningDelaySeconds_(0)
+	, framePeriod_(DEFAULT_FRAME_PERIOD)
+{}
+
+Mog2Algorithm::Mog2Algorithm(const Mog2AlgorithmSettings& settings)
+	: settings_(settings)
+	, learningDelaySeconds_(0)
+	, framePeriod_(DEFAULT_FRAME_PERIOD)
+{}
+
+void Mog2Algorithm::learn(const cv::Mat& image) {
+	apply(image, -1);
+}
+
+cv::Mat Mog2Algorithm::detect(const cv::Mat& image) {
+	boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+	if (!lastDetectTime_.is_special() && now > lastDetectTime_) {
+		framePeriod_ = (1.0 - FRAME_PERIOD_ALPHA) * framePeriod_ + FRAME_PERIOD_ALPHA * (now - lastDetectTime_).total_microseconds();
+	}
+	lastDetectTime_ = now;
+
+	double learningRate = settings_.learningRate_;
+	if (learningRate < 0) {
+		if (learningDelaySeconds_ > 0 && !model_.empty()) {
+			// вес новой гауссианы 1 - (1 - rate)^n превышает 1 - backgroundRatio примерно через -ln(backgroundRatio) / rate кадров
+			double delayFrames = std::max(1.0, learningDelaySeconds_ * 1e6 / std::max(framePeriod_, 1.0));
+			learningRate = -std::log(model_->getBackgroundRatio()) / delayFrames;
+		}
+	}
+	return apply(image, learningRate);
+}
+
+cv::Mat Mog2Algorithm::apply(const cv::Mat& image, double learningRate) {
+	if (image.empty()) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": image");
+	}
+
+	const cv::Mat* input = &image;
+	if (settings_.scale_ < 1) {
+		cv::Size scaledSize(std::max(1, cvRound(image.cols * settings_.scale_)), std::max(1, cvRound(image.rows * settings_.scale_)));
+		cv::resize(image, scaledImage_, scaledSize, 0, 0, cv::INTER_AREA);
+		input = &scaledImage_;
+	}
+
+	if (model_.empty() || input->size() != modelSize_) {
+		LOG_DEBUG("Mog2Algorithm: new model " << input->cols << "x" << input->rows);
+		model_ = cv::createBackgroundSubtractorMOG2();
+		modelSize_ = input->size();
+		configure();
+	}
+
+	model_->apply(*input, modelMask_, learningRate);
+
+	if (input == &image) {
+		foreground_ = modelMask_;
+	} else {
+		cv::resize(modelMask_, foreground_, image.size(), 0, 0, cv::INTER_NEAREST);
+	}
+	return foreground_;
+}
+
+void Mog2Algorithm::configure() {
+	if (model_.empty()) {
+		return;
+	}
+	model_->setHistory(settings_.history_);
+	model_->setVarThreshold(settings_.varThreshold_);
+	model_->setDetectShadows(settings_.detectShadows_);
+	// тени помечаются как фон
+	model_->setShadowValue(0);
+}
+
+void Mog2Algorithm::reset() {
+	lastDetectTime_ = boost::posix_time::not_a_date_time;
+	framePeriod_ = DEFAULT_FRAME_PERIOD;
+}
+
+void Mog2Algorithm::clearStaleEntries() {
+}
+
+void Mog2Algorithm::setLearningDelaySeconds(int seconds) {
+	learningDelaySeconds_ = std::max(seconds, 0);
+}
+
+void Mog2Algorithm::setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings) {
+	try {
+
+		std::string lexCastError = errors::ERR_05_SETTINGS_CAN_NOT_BE_APPLIED_INCORRECT_PARAMETER;
+		std::string error = errors::ERR_06_SETTINGS_CAN_NOT_BE_APPLIED_PARAMETER_NOT_FOUND;
+
+		{
+			std::string paramName = "mog2History";
+			if (settings.count(paramName)) {
+				settings_.history_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "mog2VarThreshold";
+			if (settings.count(paramName)) {
+				settings_.varThreshold_ = System::throwingLexCast<std::string, double>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "mog2Shadows";
+			if (settings.count(paramName)) {
+				settings_.detectShadows_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "mog2LearningRate";
+			if (settings.count(paramName)) {
+				settings_.learningRate_ = System::throwingLexCast<std::string, double>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				if (settings_.learningRate_ > 1) {
+					errors::throwException(lexCastError + paramName);
+				}
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "mog2Scale";
+			if (settings.count(paramName)) {
+				settings_.scale_ = System::throwingLexCast<std::string, double>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				if (settings_.scale_ <= 0 || settings_.scale_ > 1) {
+					errors::throwException(lexCastError + paramName);
+				}
+				usedSettings.insert(paramName);
+			}
+		}
+
+		configure();
+
+	} catch (std::string& err) {
+		errors::throwException(err);
+	} catch (...) {
+		errors::throwException(errors::ERR_04_SETTINGS_CAN_NOT_BE_APPLIED);
+	}
+}
+
+void Mog2Algorithm::getSettings(xml::Request::Params &settings) {
+	settings["mog2History"] = boost::lexical_cast<std::string>(settings_.history_);
+	settings["mog2VarThreshold"] = boost::lexical_cast<std::string>(settings_.varThreshold_);
+	settings["mog2Shadows"] = boost::lexical_cast<std::string>(settings_.detectShadows_);
+	settings["mog2LearningRate"] = boost::lexical_cast<std::string>(settings_.learningRate_);
+	settings["mog2Scale"] = boost::lexical_cast<std::string>(settings_.scale_);
+}
+
+std::string Mog2Algorithm::getType() {
+	return MOG2_ALGORITHM;
+}
+
+void Mog2Algorithm::clear() {
+	model_.release();
+	modelSize_ = cv::Size();
+	scaledImage_ = cv::Mat();
+	modelMask_ = cv::Mat();
+	foreground_ = cv::Mat();
+	reset();
+}
@@ -0,0 +1,208 @@
+#ifndef Mog2Algorithm_h_
+#define Mog2Algorithm_h_
+
+#include <opencv2/video/background_segm.hpp>
+#include "BackgroundSeparationAlgorithm.h"
+
+/**
+ * Алгоритм отделения объектов от фона смесью гауссиан (cv::BackgroundSubtractorMOG2).
+ *
+ * Тени считаются фоном. Модель может строиться по уменьшенному кадру, тогда маска переднего плана
+ * растягивается обратно до размера кадра.
+ */
+class Mog2Algorithm
+	: public BackgroundSeparationAlgorithm
+{
+public:
+
+	/**
+	 * Тип алгоритма.
+	 */
+	static const std::string MOG2_ALGORITHM;
+
+	/**
+	 * Класс настроек алгоритма.
+	 */
+	class Mog2AlgorithmSettings {
+
+	public:
+
+		/**
+		 * Значения по умолчанию соответствующих полей.
+		 *
+		 * @{
+		 */
+		static const int HISTORY;
+		static const double VAR_THRESHOLD;
+		static const bool DETECT_SHADOWS;
+		static const double LEARNING_RATE;
+		static const double SCALE;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Количество кадров, по которым обучается модель при обучении.
+		 */
+		int history_;
+
+		/**
+		 * Порог квадрата расстояния Махаланобиса, до которого пиксель соответствует фону.
+		 */
+		double varThreshold_;
+
+		/**
+		 * Выделять тени, чтобы не считать их передним планом.
+		 */
+		bool detectShadows_;
+
+		/**
+		 * Скорость обучения при классификации, от 0 до 1. Отрицательное значение -- выбирается по
+		 * setLearningDelaySeconds(), чтобы новый предмет становился фоном не раньше, чем за это время.
+		 */
+		double learningRate_;
+
+		/**
+		 * Масштаб кадра, по которому строится модель, от 0 (не включая) до 1.
+		 */
+		double scale_;
+
+		/**
+		 * Создаёт объект класса с параметрами по умолчанию.
+		 */
+		Mog2AlgorithmSettings();
+
+		/**
+		 * Создаёт объект класса с заданными параметрами.
+		 *
+		 * @param описание параметров смотри у описания соответствующих полей класса.
+		 */
+		Mog2AlgorithmSettings(int history, double varThreshold, bool detectShadows, double learningRate, double scale);
+
+	};
+
+	/**
+	 * Создаёт алгоритм с настройками по умолчанию.
+	 */
+	Mog2Algorithm();
+
+	/**
+	 * Создаёт алгоритм с заданными настройками.
+	 */
+	Mog2Algorithm(const Mog2AlgorithmSettings& settings);
+
+	/**
+	 * Обучает модель на кадре со скоростью, определяемой history_.
+	 */
+	virtual void learn(const cv::Mat& image);
+
+	/**
+	 * Отделяет объекты от фона и дообучает модель.
+	 *
+	 * @return маска CV_8U размера кадра, 255 - передний план, 0 - фон.
+	 */
+	virtual cv::Mat detect(const cv::Mat& image);
+
+	/**
+	 * Завершает этап работы: забывает оценку частоты кадров. Обученная модель сохраняется.
+	 */
+	virtual void reset();
+
+	/**
+	 * Ничего не делает: веса давно не встречавшихся гауссиан и так убывают.
+	 */
+	virtual void clearStaleEntries();
+
+	/**
+	 * Устанавливает, за сколько секунд неподвижный предмет становится фоном при классификации.
+	 */
+	virtual void setLearningDelaySeconds(int seconds);
+
+	/**
+	 * Устанавливает настройки(параметры) алгоритма. Все параметры необязательны.
+	 *
+	 * @param settings параметры(настройки) алгоритма.
+	 * @param usedSettings множество используемых настроек.
+	 */
+	virtual void setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings);
+
+	/**
+	 * Возвращает настройки(параметры) алгоритма.
+	 *
+	 * @param settings параметры(настройки) алгоритма.
+	 */
+	virtual void getSettings(xml::Request::Params &settings);
+
+	/**
+	 * Возвращает тип алгоритма.
+	 */
+	virtual std::string getType();
+
+	/**
+	 * Забывает модель целиком.
+	 */
+	virtual void clear();
+
+private:
+
+	/**
+	 * Настройки алгоритма.
+	 */
+	Mog2AlgorithmSettings settings_;
+
+	/**
+	 * Модель фона, создаётся по первому кадру.
+	 */
+	cv::Ptr<cv::BackgroundSubtractorMOG2> model_;
+
+	/**
+	 * Размер кадра, по которому построена модель (уже уменьшенного).
+	 */
+	cv::Size modelSize_;
+
+	/**
+	 * Задержка превращения неподвижного предмета в фон (сек).
+	 */
+	int learningDelaySeconds_;
+
+	/**
+	 * Оценка периода кадров при классификации (мкс).
+	 */
+	double framePeriod_;
+
+	/**
+	 * Время предыдущего вызова detect().
+	 */
+	boost::posix_time::ptime lastDetectTime_;
+
+	/**
+	 * Уменьшенный кадр.
+	 */
+	cv::Mat scaledImage_;
+
+	/**
+	 * Маска переднего плана модели.
+	 */
+	cv::Mat modelMask_;
+
+	/**
+	 * Маска переднего плана размера кадра.
+	 */
+	cv::Mat foreground_;
+
+	/**
+	 * Пропускает кадр через модель, создавая её при необходимости.
+	 *
+	 * @param learningRate скорость обучения, отрицательная -- по history_.
+	 * @return маска переднего плана размера кадра.
+	 */
+	cv::Mat apply(const cv::Mat& image, double learningRate);
+
+	/**
+	 * Передаёт настройки в созданную модель.
+	 */
+	void configure();
+
+};
+
+#endif // Mog2Algorithm_h_
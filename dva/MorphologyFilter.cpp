@@ -1,4 +1,12 @@
 #include "MorphologyFilter.h"
+#include <algorithm>
+#include <boost/bind.hpp>
+#include "WorkStealingPool.h"
+
+/**
+ * Минимальная высота полосы строк, обрабатываемой одной задачей пула.
+ */
+static const int BAND_ROWS = 64;
 
 const int MorphologyFilter::MorphologyFilterSettings::CLOSE_ITR = 1;
 
@@ -21,14 +29,32 @@ cv::Mat MorphologyFilter::operator()(cv::Mat& img) {
 		errors::throwException(errors::ERR_08_IMAGE_MUST_BE_CONTINUOUS);
 	}
 	
+	// В результат попадает только замыкание исходной маски (размыкание им перезаписывалось), поэтому оно одно
+	// и считается. Полосы захватывают соседние строки, и результат совпадает с обработкой кадра целиком.
 	cv::Mat buf(img.size(), img.type());
-	buf.setTo(0);
-	cv::morphologyEx(img, buf, CV_MOP_OPEN, cv::Mat(), cv::Point(-1, -1), settings_.closeItr_ );
-	cv::morphologyEx(img, buf, CV_MOP_CLOSE, cv::Mat(), cv::Point(-1, -1), settings_.closeItr_ );
+	int halo = 2 * settings_.closeItr_;
+	WorkStealingPool::getDefault().parallelFor(0, img.rows, std::max(BAND_ROWS, 2 * halo),
+		boost::bind(&MorphologyFilter::closeRows, this, boost::cref(img), &buf, _1, _2));
 	
 	return buf;
 }
 
+void MorphologyFilter::closeRows(const cv::Mat& img, cv::Mat* buf, int rowBegin, int rowEnd) {
+	// замыкание с closeItr_ итерациями меняет строку по строкам не дальше 2 * closeItr_ от неё
+	int halo = 2 * settings_.closeItr_;
+	int begin = std::max(0, rowBegin - halo);
+	int end = std::min(img.rows, rowEnd + halo);
+	cv::Mat band;
+	cv::morphologyEx(img.rowRange(begin, end), band, CV_MOP_CLOSE, cv::Mat(), cv::Point(-1, -1), settings_.closeItr_);
+	band.rowRange(rowBegin - begin, rowEnd - begin).copyTo(buf->rowRange(rowBegin, rowEnd));
+}
+
+AnCommon::BitMask& MorphologyFilter::operator()(AnCommon::BitMask& mask) {
+	// Как и в варианте для cv::Mat, в результат попадает только замыкание исходной маски.
+	mask.close(settings_.closeItr_);
+	return mask;
+}
+
 void MorphologyFilter::setSettings(const MorphologyFilter::MorphologyFilterSettings &settings) {
 	settings_ = settings;
 }
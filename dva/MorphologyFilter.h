@@ -73,6 +73,14 @@ public:
 	 */
 	virtual cv::Mat operator()(cv::Mat& img);
 	
+	/**
+	 * Выполняет морфологическое преобразование упакованной бинарной маски на месте.
+	 * 
+	 * @param mask бинарная маска.
+	 * @return ссылка на преобразованную маску.
+	 */
+	AnCommon::BitMask& operator()(AnCommon::BitMask& mask);
+	
 	/**
 	 * Возвращает тип фильтра.
 	 * 
@@ -109,6 +117,16 @@ public:
 	
 private:
 	
+	/**
+	 * Записывает в строки [rowBegin, rowEnd) @a buf морфологическое замыкание изображения @a img.
+	 * 
+	 * @param img входное изображение.
+	 * @param buf результат, того же размера и типа, что и @a img.
+	 * @param rowBegin первая строка полосы.
+	 * @param rowEnd строка за последней строкой полосы.
+	 */
+	void closeRows(const cv::Mat& img, cv::Mat* buf, int rowBegin, int rowEnd);
+	
 	/**
 	 * Настройки(параметры) фильтра.
 	 */
@@ -0,0 +1,130 @@
+#include "MotionGate.h"
+#include <algorithm>
+#include <logging/logging.hpp>
+#include "System.h"
+#include <utils/maputils.hpp>
+
+const bool MotionGate::MotionGateSettings::ENABLED = false;
+const int MotionGate::MotionGateSettings::ROW_STEP = 4;
+const double MotionGate::MotionGateSettings::THRESHOLD = 1.0;
+const int MotionGate::MotionGateSettings::MAX_SKIPPED_FRAMES = 25;
+
+MotionGate::MotionGateSettings::MotionGateSettings()
+	: enabled_(ENABLED)
+	, rowStep_(ROW_STEP)
+	, threshold_(THRESHOLD)
+	, maxSkippedFrames_(MAX_SKIPPED_FRAMES)
+{}
+
+MotionGate::MotionGateSettings::MotionGateSettings(bool enabled, int rowStep, double threshold, int maxSkippedFrames)
+	: enabled_(enabled)
+	, rowStep_(rowStep)
+	, threshold_(threshold)
+	, maxSkippedFrames_(maxSkippedFrames)
+{}
+
+MotionGate::MotionGate()
+	: skippedFrames_(0)
+	, lastDifference_(0.0)
+{}
+
+MotionGate::MotionGate(const MotionGateSettings& settings)
+	: settings_(settings)
+	, skippedFrames_(0)
+	, lastDifference_(0.0)
+{}
+
+cv::Mat MotionGate::sampleRows(const cv::Mat& image) const {
+	if (image.depth() != CV_8U) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": image");
+	}
+	int step = std::max(1, settings_.rowStep_);
+	int rows = (image.rows + step - 1) / step;
+	return cv::Mat(rows, image.cols * image.channels(), CV_8U, image.data, image.step * step);
+}
+
+bool MotionGate::shouldSkip(const cv::Mat& image) {
+	lastDifference_ = 0.0;
+	if (!settings_.enabled_) {
+		return false;
+	}
+
+	cv::Mat sampled = sampleRows(image);
+	if (reference_.size() == sampled.size() && skippedFrames_ < settings_.maxSkippedFrames_) {
+		// cv::norm векторизован внутри OpenCV, прореженный заголовок не требует копирования кадра.
+		lastDifference_ = cv::norm(sampled, reference_, cv::NORM_L1) / sampled.total();
+		if (lastDifference_ < settings_.threshold_) {
+			skippedFrames_++;
+			LOG_TRACE("MotionGate: frame skipped, difference = " << lastDifference_);
+			return true;
+		}
+	}
+
+	sampled.copyTo(reference_);
+	skippedFrames_ = 0;
+	return false;
+}
+
+double MotionGate::getLastDifference() const {
+	return lastDifference_;
+}
+
+bool MotionGate::isEnabled() const {
+	return settings_.enabled_;
+}
+
+void MotionGate::setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings) {
+	try {
+
+		std::string lexCastError = errors::ERR_05_SETTINGS_CAN_NOT_BE_APPLIED_INCORRECT_PARAMETER;
+		std::string error = errors::ERR_06_SETTINGS_CAN_NOT_BE_APPLIED_PARAMETER_NOT_FOUND;
+
+		{
+			std::string paramName = "motionGate";
+			if (settings.count(paramName)) {
+				settings_.enabled_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "motionGateRowStep";
+			if (settings.count(paramName)) {
+				settings_.rowStep_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "motionGateThreshold";
+			if (settings.count(paramName)) {
+				settings_.threshold_ = System::throwingLexCast<std::string, double>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "motionGateMaxSkippedFrames";
+			if (settings.count(paramName)) {
+				settings_.maxSkippedFrames_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+
+	} catch (std::string& err) {
+		errors::throwException(err);
+	} catch (...) {
+		errors::throwException(errors::ERR_04_SETTINGS_CAN_NOT_BE_APPLIED);
+	}
+	clear();
+}
+
+void MotionGate::getSettings(xml::Request::Params &settings) {
+	settings["motionGate"] = boost::lexical_cast<std::string>(settings_.enabled_);
+	settings["motionGateRowStep"] = boost::lexical_cast<std::string>(settings_.rowStep_);
+	settings["motionGateThreshold"] = boost::lexical_cast<std::string>(settings_.threshold_);
+	settings["motionGateMaxSkippedFrames"] = boost::lexical_cast<std::string>(settings_.maxSkippedFrames_);
+}
+
+void MotionGate::clear() {
+	reference_ = cv::Mat();
+	skippedFrames_ = 0;
+	lastDifference_ = 0.0;
+}
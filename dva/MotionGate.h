@@ -0,0 +1,150 @@
+#ifndef MotionGate_h_
+#define MotionGate_h_
+
+#include <opencv/cv.h>
+#include <opencv/cxcore.hpp>
+#include <networking/ExchangeTypes.hpp>
+#include "AnCommon.h"
+
+/**
+ * Дешёвая глобальная оценка изменений в кадре, позволяющая пропускать дорогие алгоритмы на неизменившихся кадрах.
+ *
+ * Кадр сравнивается не с предыдущим, а с последним обработанным (опорным) кадром,
+ * поэтому медленно накапливающиеся изменения (например, дым) рано или поздно превышают порог.
+ */
+class MotionGate {
+
+public:
+
+	/**
+	 * Класс настроек(параметров) фильтра изменений.
+	 */
+	class MotionGateSettings {
+
+	public:
+
+		/**
+		 * Значения по умолчанию соответствующих полей.
+		 *
+		 * @{
+		 */
+		static const bool ENABLED;
+		static const int ROW_STEP;
+		static const double THRESHOLD;
+		static const int MAX_SKIPPED_FRAMES;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Показывает, включён ли пропуск неизменившихся кадров.
+		 */
+		bool enabled_;
+
+		/**
+		 * Шаг прореживания строк при сравнении кадров.
+		 */
+		int rowStep_;
+
+		/**
+		 * Среднее абсолютное отличие байта от опорного кадра, начиная с которого кадр считается изменившимся.
+		 */
+		double threshold_;
+
+		/**
+		 * Наибольшее количество подряд пропущенных кадров, после которого кадр обрабатывается в любом случае.
+		 */
+		int maxSkippedFrames_;
+
+		/**
+		 * Создаёт объект класса с параметрами по умолчанию.
+		 */
+		MotionGateSettings();
+
+		/**
+		 * Создаёт объект класса с заданными параметрами.
+		 *
+		 * @param описание параметров смотри у описания соответствующих полей класса.
+		 */
+		MotionGateSettings(bool enabled, int rowStep, double threshold, int maxSkippedFrames);
+
+	};
+
+	/**
+	 * Создаёт фильтр с настройками по умолчанию.
+	 */
+	MotionGate();
+
+	/**
+	 * Создаёт фильтр с заданными настройками.
+	 */
+	MotionGate(const MotionGateSettings& settings);
+
+	/**
+	 * Решает, можно ли пропустить обработку кадра. Если кадр нужно обработать, он становится опорным.
+	 *
+	 * @param image текущий кадр.
+	 * @return true - кадр почти не отличается от опорного и его можно пропустить.
+	 */
+	bool shouldSkip(const cv::Mat& image);
+
+	/**
+	 * Возвращает среднее абсолютное отличие байта текущего кадра от опорного, посчитанное последним вызовом shouldSkip().
+	 */
+	double getLastDifference() const;
+
+	/**
+	 * Показывает, включён ли пропуск кадров.
+	 */
+	bool isEnabled() const;
+
+	/**
+	 * Устанавливает настройки(параметры) фильтра. Все параметры необязательны.
+	 *
+	 * @param settings параметры(настройки) фильтра.
+	 * @param usedSettings множество используемых настроек.
+	 */
+	void setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings);
+
+	/**
+	 * Возвращает настройки(параметры) фильтра.
+	 *
+	 * @param settings параметры(настройки) фильтра.
+	 */
+	void getSettings(xml::Request::Params &settings);
+
+	/**
+	 * Забывает опорный кадр.
+	 */
+	void clear();
+
+private:
+
+	/**
+	 * Настройки фильтра.
+	 */
+	MotionGateSettings settings_;
+
+	/**
+	 * Прореженные строки опорного кадра.
+	 */
+	cv::Mat reference_;
+
+	/**
+	 * Количество подряд пропущенных кадров.
+	 */
+	int skippedFrames_;
+
+	/**
+	 * Результат последнего сравнения.
+	 */
+	double lastDifference_;
+
+	/**
+	 * Возвращает заголовок, ссылающийся на каждую rowStep_-ю строку кадра, с элементами-байтами.
+	 */
+	cv::Mat sampleRows(const cv::Mat& image) const;
+
+};
+
+#endif // MotionGate_h_
@@ -0,0 +1,61 @@
+#include "RecordingDetector.h"
+
+RecordingDetector::RecordingDetector(Detector::SharedPtr detector, const std::string& path,
+		const StreamRecorder::StreamRecorderSettings& settings)
+	: detector_(detector)
+	, path_(path)
+	, recorder_(settings)
+{
+}
+
+RecordingDetector::~RecordingDetector() {
+	recorder_.close();
+}
+
+void RecordingDetector::on() {
+	recorder_.open(path_, detector_->getType());
+	recorder_.recordSettings(detector_->getSettings());
+	try {
+		detector_->on();
+	} catch (...) {
+		recorder_.close();
+		throw;
+	}
+	Detector::on();
+}
+
+void RecordingDetector::off() {
+	detector_->off();
+	recorder_.close();
+	Detector::off();
+}
+
+void RecordingDetector::execute(const cv::Mat& image, const boost::posix_time::ptime& imageTime, std::string& resultingXml) {
+	recorder_.recordFrame(image, imageTime);
+	detector_->execute(image, imageTime, resultingXml);
+}
+
+std::string RecordingDetector::getType() {
+	return detector_->getType();
+}
+
+void RecordingDetector::setSettings(xml::Request::Params params) {
+	detector_->setSettings(params);
+	recorder_.recordSettings(params);
+}
+
+xml::Request::Params RecordingDetector::getSettings() {
+	return detector_->getSettings();
+}
+
+const DegradationPolicy& RecordingDetector::getDegradationPolicy() {
+	return detector_->getDegradationPolicy();
+}
+
+void RecordingDetector::setSkipSerializationOnlyFrames(bool skip) {
+	detector_->setSkipSerializationOnlyFrames(skip);
+}
+
+Detector::SharedPtr RecordingDetector::getDetector() {
+	return detector_;
+}
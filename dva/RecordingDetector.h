@@ -0,0 +1,97 @@
+#ifndef RecordingDetector_h_
+#define RecordingDetector_h_
+
+#include "Detector.h"
+#include "StreamRecording.h"
+
+/**
+ * Детектор-обёртка, записывающий входной поток другого детектора (кадры и изменения настроек) для воспроизведения
+ * StreamReplayer. Запись ведётся, пока детектор включён; при включении записываются текущие настройки.
+ */
+class RecordingDetector
+	: public Detector
+{
+public:
+
+	/**
+	 * Создаёт обёртку.
+	 *
+	 * @param detector записываемый детектор.
+	 * @param path путь к файлу записи, при каждом включении файл перезаписывается.
+	 * @param settings настройки записи.
+	 */
+	RecordingDetector(Detector::SharedPtr detector, const std::string& path,
+		const StreamRecorder::StreamRecorderSettings& settings = StreamRecorder::StreamRecorderSettings());
+
+	/**
+	 * Дописывает и закрывает запись.
+	 */
+	virtual ~RecordingDetector();
+
+	/**
+	 * Открывает запись и включает детектор.
+	 *
+	 * @throw std::string описание ошибки.
+	 */
+	virtual void on();
+
+	/**
+	 * Выключает детектор и закрывает запись.
+	 */
+	virtual void off();
+
+	/**
+	 * Записывает кадр и передаёт его детектору.
+	 */
+	virtual void execute(const cv::Mat& image, const boost::posix_time::ptime& imageTime, std::string& resultingXml);
+
+	/**
+	 * Возвращает тип записываемого детектора.
+	 */
+	virtual std::string getType();
+
+	/**
+	 * Передаёт настройки детектору и записывает их, если они приняты.
+	 */
+	virtual void setSettings(xml::Request::Params params);
+
+	/**
+	 * Возвращает настройки записываемого детектора.
+	 */
+	virtual xml::Request::Params getSettings();
+
+	/**
+	 * Возвращает поведение при перегрузке записываемого детектора.
+	 */
+	virtual const DegradationPolicy& getDegradationPolicy();
+
+	/**
+	 * Передаёт записываемому детектору пропуск кадров, только повторяющих прежний результат.
+	 */
+	virtual void setSkipSerializationOnlyFrames(bool skip);
+
+	/**
+	 * Возвращает записываемый детектор.
+	 */
+	Detector::SharedPtr getDetector();
+
+private:
+
+	/**
+	 * Записываемый детектор.
+	 */
+	Detector::SharedPtr detector_;
+
+	/**
+	 * Путь к файлу записи.
+	 */
+	std::string path_;
+
+	/**
+	 * Запись входного потока.
+	 */
+	StreamRecorder recorder_;
+
+};
+
+#endif // RecordingDetector_h_
@@ -0,0 +1,160 @@
+#include "RegionOfInterest.h"
+#include <algorithm>
+#include <sstream>
+#include <boost/lexical_cast.hpp>
+#include <logging/logging.hpp>
+#include <utils/maputils.hpp>
+
+RegionOfInterest::RegionOfInterest()
+	: dirty_(true)
+{}
+
+void RegionOfInterest::setPolygon(const std::string& polygon) {
+	std::vector<cv::Point2f> points;
+	std::stringstream vertices(polygon);
+	std::string vertex;
+	try {
+		while (std::getline(vertices, vertex, ';')) {
+			if (vertex.empty()) {
+				continue;
+			}
+			size_t comma = vertex.find(',');
+			if (comma == std::string::npos) {
+				throw std::string();
+			}
+			float x = boost::lexical_cast<float>(vertex.substr(0, comma));
+			float y = boost::lexical_cast<float>(vertex.substr(comma + 1));
+			points.push_back(cv::Point2f(x, y));
+		}
+	} catch (...) {
+		errors::throwException(errors::ERR_05_SETTINGS_CAN_NOT_BE_APPLIED_INCORRECT_PARAMETER + "roi");
+	}
+
+	if (!points.empty() && points.size() < 3) {
+		errors::throwException(errors::ERR_05_SETTINGS_CAN_NOT_BE_APPLIED_INCORRECT_PARAMETER + "roi");
+	}
+
+	polygon_ = points;
+	dirty_ = true;
+}
+
+std::string RegionOfInterest::getPolygon() const {
+	std::stringstream result;
+	for (size_t i = 0; i < polygon_.size(); i++) {
+		if (i) {
+			result << ";";
+		}
+		result << polygon_[i].x << "," << polygon_[i].y;
+	}
+	return result.str();
+}
+
+bool RegionOfInterest::isFullFrame() const {
+	return polygon_.empty();
+}
+
+void RegionOfInterest::prepare(const cv::Size& frameSize, const cv::Size& blockSize) {
+	if (!dirty_ && frameSize == frameSize_ && blockSize == blockSize_) {
+		return;
+	}
+	frameSize_ = frameSize;
+	blockSize_ = blockSize;
+	dirty_ = false;
+	boundingRect_ = cv::Rect(cv::Point(0, 0), frameSize_);
+
+	if (isFullFrame()) {
+		pixelMask_ = cv::Mat();
+		blockMask_ = cv::Mat();
+		rowBegin_.clear();
+		rowEnd_.clear();
+		return;
+	}
+
+	LOG_DEBUG("RegionOfInterest: rasterising " << polygon_.size() << " vertices for " << frameSize_.width << "x" << frameSize_.height);
+
+	std::vector<cv::Point> vertices(polygon_.size());
+	for (size_t i = 0; i < polygon_.size(); i++) {
+		vertices[i] = cv::Point(cvRound(polygon_[i].x * frameSize_.width / 100.f), cvRound(polygon_[i].y * frameSize_.height / 100.f));
+	}
+	u_int8_t zero = 0;
+	pixelMask_ = cv::Mat(frameSize_, CV_8U, zero);
+	const cv::Point* contour = &vertices[0];
+	int count = vertices.size();
+	cv::fillPoly(pixelMask_, &contour, &count, 1, cv::Scalar(1));
+
+	rowBegin_.assign(frameSize_.height, 0);
+	rowEnd_.assign(frameSize_.height, 0);
+	int top = frameSize_.height, bottom = 0, left = frameSize_.width, right = 0;
+	for (int y = 0; y < frameSize_.height; y++) {
+		const uchar* row = pixelMask_.ptr(y);
+		int begin = 0;
+		while (begin < frameSize_.width && row[begin] == 0) {
+			begin++;
+		}
+		if (begin == frameSize_.width) {
+			continue;
+		}
+		int end = frameSize_.width;
+		while (row[end - 1] == 0) {
+			end--;
+		}
+		rowBegin_[y] = begin;
+		rowEnd_[y] = end;
+		top = std::min(top, y);
+		bottom = y + 1;
+		left = std::min(left, begin);
+		right = std::max(right, end);
+	}
+	boundingRect_ = top < bottom ? cv::Rect(left, top, right - left, bottom - top) : cv::Rect();
+
+	if (blockSize_.width > 0 && blockSize_.height > 0) {
+		cv::Size blocks((frameSize_.width + blockSize_.width - 1) / blockSize_.width, (frameSize_.height + blockSize_.height - 1) / blockSize_.height);
+		blockMask_ = cv::Mat(blocks, CV_8U, zero);
+		for (int y = 0; y < frameSize_.height; y++) {
+			uchar* blockRow = blockMask_.ptr(y / blockSize_.height);
+			for (int x = rowBegin_[y]; x < rowEnd_[y]; x++) {
+				if (pixelMask_.ptr(y)[x]) {
+					blockRow[x / blockSize_.width] = 1;
+				}
+			}
+		}
+	} else {
+		blockMask_ = cv::Mat();
+	}
+}
+
+const cv::Mat& RegionOfInterest::getPixelMask() const {
+	return pixelMask_;
+}
+
+const cv::Mat& RegionOfInterest::getBlockMask() const {
+	return blockMask_;
+}
+
+bool RegionOfInterest::isBlockActive(int blockX, int blockY) const {
+	return blockMask_.empty() || blockMask_.ptr(blockY)[blockX] != 0;
+}
+
+int RegionOfInterest::getRowBegin(int y) const {
+	return rowBegin_.empty() ? 0 : rowBegin_[y];
+}
+
+int RegionOfInterest::getRowEnd(int y) const {
+	return rowEnd_.empty() ? frameSize_.width : rowEnd_[y];
+}
+
+cv::Rect RegionOfInterest::getBoundingRect() const {
+	return boundingRect_;
+}
+
+void RegionOfInterest::setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings) {
+	std::string paramName = "roi";
+	if (settings.count(paramName)) {
+		setPolygon(MapUtils::value(settings, paramName, errors::ERR_06_SETTINGS_CAN_NOT_BE_APPLIED_PARAMETER_NOT_FOUND + paramName));
+		usedSettings.insert(paramName);
+	}
+}
+
+void RegionOfInterest::getSettings(xml::Request::Params &settings) {
+	settings["roi"] = getPolygon();
+}
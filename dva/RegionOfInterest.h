@@ -0,0 +1,151 @@
+#ifndef RegionOfInterest_h_
+#define RegionOfInterest_h_
+
+#include <opencv/cv.h>
+#include <opencv/cxcore.hpp>
+#include <networking/ExchangeTypes.hpp>
+#include "AnCommon.h"
+
+/**
+ * Область кадра, за которой следит детектор, заданная многоугольником.
+ *
+ * Вершины задаются в процентах от ширины и высоты кадра, поэтому область не зависит от разрешения
+ * и от frameMinification(). Многоугольник растеризуется один раз при изменении размера кадра или блока;
+ * алгоритмы затем пропускают строки и блоки вне области целиком.
+ */
+class RegionOfInterest {
+
+public:
+
+	/**
+	 * Создаёт область, совпадающую со всем кадром.
+	 */
+	RegionOfInterest();
+
+	/**
+	 * Устанавливает многоугольник из строки вида "x1,y1;x2,y2;x3,y3...", пустая строка означает весь кадр.
+	 *
+	 * @param polygon вершины многоугольника в процентах от размеров кадра.
+	 * @throw std::string при неверном формате.
+	 */
+	void setPolygon(const std::string& polygon);
+
+	/**
+	 * Возвращает многоугольник в формате setPolygon().
+	 */
+	std::string getPolygon() const;
+
+	/**
+	 * Показывает, что область совпадает со всем кадром.
+	 */
+	bool isFullFrame() const;
+
+	/**
+	 * Растеризует многоугольник, если изменился размер кадра или блока.
+	 *
+	 * @param frameSize размер кадра.
+	 * @param blockSize размер блока; если пуст, маска блоков не строится.
+	 */
+	void prepare(const cv::Size& frameSize, const cv::Size& blockSize = cv::Size());
+
+	/**
+	 * Попиксельная маска области (0 или 1), пуста если область совпадает с кадром.
+	 */
+	const cv::Mat& getPixelMask() const;
+
+	/**
+	 * Маска блоков (0 или 1) размером ceil(frameSize / blockSize): блок отмечен, если хотя бы один его пиксель внутри области.
+	 * Пуста, если область совпадает с кадром.
+	 */
+	const cv::Mat& getBlockMask() const;
+
+	/**
+	 * Показывает, лежит ли блок хотя бы частично внутри области.
+	 */
+	bool isBlockActive(int blockX, int blockY) const;
+
+	/**
+	 * Диапазон столбцов [getRowBegin(y), getRowEnd(y)) строки @a y, содержащий все пиксели области в этой строке.
+	 * Для строк вне области диапазон пуст.
+	 *
+	 * @{
+	 */
+	int getRowBegin(int y) const;
+
+	int getRowEnd(int y) const;
+	/**
+	 * @}
+	 */
+
+	/**
+	 * Обрамляющий прямоугольник области в пикселях.
+	 */
+	cv::Rect getBoundingRect() const;
+
+	/**
+	 * Устанавливает область из параметра "roi", параметр необязателен.
+	 *
+	 * @param settings параметры(настройки).
+	 * @param usedSettings множество используемых настроек.
+	 */
+	void setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings);
+
+	/**
+	 * Возвращает параметр "roi".
+	 *
+	 * @param settings параметры(настройки).
+	 */
+	void getSettings(xml::Request::Params &settings);
+
+private:
+
+	/**
+	 * Вершины многоугольника в процентах от размеров кадра.
+	 */
+	std::vector<cv::Point2f> polygon_;
+
+	/**
+	 * Размер кадра, для которого построены маски.
+	 */
+	cv::Size frameSize_;
+
+	/**
+	 * Размер блока, для которого построена маска блоков.
+	 */
+	cv::Size blockSize_;
+
+	/**
+	 * Показывает, что маски нужно построить заново.
+	 */
+	bool dirty_;
+
+	/**
+	 * Попиксельная маска.
+	 */
+	cv::Mat pixelMask_;
+
+	/**
+	 * Маска блоков.
+	 */
+	cv::Mat blockMask_;
+
+	/**
+	 * Диапазоны столбцов по строкам.
+	 *
+	 * @{
+	 */
+	std::vector<int> rowBegin_;
+
+	std::vector<int> rowEnd_;
+	/**
+	 * @}
+	 */
+
+	/**
+	 * Обрамляющий прямоугольник.
+	 */
+	cv::Rect boundingRect_;
+
+};
+
+#endif // RegionOfInterest_h_
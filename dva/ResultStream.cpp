@@ -0,0 +1,197 @@
+#include "ResultStream.h"
+#include <sstream>
+#include <vector>
+#include <logging/logging.hpp>
+#include "System.h"
+#include <utils/maputils.hpp>
+
+const bool ResultStream::ResultStreamSettings::DELTA_OUTPUT = false;
+const int ResultStream::ResultStreamSettings::KEYFRAME_INTERVAL = 100;
+
+ResultStream::ResultStreamSettings::ResultStreamSettings()
+	: deltaOutput_(DELTA_OUTPUT)
+	, keyframeInterval_(KEYFRAME_INTERVAL)
+{}
+
+ResultStream::ResultStreamSettings::ResultStreamSettings(bool deltaOutput, int keyframeInterval)
+	: deltaOutput_(deltaOutput)
+	, keyframeInterval_(keyframeInterval)
+{}
+
+ResultStream::ResultStream()
+	: hasResult_(false)
+	, framesSinceKeyframe_(0)
+	, nextId_(1)
+{}
+
+ResultStream::ResultStream(const ResultStreamSettings& settings)
+	: settings_(settings)
+	, hasResult_(false)
+	, framesSinceKeyframe_(0)
+	, nextId_(1)
+{}
+
+std::string ResultStream::build(const std::list<AnCommon::Object>& objects, const cv::Mat& mask, const cv::Size& blockSize, int minObjectArea, int maxObjectArea) {
+	if (!settings_.deltaOutput_) {
+		lastFull_ = AnCommon::getXMLObjectList(objects, blockSize, minObjectArea, maxObjectArea) + AnCommon::getXMLBitMap(mask, blockSize);
+		hasResult_ = true;
+		return lastFull_;
+	}
+
+	bool keyframe = nextIsKeyframe(blockSize != blockSize_ || mask.size() != mask_.size());
+
+	// Каждый новый объект получает id наиболее пересекающегося с ним ещё не сопоставленного объекта предыдущего результата
+	std::vector<AnCommon::Object> previous(objects_.begin(), objects_.end());
+	std::vector<bool> matched(previous.size(), false);
+	std::list<AnCommon::Object> current;
+	std::stringstream appeared, updated, disappeared;
+	for (std::list<AnCommon::Object>::const_iterator i = objects.begin(); i != objects.end(); i++) {
+		cv::Rect rect = i->getRect();
+		int area = blockSize.area() * rect.area();
+		if (area < minObjectArea || maxObjectArea < area) {
+			continue;
+		}
+		int best = -1;
+		int bestArea = 0;
+		for (size_t j = 0; j < previous.size(); j++) {
+			int intersection = (rect & previous[j].getRect()).area();
+			if (!matched[j] && intersection > bestArea) {
+				best = j;
+				bestArea = intersection;
+			}
+		}
+		AnCommon::Object object(0, rect);
+		if (best < 0) {
+			object.setId(nextId_++);
+			appeared << AnCommon::getXMLObject(object, blockSize);
+		} else {
+			matched[best] = true;
+			object.setId(previous[best].getId());
+			if (previous[best].getRect() != rect) {
+				updated << AnCommon::getXMLObject(object, blockSize);
+			}
+		}
+		current.push_back(object);
+	}
+	for (size_t j = 0; j < previous.size(); j++) {
+		if (!matched[j]) {
+			disappeared << "<id>" << previous[j].getId() << "</id>";
+		}
+	}
+
+	std::string changedBlocks = keyframe ? std::string() : getChangedBlocks(mask);
+
+	objects_.swap(current);
+	mask.copyTo(mask_);
+	blockSize_ = blockSize;
+	lastFull_.clear();
+	hasResult_ = true;
+
+	if (keyframe) {
+		return getKeyframe();
+	}
+
+	std::string result = "<delta>";
+	if (!appeared.str().empty()) {
+		result += "<appeared>" + appeared.str() + "</appeared>";
+	}
+	if (!updated.str().empty()) {
+		result += "<updated>" + updated.str() + "</updated>";
+	}
+	if (!disappeared.str().empty()) {
+		result += "<disappeared>" + disappeared.str() + "</disappeared>";
+	}
+	if (!changedBlocks.empty()) {
+		result += "<changedBlocks>" + changedBlocks + "</changedBlocks>";
+	}
+	result += "</delta>";
+	return result;
+}
+
+std::string ResultStream::buildUnchanged() {
+	if (!settings_.deltaOutput_) {
+		return lastFull_;
+	}
+	if (nextIsKeyframe(false)) {
+		return getKeyframe();
+	}
+	return "<delta></delta>";
+}
+
+bool ResultStream::hasResult() const {
+	return hasResult_;
+}
+
+bool ResultStream::nextIsKeyframe(bool forced) {
+	framesSinceKeyframe_++;
+	if (forced || !hasResult_ || framesSinceKeyframe_ >= settings_.keyframeInterval_) {
+		framesSinceKeyframe_ = 0;
+		return true;
+	}
+	return false;
+}
+
+std::string ResultStream::getKeyframe() {
+	if (lastFull_.empty()) {
+		LOG_TRACE("ResultStream: serialising keyframe, " << objects_.size() << " objects");
+		lastFull_ = "<keyframe>" + AnCommon::getXMLObjectList(objects_, blockSize_) + AnCommon::getXMLBitMap(mask_, blockSize_) + "</keyframe>";
+	}
+	return lastFull_;
+}
+
+std::string ResultStream::getChangedBlocks(const cv::Mat& mask) const {
+	std::stringstream result;
+	for (int y = 0; y < mask.rows; y++) {
+		const uchar* row = mask.ptr(y);
+		const uchar* prevRow = mask_.ptr(y);
+		for (int x = 0; x < mask.cols; x++) {
+			if ((row[x] != 0) != (prevRow[x] != 0)) {
+				result << "<block>" << x << "," << y << "," << (row[x] ? 1 : 0) << "</block>";
+			}
+		}
+	}
+	return result.str();
+}
+
+void ResultStream::setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings) {
+	try {
+
+		std::string lexCastError = errors::ERR_05_SETTINGS_CAN_NOT_BE_APPLIED_INCORRECT_PARAMETER;
+		std::string error = errors::ERR_06_SETTINGS_CAN_NOT_BE_APPLIED_PARAMETER_NOT_FOUND;
+
+		{
+			std::string paramName = "deltaOutput";
+			if (settings.count(paramName)) {
+				settings_.deltaOutput_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "keyframeInterval";
+			if (settings.count(paramName)) {
+				settings_.keyframeInterval_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+
+	} catch (std::string& err) {
+		errors::throwException(err);
+	} catch (...) {
+		errors::throwException(errors::ERR_04_SETTINGS_CAN_NOT_BE_APPLIED);
+	}
+	clear();
+}
+
+void ResultStream::getSettings(xml::Request::Params &settings) {
+	settings["deltaOutput"] = boost::lexical_cast<std::string>(settings_.deltaOutput_);
+	settings["keyframeInterval"] = boost::lexical_cast<std::string>(settings_.keyframeInterval_);
+}
+
+void ResultStream::clear() {
+	objects_.clear();
+	mask_ = cv::Mat();
+	blockSize_ = cv::Size();
+	lastFull_.clear();
+	hasResult_ = false;
+	framesSinceKeyframe_ = 0;
+}
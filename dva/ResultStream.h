@@ -0,0 +1,180 @@
+#ifndef ResultStream_h_
+#define ResultStream_h_
+
+#include <opencv/cv.h>
+#include <opencv/cxcore.hpp>
+#include <networking/ExchangeTypes.hpp>
+#include "AnCommon.h"
+
+/**
+ * Формирует xml-результат детектора: полный на каждом кадре либо, в режиме изменений, поток событий.
+ *
+ * В режиме изменений объекты сопоставляются с объектами предыдущего результата по пересечению
+ * обрамляющих прямоугольников и сохраняют свой id, пока существуют. Вместо полного результата
+ * передаются события появления(appeared), изменения(updated) и исчезновения(disappeared) объектов
+ * и изменившиеся блоки битовой карты, а раз в keyframeInterval_ результатов -- полный ключевой результат.
+ */
+class ResultStream {
+
+public:
+
+	/**
+	 * Класс настроек(параметров) потока результатов.
+	 */
+	class ResultStreamSettings {
+
+	public:
+
+		/**
+		 * Значения по умолчанию соответствующих полей.
+		 *
+		 * @{
+		 */
+		static const bool DELTA_OUTPUT;
+		static const int KEYFRAME_INTERVAL;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Показывает, передаются ли только изменения результата.
+		 */
+		bool deltaOutput_;
+
+		/**
+		 * Количество результатов между полными ключевыми результатами в режиме изменений.
+		 */
+		int keyframeInterval_;
+
+		/**
+		 * Создаёт объект класса с параметрами по умолчанию.
+		 */
+		ResultStreamSettings();
+
+		/**
+		 * Создаёт объект класса с заданными параметрами.
+		 *
+		 * @param описание параметров смотри у описания соответствующих полей класса.
+		 */
+		ResultStreamSettings(bool deltaOutput, int keyframeInterval);
+
+	};
+
+	/**
+	 * Создаёт поток с настройками по умолчанию.
+	 */
+	ResultStream();
+
+	/**
+	 * Создаёт поток с заданными настройками.
+	 */
+	ResultStream(const ResultStreamSettings& settings);
+
+	/**
+	 * Формирует результат по новому списку объектов и битовой карте.
+	 *
+	 * @param objects список объектов, прямоугольники заданы в блоках.
+	 * @param mask битовая карта блоков.
+	 * @param blockSize размер блока в пикселях.
+	 * @param minObjectArea минимальная площадь объекта в пикселях анализируемого (уменьшенного) кадра.
+	 * @param maxObjectArea максимальная площадь объекта в пикселях анализируемого (уменьшенного) кадра.
+	 * @return строка в формате xml.
+	 */
+	std::string build(const std::list<AnCommon::Object>& objects, const cv::Mat& mask, const cv::Size& blockSize, 
+			int minObjectArea = std::numeric_limits<int>().min(), int maxObjectArea = std::numeric_limits<int>().max());
+
+	/**
+	 * Формирует результат, когда объекты и битовая карта не изменились с последнего вызова build().
+	 * Допустимо только при hasResult().
+	 *
+	 * @return прежний полный результат, пустое изменение либо ключевой результат, если подошла его очередь.
+	 */
+	std::string buildUnchanged();
+
+	/**
+	 * Показывает, сформирован ли хотя бы один результат после clear().
+	 */
+	bool hasResult() const;
+
+	/**
+	 * Устанавливает настройки(параметры) потока. Все параметры необязательны.
+	 *
+	 * @param settings параметры(настройки) потока.
+	 * @param usedSettings множество используемых настроек.
+	 */
+	void setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings);
+
+	/**
+	 * Возвращает настройки(параметры) потока.
+	 *
+	 * @param settings параметры(настройки) потока.
+	 */
+	void getSettings(xml::Request::Params &settings);
+
+	/**
+	 * Забывает предыдущий результат, следующий результат будет ключевым. Нумерация id объектов продолжается.
+	 */
+	void clear();
+
+private:
+
+	/**
+	 * Настройки потока.
+	 */
+	ResultStreamSettings settings_;
+
+	/**
+	 * Объекты последнего результата со стабильными id.
+	 */
+	std::list<AnCommon::Object> objects_;
+
+	/**
+	 * Битовая карта последнего результата.
+	 */
+	cv::Mat mask_;
+
+	/**
+	 * Размер блока последнего результата.
+	 */
+	cv::Size blockSize_;
+
+	/**
+	 * Последний полный результат; в режиме изменений пуст, пока не понадобится.
+	 */
+	std::string lastFull_;
+
+	/**
+	 * Показывает, сформирован ли результат после clear().
+	 */
+	bool hasResult_;
+
+	/**
+	 * Количество результатов после последнего ключевого.
+	 */
+	int framesSinceKeyframe_;
+
+	/**
+	 * Следующий свободный id объекта.
+	 */
+	int nextId_;
+
+	/**
+	 * Отсчитывает очередной результат и решает, должен ли он быть ключевым.
+	 *
+	 * @param forced результат должен быть ключевым независимо от счётчика (например, изменился размер карты).
+	 */
+	bool nextIsKeyframe(bool forced);
+
+	/**
+	 * Ключевой результат по сохранённым объектам и битовой карте.
+	 */
+	std::string getKeyframe();
+
+	/**
+	 * Возвращает элементы <block>x,y,значение</block> для блоков, различающихся в @a mask и @a mask_.
+	 */
+	std::string getChangedBlocks(const cv::Mat& mask) const;
+
+};
+
+#endif // ResultStream_h_
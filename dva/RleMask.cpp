@@ -0,0 +1,202 @@
+#include "RleMask.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include "Errors.h"
+
+namespace AnCommon {
+
+RleMask::RleMask()
+	: nextRow_(0)
+{
+	reset(cv::Size(0, 0));
+}
+
+RleMask::RleMask(const cv::Size& size)
+	: nextRow_(0)
+{
+	reset(size);
+}
+
+RleMask::RleMask(const cv::Mat& mask)
+	: nextRow_(0)
+{
+	assign(mask);
+}
+
+void RleMask::reset(const cv::Size& size) {
+	size_ = size;
+	spans_.clear();
+	rowStart_.assign(size_.height + 1, 0);
+	nextRow_ = 0;
+}
+
+void RleMask::closeRowsUpTo(int y) {
+	while (nextRow_ <= y) {
+		rowStart_[nextRow_] = spans_.size();
+		nextRow_++;
+	}
+}
+
+void RleMask::addSpan(int y, int x, int length) {
+	closeRowsUpTo(y);
+	spans_.push_back(Span(y, x, length));
+}
+
+void RleMask::assign(const cv::Mat& mask) {
+	if (mask.type() != CV_8UC1) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": mask");
+	}
+
+	reset(mask.size());
+	const int width = size_.width;
+	for (int y = 0; y < size_.height; y++) {
+		const uchar* ptr = mask.ptr(y);
+		int x = 0;
+		while (x < width) {
+			// пропускаем нулевые участки по 8 байт
+			while (x + 8 <= width) {
+				uint64_t chunk;
+				std::memcpy(&chunk, ptr + x, sizeof(chunk));
+				if (chunk != 0) {
+					break;
+				}
+				x += 8;
+			}
+			while (x < width && ptr[x] == 0) {
+				x++;
+			}
+			if (x == width) {
+				break;
+			}
+			int start = x;
+			while (x < width && ptr[x] != 0) {
+				x++;
+			}
+			addSpan(y, start, x - start);
+		}
+	}
+}
+
+cv::Size RleMask::size() const {
+	return size_;
+}
+
+const Spans& RleMask::spans() const {
+	return spans_;
+}
+
+Spans::const_iterator RleMask::rowBegin(int y) const {
+	return spans_.begin() + (y < nextRow_ ? rowStart_[y] : spans_.size());
+}
+
+Spans::const_iterator RleMask::rowEnd(int y) const {
+	return spans_.begin() + (y + 1 < nextRow_ ? rowStart_[y + 1] : spans_.size());
+}
+
+/**
+ * Находит корень множества с объединением путей.
+ */
+static int findRoot(std::vector<int>& parent, int i) {
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+std::vector<RleMask::Component> RleMask::getComponents() const {
+	std::vector<int> parent(spans_.size());
+	for (size_t i = 0; i < parent.size(); i++) {
+		parent[i] = i;
+	}
+
+	// Серии соседних строк касаются, если их столбцы пересекаются с учётом диагонали.
+	for (int y = 1; y < size_.height; y++) {
+		Spans::const_iterator prev = rowBegin(y - 1);
+		Spans::const_iterator prevEnd = rowEnd(y - 1);
+		for (Spans::const_iterator cur = rowBegin(y); cur != rowEnd(y) && prev != prevEnd; ) {
+			int curFirst = cur->x;
+			int curLast = cur->x + cur->length - 1;
+			int prevFirst = prev->x;
+			int prevLast = prev->x + prev->length - 1;
+			if (prevFirst <= curLast + 1 && curFirst <= prevLast + 1) {
+				int a = findRoot(parent, prev - spans_.begin());
+				int b = findRoot(parent, cur - spans_.begin());
+				if (a != b) {
+					parent[std::max(a, b)] = std::min(a, b);
+				}
+			}
+			if (prevLast < curLast) {
+				prev++;
+			} else {
+				cur++;
+			}
+		}
+	}
+
+	std::vector<Component> result;
+	std::vector<int> componentIndex(spans_.size(), -1);
+	for (size_t i = 0; i < spans_.size(); i++) {
+		int root = findRoot(parent, i);
+		if (componentIndex[root] < 0) {
+			componentIndex[root] = result.size();
+			result.push_back(Component());
+			result.back().rect = cv::Rect(spans_[i].x, spans_[i].y, spans_[i].length, 1);
+		}
+		Component& component = result[componentIndex[root]];
+		component.rect |= cv::Rect(spans_[i].x, spans_[i].y, spans_[i].length, 1);
+		component.area += spans_[i].length;
+	}
+	return result;
+}
+
+std::list<Object> createObjectList(const RleMask& mask, int minObjectArea, int maxObjectArea) {
+	std::vector<RleMask::Component> components = mask.getComponents();
+
+	std::list<Object> result;
+	int idNum = 1;
+	for (size_t i = 0; i < components.size(); i++) {
+		const cv::Rect& rect = components[i].rect;
+		if (minObjectArea <= rect.area() && rect.area() <= maxObjectArea) {
+			result.push_back(Object(idNum, rect));
+			idNum++;
+		}
+	}
+
+	return result;
+}
+
+std::string getXMLBitMap(const RleMask& mask, cv::Size blockSize) {
+	std::stringstream header;
+	header << "<blockSize>";
+	{
+		header << "<w>" << blockSize.width * AnCommon::getFrameMinification() << "</w>";
+		header << "<h>" << blockSize.height * AnCommon::getFrameMinification() << "</h>";
+	}
+	header << "</blockSize>";
+
+	header << "<data>";
+	header << "\n";
+
+	std::string result = header.str();
+	const int width = mask.size().width;
+	// длина карты известна заранее: <line>, width символов и </line> на строку
+	result.reserve(result.size() + mask.size().height * (width + 13) + 7);
+	for (int y = 0; y < mask.size().height; y++) {
+		result += "<line>";
+		int x = 0;
+		for (Spans::const_iterator i = mask.rowBegin(y); i != mask.rowEnd(y); i++) {
+			result.append(i->x - x, '0');
+			result.append(i->length, '1');
+			x = i->x + i->length;
+		}
+		result.append(width - x, '0');
+		result += "</line>";
+	}
+	result += "</data>";
+
+	return result;
+}
+
+} // namespace AnCommon
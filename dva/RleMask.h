@@ -0,0 +1,161 @@
+#ifndef RleMask_h_
+#define RleMask_h_
+
+#include <opencv/cv.h>
+#include <opencv/cv.hpp>
+#include <vector>
+#include "AnCommon.h"
+
+namespace AnCommon {
+
+/**
+ * Бинарная маска, закодированная длинами серий по строкам.
+ *
+ * Предназначена для масок, почти целиком состоящих из нулей (карты блоков с объектами, маски переднего плана):
+ * стоимость всех операций, кроме построения по cv::Mat, пропорциональна количеству серий, а не площади кадра.
+ * По ней строятся список объектов и битовая карта xml-результата детекторов.
+ */
+class RleMask {
+
+public:
+
+	/**
+	 * Связная (в смысле 8-связности) компонента маски.
+	 */
+	struct Component {
+
+		/**
+		 * Обрамляющий прямоугольник.
+		 */
+		cv::Rect rect;
+
+		/**
+		 * Количество пикселей.
+		 */
+		int area;
+
+		/**
+		 * Создаёт пустую компоненту.
+		 */
+		Component()
+			: area(0) {};
+	};
+
+	/**
+	 * Создаёт пустую маску.
+	 */
+	RleMask();
+
+	/**
+	 * Создаёт маску заданного размера без единичных пикселей.
+	 */
+	explicit RleMask(const cv::Size& size);
+
+	/**
+	 * Создаёт маску по одноканальной 8-битной матрице, см. assign().
+	 */
+	explicit RleMask(const cv::Mat& mask);
+
+	/**
+	 * Перезаполняет маску по одноканальной 8-битной матрице, ненулевые элементы становятся единицами.
+	 * Нулевые участки строки пропускаются по 8 байт за раз.
+	 *
+	 * @param mask исходная маска.
+	 */
+	void assign(const cv::Mat& mask);
+
+	/**
+	 * Очищает маску и задаёт её размер; серии затем добавляются через addSpan() строго по возрастанию строк и столбцов.
+	 */
+	void reset(const cv::Size& size);
+
+	/**
+	 * Добавляет серию в конец маски.
+	 *
+	 * @param y строка.
+	 * @param x первый столбец.
+	 * @param length длина серии.
+	 */
+	void addSpan(int y, int x, int length);
+
+	/**
+	 * Размер маски в пикселях.
+	 */
+	cv::Size size() const;
+
+	/**
+	 * Все серии маски.
+	 */
+	const Spans& spans() const;
+
+	/**
+	 * Серии строки @a y: [rowBegin(y), rowEnd(y)).
+	 *
+	 * @{
+	 */
+	Spans::const_iterator rowBegin(int y) const;
+
+	Spans::const_iterator rowEnd(int y) const;
+	/**
+	 * @}
+	 */
+
+	/**
+	 * Находит связные компоненты, объединяя серии соседних строк, которые касаются хотя бы по диагонали.
+	 *
+	 * @return компоненты в порядке их первого появления при обходе сверху вниз.
+	 */
+	std::vector<Component> getComponents() const;
+
+private:
+
+	/**
+	 * Размер маски.
+	 */
+	cv::Size size_;
+
+	/**
+	 * Серии, упорядоченные по строкам и столбцам.
+	 */
+	Spans spans_;
+
+	/**
+	 * Индекс первой серии каждой строки, последний элемент равен spans_.size().
+	 */
+	std::vector<int> rowStart_;
+
+	/**
+	 * Номер строки, для которой будет добавлена следующая серия (для заполнения @a rowStart_).
+	 */
+	int nextRow_;
+
+	/**
+	 * Закрывает строки вплоть до @a y, заполняя @a rowStart_.
+	 */
+	void closeRowsUpTo(int y);
+
+};
+
+/**
+ * Создаёт список объектов по 8-связным компонентам серий маски.
+ *
+ * В отличие от createObjectList() для cv::Mat, прямоугольник объекта -- точный обрамляющий прямоугольник компоненты,
+ * без аппроксимации контура, а компоненты, лежащие в дырах других компонент, тоже становятся объектами
+ * (внешние контуры CV_RETR_EXTERNAL их не находят).
+ *
+ * @param mask маска.
+ * @param minObjectArea минимальная площадь обрамляющего прямоугольника объекта.
+ * @param maxObjectArea максимальная площадь обрамляющего прямоугольника объекта.
+ * @return список объектов.
+ */
+std::list<Object> createObjectList(const RleMask& mask, int minObjectArea = std::numeric_limits<int>().min(), int maxObjectArea = std::numeric_limits<int>().max());
+
+/**
+ * То же, что и getXMLBitMap() для cv::Mat. Строки дописываются в результат участками серий и промежутков между ними,
+ * поэтому работа, кроме копирования самих символов карты, пропорциональна количеству серий.
+ */
+std::string getXMLBitMap(const RleMask& mask, cv::Size blockSize);
+
+} // namespace AnCommon
+
+#endif // RleMask_h_
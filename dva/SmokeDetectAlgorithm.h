@@ -16,6 +16,11 @@ protected:
 	 */
 	cv::Size blockSize_;
 	
+	/**
+	 * Маска блоков, которые нужно анализировать (0 или 1); пустая маска означает все блоки.
+	 */
+	cv::Mat blockMask_;
+	
 public:
 	
 	/**
@@ -33,6 +38,20 @@ public:
 	using Algorithm::detect;
 	virtual cv::Mat detect(const cv::Mat& img, const cv::Size &blockSize) = 0;
 	
+	/**
+	 * Показывает, можно ли не вызывать detect() на кадрах, почти не отличающихся от последнего обработанного.
+	 * 
+	 * @return true - кадр можно пропустить, вызвав вместо detect() ageSkippedFrame().
+	 */
+	virtual bool isSkippable() {
+		return false;
+	}
+	
+	/**
+	 * Обновляет состояние алгоритма на пропущенном кадре так, как если бы кадр не изменился.
+	 */
+	virtual void ageSkippedFrame() {}
+	
 	/**
 	 * Устанавливает размер блоков, на которые делиться изображение для анализа изображения.
 	 * 
@@ -42,6 +61,15 @@ public:
 		blockSize_ = blockSize;
 	}
 	
+	/**
+	 * Устанавливает маску блоков, которые нужно анализировать; остальные блоки пропускаются целиком.
+	 * 
+	 * @param blockMask маска размером ceil(размер кадра / blockSize) или пустая маска.
+	 */
+	virtual void setBlockMask(const cv::Mat &blockMask) {
+		blockMask_ = blockMask;
+	}
+	
 };
 
 #endif // FireDetectAlgorithm_h_
\ No newline at end of file
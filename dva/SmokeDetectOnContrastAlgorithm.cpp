@@ -4,12 +4,19 @@
 #include "AnCommon.h"
 #include "System.h"
 #include <utils/maputils.hpp>
+#include <boost/bind.hpp>
+#include "WorkStealingPool.h"
 
 /**
  * Радиус фильтра. 
  */
 static const int MORPHOLOGY_KERNEL_RADIUS = 1;
 
+/**
+ * Наименьшая высота полосы строк, обрабатываемой одной задачей пула.
+ */
+static const int CONTRAST_BAND_ROWS = 32;
+
 const std::string SmokeDetectOnContrastAlgorithm::SMOKE_DETECT_ON_CONTRAST = "SMOKE_DETECT_ON_CONTRAST";
 
 const float SmokeDetectOnContrastAlgorithm::SmokeDetectOnContrastAlgorithmSettings::THRESHOLD = 0.7f; 
@@ -86,6 +93,7 @@ std::string SmokeDetectOnContrastAlgorithm::getType() {
 	
 void SmokeDetectOnContrastAlgorithm::clear() {
 	vecSmokeContrastData_.clear();
+	frameSize_ = cv::Size();
 	tempHSVImage.setTo(cv::Scalar(CV_RGB(0,0,0)));
 	tempVImage.setTo(cv::Scalar(CV_RGB(0,0,0)));
 	tempMorphologyResult.setTo(cv::Scalar(CV_RGB(0,0,0)));
@@ -99,9 +107,89 @@ cv::Mat SmokeDetectOnContrastAlgorithm::detect(const cv::Mat& img, const cv::Siz
 cv::Mat SmokeDetectOnContrastAlgorithm::detect(const cv::Mat& img) {
 	LOG_TRACE("SmokeDetectOnContrast::detect begins"); 
 	
+	if (tempHSVImage.size() != img.size()) {
+		tempHSVImage = cv::Mat(img.size(), IPL_DEPTH_8U, 3);
+	}
+
+	if (tempVImage.size() != img.size()) {
+		tempVImage = cv::Mat(img.size(), IPL_DEPTH_8U, 3);
+	}
+
+	if (tempMorphologyResult.size() != img.size()) {
+		tempMorphologyResult = cv::Mat(img.size(), IPL_DEPTH_8U, 1);
+	}
+
+	computeContrast(img, blockSize_, blockMask_, tempHSVImage, tempVImage, tempMorphologyResult);
+	cv::Mat result = detectOnContrast(tempMorphologyResult);
 	
-	int imgSizeX = img.size().width;
-	int imgSizeY = img.size().height;
+	LOG_TRACE("SmokeDetectOnContrast::detect end"); 
+	
+	return result;
+}
+
+void SmokeDetectOnContrastAlgorithm::computeContrast(const cv::Mat& img, cv::Mat& contrast) const {
+	computeContrast(img, blockSize_, blockMask_, contrast);
+}
+
+void SmokeDetectOnContrastAlgorithm::computeContrast(const cv::Mat& img, const cv::Size& blockSize, const cv::Mat& blockMask, cv::Mat& contrast) {
+	cv::Mat hsv(img.size(), CV_8UC3);
+	cv::Mat v(img.size(), CV_8UC1);
+	contrast.create(img.size(), CV_8UC1);
+	computeContrast(img, blockSize, blockMask, hsv, v, contrast);
+}
+
+void SmokeDetectOnContrastAlgorithm::computeContrast(const cv::Mat& img, const cv::Size& blockSize, const cv::Mat& blockMask, 
+		cv::Mat& hsv, cv::Mat& v, cv::Mat& contrast) {
+	cv::Size blocks((img.size().width - 1) / blockSize.width + 1, (img.size().height - 1) / blockSize.height + 1);
+	bool useBlockMask = !blockMask.empty() && blockMask.size() == blocks;
+	// преобразования выполняются только в части кадра, покрывающей анализируемые блоки
+	cv::Rect workRect = useBlockMask ? getWorkRect(img.size(), blockSize, blockMask) : cv::Rect(cv::Point(0, 0), img.size());
+	if (workRect.area() <= 0) {
+		return;
+	}
+	
+	// полосы записываются в части матриц, поэтому матрицы должны заранее иметь нужный тип
+	hsv.create(img.size(), CV_8UC3);
+	v.create(img.size(), CV_8UC1);
+	contrast.create(img.size(), CV_8UC1);
+	
+	// Полосы строк обрабатываются в общем пуле. Яркость полосы нужна соседним полосам для морфологии,
+	// поэтому она вычисляется для всех полос до морфологического преобразования.
+	WorkStealingPool& pool = WorkStealingPool::getDefault();
+	pool.parallelFor(workRect.y, workRect.y + workRect.height, CONTRAST_BAND_ROWS, 
+		boost::bind(&SmokeDetectOnContrastAlgorithm::computeBrightnessRows, boost::cref(img), workRect, boost::ref(hsv), boost::ref(v), _1, _2));
+	cv::Mat kern = cv::getStructuringElement(CV_SHAPE_ELLIPSE, cv::Size(MORPHOLOGY_KERNEL_RADIUS * 2 + 1, MORPHOLOGY_KERNEL_RADIUS * 2 + 1), cv::Point(MORPHOLOGY_KERNEL_RADIUS, MORPHOLOGY_KERNEL_RADIUS));
+	pool.parallelFor(workRect.y, workRect.y + workRect.height, CONTRAST_BAND_ROWS, 
+		boost::bind(&SmokeDetectOnContrastAlgorithm::computeGradientRows, boost::cref(v), workRect, boost::cref(kern), boost::ref(contrast), _1, _2));
+}
+
+void SmokeDetectOnContrastAlgorithm::computeBrightnessRows(const cv::Mat& img, const cv::Rect& workRect, cv::Mat& hsv, cv::Mat& v, int rowBegin, int rowEnd) {
+	cv::Rect band(workRect.x, rowBegin, workRect.width, rowEnd - rowBegin);
+	cv::Mat hsvPart = hsv(band);
+	cv::Mat vPart = v(band);
+	int indices[] = {2, 0};
+	cv::cvtColor(img(band), hsvPart, CV_BGR2HSV);
+	cv::mixChannels(&hsvPart, 1, &vPart, 1, indices, 1);
+}
+
+void SmokeDetectOnContrastAlgorithm::computeGradientRows(const cv::Mat& v, const cv::Rect& workRect, const cv::Mat& kern, cv::Mat& contrast, int rowBegin, int rowEnd) {
+	// полоса расширяется на радиус ядра, чтобы на её краях использовались строки соседних полос, а не граница
+	int haloBegin = std::max(workRect.y, rowBegin - MORPHOLOGY_KERNEL_RADIUS);
+	int haloEnd = std::min(workRect.y + workRect.height, rowEnd + MORPHOLOGY_KERNEL_RADIUS);
+	cv::Mat vPart = v(cv::Rect(workRect.x, haloBegin, workRect.width, haloEnd - haloBegin));
+	cv::Mat contrastPart = contrast(cv::Rect(workRect.x, rowBegin, workRect.width, rowEnd - rowBegin));
+	if (haloBegin == rowBegin && haloEnd == rowEnd) {
+		cv::morphologyEx(vPart, contrastPart, CV_MOP_GRADIENT, kern);
+		return;
+	}
+	cv::Mat buf;
+	cv::morphologyEx(vPart, buf, CV_MOP_GRADIENT, kern);
+	buf.rowRange(rowBegin - haloBegin, rowEnd - haloBegin).copyTo(contrastPart);
+}
+
+cv::Mat SmokeDetectOnContrastAlgorithm::detectOnContrast(const cv::Mat& contrast) {
+	int imgSizeX = contrast.size().width;
+	int imgSizeY = contrast.size().height;
 
 	int blockSizeX = blockSize_.width;
 	int blockSizeY = blockSize_.height;
@@ -114,36 +202,23 @@ cv::Mat SmokeDetectOnContrastAlgorithm::detect(const cv::Mat& img) {
 	LOG_TRACE("cv::Mat result"); 
 	cv::Mat result(cv::Size(blocksPerX, blocksPerY), CV_8U, CV_RGB(0,0,0)); 
 
-	if (tempHSVImage.size() != img.size()) {
-		tempHSVImage = cv::Mat(img.size(), IPL_DEPTH_8U, 3);
-	}
-
-	if (tempVImage.size() != img.size()) {
-		tempVImage = cv::Mat(img.size(), IPL_DEPTH_8U, 3);
-	}
-
-	if (tempMorphologyResult.size() != img.size()) {
-		tempMorphologyResult = cv::Mat(img.size(), IPL_DEPTH_8U, 1);
-	}
-
 	if (vecSmokeContrastData_.size() != static_cast<size_t>(blocksPerX * blocksPerY)) {
 		vecSmokeContrastData_.resize(blocksPerX * blocksPerY);
 	}
+	frameSize_ = contrast.size();
 	
 	bool modeAND = false;
 	
-	cv::cvtColor(img, tempHSVImage, CV_BGR2HSV);
-	int indices[] = {2, 0};
-	std::vector<cv::Mat> v(1, tempHSVImage);
-	std::vector<cv::Mat> w(1, tempVImage);
-	cv::mixChannels(&tempHSVImage, 1, &tempVImage, 1, indices, 1);
-	cv::Mat kern = cv::getStructuringElement(CV_SHAPE_ELLIPSE, cv::Size(MORPHOLOGY_KERNEL_RADIUS * 2 + 1, MORPHOLOGY_KERNEL_RADIUS * 2 + 1), cv::Point(MORPHOLOGY_KERNEL_RADIUS, MORPHOLOGY_KERNEL_RADIUS));
-	cv::morphologyEx(tempVImage, tempMorphologyResult, CV_MOP_GRADIENT, kern);
+	bool useBlockMask = !blockMask_.empty() && blockMask_.size() == cv::Size(blocksPerX, blocksPerY);
 	
 	for (int y = 0, i = 0; y < imgSizeY; y += blockSizeY) {
 		for (int x = 0; x < imgSizeX; x += blockSizeX, i++) {
+			
+			if (useBlockMask && !blockMask_.ptr(y / blockSizeY)[x / blockSizeX]) { // блок вне области, за которой следит детектор.
+				continue;
+			}
 	
-			float average = AnCommon::getAverageChanelValueInRect(tempMorphologyResult, x, y, std::min(blockSizeX, imgSizeX - x), std::min(blockSizeY, imgSizeY - y), 0); //текущая контрастность в блоке
+			float average = AnCommon::getAverageChanelValueInRect(contrast, x, y, std::min(blockSizeX, imgSizeX - x), std::min(blockSizeY, imgSizeY - y), 0); //текущая контрастность в блоке
 			std::list<float> &emaBuf = vecSmokeContrastData_[i].emaBuf;
 	
 			uchar& maskItem = result.ptr(y / blockSizeY)[x / blockSizeX];
@@ -170,19 +245,135 @@ cv::Mat SmokeDetectOnContrastAlgorithm::detect(const cv::Mat& img) {
 				}
 			}
 
+			vecSmokeContrastData_[i].lastAverage = average;
 			if (!vecSmokeContrastData_[i].isSmoke) { // если кадр не дымный, то обновляем историю значений.
-				if (emaBuf.size()) {
-					emaBuf.push_back(emaBuf.back() * (1.f - settings_.emaAlpha_) + average * settings_.emaAlpha_);
-				} else {
-					emaBuf.push_back(average);
-				}
-				while (static_cast<int>(emaBuf.size()) > settings_.emaDelay_) {
-					emaBuf.pop_front();
-				}
+				updateHistory(vecSmokeContrastData_[i], average);
 			}
 		}
 	}
-	LOG_TRACE("SmokeDetectOnContrast::detect end"); 
 	
 	return result;
 }
+
+void SmokeDetectOnContrastAlgorithm::updateHistory(SmokeDetectContrastData& data, float average) {
+	std::list<float> &emaBuf = data.emaBuf;
+	if (emaBuf.size()) {
+		emaBuf.push_back(emaBuf.back() * (1.f - settings_.emaAlpha_) + average * settings_.emaAlpha_);
+	} else {
+		emaBuf.push_back(average);
+	}
+	while (static_cast<int>(emaBuf.size()) > settings_.emaDelay_) {
+		emaBuf.pop_front();
+	}
+}
+
+cv::Rect SmokeDetectOnContrastAlgorithm::getWorkRect(const cv::Size& imgSize, const cv::Size& blockSize, const cv::Mat& blockMask) {
+	int left = blockMask.cols, top = blockMask.rows, right = 0, bottom = 0;
+	for (int blockY = 0; blockY < blockMask.rows; blockY++) {
+		for (int blockX = 0; blockX < blockMask.cols; blockX++) {
+			if (blockMask.ptr(blockY)[blockX]) {
+				left = std::min(left, blockX);
+				top = std::min(top, blockY);
+				right = std::max(right, blockX + 1);
+				bottom = std::max(bottom, blockY + 1);
+			}
+		}
+	}
+	if (left >= right) {
+		return cv::Rect();
+	}
+	cv::Rect rect(left * blockSize.width - MORPHOLOGY_KERNEL_RADIUS,
+				  top * blockSize.height - MORPHOLOGY_KERNEL_RADIUS,
+				  (right - left) * blockSize.width + 2 * MORPHOLOGY_KERNEL_RADIUS,
+				  (bottom - top) * blockSize.height + 2 * MORPHOLOGY_KERNEL_RADIUS);
+	return rect & cv::Rect(cv::Point(0, 0), imgSize);
+}
+
+bool SmokeDetectOnContrastAlgorithm::isSkippable() {
+	return true;
+}
+
+void SmokeDetectOnContrastAlgorithm::ageSkippedFrame() {
+	for (size_t i = 0; i < vecSmokeContrastData_.size(); i++) {
+		if (!vecSmokeContrastData_[i].isSmoke && !vecSmokeContrastData_[i].emaBuf.empty()) {
+			updateHistory(vecSmokeContrastData_[i], vecSmokeContrastData_[i].lastAverage);
+		}
+	}
+}
+
+cv::Size SmokeDetectOnContrastAlgorithm::getFrameSize() const {
+	return frameSize_;
+}
+
+std::string SmokeDetectOnContrastAlgorithm::getSnapshotType() {
+	return getType();
+}
+
+u_int32_t SmokeDetectOnContrastAlgorithm::getSnapshotVersion() {
+	return 2;
+}
+
+u_int64_t SmokeDetectOnContrastAlgorithm::getSnapshotFingerprint(const cv::Size& frameSize) {
+	// порог threshold только сравнивается с историей и на неё не влияет
+	return SnapshotFingerprint().add(frameSize).add(blockSize_).add(settings_.emaAlpha_).add(settings_.emaDelay_).get();
+}
+
+bool SmokeDetectOnContrastAlgorithm::hasSnapshotState() {
+	return !vecSmokeContrastData_.empty();
+}
+
+void SmokeDetectOnContrastAlgorithm::saveSnapshot(SnapshotWriter& writer) {
+	writer.write(frameSize_.width);
+	writer.write(frameSize_.height);
+	writer.write(blockSize_.width);
+	writer.write(blockSize_.height);
+	writer.write(static_cast<u_int32_t>(vecSmokeContrastData_.size()));
+	for (size_t i = 0; i < vecSmokeContrastData_.size(); i++) {
+		const SmokeDetectContrastData& data = vecSmokeContrastData_[i];
+		writer.write(static_cast<u_int8_t>(data.isSmoke));
+		writer.write(data.lastAverage);
+		writer.write(static_cast<u_int32_t>(data.emaBuf.size()));
+		for (std::list<float>::const_iterator ema = data.emaBuf.begin(); ema != data.emaBuf.end(); ema++) {
+			writer.write(*ema);
+		}
+	}
+}
+
+void SmokeDetectOnContrastAlgorithm::restoreSnapshot(SnapshotReader& reader) {
+	// состояние меняется только после того, как снимок прочитан целиком
+	cv::Size frameSize;
+	reader.read(frameSize.width);
+	reader.read(frameSize.height);
+	cv::Size blockSize;
+	reader.read(blockSize.width);
+	reader.read(blockSize.height);
+	u_int32_t count;
+	reader.read(count);
+	// количество блоков берётся из снимка, поэтому сверяется с сеткой, заданной размером кадра и блока
+	if (frameSize.width <= 0 || frameSize.height <= 0 || blockSize.width <= 0 || blockSize.height <= 0
+		|| count != static_cast<u_int64_t>((frameSize.width - 1) / blockSize.width + 1) * ((frameSize.height - 1) / blockSize.height + 1)
+	) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": snapshot");
+	}
+	std::vector<SmokeDetectContrastData> blocks(count);
+	for (size_t i = 0; i < blocks.size(); i++) {
+		u_int8_t isSmoke;
+		u_int32_t emaSize;
+		reader.read(isSmoke);
+		reader.read(blocks[i].lastAverage);
+		reader.read(emaSize);
+		if (static_cast<int>(emaSize) > settings_.emaDelay_) {
+			errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": snapshot");
+		}
+		blocks[i].isSmoke = isSmoke != 0;
+		for (u_int32_t j = 0; j < emaSize; j++) {
+			float ema;
+			reader.read(ema);
+			blocks[i].emaBuf.push_back(ema);
+		}
+	}
+	frameSize_ = frameSize;
+	blockSize_ = blockSize;
+	vecSmokeContrastData_.swap(blocks);
+	LOG_DEBUG("SmokeDetectOnContrast: restored history of " << vecSmokeContrastData_.size() << " blocks");
+}
@@ -2,12 +2,14 @@
 #define SmokeDetectOnContrastAlgorithm_h_
 
 #include "SmokeDetectAlgorithm.h"
+#include "Snapshot.h"
 
 /**
  * Класс алгоритма детектирования огня по динамике.
  */
 class SmokeDetectOnContrastAlgorithm 
 	: public SmokeDetectAlgorithm
+	, public Snapshotable
 {
 public:
 	
@@ -82,11 +84,17 @@ public:
 		 */
 		bool isSmoke;
 
+		/**
+		 * Контрастность блока на последнем обработанном кадре.
+		 */
+		float lastAverage;
+
 		/**
 		 * Создаёт пустую историю блока.
 		 */
 		SmokeDetectContrastData()
 			: isSmoke(false)
+			, lastAverage(0.f)
 		{}
 	};
 
@@ -119,6 +127,29 @@ public:
 	 */
 	virtual cv::Mat detect(const cv::Mat& img, const cv::Size &blockSize);
 	
+	/**
+	 * Вычисляет контрастность кадра -- первую, не зависящую от предыдущих кадров, часть detect().
+	 * Состояние алгоритма не меняется, поэтому контрастность разных кадров можно вычислять параллельно;
+	 * размер блоков и маска блоков должны быть установлены заранее.
+	 * 
+	 * @param img текущий кадр.
+	 * @param contrast сюда помещается контрастность (CV_8UC1); вне анализируемых блоков значения не определены.
+	 */
+	void computeContrast(const cv::Mat& img, cv::Mat& contrast) const;
+	
+	/**
+	 * То же, но с явно заданными размером блоков и маской блоков вместо установленных в алгоритме.
+	 */
+	static void computeContrast(const cv::Mat& img, const cv::Size& blockSize, const cv::Mat& blockMask, cv::Mat& contrast);
+	
+	/**
+	 * Вторая часть detect(): обновляет историю блоков по контрастности, вычисленной computeContrast().
+	 * 
+	 * @param contrast контрастность текущего кадра.
+	 * @return результат работы детектора.
+	 */
+	cv::Mat detectOnContrast(const cv::Mat& contrast);
+	
 	/**
 	 * Устанавливает настройки(параметры) алгоритма.
 	 * 
@@ -160,8 +191,95 @@ public:
 	 */
 	virtual void clear();
 	
+	/**
+	 * Алгоритм можно пропускать на неизменившихся кадрах.
+	 */
+	virtual bool isSkippable();
+	
+	/**
+	 * Продвигает историю контрастности недымных блоков, повторяя их последнее значение,
+	 * чтобы задержка @a emaDelay_ по-прежнему отсчитывалась в кадрах.
+	 */
+	virtual void ageSkippedFrame();
+
+	/**
+	 * Возвращает размер кадра, по которому построена статистика блоков.
+	 */
+	cv::Size getFrameSize() const;
+
+	/**
+	 * Сохранение и восстановление состояния алгоритма, см. Snapshotable.
+	 *
+	 * @{
+	 */
+	virtual std::string getSnapshotType();
+
+	virtual u_int32_t getSnapshotVersion();
+
+	virtual u_int64_t getSnapshotFingerprint(const cv::Size& frameSize);
+
+	virtual bool hasSnapshotState();
+
+	virtual void saveSnapshot(SnapshotWriter& writer);
+
+	virtual void restoreSnapshot(SnapshotReader& reader);
+	/**
+	 * @}
+	 */
+	
 private:
 	
+	/**
+	 * Добавляет в историю блока новое значение экспоненциального скользящего среднего.
+	 * 
+	 * @param data история блока.
+	 * @param average текущая контрастность блока.
+	 */
+	void updateHistory(SmokeDetectContrastData& data, float average);
+	
+	/**
+	 * Возвращает прямоугольник, покрывающий все анализируемые блоки вместе с окрестностью морфологического ядра.
+	 * 
+	 * @param imgSize размер кадра.
+	 * @param blockSize размер блоков.
+	 * @param blockMask маска анализируемых блоков.
+	 */
+	static cv::Rect getWorkRect(const cv::Size& imgSize, const cv::Size& blockSize, const cv::Mat& blockMask);
+	
+	/**
+	 * Вычисляет контрастность кадра во временных матрицах заданного размера.
+	 * 
+	 * @param img текущий кадр.
+	 * @param blockSize размер блоков.
+	 * @param blockMask маска анализируемых блоков.
+	 * @param hsv кадр в формате HSV.
+	 * @param v яркость кадра.
+	 * @param contrast результат морфологического преобразования яркости.
+	 */
+	static void computeContrast(const cv::Mat& img, const cv::Size& blockSize, const cv::Mat& blockMask, 
+		cv::Mat& hsv, cv::Mat& v, cv::Mat& contrast);
+	
+	/**
+	 * Вычисляет яркость строк [rowBegin, rowEnd) анализируемой части кадра.
+	 * 
+	 * @param img текущий кадр.
+	 * @param workRect анализируемая часть кадра.
+	 * @param hsv кадр в формате HSV.
+	 * @param v яркость кадра.
+	 */
+	static void computeBrightnessRows(const cv::Mat& img, const cv::Rect& workRect, cv::Mat& hsv, cv::Mat& v, int rowBegin, int rowEnd);
+	
+	/**
+	 * Вычисляет контрастность строк [rowBegin, rowEnd) анализируемой части кадра по яркости, уже вычисленной
+	 * для всей части; результат совпадает с преобразованием всей части сразу.
+	 * 
+	 * @param v яркость кадра.
+	 * @param workRect анализируемая часть кадра.
+	 * @param kern морфологическое ядро.
+	 * @param contrast результат морфологического преобразования яркости.
+	 */
+	static void computeGradientRows(const cv::Mat& v, const cv::Rect& workRect, const cv::Mat& kern, cv::Mat& contrast, int rowBegin, int rowEnd);
+	
 	/**
 	 * Настройки алгоритма.
 	 */
@@ -172,6 +290,11 @@ private:
 	 */
 	std::vector <SmokeDetectContrastData> vecSmokeContrastData_;
 
+	/**
+	 * Размер кадра, по которому построена статистика блоков.
+	 */
+	cv::Size frameSize_;
+
 	/**
 	 *  Представление текущего кадра в формате HSV.
 	 */
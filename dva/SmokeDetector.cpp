@@ -6,57 +6,250 @@
 #include <utils/macros.hpp>
 #include <utils/maputils.hpp>
 #include "AnCommon.h"
+#include "RleMask.h"
 #include "RectMerger.h"
+#include <boost/bind.hpp>
+#include "WorkStealingPool.h"
 
 const std::string SmokeDetector::SMOKE_DETECTOR = "SMOKE_DETECTOR";
 
+SmokeDetector::SmokeDetector()
+	: resultBuilt_(false)
+	, snapshotRestorePending_(false)
+{
+	// история контраста блоков и её снимок привязаны к размеру кадра и сбросились бы при его смене
+	DegradationPolicy::DegradationPolicySettings policy;
+	policy.degradeLast_ = true;
+	policy.minifiable_ = false;
+	degradationPolicy_ = DegradationPolicy(policy);
+}
+
 void SmokeDetector::on() {
 	LOG_INFO("SmokeDetector::on");
 	Detector::on();
+	snapshotRestorePending_ = true;
 }
 
 void SmokeDetector::off() {
 	LOG_INFO("SmokeDetector::off");
+	// история блоков переживает выключение детектора
+	if (smokeDetectOnContrastAlg_.getFrameSize().area() > 0) {
+		snapshotStore_.saveNow(&smokeDetectOnContrastAlg_, smokeDetectOnContrastAlg_.getFrameSize());
+	}
+	snapshotStore_.wait();
 	Detector::off();
 }
 	
 void SmokeDetector::execute(const cv::Mat& image, const boost::posix_time::ptime& imageTime, std::string& resultingXml) {
-	LOG_INFO("SmokeDetector::execute begin");
+	PendingResult pending;
+	detectFrame(image, imageTime, pending, 0);
+	serialize(pending, resultingXml);
+}
+
+void SmokeDetector::executeBatch(const cv::Mat* images, const boost::posix_time::ptime* imageTimes, size_t count, std::vector<std::string>& results) {
+	LOG_TRACE("SmokeDetector::executeBatch begin");
+	
+	for (size_t i = 1; i < count; i++) {
+		if (images[i].size() != images[0].size()) {
+			Detector::executeBatch(images, imageTimes, count, results);
+			return;
+		}
+	}
+	results.resize(count);
+	if (count == 0) {
+		return;
+	}
+	
+	std::vector<cv::Mat> contrasts(count);
+	try {
+		cv::Size blockSize = getBlockSize(images[0].size());
+		roi_.prepare(images[0].size(), blockSize);
+		smokeDetectOnContrastAlg_.setBlockSize(blockSize);
+		smokeDetectOnContrastAlg_.setBlockMask(roi_.getBlockMask());
+		
+		// контрастность не зависит от предыдущих кадров и вычисляется для всего пакета до обновления истории блоков
+		WorkStealingPool::getDefault().parallelFor(0, static_cast<int>(count), 1,
+			boost::bind(&SmokeDetector::computeContrasts, &smokeDetectOnContrastAlg_, images, &contrasts, _1, _2));
+	} catch (...) {
+		// ошибка будет сообщена в результатах кадров при покадровом анализе
+		contrasts.clear();
+	}
+	
+	for (size_t i = 0; i < count; i++) {
+		bool prepared = !contrasts.empty() && !contrasts[i].empty();
+		PendingResult pending;
+		detectFrame(images[i], imageTimes[i], pending, prepared ? &contrasts[i] : 0);
+		serialize(pending, results[i]);
+		if (prepared) {
+			contrasts[i].release();
+		}
+	}
+	
+	LOG_TRACE("SmokeDetector::executeBatch end");
+}
+
+void SmokeDetector::computeContrasts(const SmokeDetectOnContrastAlgorithm* algorithm, const cv::Mat* images, 
+		std::vector<cv::Mat>* contrasts, int begin, int end) {
+	for (int i = begin; i < end; i++) {
+		try {
+			algorithm->computeContrast(images[i], (*contrasts)[i]);
+		} catch (...) {
+			// кадр будет проанализирован целиком, и ошибка попадёт в его результат
+			(*contrasts)[i].release();
+		}
+	}
+}
+
+cv::Mat SmokeDetector::prepare(const cv::Mat& image) {
+	cv::Size blockSize;
+	cv::Mat blockMask;
+	{
+		boost::mutex::scoped_lock lock(preparedMutex_);
+		if (image.size() != preparedFrameSize_) {
+			return cv::Mat();
+		}
+		blockSize = preparedBlockSize_;
+		blockMask = preparedBlockMask_;
+	}
 	
+	cv::Mat contrast;
 	try {
-		std::string dataDetector = detectSmoke(image);
-		resultingXml = "<smokeDetect>" + dataDetector + "</smokeDetect>";
+		SmokeDetectOnContrastAlgorithm::computeContrast(image, blockSize, blockMask, contrast);
+	} catch (...) {
+		// кадр будет проанализирован целиком, и ошибка попадёт в его результат
+		contrast.release();
+	}
+	return contrast;
+}
+
+void SmokeDetector::detectPrepared(const cv::Mat& image, const cv::Mat& prepared, const boost::posix_time::ptime& imageTime, PendingResult& pending) {
+	detectFrame(image, imageTime, pending, prepared.empty() || prepared.size() != image.size() ? 0 : &prepared);
+}
+
+void SmokeDetector::serialize(PendingResult& pending, std::string& resultingXml) {
+	try {
+		if (pending.kind == PendingResult::BUILD) {
+			resultingXml = "<smokeDetect>" + resultStream_.build(pending.objects, pending.mask, pending.blockSize, pending.minObjectArea) + "</smokeDetect>";
+		} else if (pending.kind == PendingResult::BUILD_UNCHANGED) {
+			resultingXml = "<smokeDetect>" + resultStream_.buildUnchanged() + "</smokeDetect>";
+		} else {
+			Detector::serialize(pending, resultingXml);
+		}
 	} catch (std::string &error) {
 		resultingXml = "<smokeDetect><error>" + error + "</error></smokeDetect>";
 	} catch (...) {
 		resultingXml = "<smokeDetect><error> undetifier error </error></smokeDetect>";
 	}
+}
+
+cv::Size SmokeDetector::getBlockSize(const cv::Size& imageSize) {
+	return cv::Size(imageSize.width / settings_.numWidthBlocks_, imageSize.height / settings_.numHeightBlocks_);
+}
+
+void SmokeDetector::detectFrame(const cv::Mat& image, const boost::posix_time::ptime& imageTime, PendingResult& pending, const cv::Mat* contrast) {
+	LOG_TRACE("SmokeDetector::execute begin");
+	
+	pending.kind = PendingResult::NONE;
+	try {
+		if (snapshotRestorePending_) {
+			snapshotRestorePending_ = false;
+			restoreSnapshot(image, imageTime);
+		}
+		
+		// пока результата нет, кадр всё равно анализируется: фильтр не спрашивается, чтобы его опорный кадр
+		// и счётчик пропусков менялись только вместе с действительно пропущенными кадрами
+		if (resultBuilt_ && smokeDetectOnContrastAlg_.isSkippable() && motionGate_.shouldSkip(image)) {
+			smokeDetectOnContrastAlg_.ageSkippedFrame();
+			if (skipSerializationOnlyFrames_) {
+				// исполнитель перегружен: результат кадра лишь повторил бы прежний
+				return;
+			}
+			if (!alertThrottle_.shouldEmit(imageTime, settings_.alertTime_)) {
+				return;
+			}
+			pending.kind = PendingResult::BUILD_UNCHANGED;
+			LOG_INFO("SmokeDetector::execute end (frame skipped)");
+			return;
+		}
+		
+		bool emit = detectSmoke(image, imageTime, pending, contrast);
+		snapshotStore_.save(&smokeDetectOnContrastAlg_, image.size(), imageTime);
+		if (!emit) {
+			// кадр не сообщается: ни результат, ни журнал не формируются
+			pending.kind = PendingResult::NONE;
+			return;
+		}
+		pending.kind = PendingResult::BUILD;
+		resultBuilt_ = true;
+	} catch (std::string &error) {
+		pending.kind = PendingResult::READY;
+		pending.xml = "<smokeDetect><error>" + error + "</error></smokeDetect>";
+	} catch (...) {
+		pending.kind = PendingResult::READY;
+		pending.xml = "<smokeDetect><error> undetifier error </error></smokeDetect>";
+	}
 	
 	LOG_INFO("SmokeDetector::execute end");
 }
 	
+void SmokeDetector::restoreSnapshot(const cv::Mat& image, const boost::posix_time::ptime& imageTime) {
+	if (!snapshotStore_.isEnabled()) {
+		return;
+	}
+	// размер блоков входит в отпечаток снимка
+	smokeDetectOnContrastAlg_.setBlockSize(getBlockSize(image.size()));
+	// восстановление атомарно: при неудаче история блоков не меняется
+	if (snapshotStore_.restore(&smokeDetectOnContrastAlg_, image.size(), imageTime)) {
+		LOG_INFO("Smoke block history restored from snapshot");
+	}
+}
+
 std::string SmokeDetector::getType() {
 	return SMOKE_DETECTOR;
 }
 
-std::string SmokeDetector::detectSmoke(const cv::Mat& image) {
+bool SmokeDetector::detectSmoke(const cv::Mat& image, const boost::posix_time::ptime& imageTime, PendingResult& pending, const cv::Mat* contrast) {
 	BEGIN_FUNCTION
-	LOG_DEBUG("SmokeDetector::detectSmoke begin");
+	LOG_TRACE("SmokeDetector::detectSmoke begin");
 
-	int blockSizeX = image.size().width / settings_.numWidthBlocks_;
-	int blockSizeY = image.size().height / settings_.numHeightBlocks_;
+	cv::Size blockSize = getBlockSize(image.size());
+	int blockSizeX = blockSize.width;
+	int blockSizeY = blockSize.height;
 
 	LOG_DEBUG("detectSmoke detectorOnContrast");
-	cv::Mat mask = smokeDetectOnContrastAlg_.detect(image, cv::Size(blockSizeX, blockSizeY));
+	cv::Mat mask;
+	if (contrast) {
+		// блоки и область анализа подготовлены для всего пакета
+		mask = smokeDetectOnContrastAlg_.detectOnContrast(*contrast);
+	} else {
+		roi_.prepare(image.size(), blockSize);
+		smokeDetectOnContrastAlg_.setBlockMask(roi_.getBlockMask());
+		mask = smokeDetectOnContrastAlg_.detect(image, blockSize);
+		
+		boost::mutex::scoped_lock lock(preparedMutex_);
+		if (preparedFrameSize_ != image.size() || preparedBlockSize_ != blockSize) {
+			preparedFrameSize_ = image.size();
+			preparedBlockSize_ = blockSize;
+			preparedBlockMask_ = roi_.getBlockMask().clone();
+		}
+	}
+
+	// список объектов строится по карте блоков на каждом кадре: по нему решается, появился ли новый очаг;
+	// карта почти всегда пуста, поэтому объекты ищутся по сериям
+	std::list<AnCommon::Object> objects = AnCommon::createObjectList(AnCommon::RleMask(mask));
+	if (!alertThrottle_.shouldEmit(imageTime, objects, settings_.alertTime_)) {
+		return false;
+	}
 
-	LOG_DEBUG("detectSmoke getXMLObjectList");
-	std::string result = 
-		AnCommon::getXMLObjectList(AnCommon::createObjectList(mask, 3.0), cv::Size(blockSizeX, blockSizeY), static_cast<int>(settings_.minSmokeArea_ * image.size().area() / 100)) + 
-		AnCommon::getXMLBitMap(mask, cv::Size(blockSizeX, blockSizeY));
+	// xml формируется в serialize(), возможно после анализа следующего кадра, поэтому карта блоков копируется
+	pending.objects.swap(objects);
+	pending.mask = mask.clone();
+	pending.blockSize = cv::Size(blockSizeX, blockSizeY);
+	pending.minObjectArea = static_cast<int>(settings_.minSmokeArea_ * image.size().area() / 100);
 
 	LOG_DEBUG("SmokeDetector::detectSmoke end");
 
-	return result;
+	return true;
 
 	END_FUNCTION
 }
@@ -93,6 +286,15 @@ void SmokeDetector::setSettings(xml::Request::Params params) {
 			usedSettings.insert(paramName);
 		}
 		
+		snapshotStore_.setSettings(params, smokeDetectOnContrastAlg_.getType(), &smokeDetectOnContrastAlg_, usedSettings);
+		motionGate_.setSettings(params, usedSettings);
+		roi_.setSettings(params, usedSettings);
+		resetPrepared();
+		resultStream_.setSettings(params, usedSettings);
+		resultBuilt_ = false;
+		alertThrottle_.clear();
+		degradationPolicy_.setSettings(params, usedSettings);
+		
 		AnCommon::StrSet usedSettings1;
 		// параметры для детектора отделения объектов от фона
 		smokeDetectOnContrastAlg_.setSettings(params, usedSettings1);
@@ -127,11 +329,31 @@ xml::Request::Params SmokeDetector::getSettings() {
 	set["numHeightBlocks"] = boost::lexical_cast<std::string>(settings_.numHeightBlocks_);
 	set["minSmokeArea"] = boost::lexical_cast<std::string>(settings_.minSmokeArea_);
 
+	snapshotStore_.getSettings(set);
+	motionGate_.getSettings(set);
+	roi_.getSettings(set);
+	resultStream_.getSettings(set);
+	degradationPolicy_.getSettings(set);
+
 	// параметры для детектирования оставленных вещей
 	smokeDetectOnContrastAlg_.getSettings(set);
 	return set;
 }
 	
+void SmokeDetector::resetPrepared() {
+	boost::mutex::scoped_lock lock(preparedMutex_);
+	preparedFrameSize_ = cv::Size();
+	preparedBlockSize_ = cv::Size();
+	preparedBlockMask_.release();
+}
+
 void SmokeDetector::clear() {
+	resetPrepared();
 	smokeDetectOnContrastAlg_.clear();
+	motionGate_.clear();
+	resultStream_.clear();
+	resultBuilt_ = false;
+	alertThrottle_.clear();
+	snapshotStore_.clear();
+	snapshotRestorePending_ = false;
 }
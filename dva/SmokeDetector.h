@@ -4,6 +4,12 @@
 #include "Detector.h"
 #include "SmokeDetectOnContrastAlgorithm.h"
 #include "SmokeDetectSettings.h"
+#include "MotionGate.h"
+#include "RegionOfInterest.h"
+#include "ResultStream.h"
+#include "AlertThrottle.h"
+#include "Snapshot.h"
+#include <boost/thread/mutex.hpp>
 
 /**
  * Класс детектор огня.
@@ -18,6 +24,11 @@ public:
 	 */
 	static const std::string SMOKE_DETECTOR;
 
+	/**
+	 * Создаёт детектор. При перегрузке исполнителя поток детектора дыма по умолчанию деградирует последним.
+	 */
+	SmokeDetector();
+
 	/**
 	 * Включает детектор.
 	 * 
@@ -40,6 +51,34 @@ public:
 	 */
 	virtual void execute(const cv::Mat& image, const boost::posix_time::ptime& imageTime, std::string& resultingXml);
 	
+	/**
+	 * Анализирует пакет кадров. Блоки и область анализа подготавливаются один раз на пакет, а контрастность
+	 * всех кадров вычисляется заранее параллельно; история блоков затем обновляется по кадрам по порядку.
+	 * Пакет кадров разного размера анализируется покадрово.
+	 * 
+	 * @see Detector::executeBatch()
+	 */
+	virtual void executeBatch(const cv::Mat* images, const boost::posix_time::ptime* imageTimes, size_t count, std::vector<std::string>& results);
+	
+	/**
+	 * Вычисляет контрастность кадра, если размер кадра совпадает с размером предыдущего проанализированного кадра.
+	 * 
+	 * @see Detector::prepare()
+	 */
+	virtual cv::Mat prepare(const cv::Mat& image);
+	
+	/**
+	 * @see Detector::detectPrepared()
+	 */
+	virtual void detectPrepared(const cv::Mat& image, const cv::Mat& prepared, const boost::posix_time::ptime& imageTime, PendingResult& pending);
+	
+	/**
+	 * Формирует xml результата потоком результатов (ResultStream).
+	 * 
+	 * @see Detector::serialize()
+	 */
+	virtual void serialize(PendingResult& pending, std::string& resultingXml);
+	
 	/**
 	 * Возвращает тип детектора.
 	 * 
@@ -79,13 +118,105 @@ private:
 	 * Алгоритм детектирования дыма по контрастности.
 	 */
 	SmokeDetectOnContrastAlgorithm smokeDetectOnContrastAlg_;
+	
+	/**
+	 * Область кадра, за которой следит детектор.
+	 */
+	RegionOfInterest roi_;
+	
+	/**
+	 * Фильтр, пропускающий неизменившиеся кадры.
+	 */
+	MotionGate motionGate_;
+	
+	/**
+	 * Поток результатов; на пропущенных кадрах повторяет последний результат.
+	 */
+	ResultStream resultStream_;
+	
+	/**
+	 * Ограничивает частоту сообщений интервалом alertTime_.
+	 */
+	AlertThrottle alertThrottle_;
+
+	/**
+	 * Снимок истории контрастности блоков.
+	 */
+	SnapshotStore snapshotStore_;
+	
+	/**
+	 * После clear() или смены настроек потока результатов уже заказан полный результат (PendingResult::BUILD),
+	 * и повторять его можно через PendingResult::BUILD_UNCHANGED. Хранится отдельно от ResultStream::hasResult():
+	 * сериализация может выполняться позже анализа и в другом потоке.
+	 */
+	bool resultBuilt_;
+	
+	/**
+	 * Детектор включён, но попытки восстановить историю блоков из снимка ещё не было.
+	 * Восстановление откладывается до первого кадра, чтобы был известен размер кадра.
+	 */
+	bool snapshotRestorePending_;
 
+	/**
+	 * Размер кадра, размер блоков и маска блоков, с которыми проанализирован последний кадр без подготовки.
+	 * По ним prepare() вычисляет контрастность, не обращаясь к алгоритму, состояние которого меняется в другом потоке.
+	 * 
+	 * @{
+	 */
+	cv::Size preparedFrameSize_;
+	
+	cv::Size preparedBlockSize_;
+	
+	cv::Mat preparedBlockMask_;
+	/**
+	 * @}
+	 */
+	
+	/**
+	 * Защищает размеры и маску для prepare().
+	 */
+	boost::mutex preparedMutex_;
+	
+	/**
+	 * Сбрасывает размеры и маску для prepare(): следующий кадр анализируется без подготовки.
+	 */
+	void resetPrepared();
+	
 	/**
 	 * Производит все необходимые действия для детектирования дыма.
 	 * 
-	 * @return результат детектирования в определённом формате(формат описан в соответствующей статье wiki).
+	 * @param image текущий кадр.
+	 * @param imageTime время отправления кадра.
+	 * @param pending объекты и битовая карта для результата, заполняются только если результат нужно сообщить.
+	 * @return true - результат кадра нужно сообщить, false - кадр не сообщается (см. alertTime_).
+	 */
+	bool detectSmoke(const cv::Mat& image, const boost::posix_time::ptime& imageTime, PendingResult& pending, const cv::Mat* contrast);
+	
+	/**
+	 * Восстанавливает историю блоков из снимка, если он задан и снят с кадров того же размера и с теми же настройками.
+	 * 
+	 * @param image первый кадр после включения детектора.
+	 * @param imageTime время отправления кадра.
+	 */
+	void restoreSnapshot(const cv::Mat& image, const boost::posix_time::ptime& imageTime);
+	
+	/**
+	 * Анализирует кадр, см. detectPrepared().
+	 * 
+	 * @param contrast контрастность кадра, вычисленная заранее для пакета или prepare(), или 0.
+	 */
+	void detectFrame(const cv::Mat& image, const boost::posix_time::ptime& imageTime, PendingResult& pending, const cv::Mat* contrast);
+	
+	/**
+	 * Возвращает размер блоков для кадра заданного размера.
+	 */
+	cv::Size getBlockSize(const cv::Size& imageSize);
+	
+	/**
+	 * Вычисляет контрастность кадров пакета с номерами [begin, end).
 	 */
-	std::string detectSmoke(const cv::Mat& image);
+	static void computeContrasts(const SmokeDetectOnContrastAlgorithm* algorithm, const cv::Mat* images, 
+		std::vector<cv::Mat>* contrasts, int begin, int end);
 	
 };
 
@@ -0,0 +1,451 @@
+#include "Snapshot.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/bind.hpp>
+#include <logging/logging.hpp>
+#include "Errors.h"
+#include "System.h"
+#include <utils/maputils.hpp>
+
+namespace {
+
+/**
+ * Версия формата файла снимка.
+ */
+const u_int32_t FORMAT_VERSION = 1;
+
+/**
+ * Сигнатура файла снимка.
+ */
+const char MAGIC[4] = { 'D', 'V', 'A', 'S' };
+
+/**
+ * Параметры хеша FNV-1a.
+ *
+ * @{
+ */
+const u_int64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const u_int64_t FNV_PRIME = 1099511628211ULL;
+/**
+ * @}
+ */
+
+/**
+ * Ошибка повреждённого снимка.
+ */
+const std::string SNAPSHOT_ERROR = errors::ERR_11_INCORRECT_PARAMETER + ": snapshot";
+
+} // namespace
+
+SnapshotFingerprint::SnapshotFingerprint()
+	: hash_(FNV_OFFSET_BASIS)
+{}
+
+SnapshotFingerprint& SnapshotFingerprint::add(const void* data, size_t size) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash_ = (hash_ ^ bytes[i]) * FNV_PRIME;
+	}
+	return *this;
+}
+
+SnapshotFingerprint& SnapshotFingerprint::add(const std::string& value) {
+	// длина отделяет соседние строки друг от друга
+	add(static_cast<int>(value.size()));
+	return add(value.data(), value.size());
+}
+
+SnapshotFingerprint& SnapshotFingerprint::add(int value) {
+	return add(&value, sizeof(value));
+}
+
+SnapshotFingerprint& SnapshotFingerprint::add(double value) {
+	return add(&value, sizeof(value));
+}
+
+SnapshotFingerprint& SnapshotFingerprint::add(const cv::Size& value) {
+	return add(value.width).add(value.height);
+}
+
+SnapshotFingerprint& SnapshotFingerprint::add(const xml::Request::Params& settings) {
+	for (xml::Request::Params::const_iterator i = settings.begin(); i != settings.end(); i++) {
+		add(i->first).add(i->second);
+	}
+	return *this;
+}
+
+u_int64_t SnapshotFingerprint::get() const {
+	return hash_;
+}
+
+const size_t SnapshotWriter::ALIGNMENT = 16;
+
+SnapshotWriter::SnapshotWriter(const std::string& modelType, u_int32_t modelVersion, u_int64_t fingerprint) {
+	SnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(header.magic));
+	header.formatVersion = FORMAT_VERSION;
+	strncpy(header.modelType, modelType.c_str(), sizeof(header.modelType) - 1);
+	header.modelVersion = modelVersion;
+	header.fingerprint = fingerprint;
+	write(header);
+}
+
+void SnapshotWriter::write(const void* data, size_t size) {
+	const char* bytes = static_cast<const char*>(data);
+	buffer_.insert(buffer_.end(), bytes, bytes + size);
+}
+
+void SnapshotWriter::writeMat(const cv::Mat& mat) {
+	int rows = mat.rows;
+	int cols = mat.cols;
+	int type = mat.type();
+	write(rows);
+	write(cols);
+	write(type);
+	align();
+	size_t rowSize = cols * mat.elemSize();
+	for (int y = 0; y < rows; y++) {
+		write(mat.ptr(y), rowSize);
+	}
+	align();
+}
+
+void SnapshotWriter::align() {
+	buffer_.resize((buffer_.size() + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT, 0);
+}
+
+void SnapshotWriter::release(std::vector<char>& buffer) {
+	SnapshotHeader* header = reinterpret_cast<SnapshotHeader*>(&buffer_[0]);
+	header->payloadSize = buffer_.size() - sizeof(SnapshotHeader);
+	buffer.swap(buffer_);
+	buffer_.clear();
+}
+
+SnapshotReader::SnapshotReader()
+	: data_(0)
+	, size_(0)
+	, position_(0)
+	, mapping_(0)
+{}
+
+SnapshotReader::~SnapshotReader() {
+	close();
+}
+
+bool SnapshotReader::open(const std::string& path, const std::string& modelType, u_int32_t modelVersion, u_int64_t fingerprint) {
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		LOG_INFO("Snapshot " << path << " is not available");
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) < 0 || info.st_size < static_cast<off_t>(sizeof(SnapshotHeader))) {
+		::close(fd);
+		errors::throwException(SNAPSHOT_ERROR);
+	}
+	void* mapping = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED) {
+		errors::throwException(SNAPSHOT_ERROR);
+	}
+
+	mapping_ = mapping;
+	data_ = static_cast<const char*>(mapping);
+	size_ = info.st_size;
+	if (!validate(modelType, modelVersion, fingerprint)) {
+		close();
+		return false;
+	}
+	LOG_INFO("Snapshot " << path << " mapped, " << size_ << " bytes");
+	return true;
+}
+
+bool SnapshotReader::assign(const char* data, size_t size, const std::string& modelType, u_int32_t modelVersion, u_int64_t fingerprint) {
+	close();
+	if (size < sizeof(SnapshotHeader)) {
+		errors::throwException(SNAPSHOT_ERROR);
+	}
+	data_ = data;
+	size_ = size;
+	if (!validate(modelType, modelVersion, fingerprint)) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool SnapshotReader::validate(const std::string& modelType, u_int32_t modelVersion, u_int64_t fingerprint) {
+	SnapshotHeader header;
+	memcpy(&header, data_, sizeof(header));
+	if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.payloadSize != size_ - sizeof(header)) {
+		errors::throwException(SNAPSHOT_ERROR);
+	}
+	header.modelType[sizeof(header.modelType) - 1] = 0;
+	if (header.formatVersion != FORMAT_VERSION || modelType != header.modelType || header.modelVersion != modelVersion) {
+		LOG_INFO("Snapshot of " << header.modelType << " v" << header.modelVersion << " (format " << header.formatVersion 
+			<< ") does not match " << modelType << " v" << modelVersion);
+		return false;
+	}
+	if (header.fingerprint != fingerprint) {
+		LOG_INFO("Snapshot of " << modelType << " was taken with different settings or frame size");
+		return false;
+	}
+	position_ = sizeof(header);
+	return true;
+}
+
+void SnapshotReader::read(void* data, size_t size) {
+	if (size > size_ - position_) {
+		errors::throwException(SNAPSHOT_ERROR);
+	}
+	memcpy(data, data_ + position_, size);
+	position_ += size;
+}
+
+cv::Mat SnapshotReader::readMat() {
+	int rows, cols, type;
+	read(rows);
+	read(cols);
+	read(type);
+	align();
+	if (rows < 0 || cols < 0 || type != CV_MAT_TYPE(type)) {
+		errors::throwException(SNAPSHOT_ERROR);
+	}
+	if (rows == 0 || cols == 0) {
+		return cv::Mat();
+	}
+	size_t dataSize = static_cast<size_t>(rows) * cols * CV_ELEM_SIZE(type);
+	if (dataSize > size_ - position_) {
+		errors::throwException(SNAPSHOT_ERROR);
+	}
+	cv::Mat result(rows, cols, type, const_cast<char*>(data_ + position_));
+	position_ += dataSize;
+	align();
+	return result;
+}
+
+void SnapshotReader::align() {
+	position_ = std::min(size_, (position_ + SnapshotWriter::ALIGNMENT - 1) / SnapshotWriter::ALIGNMENT * SnapshotWriter::ALIGNMENT);
+}
+
+bool SnapshotReader::isEnd() const {
+	return position_ == size_;
+}
+
+void SnapshotReader::close() {
+	if (mapping_) {
+		munmap(mapping_, size_);
+		mapping_ = 0;
+	}
+	data_ = 0;
+	size_ = 0;
+	position_ = 0;
+}
+
+void Snapshotable::serialize(const cv::Size& frameSize, std::vector<char>& snapshot) {
+	SnapshotWriter writer(getSnapshotType(), getSnapshotVersion(), getSnapshotFingerprint(frameSize));
+	saveSnapshot(writer);
+	writer.release(snapshot);
+}
+
+bool Snapshotable::deserialize(const cv::Size& frameSize, const std::vector<char>& snapshot) {
+	if (snapshot.empty()) {
+		return false;
+	}
+	SnapshotReader reader;
+	if (!reader.assign(&snapshot[0], snapshot.size(), getSnapshotType(), getSnapshotVersion(), getSnapshotFingerprint(frameSize))) {
+		return false;
+	}
+	restoreSnapshot(reader);
+	return true;
+}
+
+SnapshotFileSaver::SnapshotFileSaver()
+	: busy_(false)
+{}
+
+SnapshotFileSaver::~SnapshotFileSaver() {
+	wait();
+}
+
+bool SnapshotFileSaver::isBusy() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return busy_;
+}
+
+bool SnapshotFileSaver::saveAsync(const std::string& path, std::vector<char>& snapshot) {
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		if (busy_) {
+			return false;
+		}
+		busy_ = true;
+	}
+	// предыдущий поток уже закончил работу, join() не ждёт
+	if (thread_) {
+		thread_->join();
+	}
+	path_ = path;
+	snapshot_.swap(snapshot);
+	snapshot.clear();
+	thread_.reset(new boost::thread(boost::bind(&SnapshotFileSaver::run, this)));
+	return true;
+}
+
+void SnapshotFileSaver::save(const std::string& path, const std::vector<char>& snapshot) {
+	std::string tempPath = path + ".tmp";
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if (!file) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": snapshotPath");
+	}
+	bool written = fwrite(&snapshot[0], 1, snapshot.size(), file) == snapshot.size() && fflush(file) == 0 && fsync(fileno(file)) == 0;
+	written = fclose(file) == 0 && written;
+	if (!written || rename(tempPath.c_str(), path.c_str()) != 0) {
+		unlink(tempPath.c_str());
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": snapshotPath");
+	}
+}
+
+void SnapshotFileSaver::wait() {
+	if (thread_) {
+		thread_->join();
+		thread_.reset();
+	}
+}
+
+void SnapshotFileSaver::run() {
+	try {
+		save(path_, snapshot_);
+		LOG_DEBUG("Snapshot " << path_ << " saved, " << snapshot_.size() << " bytes");
+	} catch (std::string& error) {
+		LOG_ERROR("Snapshot " << path_ << " was not saved: " << error);
+	} catch (...) {
+		LOG_ERROR("Snapshot " << path_ << " was not saved");
+	}
+	std::vector<char>().swap(snapshot_);
+	boost::mutex::scoped_lock lock(mutex_);
+	busy_ = false;
+}
+
+const std::string SnapshotStore::SnapshotStoreSettings::PATH = "";
+const int SnapshotStore::SnapshotStoreSettings::INTERVAL = 600;
+
+SnapshotStore::SnapshotStoreSettings::SnapshotStoreSettings()
+	: path_(PATH)
+	, interval_(INTERVAL)
+{}
+
+SnapshotStore::SnapshotStore()
+	: lastSnapshotTime_(boost::posix_time::not_a_date_time)
+{}
+
+bool SnapshotStore::isEnabled() const {
+	return !settings_.path_.empty();
+}
+
+bool SnapshotStore::restore(Snapshotable* model, const cv::Size& frameSize, const boost::posix_time::ptime& time) {
+	if (!model || !isEnabled()) {
+		return false;
+	}
+	try {
+		SnapshotReader reader;
+		if (!reader.open(settings_.path_, model->getSnapshotType(), model->getSnapshotVersion(), model->getSnapshotFingerprint(frameSize))) {
+			return false;
+		}
+		model->restoreSnapshot(reader);
+		lastSnapshotTime_ = time;
+		return true;
+	} catch (std::string& error) {
+		LOG_WARN("Snapshot " << settings_.path_ << " was not restored: " << error);
+	} catch (...) {
+		LOG_WARN("Snapshot " << settings_.path_ << " was not restored");
+	}
+	return false;
+}
+
+void SnapshotStore::save(Snapshotable* model, const cv::Size& frameSize, const boost::posix_time::ptime& time) {
+	if (!model || !isEnabled() || saver_.isBusy()) {
+		return;
+	}
+	if (lastSnapshotTime_.is_special()) {
+		// первый снимок -- через интервал после начала работы модели
+		lastSnapshotTime_ = time;
+		return;
+	}
+	if (!time.is_special() && time >= lastSnapshotTime_ && time - lastSnapshotTime_ < boost::posix_time::seconds(settings_.interval_)) {
+		return;
+	}
+	write(model, frameSize, time);
+}
+
+void SnapshotStore::saveNow(Snapshotable* model, const cv::Size& frameSize) {
+	if (!model || !isEnabled()) {
+		return;
+	}
+	// периодический снимок может ещё писаться, окончательный снимок не должен из-за этого пропасть
+	saver_.wait();
+	write(model, frameSize, boost::posix_time::microsec_clock::local_time());
+	saver_.wait();
+}
+
+void SnapshotStore::write(Snapshotable* model, const cv::Size& frameSize, const boost::posix_time::ptime& time) {
+	if (!model->hasSnapshotState()) {
+		return;
+	}
+	// в потоке обработки модель только копируется в буфер, запись на диск идёт в отдельном потоке
+	std::vector<char> snapshot;
+	model->serialize(frameSize, snapshot);
+	saver_.saveAsync(settings_.path_, snapshot);
+	lastSnapshotTime_ = time;
+}
+
+void SnapshotStore::wait() {
+	saver_.wait();
+}
+
+void SnapshotStore::setSettings(const xml::Request::Params &settings, const std::string& modelType, Snapshotable* model, AnCommon::StrSet &usedSettings) {
+	try {
+
+		std::string lexCastError = errors::ERR_05_SETTINGS_CAN_NOT_BE_APPLIED_INCORRECT_PARAMETER;
+		std::string error = errors::ERR_06_SETTINGS_CAN_NOT_BE_APPLIED_PARAMETER_NOT_FOUND;
+
+		{
+			std::string paramName = "snapshotPath";
+			if (settings.count(paramName)) {
+				settings_.path_ = MapUtils::value(settings, paramName, error + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "snapshotInterval";
+			if (settings.count(paramName)) {
+				settings_.interval_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+
+	} catch (std::string& err) {
+		errors::throwException(err);
+	} catch (...) {
+		errors::throwException(errors::ERR_04_SETTINGS_CAN_NOT_BE_APPLIED);
+	}
+	if (isEnabled() && !model) {
+		LOG_WARN("snapshotPath is ignored: " << modelType << " does not support snapshots");
+	}
+}
+
+void SnapshotStore::getSettings(xml::Request::Params &settings) {
+	settings["snapshotPath"] = settings_.path_;
+	settings["snapshotInterval"] = boost::lexical_cast<std::string>(settings_.interval_);
+}
+
+void SnapshotStore::clear() {
+	lastSnapshotTime_ = boost::posix_time::not_a_date_time;
+}
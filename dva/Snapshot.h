@@ -0,0 +1,563 @@
+#ifndef Snapshot_h_
+#define Snapshot_h_
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+#include <opencv/cxcore.hpp>
+#include <networking/ExchangeTypes.hpp>
+#include "AnCommon.h"
+
+/**
+ * Снимок состояния модели -- компактный двоичный формат для сохранения и восстановления обученных моделей.
+ *
+ * Файл состоит из заголовка фиксированного размера и данных модели. Заголовок содержит сигнатуру,
+ * версию формата, тип и версию модели, отпечаток её настроек и размер данных. Матрицы выравниваются
+ * на SnapshotWriter::ALIGNMENT байт, поэтому при чтении отображённого в память файла они используются без копирования.
+ * Порядок байт -- порядок байт машины, записавшей снимок.
+ */
+struct SnapshotHeader {
+
+	/**
+	 * Сигнатура "DVAS".
+	 */
+	char magic[4];
+
+	/**
+	 * Версия формата файла.
+	 */
+	u_int32_t formatVersion;
+
+	/**
+	 * Тип модели, строка дополнена нулями.
+	 */
+	char modelType[32];
+
+	/**
+	 * Версия раскладки данных модели.
+	 */
+	u_int32_t modelVersion;
+
+	/**
+	 * Не используется, равно нулю.
+	 */
+	u_int32_t reserved;
+
+	/**
+	 * Отпечаток настроек и размера кадра, при которых снята модель.
+	 */
+	u_int64_t fingerprint;
+
+	/**
+	 * Размер данных модели после заголовка в байтах.
+	 */
+	u_int64_t payloadSize;
+
+};
+
+/**
+ * Отпечаток (FNV-1a, 64 бита) настроек модели и размера кадра. Снимок восстанавливается только при совпадении отпечатков.
+ */
+class SnapshotFingerprint {
+
+public:
+
+	/**
+	 * Создаёт отпечаток пустой последовательности.
+	 */
+	SnapshotFingerprint();
+
+	/**
+	 * Добавляет в отпечаток произвольные байты.
+	 */
+	SnapshotFingerprint& add(const void* data, size_t size);
+
+	/**
+	 * Добавляет в отпечаток значение соответствующего типа.
+	 *
+	 * @{
+	 */
+	SnapshotFingerprint& add(const std::string& value);
+
+	SnapshotFingerprint& add(int value);
+
+	SnapshotFingerprint& add(double value);
+
+	SnapshotFingerprint& add(const cv::Size& value);
+	/**
+	 * @}
+	 */
+
+	/**
+	 * Добавляет в отпечаток все пары имя-значение настроек.
+	 */
+	SnapshotFingerprint& add(const xml::Request::Params& settings);
+
+	/**
+	 * Возвращает значение отпечатка.
+	 */
+	u_int64_t get() const;
+
+private:
+
+	/**
+	 * Текущее значение хеша.
+	 */
+	u_int64_t hash_;
+
+};
+
+/**
+ * Формирует снимок в памяти.
+ */
+class SnapshotWriter {
+
+public:
+
+	/**
+	 * Выравнивание матриц внутри снимка в байтах.
+	 */
+	static const size_t ALIGNMENT;
+
+	/**
+	 * Начинает снимок модели.
+	 *
+	 * @param modelType тип модели (не длиннее 31 символа).
+	 * @param modelVersion версия раскладки данных модели.
+	 * @param fingerprint отпечаток настроек, см. SnapshotFingerprint.
+	 */
+	SnapshotWriter(const std::string& modelType, u_int32_t modelVersion, u_int64_t fingerprint);
+
+	/**
+	 * Дописывает байты в снимок.
+	 */
+	void write(const void* data, size_t size);
+
+	/**
+	 * Дописывает значение простого типа.
+	 */
+	template <class T>
+	void write(const T& value) {
+		write(&value, sizeof(T));
+	}
+
+	/**
+	 * Дописывает размеры, тип и элементы матрицы; элементы выравниваются на ALIGNMENT байт.
+	 */
+	void writeMat(const cv::Mat& mat);
+
+	/**
+	 * Дописывает нули до границы ALIGNMENT байт.
+	 */
+	void align();
+
+	/**
+	 * Возвращает снимок (заголовок и данные) и передаёт владение буфером вызывающему.
+	 *
+	 * @param buffer сюда помещается снимок, прежнее содержимое теряется.
+	 */
+	void release(std::vector<char>& buffer);
+
+private:
+
+	/**
+	 * Заголовок и данные снимка.
+	 */
+	std::vector<char> buffer_;
+
+};
+
+/**
+ * Читает снимок из памяти или из отображённого в память файла.
+ */
+class SnapshotReader
+	: boost::noncopyable
+{
+
+public:
+
+	/**
+	 * Создаёт пустой объект.
+	 */
+	SnapshotReader();
+
+	/**
+	 * Освобождает отображение файла.
+	 */
+	~SnapshotReader();
+
+	/**
+	 * Отображает файл снимка в память и проверяет заголовок.
+	 *
+	 * @return false, если файла нет или он снят с другой модели, версии или настроек.
+	 * @throw std::string если файл повреждён.
+	 */
+	bool open(const std::string& path, const std::string& modelType, u_int32_t modelVersion, u_int64_t fingerprint);
+
+	/**
+	 * Читает снимок из буфера без копирования, буфер должен жить дольше объекта.
+	 *
+	 * @return false, если снимок снят с другой модели, версии или настроек.
+	 * @throw std::string если снимок повреждён.
+	 */
+	bool assign(const char* data, size_t size, const std::string& modelType, u_int32_t modelVersion, u_int64_t fingerprint);
+
+	/**
+	 * Читает очередные байты снимка.
+	 *
+	 * @throw std::string при выходе за конец данных.
+	 */
+	void read(void* data, size_t size);
+
+	/**
+	 * Читает значение простого типа.
+	 */
+	template <class T>
+	void read(T& value) {
+		read(&value, sizeof(T));
+	}
+
+	/**
+	 * Читает матрицу, записанную SnapshotWriter::writeMat().
+	 *
+	 * @return заголовок, ссылающийся на данные снимка; действителен, пока жив объект и не вызван close().
+	 * @throw std::string при выходе за конец данных.
+	 */
+	cv::Mat readMat();
+
+	/**
+	 * Пропускает байты до границы SnapshotWriter::ALIGNMENT.
+	 */
+	void align();
+
+	/**
+	 * Показывает, что данные прочитаны полностью.
+	 */
+	bool isEnd() const;
+
+	/**
+	 * Освобождает отображение файла.
+	 */
+	void close();
+
+private:
+
+	/**
+	 * Начало снимка (заголовка).
+	 */
+	const char* data_;
+
+	/**
+	 * Размер снимка с заголовком.
+	 */
+	size_t size_;
+
+	/**
+	 * Позиция чтения от начала снимка.
+	 */
+	size_t position_;
+
+	/**
+	 * Отображение файла, 0 если снимок читается из буфера.
+	 */
+	void* mapping_;
+
+	/**
+	 * Проверяет заголовок снимка.
+	 */
+	bool validate(const std::string& modelType, u_int32_t modelVersion, u_int64_t fingerprint);
+
+};
+
+/**
+ * Модель, состояние которой можно сохранить в снимок и восстановить из него.
+ *
+ * Реализуется алгоритмами наряду с их основным интерфейсом; детекторы сохраняют и восстанавливают модели
+ * через SnapshotStore.
+ */
+class Snapshotable {
+
+public:
+
+	virtual ~Snapshotable() {}
+
+	/**
+	 * Тип модели, записываемый в заголовок снимка.
+	 */
+	virtual std::string getSnapshotType() = 0;
+
+	/**
+	 * Версия раскладки данных снимка, увеличивается при каждом несовместимом изменении.
+	 */
+	virtual u_int32_t getSnapshotVersion() = 0;
+
+	/**
+	 * Отпечаток настроек, от которых зависит состояние модели, и размера кадра.
+	 *
+	 * @param frameSize размер обрабатываемых кадров.
+	 */
+	virtual u_int64_t getSnapshotFingerprint(const cv::Size& frameSize) = 0;
+
+	/**
+	 * Показывает, что модель обучена и её есть смысл сохранять.
+	 */
+	virtual bool hasSnapshotState() = 0;
+
+	/**
+	 * Записывает состояние модели.
+	 */
+	virtual void saveSnapshot(SnapshotWriter& writer) = 0;
+
+	/**
+	 * Восстанавливает состояние модели; данные читателя можно использовать только во время вызова.
+	 *
+	 * @throw std::string если данные не соответствуют модели.
+	 */
+	virtual void restoreSnapshot(SnapshotReader& reader) = 0;
+
+	/**
+	 * Сохраняет состояние модели в снимок в памяти.
+	 *
+	 * @param frameSize размер обрабатываемых кадров.
+	 * @param snapshot сюда помещается снимок.
+	 */
+	void serialize(const cv::Size& frameSize, std::vector<char>& snapshot);
+
+	/**
+	 * Восстанавливает состояние модели из снимка в памяти.
+	 *
+	 * @param frameSize размер обрабатываемых кадров.
+	 * @param snapshot снимок, сохранённый serialize().
+	 * @return false, если снимок снят с другой модели, версии, настроек или размера кадра; состояние модели не меняется.
+	 * @throw std::string если снимок повреждён.
+	 */
+	bool deserialize(const cv::Size& frameSize, const std::vector<char>& snapshot);
+
+};
+
+/**
+ * Записывает снимки в файл в отдельном потоке, чтобы запись на диск не задерживала обработку кадров.
+ *
+ * Одновременно пишется не больше одного снимка. Файл заменяется атомарно: снимок пишется во временный файл,
+ * который затем переименовывается.
+ */
+class SnapshotFileSaver
+	: boost::noncopyable
+{
+
+public:
+
+	/**
+	 * Создаёт объект без активной записи.
+	 */
+	SnapshotFileSaver();
+
+	/**
+	 * Дожидается окончания записи.
+	 */
+	~SnapshotFileSaver();
+
+	/**
+	 * Показывает, что предыдущий снимок ещё записывается.
+	 */
+	bool isBusy();
+
+	/**
+	 * Начинает запись снимка, если предыдущая запись закончена.
+	 *
+	 * @param path путь к файлу.
+	 * @param snapshot снимок; при успехе буфер забирается, иначе остаётся нетронутым.
+	 * @return false, если предыдущий снимок ещё записывается.
+	 */
+	bool saveAsync(const std::string& path, std::vector<char>& snapshot);
+
+	/**
+	 * Записывает снимок в файл в текущем потоке.
+	 *
+	 * @throw std::string при ошибке записи.
+	 */
+	static void save(const std::string& path, const std::vector<char>& snapshot);
+
+	/**
+	 * Дожидается окончания записи.
+	 */
+	void wait();
+
+private:
+
+	/**
+	 * Поток записи.
+	 */
+	boost::shared_ptr<boost::thread> thread_;
+
+	/**
+	 * Защищает @a busy_.
+	 */
+	boost::mutex mutex_;
+
+	/**
+	 * Идёт запись.
+	 */
+	bool busy_;
+
+	/**
+	 * Путь и снимок, которые пишет поток.
+	 *
+	 * @{
+	 */
+	std::string path_;
+
+	std::vector<char> snapshot_;
+	/**
+	 * @}
+	 */
+
+	/**
+	 * Тело потока записи.
+	 */
+	void run();
+
+};
+
+/**
+ * Хранилище снимка модели детектора: восстанавливает модель при включении детектора, периодически
+ * сохраняет её и сохраняет окончательно при выключении.
+ *
+ * Одно место, через которое детекторы работают со снимками своих моделей (Snapshotable); путь и интервал
+ * снимков -- настройки хранилища, а не модели, и переживают выключение детектора.
+ */
+class SnapshotStore
+	: boost::noncopyable
+{
+
+public:
+
+	/**
+	 * Класс настроек(параметров) хранилища снимка.
+	 */
+	class SnapshotStoreSettings {
+
+	public:
+
+		/**
+		 * Значения по умолчанию соответствующих полей.
+		 *
+		 * @{
+		 */
+		static const std::string PATH;
+		static const int INTERVAL;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Файл снимка; пустая строка -- снимки не сохраняются и не восстанавливаются.
+		 */
+		std::string path_;
+
+		/**
+		 * Интервал периодического сохранения снимка (сек).
+		 */
+		int interval_;
+
+		/**
+		 * Создаёт объект класса с параметрами по умолчанию.
+		 */
+		SnapshotStoreSettings();
+
+	};
+
+	/**
+	 * Создаёт хранилище с настройками по умолчанию (снимки выключены).
+	 */
+	SnapshotStore();
+
+	/**
+	 * Показывает, задан ли файл снимка.
+	 */
+	bool isEnabled() const;
+
+	/**
+	 * Восстанавливает модель из снимка.
+	 *
+	 * @param model модель; 0, если модель не поддерживает снимки.
+	 * @param frameSize размер обрабатываемых кадров.
+	 * @param time время текущего кадра, от него отсчитывается следующий периодический снимок.
+	 * @return true - модель восстановлена; при false модель могла восстановиться частично и должна быть сброшена.
+	 */
+	bool restore(Snapshotable* model, const cv::Size& frameSize, const boost::posix_time::ptime& time);
+
+	/**
+	 * Отдаёт снимок модели на запись, если с предыдущего снимка прошло не меньше интервала.
+	 * Первый снимок делается через интервал после первого вызова.
+	 *
+	 * @param model модель; 0, если модель не поддерживает снимки.
+	 * @param frameSize размер обрабатываемых кадров.
+	 * @param time время текущего кадра.
+	 */
+	void save(Snapshotable* model, const cv::Size& frameSize, const boost::posix_time::ptime& time);
+
+	/**
+	 * Дожидается записи предыдущего снимка, записывает снимок модели и дожидается окончания записи.
+	 *
+	 * @param model модель; 0, если модель не поддерживает снимки.
+	 * @param frameSize размер обрабатываемых кадров.
+	 */
+	void saveNow(Snapshotable* model, const cv::Size& frameSize);
+
+	/**
+	 * Дожидается окончания записи снимка.
+	 */
+	void wait();
+
+	/**
+	 * Устанавливает настройки(параметры) хранилища. Все параметры необязательны.
+	 *
+	 * @param settings параметры(настройки) детектора.
+	 * @param modelType тип модели детектора, для предупреждения, если модель не поддерживает снимки.
+	 * @param model модель детектора; 0, если модель не поддерживает снимки.
+	 * @param usedSettings множество используемых настроек.
+	 */
+	void setSettings(const xml::Request::Params &settings, const std::string& modelType, Snapshotable* model, AnCommon::StrSet &usedSettings);
+
+	/**
+	 * Возвращает настройки(параметры) хранилища.
+	 *
+	 * @param settings параметры(настройки) детектора.
+	 */
+	void getSettings(xml::Request::Params &settings);
+
+	/**
+	 * Забывает время последнего снимка, настройки сохраняются.
+	 */
+	void clear();
+
+private:
+
+	/**
+	 * Настройки хранилища.
+	 */
+	SnapshotStoreSettings settings_;
+
+	/**
+	 * Запись снимков в файл.
+	 */
+	SnapshotFileSaver saver_;
+
+	/**
+	 * Время кадра, на котором модель последний раз отдана на запись или восстановлена.
+	 */
+	boost::posix_time::ptime lastSnapshotTime_;
+
+	/**
+	 * Снимает модель и отдаёт снимок на запись.
+	 */
+	void write(Snapshotable* model, const cv::Size& frameSize, const boost::posix_time::ptime& time);
+
+};
+
+#endif // Snapshot_h_
@@ -0,0 +1,182 @@
+#include "StreamPipeline.h"
+#include <boost/bind.hpp>
+#include <logging/logging.hpp>
+#include "AnCommon.h"
+
+const int StreamPipeline::StreamPipelineSettings::QUEUE_SIZE = 2;
+
+StreamPipeline::StreamPipelineSettings::StreamPipelineSettings()
+	: queueSize_(QUEUE_SIZE)
+{}
+
+StreamPipeline::StreamPipeline(Detector::SharedPtr detector, const Detector::ResultCallback& callback, const StreamPipelineSettings& settings)
+	: detector_(detector)
+	, callback_(callback)
+	, settings_(settings)
+	, framesInFlight_(0)
+	, rejectedFrames_(0)
+	, stopping_(false)
+	, decodeDone_(false)
+	, detectDone_(false)
+{
+	threads_.create_thread(boost::bind(&StreamPipeline::runDecode, this));
+	threads_.create_thread(boost::bind(&StreamPipeline::runDetect, this));
+	threads_.create_thread(boost::bind(&StreamPipeline::runDeliver, this));
+}
+
+StreamPipeline::~StreamPipeline() {
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		stopping_ = true;
+	}
+	changed_.notify_all();
+	threads_.join_all();
+}
+
+bool StreamPipeline::submit(std::vector<char>& encodedImage, const boost::posix_time::ptime& imageTime) {
+	Frame frame;
+	frame.result.imageTime = imageTime;
+	frame.encodedImage.swap(encodedImage);
+	if (!enqueue(frame)) {
+		frame.encodedImage.swap(encodedImage);
+		return false;
+	}
+	return true;
+}
+
+bool StreamPipeline::submit(const cv::Mat& image, const boost::posix_time::ptime& imageTime) {
+	Frame frame;
+	frame.result.imageTime = imageTime;
+	image.copyTo(frame.image);
+	return enqueue(frame);
+}
+
+bool StreamPipeline::enqueue(Frame& frame) {
+	boost::mutex::scoped_lock lock(mutex_);
+	if (static_cast<int>(decodeQueue_.size()) >= settings_.queueSize_) {
+		rejectedFrames_++;
+		return false;
+	}
+	decodeQueue_.push_back(Frame());
+	std::swap(decodeQueue_.back(), frame);
+	framesInFlight_++;
+	changed_.notify_all();
+	return true;
+}
+
+void StreamPipeline::wait() {
+	boost::mutex::scoped_lock lock(mutex_);
+	while (framesInFlight_ > 0) {
+		changed_.wait(lock);
+	}
+}
+
+int StreamPipeline::getRejectedFrames() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return rejectedFrames_;
+}
+
+bool StreamPipeline::take(Queue& queue, Queue* next, const bool& upstreamDone, Frame& frame) {
+	boost::mutex::scoped_lock lock(mutex_);
+	// кадр забирается, только когда следующему этапу есть куда его положить, чтобы этапы не копили кадры сверх очередей
+	while ((queue.empty() || (next && static_cast<int>(next->size()) >= settings_.queueSize_)) && !(upstreamDone && queue.empty())) {
+		changed_.wait(lock);
+	}
+	if (queue.empty()) {
+		return false;
+	}
+	std::swap(frame, queue.front());
+	queue.pop_front();
+	changed_.notify_all();
+	return true;
+}
+
+void StreamPipeline::finish(bool& done) {
+	boost::mutex::scoped_lock lock(mutex_);
+	done = true;
+	changed_.notify_all();
+}
+
+void StreamPipeline::put(Queue& queue, Frame& frame) {
+	boost::mutex::scoped_lock lock(mutex_);
+	queue.push_back(Frame());
+	std::swap(queue.back(), frame);
+	changed_.notify_all();
+}
+
+void StreamPipeline::runDecode() {
+	Frame frame;
+	while (take(decodeQueue_, &detectQueue_, stopping_, frame)) {
+		try {
+			if (frame.image.empty()) {
+				frame.image = AnCommon::decodeImage(frame.encodedImage);
+				std::vector<char>().swap(frame.encodedImage);
+			}
+			frame.prepared = detector_->prepare(frame.image);
+		} catch (std::string& error) {
+			frame.result.failed = true;
+			frame.result.error = error;
+		} catch (...) {
+			frame.result.failed = true;
+			frame.result.error = "unknown error";
+		}
+		put(detectQueue_, frame);
+		frame = Frame();
+	}
+	finish(decodeDone_);
+}
+
+void StreamPipeline::runDetect() {
+	Frame frame;
+	while (take(detectQueue_, &deliverQueue_, decodeDone_, frame)) {
+		if (!frame.result.failed) {
+			try {
+				detector_->detectPrepared(frame.image, frame.prepared, frame.result.imageTime, frame.pending);
+			} catch (std::string& error) {
+				frame.result.failed = true;
+				frame.result.error = error;
+			} catch (...) {
+				frame.result.failed = true;
+				frame.result.error = "unknown error";
+			}
+		}
+		// кадр больше не нужен, память освобождается до выдачи результата
+		frame.image.release();
+		frame.prepared.release();
+		put(deliverQueue_, frame);
+		frame = Frame();
+	}
+	finish(detectDone_);
+}
+
+void StreamPipeline::runDeliver() {
+	Frame frame;
+	while (take(deliverQueue_, 0, detectDone_, frame)) {
+		if (!frame.result.failed) {
+			try {
+				detector_->serialize(frame.pending, frame.result.resultingXml);
+			} catch (std::string& error) {
+				frame.result.failed = true;
+				frame.result.error = error;
+			} catch (...) {
+				frame.result.failed = true;
+				frame.result.error = "unknown error";
+			}
+		}
+		if (frame.result.failed) {
+			LOG_ERROR("StreamPipeline: " << detector_->getType() << " failed: " << frame.result.error);
+		}
+		if (callback_) {
+			try {
+				callback_(frame.result);
+			} catch (...) {
+				LOG_ERROR("StreamPipeline: result callback of " << detector_->getType() << " failed");
+			}
+		}
+		frame = Frame();
+
+		boost::mutex::scoped_lock lock(mutex_);
+		framesInFlight_--;
+		changed_.notify_all();
+	}
+}
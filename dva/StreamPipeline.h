@@ -0,0 +1,239 @@
+#ifndef StreamPipeline_h_
+#define StreamPipeline_h_
+
+#include <deque>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+#include "Detector.h"
+
+/**
+ * Конвейерный анализ кадров одной камеры.
+ *
+ * Кадр проходит три этапа, каждый в своём потоке: декодирование и подготовка (Detector::prepare()), анализ детектором
+ * (Detector::detectPrepared()) и сериализация результата в xml (Detector::serialize()) с выдачей обработчику
+ * (например, отправкой по сети). Пока детектор анализирует кадр N, кадр N+1 уже декодируется и подготавливается,
+ * а результат кадра N-1 сериализуется и выдаётся, поэтому пропускная способность одной камеры ограничена самым
+ * медленным этапом, а не их суммой. Порядок кадров и результатов сохраняется.
+ */
+class StreamPipeline
+	: boost::noncopyable
+{
+
+public:
+
+	/**
+	 * Класс настроек конвейера.
+	 */
+	class StreamPipelineSettings {
+
+	public:
+
+		/**
+		 * Значения по умолчанию соответствующих полей.
+		 *
+		 * @{
+		 */
+		static const int QUEUE_SIZE;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Наибольшее количество кадров, ожидающих каждого этапа. Если заполнена очередь декодирования, кадр отвергается;
+		 * если заполнена очередь следующего этапа, этап ждёт.
+		 */
+		int queueSize_;
+
+		/**
+		 * Создаёт объект класса с параметрами по умолчанию.
+		 */
+		StreamPipelineSettings();
+
+	};
+
+	/**
+	 * Запускает потоки этапов.
+	 *
+	 * @param detector детектор камеры; его setSettings(), on() и off() вызываются только после wait().
+	 * @param callback обработчик результатов, вызывается в потоке выдачи в порядке поступления кадров.
+	 * @param settings настройки конвейера.
+	 */
+	StreamPipeline(Detector::SharedPtr detector, const Detector::ResultCallback& callback,
+		const StreamPipelineSettings& settings = StreamPipelineSettings());
+
+	/**
+	 * Дожидается обработки поступивших кадров и останавливает потоки.
+	 */
+	~StreamPipeline();
+
+	/**
+	 * Принимает сжатый кадр, декодируется он в потоке конвейера (AnCommon::decodeImage()).
+	 *
+	 * @param encodedImage сжатый кадр; при успехе содержимое забирается, и вектор становится пустым.
+	 * @param imageTime время отправления кадра.
+	 * @return false, если очередь заполнена; кадр отброшен, обработчик не вызывается.
+	 */
+	bool submit(std::vector<char>& encodedImage, const boost::posix_time::ptime& imageTime);
+
+	/**
+	 * Принимает декодированный кадр, кадр копируется.
+	 *
+	 * @return false, если очередь заполнена; кадр отброшен, обработчик не вызывается.
+	 */
+	bool submit(const cv::Mat& image, const boost::posix_time::ptime& imageTime);
+
+	/**
+	 * Дожидается выдачи результатов всех принятых кадров. Нельзя вызывать из обработчика результатов.
+	 */
+	void wait();
+
+	/**
+	 * Количество отвергнутых кадров.
+	 */
+	int getRejectedFrames();
+
+private:
+
+	/**
+	 * Кадр на конвейере.
+	 */
+	struct Frame {
+
+		std::vector<char> encodedImage;
+
+		cv::Mat image;
+
+		/**
+		 * Результат Detector::prepare().
+		 */
+		cv::Mat prepared;
+
+		/**
+		 * Результат Detector::detectPrepared(), сериализуется на этапе выдачи.
+		 */
+		Detector::PendingResult pending;
+
+		Detector::Result result;
+
+	};
+
+	/**
+	 * Очередь перед этапом.
+	 */
+	typedef std::deque<Frame> Queue;
+
+	/**
+	 * Детектор камеры.
+	 */
+	Detector::SharedPtr detector_;
+
+	/**
+	 * Обработчик результатов.
+	 */
+	Detector::ResultCallback callback_;
+
+	/**
+	 * Настройки конвейера.
+	 */
+	StreamPipelineSettings settings_;
+
+	/**
+	 * Очереди перед этапами декодирования, анализа и выдачи.
+	 *
+	 * @{
+	 */
+	Queue decodeQueue_;
+
+	Queue detectQueue_;
+
+	Queue deliverQueue_;
+	/**
+	 * @}
+	 */
+
+	/**
+	 * Количество принятых, но ещё не выданных кадров.
+	 */
+	int framesInFlight_;
+
+	/**
+	 * Количество отвергнутых кадров.
+	 */
+	int rejectedFrames_;
+
+	/**
+	 * Потоки должны закончить очереди и завершиться.
+	 */
+	bool stopping_;
+
+	/**
+	 * Потоки декодирования и анализа завершились; следующий этап завершается, опустошив свою очередь.
+	 *
+	 * @{
+	 */
+	bool decodeDone_;
+
+	bool detectDone_;
+	/**
+	 * @}
+	 */
+
+	/**
+	 * Защищает очереди и счётчики.
+	 */
+	boost::mutex mutex_;
+
+	/**
+	 * Сигнализирует о любом изменении очередей.
+	 */
+	boost::condition_variable changed_;
+
+	/**
+	 * Потоки этапов.
+	 */
+	boost::thread_group threads_;
+
+	/**
+	 * Ставит кадр в очередь декодирования.
+	 */
+	bool enqueue(Frame& frame);
+
+	/**
+	 * Забирает кадр из очереди этапа, дождавшись его появления и места в очереди следующего этапа.
+	 *
+	 * @param queue очередь этапа.
+	 * @param next очередь следующего этапа, 0 для последнего.
+	 * @param upstreamDone признак того, что в очередь больше ничего не поступит.
+	 * @param frame сюда помещается кадр.
+	 * @return false, если в очередь больше ничего не поступит и она пуста.
+	 */
+	bool take(Queue& queue, Queue* next, const bool& upstreamDone, Frame& frame);
+
+	/**
+	 * Отмечает завершение этапа.
+	 */
+	void finish(bool& done);
+
+	/**
+	 * Передаёт кадр в очередь следующего этапа.
+	 */
+	void put(Queue& queue, Frame& frame);
+
+	/**
+	 * Тела потоков этапов.
+	 *
+	 * @{
+	 */
+	void runDecode();
+
+	void runDetect();
+
+	void runDeliver();
+	/**
+	 * @}
+	 */
+
+};
+
+#endif // StreamPipeline_h_
@@ -0,0 +1,661 @@
+#include "StreamRecording.h"
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/highgui/highgui_c.h>
+#include <boost/bind.hpp>
+#include <logging/logging.hpp>
+#include "Errors.h"
+
+namespace {
+
+/**
+ * Версия формата файла записи: 2 -- добавлены записи StreamRecord::GAP. Файлы версии 1 читаются.
+ */
+const u_int32_t FORMAT_VERSION = 2;
+
+/**
+ * Сигнатуры файла записи и его индекса.
+ *
+ * @{
+ */
+const char MAGIC[4] = { 'D', 'V', 'A', 'R' };
+const char INDEX_MAGIC[4] = { 'D', 'V', 'A', 'I' };
+/**
+ * @}
+ */
+
+/**
+ * Ошибка повреждённой записи.
+ */
+const std::string RECORDING_ERROR = errors::ERR_11_INCORRECT_PARAMETER + ": recording";
+
+/**
+ * Наибольший размер данных записи: заголовок записи не проверен, и без ограничения повреждённый размер
+ * приводил бы к выделению памяти по произвольному числу. Сжатый кадр 8K (7680x4320, BGRA) заведомо меньше.
+ */
+const u_int64_t MAX_RECORD_SIZE = 256 * 1024 * 1024;
+
+/**
+ * Начало отсчёта времени записей.
+ */
+const boost::posix_time::ptime EPOCH(boost::gregorian::date(1970, 1, 1));
+
+int64_t toMicroseconds(const boost::posix_time::ptime& time) {
+	return time.is_special() ? 0 : (time - EPOCH).total_microseconds();
+}
+
+boost::posix_time::ptime fromMicroseconds(int64_t time) {
+	return EPOCH + boost::posix_time::microseconds(time);
+}
+
+void appendString(std::vector<char>& buffer, const std::string& value) {
+	u_int32_t size = static_cast<u_int32_t>(value.size());
+	const char* sizeBytes = reinterpret_cast<const char*>(&size);
+	buffer.insert(buffer.end(), sizeBytes, sizeBytes + sizeof(size));
+	buffer.insert(buffer.end(), value.begin(), value.end());
+}
+
+bool takeString(const std::vector<uchar>& buffer, size_t& position, std::string& value) {
+	u_int32_t size;
+	if (position + sizeof(size) > buffer.size()) {
+		return false;
+	}
+	memcpy(&size, &buffer[position], sizeof(size));
+	position += sizeof(size);
+	if (position + size > buffer.size()) {
+		return false;
+	}
+	value.assign(reinterpret_cast<const char*>(&buffer[0]) + position, size);
+	position += size;
+	return true;
+}
+
+bool isKnownKind(u_int32_t kind) {
+	return kind == StreamRecord::FRAME || kind == StreamRecord::SETTINGS || kind == StreamRecord::GAP;
+}
+
+} // namespace
+
+StreamRecord::StreamRecord()
+	: kind(FRAME)
+	, droppedFrames(0)
+{}
+
+const std::string StreamRecorder::StreamRecorderSettings::ENCODING = ".png";
+const int StreamRecorder::StreamRecorderSettings::QUALITY = -1;
+const int StreamRecorder::StreamRecorderSettings::MAX_QUEUED_FRAMES = 50;
+const int StreamRecorder::StreamRecorderSettings::ENCODER_THREADS = 2;
+
+StreamRecorder::StreamRecorderSettings::StreamRecorderSettings()
+	: encoding_(ENCODING)
+	, quality_(QUALITY)
+	, maxQueuedFrames_(MAX_QUEUED_FRAMES)
+	, encoderThreads_(ENCODER_THREADS)
+{}
+
+StreamRecorder::QueuedRecord::QueuedRecord()
+	: state(READY)
+{}
+
+StreamRecorder::StreamRecorder(const StreamRecorderSettings& settings)
+	: settings_(settings)
+	, file_(0)
+	, queuedFrames_(0)
+	, droppedFrames_(0)
+	, gapFrames_(0)
+	, closing_(false)
+{}
+
+StreamRecorder::~StreamRecorder() {
+	close();
+}
+
+void StreamRecorder::open(const std::string& path, const std::string& detectorType) {
+	close();
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": " + path);
+	}
+
+	{
+		// записи, поставленные до запуска потока, дождутся его в очереди: в файл пишет только поток записи
+		boost::mutex::scoped_lock lock(mutex_);
+		file_ = file;
+		path_ = path;
+		index_.clear();
+		queue_.clear();
+		queuedFrames_ = 0;
+		droppedFrames_ = 0;
+		gapFrames_ = 0;
+		lastTime_ = boost::posix_time::ptime();
+		closing_ = false;
+	}
+
+	StreamRecordingHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(header.magic));
+	header.formatVersion = FORMAT_VERSION;
+	strncpy(header.detectorType, detectorType.c_str(), sizeof(header.detectorType) - 1);
+	try {
+		write(&header, sizeof(header));
+	} catch (std::string&) {
+		boost::mutex::scoped_lock lock(mutex_);
+		fclose(file_);
+		file_ = 0;
+		throw;
+	}
+
+	thread_.reset(new boost::thread(boost::bind(&StreamRecorder::run, this)));
+	for (int i = 0; i < std::max(1, settings_.encoderThreads_); i++) {
+		encoders_.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&StreamRecorder::runEncoder, this))));
+	}
+	LOG_INFO("Recording " << detectorType << " input to " << path);
+}
+
+bool StreamRecorder::isOpen() const {
+	boost::mutex::scoped_lock lock(mutex_);
+	return file_ != 0;
+}
+
+bool StreamRecorder::recordFrame(const cv::Mat& image, const boost::posix_time::ptime& imageTime) {
+	boost::mutex::scoped_lock lock(mutex_);
+	if (!file_ || closing_) {
+		return false;
+	}
+
+	lastTime_ = imageTime;
+	if (queuedFrames_ >= settings_.maxQueuedFrames_) {
+		if (gapFrames_ == 0) {
+			gapTime_ = imageTime;
+		}
+		gapFrames_++;
+		droppedFrames_++;
+		return false;
+	}
+	queueGap();
+	queue_.push_back(QueuedRecord());
+	QueuedRecord& queued = queue_.back();
+	queued.state = QueuedRecord::WAITING;
+	queued.record.kind = StreamRecord::FRAME;
+	queued.record.time = imageTime;
+	image.copyTo(queued.record.image);
+	queuedFrames_++;
+	queueChanged_.notify_one();
+	return true;
+}
+
+void StreamRecorder::recordSettings(const xml::Request::Params& settings) {
+	boost::mutex::scoped_lock lock(mutex_);
+	if (!file_ || closing_) {
+		return;
+	}
+
+	queueGap();
+	queue_.push_back(QueuedRecord());
+	StreamRecord& record = queue_.back().record;
+	record.kind = StreamRecord::SETTINGS;
+	record.time = lastTime_;
+	record.settings = settings;
+	recordReady_.notify_one();
+}
+
+void StreamRecorder::queueGap() {
+	if (gapFrames_ == 0) {
+		return;
+	}
+	queue_.push_back(QueuedRecord());
+	StreamRecord& record = queue_.back().record;
+	record.kind = StreamRecord::GAP;
+	record.time = gapTime_;
+	record.droppedFrames = gapFrames_;
+	gapFrames_ = 0;
+	recordReady_.notify_one();
+}
+
+void StreamRecorder::close() {
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		if (!file_ || closing_) {
+			return;
+		}
+		// кадры, отброшенные в конце записи, тоже отмечаются
+		queueGap();
+		closing_ = true;
+	}
+	queueChanged_.notify_all();
+	recordReady_.notify_all();
+	for (size_t i = 0; i < encoders_.size(); i++) {
+		encoders_[i]->join();
+	}
+	encoders_.clear();
+	thread_->join();
+	thread_.reset();
+
+	try {
+		StreamRecordingTrailer trailer;
+		memset(&trailer, 0, sizeof(trailer));
+		trailer.indexOffset = ftello(file_);
+		trailer.entryCount = index_.size();
+		memcpy(trailer.magic, INDEX_MAGIC, sizeof(trailer.magic));
+		if (!index_.empty()) {
+			write(&index_[0], index_.size() * sizeof(StreamIndexEntry));
+		}
+		write(&trailer, sizeof(trailer));
+	} catch (std::string& error) {
+		LOG_ERROR("Recording " << path_ << " index is not written: " << error);
+	}
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		fclose(file_);
+		file_ = 0;
+	}
+
+	LOG_INFO("Recording " << path_ << " closed, " << index_.size() << " records, " << droppedFrames_ << " frames dropped");
+}
+
+int StreamRecorder::getDroppedFrames() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return droppedFrames_;
+}
+
+void StreamRecorder::run() {
+	bool failed = false;
+	for (;;) {
+		QueuedRecord queued;
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			while ((queue_.empty() && !closing_) || (!queue_.empty() && queue_.front().state != QueuedRecord::READY)) {
+				recordReady_.wait(lock);
+			}
+			if (queue_.empty()) {
+				break;
+			}
+			std::swap(queued, queue_.front());
+			queue_.pop_front();
+			if (queued.record.kind == StreamRecord::FRAME) {
+				queuedFrames_--;
+			}
+		}
+
+		// после ошибки записи очередь только опустошается, чтобы не блокировать детектор
+		if (!failed) {
+			try {
+				write(queued);
+			} catch (std::string& error) {
+				LOG_ERROR("Recording " << path_ << " stopped: " << error);
+				failed = true;
+			} catch (...) {
+				LOG_ERROR("Recording " << path_ << " stopped");
+				failed = true;
+			}
+		}
+	}
+}
+
+void StreamRecorder::runEncoder() {
+	for (;;) {
+		QueuedRecord* queued = 0;
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			for (;;) {
+				for (std::deque<QueuedRecord>::iterator i = queue_.begin(); i != queue_.end(); i++) {
+					if (i->state == QueuedRecord::WAITING) {
+						queued = &*i;
+						break;
+					}
+				}
+				if (queued || closing_) {
+					break;
+				}
+				queueChanged_.wait(lock);
+			}
+			if (!queued) {
+				break;
+			}
+			queued->state = QueuedRecord::ENCODING;
+		}
+
+		// запись не покидает очередь, пока она не READY, поэтому сжимается без мьютекса
+		std::string error;
+		try {
+			encode(*queued);
+		} catch (std::string& e) {
+			error = e;
+		} catch (...) {
+			error = "unknown error";
+		}
+
+		boost::mutex::scoped_lock lock(mutex_);
+		queued->record.image.release();
+		queued->error = error;
+		queued->state = QueuedRecord::READY;
+		recordReady_.notify_one();
+	}
+}
+
+void StreamRecorder::encode(QueuedRecord& queued) {
+	std::vector<int> params;
+	if (settings_.encoding_ == ".png") {
+		// сжатие png по умолчанию медленнее реального времени на кадрах высокого разрешения
+		params.push_back(CV_IMWRITE_PNG_COMPRESSION);
+		params.push_back(settings_.quality_ >= 0 ? settings_.quality_ : 1);
+	} else if (settings_.quality_ >= 0 && (settings_.encoding_ == ".jpg" || settings_.encoding_ == ".jpeg")) {
+		params.push_back(CV_IMWRITE_JPEG_QUALITY);
+		params.push_back(settings_.quality_);
+	}
+	if (!cv::imencode(settings_.encoding_, queued.record.image, queued.encoded, params)) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": " + settings_.encoding_);
+	}
+}
+
+void StreamRecorder::write(const QueuedRecord& queued) {
+	const StreamRecord& record = queued.record;
+	std::vector<char> data;
+	const void* payload;
+	size_t size;
+
+	if (record.kind == StreamRecord::FRAME) {
+		if (!queued.error.empty()) {
+			errors::throwException(queued.error);
+		}
+		payload = queued.encoded.empty() ? 0 : &queued.encoded[0];
+		size = queued.encoded.size();
+	} else if (record.kind == StreamRecord::GAP) {
+		u_int32_t count = static_cast<u_int32_t>(record.droppedFrames);
+		const char* countBytes = reinterpret_cast<const char*>(&count);
+		data.insert(data.end(), countBytes, countBytes + sizeof(count));
+		payload = &data[0];
+		size = data.size();
+	} else {
+		u_int32_t count = static_cast<u_int32_t>(record.settings.size());
+		const char* countBytes = reinterpret_cast<const char*>(&count);
+		data.insert(data.end(), countBytes, countBytes + sizeof(count));
+		for (xml::Request::Params::const_iterator i = record.settings.begin(); i != record.settings.end(); i++) {
+			appendString(data, i->first);
+			appendString(data, i->second);
+		}
+		payload = &data[0];
+		size = data.size();
+	}
+
+	StreamRecordHeader header;
+	memset(&header, 0, sizeof(header));
+	header.kind = record.kind;
+	header.time = toMicroseconds(record.time);
+	header.size = size;
+
+	StreamIndexEntry entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.offset = ftello(file_);
+	entry.time = header.time;
+	entry.kind = header.kind;
+
+	write(&header, sizeof(header));
+	write(payload, size);
+	index_.push_back(entry);
+}
+
+void StreamRecorder::write(const void* data, size_t size) {
+	if (size != 0 && fwrite(data, 1, size, file_) != size) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": " + path_);
+	}
+}
+
+StreamReader::StreamReader(const std::string& path)
+	: file_(fopen(path.c_str(), "rb"))
+	, position_(0)
+	, fileSize_(0)
+{
+	if (!file_) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": " + path);
+	}
+
+	struct stat info;
+	StreamRecordingHeader header;
+	if (fstat(fileno(file_), &info) < 0 || fread(&header, sizeof(header), 1, file_) != 1
+			|| memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+		fclose(file_);
+		errors::throwException(RECORDING_ERROR);
+	}
+	if (header.formatVersion == 0 || header.formatVersion > FORMAT_VERSION) {
+		fclose(file_);
+		errors::throwException(RECORDING_ERROR + " format version");
+	}
+	header.detectorType[sizeof(header.detectorType) - 1] = 0;
+	detectorType_ = header.detectorType;
+	fileSize_ = info.st_size;
+
+	if (!readIndex(info.st_size)) {
+		LOG_WARN("Recording " << path << " was not closed, index is rebuilt");
+		rebuildIndex(info.st_size);
+	}
+	LOG_INFO("Recording " << path << " of " << detectorType_ << ": " << index_.size() << " records");
+}
+
+StreamReader::~StreamReader() {
+	fclose(file_);
+}
+
+bool StreamReader::readIndex(off_t fileSize) {
+	StreamRecordingTrailer trailer;
+	if (fileSize < static_cast<off_t>(sizeof(StreamRecordingHeader) + sizeof(trailer))
+			|| fseeko(file_, fileSize - sizeof(trailer), SEEK_SET) != 0
+			|| fread(&trailer, sizeof(trailer), 1, file_) != 1
+			|| memcmp(trailer.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0
+			|| trailer.indexOffset + trailer.entryCount * sizeof(StreamIndexEntry) + sizeof(trailer) != static_cast<u_int64_t>(fileSize)) {
+		return false;
+	}
+
+	index_.resize(trailer.entryCount);
+	if (!index_.empty() && (fseeko(file_, trailer.indexOffset, SEEK_SET) != 0
+			|| fread(&index_[0], sizeof(StreamIndexEntry), index_.size(), file_) != index_.size())) {
+		index_.clear();
+		return false;
+	}
+	return true;
+}
+
+void StreamReader::rebuildIndex(off_t fileSize) {
+	index_.clear();
+	u_int64_t offset = sizeof(StreamRecordingHeader);
+	StreamRecordHeader header;
+	while (fseeko(file_, offset, SEEK_SET) == 0 && fread(&header, sizeof(header), 1, file_) == 1) {
+		if (header.size > MAX_RECORD_SIZE) {
+			break;
+		}
+		u_int64_t end = offset + sizeof(header) + header.size;
+		if (end > static_cast<u_int64_t>(fileSize) || !isKnownKind(header.kind)) {
+			break;
+		}
+		StreamIndexEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.offset = offset;
+		entry.time = header.time;
+		entry.kind = header.kind;
+		index_.push_back(entry);
+		offset = end;
+	}
+}
+
+const std::string& StreamReader::getDetectorType() const {
+	return detectorType_;
+}
+
+size_t StreamReader::getRecordCount() const {
+	return index_.size();
+}
+
+size_t StreamReader::getFrameCount() const {
+	size_t count = 0;
+	for (size_t i = 0; i < index_.size(); i++) {
+		count += index_[i].kind == StreamRecord::FRAME;
+	}
+	return count;
+}
+
+void StreamReader::readRecord(size_t index, StreamRecord& record) {
+	if (index >= index_.size()) {
+		errors::throwException(RECORDING_ERROR);
+	}
+	const StreamIndexEntry& entry = index_[index];
+	StreamRecordHeader header;
+	if (fseeko(file_, entry.offset, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, file_) != 1 || header.kind != entry.kind) {
+		errors::throwException(RECORDING_ERROR);
+	}
+	// данные записи должны умещаться в файле до его конца; размер сравнивается с остатком, чтобы сумма не переполнилась
+	u_int64_t dataOffset = entry.offset + sizeof(header);
+	if (header.size > MAX_RECORD_SIZE || dataOffset > static_cast<u_int64_t>(fileSize_)
+			|| header.size > static_cast<u_int64_t>(fileSize_) - dataOffset) {
+		errors::throwException(RECORDING_ERROR + " record size");
+	}
+	buffer_.resize(header.size);
+	if (!buffer_.empty() && fread(&buffer_[0], 1, buffer_.size(), file_) != buffer_.size()) {
+		errors::throwException(RECORDING_ERROR);
+	}
+	position_ = index + 1;
+
+	record.kind = static_cast<StreamRecord::Kind>(header.kind);
+	record.time = fromMicroseconds(header.time);
+	record.settings.clear();
+	record.droppedFrames = 0;
+	if (record.kind == StreamRecord::FRAME) {
+		record.image = cv::imdecode(buffer_, CV_LOAD_IMAGE_UNCHANGED);
+		if (record.image.empty()) {
+			errors::throwException(errors::ERR_00_UNABLE_TO_DECODE_IMAGE);
+		}
+	} else if (record.kind == StreamRecord::GAP) {
+		record.image.release();
+		u_int32_t count;
+		if (buffer_.size() != sizeof(count)) {
+			errors::throwException(RECORDING_ERROR);
+		}
+		memcpy(&count, &buffer_[0], sizeof(count));
+		record.droppedFrames = static_cast<int>(count);
+	} else {
+		record.image.release();
+		u_int32_t count;
+		if (buffer_.size() < sizeof(count)) {
+			errors::throwException(RECORDING_ERROR);
+		}
+		memcpy(&count, &buffer_[0], sizeof(count));
+		size_t position = sizeof(count);
+		for (u_int32_t i = 0; i < count; i++) {
+			std::string name;
+			std::string value;
+			if (!takeString(buffer_, position, name) || !takeString(buffer_, position, value)) {
+				errors::throwException(RECORDING_ERROR);
+			}
+			record.settings[name] = value;
+		}
+	}
+}
+
+bool StreamReader::readRecord(StreamRecord& record) {
+	if (position_ >= index_.size()) {
+		return false;
+	}
+	readRecord(position_, record);
+	return true;
+}
+
+bool StreamReader::read(cv::Mat& frame) {
+	while (position_ < index_.size() && index_[position_].kind != StreamRecord::FRAME) {
+		position_++;
+	}
+	StreamRecord record;
+	if (!readRecord(record)) {
+		return false;
+	}
+	frame = record.image;
+	return true;
+}
+
+void StreamReader::seek(size_t index) {
+	position_ = std::min(index, index_.size());
+}
+
+StreamReplayer::Report::Report()
+	: frames(0)
+	, settingsChanges(0)
+	, results(0)
+	, totalExecuteTime(0, 0, 0)
+	, maxExecuteTime(0, 0, 0)
+	, slowestFrame(-1)
+	, lateFrames(0)
+	, gaps(0)
+	, droppedFrames(0)
+{}
+
+StreamReplayer::StreamReplayer(StreamReader& reader)
+	: reader_(reader)
+{}
+
+StreamReplayer::Report StreamReplayer::replay(Detector& detector, Pace pace, std::vector<std::string>* results) {
+	using boost::posix_time::ptime;
+	using boost::posix_time::microsec_clock;
+
+	Report report;
+	if (!detector.state()) {
+		detector.on();
+	}
+
+	ptime replayStart;
+	ptime streamStart;
+	StreamRecord record;
+	std::string resultingXml;
+	reader_.seek(0);
+	while (reader_.readRecord(record)) {
+		if (record.kind == StreamRecord::SETTINGS) {
+			detector.setSettings(record.settings);
+			report.settingsChanges++;
+			continue;
+		}
+		if (record.kind == StreamRecord::GAP) {
+			// кадры пропуска не записаны: детектор увидит скачок imageTime, как и при записи
+			LOG_WARN("Recording gap: " << record.droppedFrames << " frames dropped before frame " << report.frames);
+			report.gaps++;
+			report.droppedFrames += record.droppedFrames;
+			continue;
+		}
+
+		if (pace == ORIGINAL_PACE) {
+			ptime now = microsec_clock::universal_time();
+			if (report.frames == 0) {
+				replayStart = now;
+				streamStart = record.time;
+			}
+			ptime due = replayStart + (record.time - streamStart);
+			if (now < due) {
+				boost::this_thread::sleep(due);
+			} else if (report.frames != 0 && now > due) {
+				report.lateFrames++;
+			}
+		}
+
+		resultingXml.clear();
+		ptime executeStart = microsec_clock::universal_time();
+		detector.execute(record.image, record.time, resultingXml);
+		boost::posix_time::time_duration executeTime = microsec_clock::universal_time() - executeStart;
+
+		report.totalExecuteTime += executeTime;
+		if (report.slowestFrame < 0 || executeTime > report.maxExecuteTime) {
+			report.maxExecuteTime = executeTime;
+			report.slowestFrame = report.frames;
+		}
+		if (!resultingXml.empty()) {
+			report.results++;
+			if (results) {
+				results->push_back(resultingXml);
+			}
+		}
+		report.frames++;
+	}
+
+	LOG_INFO("Replayed " << report.frames << " frames into " << detector.getType() << ": " << report.totalExecuteTime.total_milliseconds()
+		<< " ms in execute, slowest frame " << report.slowestFrame << " (" << report.maxExecuteTime.total_microseconds() << " us), "
+		<< report.lateFrames << " late, " << report.droppedFrames << " frames missing in " << report.gaps << " gaps");
+	return report;
+}
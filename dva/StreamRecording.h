@@ -0,0 +1,651 @@
+#ifndef StreamRecording_h_
+#define StreamRecording_h_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdio>
+#include <sys/types.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+#include <boost/date_time.hpp>
+#include <opencv2/core/core.hpp>
+#include <networking/ExchangeTypes.hpp>
+#include "Detector.h"
+#include "FrameSource.h"
+
+/**
+ * Запись входного потока детектора -- файл для воспроизведения кадров и изменений настроек в исходном порядке.
+ *
+ * Файл состоит из заголовка StreamRecordingHeader, записей (StreamRecordHeader и данные) и индекса записей
+ * с завершающим StreamRecordingTrailer. Кадры хранятся сжатыми cv::imencode(), настройки -- парами строк,
+ * пропуски (кадры, отброшенные при записи) -- количеством отброшенных кадров.
+ * Индекс дописывается при закрытии; если запись прервана, индекс восстанавливается просмотром записей.
+ * Порядок байт -- порядок байт машины, сделавшей запись.
+ */
+struct StreamRecordingHeader {
+
+	/**
+	 * Сигнатура "DVAR".
+	 */
+	char magic[4];
+
+	/**
+	 * Версия формата файла.
+	 */
+	u_int32_t formatVersion;
+
+	/**
+	 * Тип записанного детектора, строка дополнена нулями.
+	 */
+	char detectorType[32];
+
+};
+
+/**
+ * Заголовок записи.
+ */
+struct StreamRecordHeader {
+
+	/**
+	 * Вид записи, см. StreamRecord::Kind.
+	 */
+	u_int32_t kind;
+
+	/**
+	 * Не используется, равно нулю.
+	 */
+	u_int32_t reserved;
+
+	/**
+	 * Время кадра (imageTime) в микросекундах от 1970-01-01, для настроек -- время последнего кадра.
+	 */
+	int64_t time;
+
+	/**
+	 * Размер данных записи после заголовка в байтах.
+	 */
+	u_int64_t size;
+
+};
+
+/**
+ * Элемент индекса записей.
+ */
+struct StreamIndexEntry {
+
+	/**
+	 * Смещение заголовка записи от начала файла.
+	 */
+	u_int64_t offset;
+
+	/**
+	 * Время записи, как в StreamRecordHeader.
+	 */
+	int64_t time;
+
+	/**
+	 * Вид записи.
+	 */
+	u_int32_t kind;
+
+	/**
+	 * Не используется, равно нулю.
+	 */
+	u_int32_t reserved;
+
+};
+
+/**
+ * Окончание файла: положение индекса.
+ */
+struct StreamRecordingTrailer {
+
+	/**
+	 * Смещение индекса от начала файла.
+	 */
+	u_int64_t indexOffset;
+
+	/**
+	 * Количество элементов индекса.
+	 */
+	u_int64_t entryCount;
+
+	/**
+	 * Сигнатура "DVAI".
+	 */
+	char magic[4];
+
+	/**
+	 * Не используется, равно нулю.
+	 */
+	u_int32_t reserved;
+
+};
+
+/**
+ * Запись входного потока: кадр или изменение настроек.
+ */
+struct StreamRecord {
+
+	/**
+	 * Вид записи.
+	 */
+	enum Kind {
+		FRAME = 1,
+		SETTINGS = 2,
+		/**
+		 * Пропуск: кадры, отброшенные при записи из-за переполнения очереди. Время -- время первого из них.
+		 */
+		GAP = 3
+	};
+
+	Kind kind;
+
+	/**
+	 * Время кадра.
+	 */
+	boost::posix_time::ptime time;
+
+	/**
+	 * Кадр, для FRAME.
+	 */
+	cv::Mat image;
+
+	/**
+	 * Настройки, для SETTINGS.
+	 */
+	xml::Request::Params settings;
+
+	/**
+	 * Количество отброшенных подряд кадров, для GAP.
+	 */
+	int droppedFrames;
+
+	StreamRecord();
+
+};
+
+/**
+ * Записывает входной поток детектора в файл в отдельном потоке, чтобы сжатие и запись на диск не задерживали обработку кадров.
+ *
+ * Кадры сжимаются в encoderThreads_ потоках и пишутся в файл в исходном порядке.
+ * Если очередь записи переполнена, кадры отбрасываются (и учитываются в getDroppedFrames()), настройки -- никогда.
+ * Вместо отброшенных подряд кадров в файл пишется одна запись StreamRecord::GAP, чтобы при воспроизведении
+ * пропуск был виден.
+ * recordFrame() и recordSettings() можно вызывать одновременно с close() из другого потока: записи после начала
+ * закрытия не принимаются.
+ */
+class StreamRecorder
+	: boost::noncopyable
+{
+
+public:
+
+	/**
+	 * Класс настроек записи.
+	 */
+	class StreamRecorderSettings {
+
+	public:
+
+		/**
+		 * Значения по умолчанию соответствующих полей.
+		 *
+		 * @{
+		 */
+		static const std::string ENCODING;
+		static const int QUALITY;
+		static const int MAX_QUEUED_FRAMES;
+		static const int ENCODER_THREADS;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Расширение формата сжатия кадров для cv::imencode(), по умолчанию ".png" -- без потерь.
+		 */
+		std::string encoding_;
+
+		/**
+		 * Качество (".jpg") или степень сжатия (".png"); -1 -- быстрейшее сжатие для ".png",
+		 * значение OpenCV по умолчанию для остальных форматов.
+		 */
+		int quality_;
+
+		/**
+		 * Наибольшее количество кадров, ожидающих записи.
+		 */
+		int maxQueuedFrames_;
+
+		/**
+		 * Количество потоков сжатия кадров; сжатие png кадра 1080p занимает десятки миллисекунд,
+		 * и одного потока не хватает для записи в реальном времени.
+		 */
+		int encoderThreads_;
+
+		/**
+		 * Создаёт объект класса с параметрами по умолчанию.
+		 */
+		StreamRecorderSettings();
+
+	};
+
+	/**
+	 * Создаёт объект без открытого файла.
+	 */
+	StreamRecorder(const StreamRecorderSettings& settings = StreamRecorderSettings());
+
+	/**
+	 * Закрывает файл.
+	 */
+	~StreamRecorder();
+
+	/**
+	 * Создаёт файл записи и запускает поток записи.
+	 *
+	 * @param path путь к файлу, существующий файл перезаписывается.
+	 * @param detectorType тип записываемого детектора (не длиннее 31 символа).
+	 * @throw std::string если файл не создаётся.
+	 */
+	void open(const std::string& path, const std::string& detectorType);
+
+	/**
+	 * Показывает, что файл открыт.
+	 */
+	bool isOpen() const;
+
+	/**
+	 * Ставит кадр в очередь записи; кадр копируется.
+	 *
+	 * @return false, если кадр отброшен из-за переполнения очереди.
+	 */
+	bool recordFrame(const cv::Mat& image, const boost::posix_time::ptime& imageTime);
+
+	/**
+	 * Ставит изменение настроек в очередь записи.
+	 */
+	void recordSettings(const xml::Request::Params& settings);
+
+	/**
+	 * Дописывает очередь и индекс и закрывает файл.
+	 */
+	void close();
+
+	/**
+	 * Количество кадров, отброшенных из-за переполнения очереди.
+	 */
+	int getDroppedFrames();
+
+private:
+
+	/**
+	 * Запись в очереди вместе со сжатым кадром.
+	 */
+	struct QueuedRecord {
+
+		/**
+		 * Состояние записи в очереди.
+		 */
+		enum State {
+			/**
+			 * Кадр ждёт сжатия.
+			 */
+			WAITING,
+			/**
+			 * Кадр сжимается.
+			 */
+			ENCODING,
+			/**
+			 * Запись готова к записи в файл.
+			 */
+			READY
+		};
+
+		StreamRecord record;
+
+		/**
+		 * Сжатый кадр, для StreamRecord::FRAME.
+		 */
+		std::vector<uchar> encoded;
+
+		/**
+		 * Ошибка сжатия кадра, пустая строка -- без ошибки.
+		 */
+		std::string error;
+
+		State state;
+
+		QueuedRecord();
+
+	};
+
+	/**
+	 * Настройки записи.
+	 */
+	StreamRecorderSettings settings_;
+
+	/**
+	 * Файл записи.
+	 */
+	FILE* file_;
+
+	/**
+	 * Путь к файлу записи.
+	 */
+	std::string path_;
+
+	/**
+	 * Индекс записанных записей.
+	 */
+	std::vector<StreamIndexEntry> index_;
+
+	/**
+	 * Поток записи.
+	 */
+	boost::shared_ptr<boost::thread> thread_;
+
+	/**
+	 * Потоки сжатия кадров.
+	 */
+	std::vector<boost::shared_ptr<boost::thread> > encoders_;
+
+	/**
+	 * Защищает файл, очередь и флаги.
+	 */
+	mutable boost::mutex mutex_;
+
+	/**
+	 * Сигнализирует потокам сжатия о новом кадре в очереди или о закрытии.
+	 */
+	boost::condition_variable queueChanged_;
+
+	/**
+	 * Сигнализирует потоку записи о готовой записи или о закрытии.
+	 */
+	boost::condition_variable recordReady_;
+
+	/**
+	 * Записи, ожидающие записи на диск; элементы не перемещаются, пока их сжимают (std::deque меняется только с концов).
+	 */
+	std::deque<QueuedRecord> queue_;
+
+	/**
+	 * Количество кадров в очереди.
+	 */
+	int queuedFrames_;
+
+	/**
+	 * Количество отброшенных кадров.
+	 */
+	int droppedFrames_;
+
+	/**
+	 * Количество отброшенных подряд кадров, для которых ещё не поставлена запись StreamRecord::GAP.
+	 */
+	int gapFrames_;
+
+	/**
+	 * Время первого из этих кадров.
+	 */
+	boost::posix_time::ptime gapTime_;
+
+	/**
+	 * Время последнего кадра, им помечаются изменения настроек.
+	 */
+	boost::posix_time::ptime lastTime_;
+
+	/**
+	 * Поток должен дописать очередь и завершиться.
+	 */
+	bool closing_;
+
+	/**
+	 * Тело потока записи: дописывает готовые записи в порядке очереди.
+	 */
+	void run();
+
+	/**
+	 * Тело потока сжатия: сжимает ожидающие кадры в порядке очереди.
+	 */
+	void runEncoder();
+
+	/**
+	 * Ставит запись StreamRecord::GAP для отброшенных кадров, если они есть; вызывается под мьютексом.
+	 */
+	void queueGap();
+
+	/**
+	 * Сжимает кадр записи.
+	 *
+	 * @throw std::string при ошибке сжатия.
+	 */
+	void encode(QueuedRecord& queued);
+
+	/**
+	 * Дописывает запись в файл.
+	 */
+	void write(const QueuedRecord& queued);
+
+	/**
+	 * Дописывает байты в файл.
+	 *
+	 * @throw std::string при ошибке записи.
+	 */
+	void write(const void* data, size_t size);
+
+};
+
+/**
+ * Читает запись входного потока. Как FrameSource отдаёт только кадры, пропуская изменения настроек и пропуски.
+ */
+class StreamReader
+	: public FrameSource
+	, boost::noncopyable
+{
+
+public:
+
+	/**
+	 * Открывает файл записи и читает (или восстанавливает) индекс.
+	 *
+	 * @throw std::string если файл не открывается или повреждён.
+	 */
+	StreamReader(const std::string& path);
+
+	/**
+	 * Закрывает файл.
+	 */
+	virtual ~StreamReader();
+
+	/**
+	 * Тип записанного детектора.
+	 */
+	const std::string& getDetectorType() const;
+
+	/**
+	 * Количество записей.
+	 */
+	size_t getRecordCount() const;
+
+	/**
+	 * Количество кадров.
+	 */
+	size_t getFrameCount() const;
+
+	/**
+	 * Читает запись с заданным номером и делает её текущей.
+	 *
+	 * @throw std::string если запись повреждена.
+	 */
+	void readRecord(size_t index, StreamRecord& record);
+
+	/**
+	 * Читает очередную запись.
+	 *
+	 * @return false, если записи кончились.
+	 * @throw std::string если запись повреждена.
+	 */
+	bool readRecord(StreamRecord& record);
+
+	/**
+	 * Читает очередной кадр, пропуская изменения настроек и пропуски.
+	 */
+	virtual bool read(cv::Mat& frame);
+
+	/**
+	 * Переходит к записи с заданным номером.
+	 */
+	void seek(size_t index);
+
+private:
+
+	/**
+	 * Файл записи.
+	 */
+	FILE* file_;
+
+	/**
+	 * Тип записанного детектора.
+	 */
+	std::string detectorType_;
+
+	/**
+	 * Индекс записей.
+	 */
+	std::vector<StreamIndexEntry> index_;
+
+	/**
+	 * Номер очередной записи.
+	 */
+	size_t position_;
+
+	/**
+	 * Размер файла записи.
+	 */
+	off_t fileSize_;
+
+	/**
+	 * Буфер сжатого кадра.
+	 */
+	std::vector<uchar> buffer_;
+
+	/**
+	 * Читает индекс из окончания файла, если он есть.
+	 */
+	bool readIndex(off_t fileSize);
+
+	/**
+	 * Восстанавливает индекс просмотром записей; неполная последняя запись отбрасывается.
+	 */
+	void rebuildIndex(off_t fileSize);
+
+};
+
+/**
+ * Воспроизводит запись входного потока через детектор.
+ */
+class StreamReplayer {
+
+public:
+
+	/**
+	 * Темп воспроизведения.
+	 */
+	enum Pace {
+		/**
+		 * Кадры подаются с исходными интервалами imageTime.
+		 */
+		ORIGINAL_PACE,
+		/**
+		 * Кадры подаются сразу друг за другом.
+		 */
+		FLAT_OUT
+	};
+
+	/**
+	 * Итог воспроизведения.
+	 */
+	struct Report {
+
+		/**
+		 * Количество обработанных кадров.
+		 */
+		int frames;
+
+		/**
+		 * Количество применённых изменений настроек.
+		 */
+		int settingsChanges;
+
+		/**
+		 * Количество непустых результатов.
+		 */
+		int results;
+
+		/**
+		 * Суммарное и наибольшее время execute().
+		 *
+		 * @{
+		 */
+		boost::posix_time::time_duration totalExecuteTime;
+
+		boost::posix_time::time_duration maxExecuteTime;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Номер кадра с наибольшим временем execute().
+		 */
+		int slowestFrame;
+
+		/**
+		 * Количество кадров, поданных позже исходного времени из-за медленной обработки предыдущих (только ORIGINAL_PACE).
+		 */
+		int lateFrames;
+
+		/**
+		 * Количество пропусков записи (StreamRecord::GAP) и отброшенных в них кадров: детектор получил
+		 * не весь исходный поток.
+		 *
+		 * @{
+		 */
+		int gaps;
+
+		int droppedFrames;
+		/**
+		 * @}
+		 */
+
+		Report();
+
+	};
+
+	/**
+	 * Создаёт объект для воспроизведения заданной записи.
+	 */
+	StreamReplayer(StreamReader& reader);
+
+	/**
+	 * Подаёт все записи в детектор: изменения настроек -- в setSettings(), кадры -- в execute(); пропуски учитываются в отчёте.
+	 * Выключенный детектор включается.
+	 *
+	 * @param detector детектор; тип может не совпадать с записанным.
+	 * @param pace темп воспроизведения.
+	 * @param results сюда дописываются непустые результаты детектора, если не 0.
+	 * @throw std::string ошибки детектора и чтения записи.
+	 */
+	Report replay(Detector& detector, Pace pace, std::vector<std::string>* results = 0);
+
+private:
+
+	/**
+	 * Запись.
+	 */
+	StreamReader& reader_;
+
+};
+
+#endif // StreamRecording_h_
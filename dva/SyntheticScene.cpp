@@ -0,0 +1,235 @@
+#include "SyntheticScene.h"
+#include <cmath>
+
+namespace {
+
+/**
+ * Время нулевого кадра.
+ */
+const boost::posix_time::ptime START_TIME(boost::gregorian::date(2000, 1, 1));
+
+/**
+ * Наибольшая непрозрачность пелены дыма и время её нарастания (сек).
+ *
+ * @{
+ */
+const double SMOKE_MAX_ALPHA = 0.35;
+const double SMOKE_RISE_SECONDS = 5;
+/**
+ * @}
+ */
+
+/**
+ * Яркость пелены дыма.
+ */
+const int SMOKE_GRAY = 180;
+
+/**
+ * Зерно генератора для кадра: от кадра зависят шум и мерцание, но не раскладка сцены.
+ */
+uint64 frameSeed(unsigned seed, int frameIndex, int salt) {
+	return (static_cast<uint64>(seed) << 32) ^ (static_cast<uint64>(frameIndex) * 2654435761u) ^ (static_cast<uint64>(salt) * 40503u) ^ 1u;
+}
+
+/**
+ * Отражает координату от краёв отрезка [low, high].
+ */
+double reflect(double value, double low, double high) {
+	double length = high - low;
+	if (length <= 0) {
+		return low;
+	}
+	double offset = std::fmod(value - low, 2 * length);
+	if (offset < 0) {
+		offset += 2 * length;
+	}
+	return low + (offset < length ? offset : 2 * length - offset);
+}
+
+} // namespace
+
+const int SyntheticScene::SyntheticSceneSettings::WIDTH = 640;
+const int SyntheticScene::SyntheticSceneSettings::HEIGHT = 480;
+const unsigned SyntheticScene::SyntheticSceneSettings::SEED = 1;
+const int SyntheticScene::SyntheticSceneSettings::FRAME_COUNT = 1000;
+const double SyntheticScene::SyntheticSceneSettings::FPS = 25;
+const int SyntheticScene::SyntheticSceneSettings::NOISE = 3;
+const int SyntheticScene::SyntheticSceneSettings::MOVING_BLOBS = 4;
+const int SyntheticScene::SyntheticSceneSettings::STANDING_OBJECTS = 2;
+const int SyntheticScene::SyntheticSceneSettings::FIRE_REGIONS = 1;
+const int SyntheticScene::SyntheticSceneSettings::SMOKE_VEILS = 1;
+
+SyntheticScene::SyntheticSceneSettings::SyntheticSceneSettings()
+	: size_(WIDTH, HEIGHT)
+	, seed_(SEED)
+	, frameCount_(FRAME_COUNT)
+	, fps_(FPS)
+	, noise_(NOISE)
+	, movingBlobs_(MOVING_BLOBS)
+	, standingObjects_(STANDING_OBJECTS)
+	, fireRegions_(FIRE_REGIONS)
+	, smokeVeils_(SMOKE_VEILS)
+{}
+
+SyntheticScene::SyntheticSceneSettings::SyntheticSceneSettings(const cv::Size& size, unsigned seed)
+	: size_(size)
+	, seed_(seed)
+	, frameCount_(FRAME_COUNT)
+	, fps_(FPS)
+	, noise_(NOISE)
+	, movingBlobs_(MOVING_BLOBS)
+	, standingObjects_(STANDING_OBJECTS)
+	, fireRegions_(FIRE_REGIONS)
+	, smokeVeils_(SMOKE_VEILS)
+{}
+
+SyntheticScene::SyntheticScene(const SyntheticSceneSettings& settings)
+	: settings_(settings)
+	, frameIndex_(0)
+{
+	const cv::Size& size = settings_.size_;
+	int minSide = std::max(1, std::min(size.width, size.height));
+	cv::RNG rng(settings_.seed_);
+
+	// фон: плавный градиент и случайные прямоугольники, дающие контрастные края
+	background_.create(size, CV_8UC3);
+	for (int y = 0; y < size.height; y++) {
+		uchar* row = background_.ptr(y);
+		for (int x = 0; x < size.width; x++) {
+			row[3 * x] = static_cast<uchar>(60 + 80 * x / std::max(1, size.width));
+			row[3 * x + 1] = static_cast<uchar>(80 + 60 * y / std::max(1, size.height));
+			row[3 * x + 2] = 100;
+		}
+	}
+	for (int i = 0; i < 40; i++) {
+		Event patch = makeEvent(rng, minSide / 16 + 1, minSide / 4 + 2);
+		cv::rectangle(background_, patch.rect, cv::Scalar(rng.uniform(40, 200), rng.uniform(40, 200), rng.uniform(40, 200)), CV_FILLED);
+	}
+
+	for (int i = 0; i < settings_.movingBlobs_; i++) {
+		Blob blob;
+		blob.radius = rng.uniform(minSide / 20 + 1, minSide / 10 + 2);
+		blob.start = cv::Point2d(rng.uniform(0., static_cast<double>(size.width)), rng.uniform(0., static_cast<double>(size.height)));
+		double speed = rng.uniform(0.01, 0.04) * minSide;
+		double angle = rng.uniform(0., 2 * CV_PI);
+		blob.velocity = cv::Point2d(speed * std::cos(angle), speed * std::sin(angle));
+		blob.color = cv::Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+		blobs_.push_back(blob);
+	}
+	for (int i = 0; i < settings_.standingObjects_; i++) {
+		standingObjects_.push_back(makeEvent(rng, minSide / 10 + 1, minSide / 5 + 2));
+		standingColors_.push_back(cv::Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256)));
+	}
+	for (int i = 0; i < settings_.fireRegions_; i++) {
+		fireRegions_.push_back(makeEvent(rng, minSide / 12 + 1, minSide / 6 + 2));
+	}
+	for (int i = 0; i < settings_.smokeVeils_; i++) {
+		smokeVeils_.push_back(makeEvent(rng, minSide / 5 + 1, minSide / 3 + 2));
+	}
+}
+
+SyntheticScene::Event SyntheticScene::makeEvent(cv::RNG& rng, int minSide, int maxSide) const {
+	const cv::Size& size = settings_.size_;
+	Event event;
+	event.rect.width = std::min(size.width, rng.uniform(minSide, maxSide + 1));
+	event.rect.height = std::min(size.height, rng.uniform(minSide, maxSide + 1));
+	event.rect.x = rng.uniform(0, size.width - event.rect.width + 1);
+	event.rect.y = rng.uniform(0, size.height - event.rect.height + 1);
+	// объекты появляются между десятой частью и половиной ролика, чтобы до них успел обучиться фон
+	int frames = settings_.frameCount_ > 0 ? settings_.frameCount_ : static_cast<int>(settings_.fps_ * 120);
+	event.appearFrame = rng.uniform(frames / 10, frames / 2 + 1);
+	return event;
+}
+
+cv::Point SyntheticScene::getBlobCenter(const Blob& blob, int frameIndex) const {
+	double x = reflect(blob.start.x + blob.velocity.x * frameIndex, blob.radius, settings_.size_.width - blob.radius);
+	double y = reflect(blob.start.y + blob.velocity.y * frameIndex, blob.radius, settings_.size_.height - blob.radius);
+	return cv::Point(cvRound(x), cvRound(y));
+}
+
+void SyntheticScene::render(int frameIndex, cv::Mat& frame) const {
+	background_.copyTo(frame);
+
+	for (size_t i = 0; i < standingObjects_.size(); i++) {
+		if (frameIndex >= standingObjects_[i].appearFrame) {
+			cv::rectangle(frame, standingObjects_[i].rect, standingColors_[i], CV_FILLED);
+		}
+	}
+
+	for (size_t i = 0; i < blobs_.size(); i++) {
+		cv::circle(frame, getBlobCenter(blobs_[i], frameIndex), blobs_[i].radius, blobs_[i].color, CV_FILLED);
+	}
+
+	for (size_t i = 0; i < fireRegions_.size(); i++) {
+		const Event& fire = fireRegions_[i];
+		if (frameIndex < fire.appearFrame) {
+			continue;
+		}
+		cv::RNG rng(frameSeed(settings_.seed_, frameIndex, static_cast<int>(i) + 1));
+		// общая яркость области меняется от кадра к кадру, отдельные пиксели -- независимо
+		double flicker = rng.uniform(0.6, 1.0);
+		for (int y = fire.rect.y; y < fire.rect.br().y; y++) {
+			uchar* row = frame.ptr(y);
+			for (int x = fire.rect.x; x < fire.rect.br().x; x++) {
+				row[3 * x] = static_cast<uchar>(rng.uniform(0, 40));
+				row[3 * x + 1] = static_cast<uchar>(flicker * rng.uniform(90, 180));
+				row[3 * x + 2] = static_cast<uchar>(rng.uniform(220, 256));
+			}
+		}
+	}
+
+	for (size_t i = 0; i < smokeVeils_.size(); i++) {
+		const Event& smoke = smokeVeils_[i];
+		if (frameIndex < smoke.appearFrame) {
+			continue;
+		}
+		// пелена постепенно сгущается и снижает контраст всего, что под ней
+		double alpha = std::min(SMOKE_MAX_ALPHA, SMOKE_MAX_ALPHA * (frameIndex - smoke.appearFrame) / (settings_.fps_ * SMOKE_RISE_SECONDS));
+		cv::Mat area = frame(smoke.rect);
+		area.convertTo(area, -1, 1 - alpha, SMOKE_GRAY * alpha);
+	}
+
+	if (settings_.noise_ > 0) {
+		cv::Mat noise(frame.size(), CV_16SC3);
+		cv::RNG rng(frameSeed(settings_.seed_, frameIndex, 0));
+		rng.fill(noise, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(settings_.noise_));
+		cv::add(frame, noise, frame, cv::noArray(), CV_8U);
+	}
+}
+
+bool SyntheticScene::read(cv::Mat& frame) {
+	if (settings_.frameCount_ > 0 && frameIndex_ >= settings_.frameCount_) {
+		return false;
+	}
+	render(frameIndex_++, frame_);
+	frame = frame_;
+	return true;
+}
+
+int SyntheticScene::getFrameIndex() const {
+	return frameIndex_;
+}
+
+void SyntheticScene::seek(int frameIndex) {
+	frameIndex_ = std::max(frameIndex, 0);
+}
+
+boost::posix_time::ptime SyntheticScene::getFrameTime(int frameIndex) const {
+	return START_TIME + boost::posix_time::microseconds(static_cast<int64_t>(frameIndex * 1e6 / settings_.fps_));
+}
+
+const std::vector<SyntheticScene::Event>& SyntheticScene::getStandingObjects() const {
+	return standingObjects_;
+}
+
+const std::vector<SyntheticScene::Event>& SyntheticScene::getFireRegions() const {
+	return fireRegions_;
+}
+
+const std::vector<SyntheticScene::Event>& SyntheticScene::getSmokeVeils() const {
+	return smokeVeils_;
+}
+
+const SyntheticScene::SyntheticSceneSettings& SyntheticScene::getSettings() const {
+	return settings_;
+}
@@ -0,0 +1,237 @@
+#ifndef SyntheticScene_h_
+#define SyntheticScene_h_
+
+#include <vector>
+#include <opencv/cv.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "FrameSource.h"
+
+/**
+ * Генератор синтетической сцены для воспроизводимых замеров и регрессионных проверок без внешних записей.
+ *
+ * Сцена -- неподвижный фон с шумом матрицы, по которому движутся пятна, появляются и остаются предметы
+ * (для детектора оставленных вещей), мерцают оранжевые области (для огня) и проступают малоконтрастные
+ * пелены (для дыма). Всё определяется зерном и разрешением: кадр с данным номером одинаков при любом
+ * порядке генерации и на любой платформе.
+ */
+class SyntheticScene
+	: public FrameSource
+{
+public:
+
+	/**
+	 * Класс настроек сцены.
+	 */
+	class SyntheticSceneSettings {
+
+	public:
+
+		/**
+		 * Значения по умолчанию соответствующих полей.
+		 *
+		 * @{
+		 */
+		static const int WIDTH;
+		static const int HEIGHT;
+		static const unsigned SEED;
+		static const int FRAME_COUNT;
+		static const double FPS;
+		static const int NOISE;
+		static const int MOVING_BLOBS;
+		static const int STANDING_OBJECTS;
+		static const int FIRE_REGIONS;
+		static const int SMOKE_VEILS;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Размер кадра.
+		 */
+		cv::Size size_;
+
+		/**
+		 * Зерно, от которого зависит вся сцена.
+		 */
+		unsigned seed_;
+
+		/**
+		 * Количество кадров, которые выдаёт read(); 0 - без ограничения.
+		 */
+		int frameCount_;
+
+		/**
+		 * Частота кадров, по которой считаются их времена.
+		 */
+		double fps_;
+
+		/**
+		 * Среднеквадратичное отклонение шума матрицы.
+		 */
+		int noise_;
+
+		/**
+		 * Количество объектов каждого вида.
+		 *
+		 * @{
+		 */
+		int movingBlobs_;
+
+		int standingObjects_;
+
+		int fireRegions_;
+
+		int smokeVeils_;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Создаёт объект класса с параметрами по умолчанию.
+		 */
+		SyntheticSceneSettings();
+
+		/**
+		 * Создаёт настройки по умолчанию для заданных размера кадра и зерна.
+		 */
+		SyntheticSceneSettings(const cv::Size& size, unsigned seed);
+
+	};
+
+	/**
+	 * Появляющийся объект сцены: область и номер кадра, с которого он виден.
+	 */
+	struct Event {
+
+		/**
+		 * Область объекта.
+		 */
+		cv::Rect rect;
+
+		/**
+		 * Номер кадра появления.
+		 */
+		int appearFrame;
+
+	};
+
+	/**
+	 * Строит сцену.
+	 */
+	SyntheticScene(const SyntheticSceneSettings& settings);
+
+	/**
+	 * Выдаёт очередной кадр CV_8UC3.
+	 *
+	 * @return false, если выданы все frameCount_ кадров.
+	 */
+	virtual bool read(cv::Mat& frame);
+
+	/**
+	 * Рисует кадр с заданным номером, не меняя позицию read().
+	 */
+	void render(int frameIndex, cv::Mat& frame) const;
+
+	/**
+	 * Номер кадра, который выдаст следующий read().
+	 */
+	int getFrameIndex() const;
+
+	/**
+	 * Переводит read() на заданный кадр.
+	 */
+	void seek(int frameIndex);
+
+	/**
+	 * Время кадра: от постоянной начальной даты с шагом 1 / fps_.
+	 */
+	boost::posix_time::ptime getFrameTime(int frameIndex) const;
+
+	/**
+	 * Объекты, которые появляются и остаются (эталон для детектора оставленных вещей).
+	 */
+	const std::vector<Event>& getStandingObjects() const;
+
+	/**
+	 * Мерцающие области (эталон для детектора огня).
+	 */
+	const std::vector<Event>& getFireRegions() const;
+
+	/**
+	 * Пелены (эталон для детектора дыма).
+	 */
+	const std::vector<Event>& getSmokeVeils() const;
+
+	/**
+	 * Возвращает настройки сцены.
+	 */
+	const SyntheticSceneSettings& getSettings() const;
+
+private:
+
+	/**
+	 * Движущееся пятно: отражается от краёв кадра.
+	 */
+	struct Blob {
+
+		cv::Point2d start;
+
+		cv::Point2d velocity;
+
+		int radius;
+
+		cv::Scalar color;
+
+	};
+
+	/**
+	 * Настройки сцены.
+	 */
+	SyntheticSceneSettings settings_;
+
+	/**
+	 * Фон без шума.
+	 */
+	cv::Mat background_;
+
+	/**
+	 * Объекты сцены.
+	 *
+	 * @{
+	 */
+	std::vector<Blob> blobs_;
+
+	std::vector<Event> standingObjects_;
+
+	std::vector<cv::Scalar> standingColors_;
+
+	std::vector<Event> fireRegions_;
+
+	std::vector<Event> smokeVeils_;
+	/**
+	 * @}
+	 */
+
+	/**
+	 * Номер кадра для read().
+	 */
+	int frameIndex_;
+
+	/**
+	 * Буфер кадра для read().
+	 */
+	cv::Mat frame_;
+
+	/**
+	 * Случайная область внутри кадра со сторонами от minSide до maxSide и номер кадра появления.
+	 */
+	Event makeEvent(cv::RNG& rng, int minSide, int maxSide) const;
+
+	/**
+	 * Положение пятна на кадре frameIndex.
+	 */
+	cv::Point getBlobCenter(const Blob& blob, int frameIndex) const;
+
+};
+
+#endif // SyntheticScene_h_
@@ -0,0 +1,665 @@
+#include "TiledCodeBookAlgorithm.h"
+#include <algorithm>
+#include <cstring>
+#include <logging/logging.hpp>
+#include "System.h"
+#include <utils/maputils.hpp>
+#include <boost/bind.hpp>
+#include "WorkStealingPool.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/**
+ * Векторные операции над TILE_WIDTH беззнаковыми байтами. Маски -- байты 0xFF (истина) или 0 (ложь).
+ * Без SSE2 те же операции выполняются поэлементно.
+ */
+#if defined(__SSE2__)
+
+typedef __m128i Lanes;
+
+inline Lanes load(const uchar* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline void store(uchar* p, Lanes v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+inline Lanes splat(int v) { return _mm_set1_epi8(static_cast<char>(v)); }
+inline Lanes zero() { return _mm_setzero_si128(); }
+inline Lanes ones() { return _mm_set1_epi8(-1); }
+inline Lanes andLanes(Lanes a, Lanes b) { return _mm_and_si128(a, b); }
+inline Lanes orLanes(Lanes a, Lanes b) { return _mm_or_si128(a, b); }
+inline Lanes andNotLanes(Lanes a, Lanes b) { return _mm_andnot_si128(b, a); }
+inline Lanes minLanes(Lanes a, Lanes b) { return _mm_min_epu8(a, b); }
+inline Lanes maxLanes(Lanes a, Lanes b) { return _mm_max_epu8(a, b); }
+inline Lanes addSat(Lanes a, Lanes b) { return _mm_adds_epu8(a, b); }
+inline Lanes subSat(Lanes a, Lanes b) { return _mm_subs_epu8(a, b); }
+inline Lanes lessEqual(Lanes a, Lanes b) { return _mm_cmpeq_epi8(_mm_min_epu8(a, b), a); }
+inline Lanes incrementWhere(Lanes v, Lanes mask) { return _mm_sub_epi8(v, mask); }
+inline Lanes decrementWhere(Lanes v, Lanes mask) { return _mm_add_epi8(v, mask); }
+inline bool any(Lanes v) { return _mm_movemask_epi8(v) != 0; }
+
+#else
+
+struct Lanes {
+	uchar v[TiledCodeBookAlgorithm::TILE_WIDTH];
+};
+
+#define LANES_APPLY(expr) Lanes r; for (int i = 0; i < TiledCodeBookAlgorithm::TILE_WIDTH; i++) { r.v[i] = (expr); } return r
+
+inline Lanes load(const uchar* p) { Lanes r; memcpy(r.v, p, sizeof(r.v)); return r; }
+inline void store(uchar* p, const Lanes& v) { memcpy(p, v.v, sizeof(v.v)); }
+inline Lanes splat(int v) { LANES_APPLY(static_cast<uchar>(v)); }
+inline Lanes zero() { return splat(0); }
+inline Lanes ones() { return splat(0xFF); }
+inline Lanes andLanes(const Lanes& a, const Lanes& b) { LANES_APPLY(a.v[i] & b.v[i]); }
+inline Lanes orLanes(const Lanes& a, const Lanes& b) { LANES_APPLY(a.v[i] | b.v[i]); }
+inline Lanes andNotLanes(const Lanes& a, const Lanes& b) { LANES_APPLY(a.v[i] & ~b.v[i]); }
+inline Lanes minLanes(const Lanes& a, const Lanes& b) { LANES_APPLY(std::min(a.v[i], b.v[i])); }
+inline Lanes maxLanes(const Lanes& a, const Lanes& b) { LANES_APPLY(std::max(a.v[i], b.v[i])); }
+inline Lanes addSat(const Lanes& a, const Lanes& b) { LANES_APPLY(std::min(a.v[i] + b.v[i], 255)); }
+inline Lanes subSat(const Lanes& a, const Lanes& b) { LANES_APPLY(std::max(a.v[i] - b.v[i], 0)); }
+inline Lanes lessEqual(const Lanes& a, const Lanes& b) { LANES_APPLY(a.v[i] <= b.v[i] ? 0xFF : 0); }
+inline Lanes incrementWhere(const Lanes& v, const Lanes& mask) { LANES_APPLY(v.v[i] + (mask.v[i] ? 1 : 0)); }
+inline Lanes decrementWhere(const Lanes& v, const Lanes& mask) { LANES_APPLY(v.v[i] - (mask.v[i] ? 1 : 0)); }
+inline bool any(const Lanes& v) { for (int i = 0; i < TiledCodeBookAlgorithm::TILE_WIDTH; i++) { if (v.v[i]) return true; } return false; }
+
+#undef LANES_APPLY
+
+#endif
+
+/**
+ * Маска пикселей, значение которых лежит в [low, high].
+ */
+inline Lanes inRange(Lanes value, Lanes low, Lanes high) {
+	return andLanes(lessEqual(low, value), lessEqual(value, high));
+}
+
+/**
+ * Маска пикселей, у которых есть место кодового слова @a slot: slot < count.
+ */
+inline Lanes slotIsUsed(Lanes counts, int slot) {
+	return andNotLanes(ones(), lessEqual(counts, splat(slot)));
+}
+
+/**
+ * Частота кадров, которая предполагается до первой оценки.
+ */
+const double DEFAULT_FRAME_PERIOD = 1e6 / 25;
+
+/**
+ * Вес нового измерения в оценке периода кадров.
+ */
+const double FRAME_PERIOD_ALPHA = 0.05;
+
+} // namespace
+
+const std::string TiledCodeBookAlgorithm::TILED_CODE_BOOK_ALGORITHM = "TILED_CODE_BOOK_ALGORITHM";
+
+const int TiledCodeBookAlgorithm::TiledCodeBookAlgorithmSettings::CAPACITY = 4;
+const int TiledCodeBookAlgorithm::TiledCodeBookAlgorithmSettings::LEARN_BOUND = 10;
+const int TiledCodeBookAlgorithm::TiledCodeBookAlgorithmSettings::MIN_MOD = 20;
+const int TiledCodeBookAlgorithm::TiledCodeBookAlgorithmSettings::MAX_MOD = 20;
+const int TiledCodeBookAlgorithm::TiledCodeBookAlgorithmSettings::STALE_SCAN_ROWS = 16;
+const int TiledCodeBookAlgorithm::TiledCodeBookAlgorithmSettings::MODEL_BUDGET_KB = 0;
+
+TiledCodeBookAlgorithm::TiledCodeBookAlgorithmSettings::TiledCodeBookAlgorithmSettings()
+	: capacity_(CAPACITY)
+	, learnBound_(LEARN_BOUND)
+	, minMod_(MIN_MOD)
+	, maxMod_(MAX_MOD)
+	, staleScanRows_(STALE_SCAN_ROWS)
+	, modelBudgetKb_(MODEL_BUDGET_KB)
+{}
+
+TiledCodeBookAlgorithm::TiledCodeBookAlgorithmSettings::TiledCodeBookAlgorithmSettings(int capacity, int learnBound, int minMod, int maxMod, int staleScanRows, int modelBudgetKb)
+	: capacity_(capacity)
+	, learnBound_(learnBound)
+	, minMod_(minMod)
+	, maxMod_(maxMod)
+	, staleScanRows_(staleScanRows)
+	, modelBudgetKb_(modelBudgetKb)
+{}
+
+TiledCodeBookAlgorithm::TiledCodeBookAlgorithm()
+	: tilesPerRow_(0)
+	, capacity_(0)
+	, time_(0)
+	, learningDelaySeconds_(0)
+	, framePeriod_(DEFAULT_FRAME_PERIOD)
+	, staleSweepRow_(-1)
+	, staleSweepLimit_(0)
+{}
+
+TiledCodeBookAlgorithm::TiledCodeBookAlgorithm(const TiledCodeBookAlgorithmSettings& settings)
+	: settings_(settings)
+	, tilesPerRow_(0)
+	, capacity_(0)
+	, time_(0)
+	, learningDelaySeconds_(0)
+	, framePeriod_(DEFAULT_FRAME_PERIOD)
+	, staleSweepRow_(-1)
+	, staleSweepLimit_(0)
+{}
+
+void TiledCodeBookAlgorithm::prepare(const cv::Mat& image) {
+	if (image.type() != CV_8UC3) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": image");
+	}
+	int capacity = getCapacity(image.size());
+	if (image.size() == size_ && capacity_ == capacity) {
+		return;
+	}
+	size_ = image.size();
+	capacity_ = capacity;
+	tilesPerRow_ = (size_.width + TILE_WIDTH - 1) / TILE_WIDTH;
+	size_t tiles = static_cast<size_t>(tilesPerRow_) * size_.height;
+	bounds_.assign(tiles * capacity_ * SLOT_BYTES, 0);
+	lastUpdate_.assign(tiles * capacity_ * TILE_WIDTH, 0);
+	stale_.assign(tiles * capacity_ * TILE_WIDTH, 0);
+	activeFrom_.assign(tiles * capacity_ * TILE_WIDTH, 0);
+	counts_.assign(tiles * TILE_WIDTH, 0);
+	time_ = 0;
+	staleSweepRow_ = -1;
+	u_int8_t zero = 0;
+	foreground_ = cv::Mat(size_, CV_8U, zero);
+	LOG_INFO("TiledCodeBookAlgorithm: new model " << size_.width << "x" << size_.height << ", " << capacity_ << " codewords per pixel, " << getModelFootprint() / 1024 << " Kb");
+	if (settings_.modelBudgetKb_ > 0 && getModelFootprint() > static_cast<size_t>(settings_.modelBudgetKb_) * 1024) {
+		LOG_WARN("TiledCodeBookAlgorithm: model budget " << settings_.modelBudgetKb_ << " Kb is too small even for one codeword per pixel");
+	}
+}
+
+int TiledCodeBookAlgorithm::getCapacity(const cv::Size& size) const {
+	if (settings_.modelBudgetKb_ <= 0) {
+		return settings_.capacity_;
+	}
+	size_t pixels = static_cast<size_t>((size.width + TILE_WIDTH - 1) / TILE_WIDTH) * TILE_WIDTH * size.height;
+	if (pixels == 0) {
+		return settings_.capacity_;
+	}
+	size_t budget = static_cast<size_t>(settings_.modelBudgetKb_) * 1024;
+	size_t perPixel = budget / pixels;
+	// счётчик кодовых слов и маска результата занимают по байту на пиксель
+	int capacity = perPixel > 2 ? static_cast<int>((perPixel - 2) / CODEWORD_BYTES) : 0;
+	return std::max(1, std::min(capacity, settings_.capacity_));
+}
+
+size_t TiledCodeBookAlgorithm::getModelFootprint() const {
+	return bounds_.capacity() * sizeof(uchar)
+		+ (lastUpdate_.capacity() + stale_.capacity() + activeFrom_.capacity()) * sizeof(int)
+		+ counts_.capacity() * sizeof(uchar)
+		+ foreground_.total() * foreground_.elemSize();
+}
+
+size_t TiledCodeBookAlgorithm::getCodewordCount() const {
+	size_t count = 0;
+	for (size_t i = 0; i < counts_.size(); i++) {
+		count += counts_[i];
+	}
+	return count;
+}
+
+void TiledCodeBookAlgorithm::loadTile(const cv::Mat& image, int y, int tileX, uchar pixels[CHANNELS][TILE_WIDTH], int& laneCount) const {
+	int x0 = tileX * TILE_WIDTH;
+	laneCount = std::min(TILE_WIDTH, size_.width - x0);
+	const uchar* row = image.ptr(y) + x0 * CHANNELS;
+	for (int lane = 0; lane < laneCount; lane++) {
+		for (int c = 0; c < CHANNELS; c++) {
+			pixels[c][lane] = row[lane * CHANNELS + c];
+		}
+	}
+	for (int lane = laneCount; lane < TILE_WIDTH; lane++) {
+		for (int c = 0; c < CHANNELS; c++) {
+			pixels[c][lane] = 0;
+		}
+	}
+}
+
+void TiledCodeBookAlgorithm::learn(const cv::Mat& image) {
+	prepare(image);
+	time_++;
+	updateRows(image, 0, size_.height, time_, time_, -1);
+	sweepStaleEntries();
+}
+
+size_t TiledCodeBookAlgorithm::learnBulk(FrameSource& frames, int threadCount) {
+	if (threadCount <= 0) {
+		threadCount = WorkStealingPool::getDefault().getThreadCount();
+	}
+	std::vector<cv::Mat> batch(BULK_BATCH_FRAMES);
+	size_t learned = 0;
+	cv::Mat frame;
+	bool hasFrame = frames.read(frame);
+	while (hasFrame) {
+		// при смене размера кадра модель строится заново, как и при последовательном обучении
+		prepare(frame);
+		int count = 0;
+		while (hasFrame && count < BULK_BATCH_FRAMES && frame.size() == size_ && frame.type() == CV_8UC3) {
+			// источник может переиспользовать буфер кадра
+			frame.copyTo(batch[count++]);
+			hasFrame = frames.read(frame);
+		}
+		learnBatch(batch, count, threadCount);
+		learned += count;
+	}
+	LOG_INFO("TiledCodeBookAlgorithm: learned " << learned << " frames in up to " << threadCount << " bands, " << getCodewordCount() << " codewords");
+	return learned;
+}
+
+void TiledCodeBookAlgorithm::learnBatch(const std::vector<cv::Mat>& batch, int count, int threadCount) {
+	if (staleSweepRow_ >= 0) {
+		// удаление устаревших слов идёт по кадрам через всю модель, его порядок сохраняется последовательным обучением
+		for (int i = 0; i < count; i++) {
+			learn(batch[i]);
+		}
+		return;
+	}
+	// полос не больше threadCount, каждая обучается одной задачей общего пула
+	WorkStealingPool::getDefault().parallelFor(0, size_.height, (size_.height + threadCount - 1) / threadCount,
+		boost::bind(&TiledCodeBookAlgorithm::learnRows, this, boost::cref(batch), count, time_ + 1, _1, _2));
+	time_ += count;
+}
+
+void TiledCodeBookAlgorithm::learnRows(const std::vector<cv::Mat>& batch, int count, int firstTime, int rowBegin, int rowEnd) {
+	for (int i = 0; i < count; i++) {
+		updateRows(batch[i], rowBegin, rowEnd, firstTime + i, firstTime + i, -1);
+	}
+}
+
+cv::Mat TiledCodeBookAlgorithm::detect(const cv::Mat& image) {
+	prepare(image);
+	time_++;
+
+	boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+	if (!lastDetectTime_.is_special() && now > lastDetectTime_) {
+		framePeriod_ = (1.0 - FRAME_PERIOD_ALPHA) * framePeriod_ + FRAME_PERIOD_ALPHA * (now - lastDetectTime_).total_microseconds();
+	}
+	lastDetectTime_ = now;
+	int delayFrames = static_cast<int>(learningDelaySeconds_ * 1e6 / std::max(framePeriod_, 1.0));
+
+	uchar pixels[CHANNELS][TILE_WIDTH];
+	int laneCount;
+	for (int y = 0; y < size_.height; y++) {
+		uchar* foreground = foreground_.ptr(y);
+		for (int tileX = 0; tileX < tilesPerRow_; tileX++) {
+			int tile = y * tilesPerRow_ + tileX;
+			loadTile(image, y, tileX, pixels, laneCount);
+			detectTile(tile, pixels, laneCount, foreground + tileX * TILE_WIDTH);
+			// новый цвет станет фоном, только если он будет наблюдаться delayFrames кадров почти без перерывов
+			updateTile(tile, pixels, laneCount, time_, time_ + delayFrames, delayFrames / 2);
+		}
+	}
+	sweepStaleEntries();
+	return foreground_;
+}
+
+void TiledCodeBookAlgorithm::updateRows(const cv::Mat& image, int rowBegin, int rowEnd, int time, int activeFrom, int candidateGap) {
+	uchar pixels[CHANNELS][TILE_WIDTH];
+	int laneCount;
+	for (int y = rowBegin; y < rowEnd; y++) {
+		for (int tileX = 0; tileX < tilesPerRow_; tileX++) {
+			loadTile(image, y, tileX, pixels, laneCount);
+			updateTile(y * tilesPerRow_ + tileX, pixels, laneCount, time, activeFrom, candidateGap);
+		}
+	}
+}
+
+void TiledCodeBookAlgorithm::detectTile(int tile, const uchar pixels[CHANNELS][TILE_WIDTH], int laneCount, uchar* foreground) {
+	const uchar* counts = &counts_[static_cast<size_t>(tile) * TILE_WIDTH];
+	Lanes countLanes = load(counts);
+	int maxCount = *std::max_element(counts, counts + TILE_WIDTH);
+
+	Lanes value[CHANNELS];
+	for (int c = 0; c < CHANNELS; c++) {
+		value[c] = load(pixels[c]);
+	}
+	Lanes minMod = splat(settings_.minMod_);
+	Lanes maxMod = splat(settings_.maxMod_);
+
+	Lanes background = zero();
+	for (int slot = 0; slot < maxCount; slot++) {
+		const uchar* bounds = slotBounds(tile, slot);
+		const int* activeFrom = &activeFrom_[slotIndex(tile, slot)];
+		uchar active[TILE_WIDTH];
+		for (int lane = 0; lane < TILE_WIDTH; lane++) {
+			active[lane] = activeFrom[lane] <= time_ ? 0xFF : 0;
+		}
+		Lanes match = andLanes(load(active), slotIsUsed(countLanes, slot));
+		for (int c = 0; c < CHANNELS; c++) {
+			Lanes low = subSat(load(bounds + BOX_MIN + c * TILE_WIDTH), minMod);
+			Lanes high = addSat(load(bounds + BOX_MAX + c * TILE_WIDTH), maxMod);
+			match = andLanes(match, inRange(value[c], low, high));
+		}
+		background = orLanes(background, match);
+	}
+
+	uchar result[TILE_WIDTH];
+	store(result, andNotLanes(ones(), background));
+	memcpy(foreground, result, laneCount);
+}
+
+void TiledCodeBookAlgorithm::updateTile(int tile, const uchar pixels[CHANNELS][TILE_WIDTH], int laneCount, int time, int activeFrom, int candidateGap) {
+	uchar* counts = &counts_[static_cast<size_t>(tile) * TILE_WIDTH];
+	Lanes countLanes = load(counts);
+	int maxCount = *std::max_element(counts, counts + TILE_WIDTH);
+
+	Lanes value[CHANNELS], low[CHANNELS], high[CHANNELS];
+	Lanes bound = splat(settings_.learnBound_);
+	for (int c = 0; c < CHANNELS; c++) {
+		value[c] = load(pixels[c]);
+		low[c] = subSat(value[c], bound);
+		high[c] = addSat(value[c], bound);
+	}
+
+	// Каждый пиксель обновляет первое кодовое слово, в диапазон обучения которого попал
+	Lanes matched = zero();
+	for (int slot = 0; slot < maxCount; slot++) {
+		uchar* bounds = slotBounds(tile, slot);
+		Lanes match = andNotLanes(slotIsUsed(countLanes, slot), matched);
+		for (int c = 0; c < CHANNELS; c++) {
+			match = andLanes(match, inRange(value[c], load(bounds + LEARN_MIN + c * TILE_WIDTH), load(bounds + LEARN_MAX + c * TILE_WIDTH)));
+		}
+		if (!any(match)) {
+			continue;
+		}
+		matched = orLanes(matched, match);
+		for (int c = 0; c < CHANNELS; c++) {
+			uchar* learnMin = bounds + LEARN_MIN + c * TILE_WIDTH;
+			uchar* learnMax = bounds + LEARN_MAX + c * TILE_WIDTH;
+			uchar* boxMin = bounds + BOX_MIN + c * TILE_WIDTH;
+			uchar* boxMax = bounds + BOX_MAX + c * TILE_WIDTH;
+			Lanes learnMinLanes = load(learnMin);
+			Lanes learnMaxLanes = load(learnMax);
+			// диапазон обучения расширяется на единицу в сторону значения пикселя
+			store(learnMin, decrementWhere(learnMinLanes, andNotLanes(match, lessEqual(learnMinLanes, low[c]))));
+			store(learnMax, incrementWhere(learnMaxLanes, andNotLanes(match, lessEqual(high[c], learnMaxLanes))));
+			store(boxMin, minLanes(load(boxMin), orLanes(value[c], andNotLanes(ones(), match))));
+			store(boxMax, maxLanes(load(boxMax), andLanes(value[c], match)));
+		}
+		uchar matchedLanes[TILE_WIDTH];
+		store(matchedLanes, match);
+		int* lastUpdate = &lastUpdate_[slotIndex(tile, slot)];
+		for (int lane = 0; lane < TILE_WIDTH; lane++) {
+			if (matchedLanes[lane]) {
+				lastUpdate[lane] = time;
+			}
+		}
+	}
+
+	uchar matchedLanes[TILE_WIDTH];
+	store(matchedLanes, matched);
+	for (int lane = 0; lane < laneCount; lane++) {
+		// Устаревание: наибольший промежуток между совпадениями; кандидаты в фон с большими промежутками удаляются
+		for (int slot = counts[lane] - 1; slot >= 0; slot--) {
+			size_t index = slotIndex(tile, slot) + lane;
+			int gap = time - lastUpdate_[index];
+			stale_[index] = std::max(stale_[index], gap);
+			if (candidateGap >= 0 && activeFrom_[index] > time && gap > candidateGap) {
+				removeCodeword(tile, lane, slot);
+			}
+		}
+		if (matchedLanes[lane]) {
+			continue;
+		}
+		int slot;
+		if (counts[lane] < capacity_) {
+			slot = counts[lane]++;
+		} else {
+			slot = findEvictionSlot(tile, lane, time, candidateGap >= 0 ? 2 * candidateGap : -1);
+			if (slot < 0) {
+				continue;
+			}
+		}
+		uchar* bounds = slotBounds(tile, slot);
+		for (int c = 0; c < CHANNELS; c++) {
+			int v = pixels[c][lane];
+			bounds[BOX_MIN + c * TILE_WIDTH + lane] = v;
+			bounds[BOX_MAX + c * TILE_WIDTH + lane] = v;
+			bounds[LEARN_MIN + c * TILE_WIDTH + lane] = std::max(v - settings_.learnBound_, 0);
+			bounds[LEARN_MAX + c * TILE_WIDTH + lane] = std::min(v + settings_.learnBound_, 255);
+		}
+		size_t index = slotIndex(tile, slot) + lane;
+		lastUpdate_[index] = time;
+		stale_[index] = 0;
+		activeFrom_[index] = activeFrom;
+	}
+}
+
+int TiledCodeBookAlgorithm::findEvictionSlot(int tile, int lane, int time, int evictAge) const {
+	int count = counts_[static_cast<size_t>(tile) * TILE_WIDTH + lane];
+	int victim = -1;
+	int victimStale = -1;
+	for (int slot = 0; slot < count; slot++) {
+		size_t index = slotIndex(tile, slot) + lane;
+		// stale_ -- наибольший промежуток за всю историю слова, то есть и редкость, и давность совпадений
+		int stale = stale_[index];
+		bool candidate = activeFrom_[index] > time;
+		// защищается фон, совпадавший недавно: исторический промежуток один раз вырос (например, пока кадр
+		// заслонял предмет) и больше не уменьшается, поэтому защита считается по текущему промежутку
+		if (evictAge >= 0 && !candidate && time - lastUpdate_[index] <= evictAge) {
+			continue;
+		}
+		if (stale > victimStale) {
+			victim = slot;
+			victimStale = stale;
+		}
+	}
+	return victim;
+}
+
+void TiledCodeBookAlgorithm::removeCodeword(int tile, int lane, int slot) {
+	uchar& count = counts_[static_cast<size_t>(tile) * TILE_WIDTH + lane];
+	int last = --count;
+	if (slot != last) {
+		uchar* to = slotBounds(tile, slot);
+		const uchar* from = slotBounds(tile, last);
+		for (int field = 0; field < SLOT_BYTES; field += TILE_WIDTH) {
+			to[field + lane] = from[field + lane];
+		}
+		size_t toIndex = slotIndex(tile, slot) + lane;
+		size_t fromIndex = slotIndex(tile, last) + lane;
+		lastUpdate_[toIndex] = lastUpdate_[fromIndex];
+		stale_[toIndex] = stale_[fromIndex];
+		activeFrom_[toIndex] = activeFrom_[fromIndex];
+	}
+}
+
+void TiledCodeBookAlgorithm::sweepStaleEntries() {
+	if (staleSweepRow_ < 0) {
+		return;
+	}
+	int rowEnd = std::min(size_.height, staleSweepRow_ + std::max(1, settings_.staleScanRows_));
+	for (int y = staleSweepRow_; y < rowEnd; y++) {
+		for (int tile = y * tilesPerRow_; tile < (y + 1) * tilesPerRow_; tile++) {
+			for (int lane = 0; lane < TILE_WIDTH; lane++) {
+				for (int slot = counts_[static_cast<size_t>(tile) * TILE_WIDTH + lane] - 1; slot >= 0; slot--) {
+					size_t index = slotIndex(tile, slot) + lane;
+					if (stale_[index] > staleSweepLimit_) {
+						removeCodeword(tile, lane, slot);
+					} else {
+						stale_[index] = 0;
+						lastUpdate_[index] = time_;
+					}
+				}
+			}
+		}
+	}
+	staleSweepRow_ = rowEnd < size_.height ? rowEnd : -1;
+}
+
+void TiledCodeBookAlgorithm::reset() {
+	lastDetectTime_ = boost::posix_time::not_a_date_time;
+	framePeriod_ = DEFAULT_FRAME_PERIOD;
+	staleSweepRow_ = -1;
+}
+
+void TiledCodeBookAlgorithm::clearStaleEntries() {
+	if (size_.area() == 0) {
+		return;
+	}
+	staleSweepLimit_ = time_ / 2;
+	staleSweepRow_ = 0;
+}
+
+void TiledCodeBookAlgorithm::setLearningDelaySeconds(int seconds) {
+	learningDelaySeconds_ = std::max(seconds, 0);
+}
+
+void TiledCodeBookAlgorithm::setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings) {
+	try {
+
+		std::string lexCastError = errors::ERR_05_SETTINGS_CAN_NOT_BE_APPLIED_INCORRECT_PARAMETER;
+		std::string error = errors::ERR_06_SETTINGS_CAN_NOT_BE_APPLIED_PARAMETER_NOT_FOUND;
+
+		{
+			std::string paramName = "codewordCapacity";
+			if (settings.count(paramName)) {
+				settings_.capacity_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				if (settings_.capacity_ < 1 || settings_.capacity_ > MAX_CAPACITY) {
+					errors::throwException(lexCastError + paramName);
+				}
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "modelBudgetKb";
+			if (settings.count(paramName)) {
+				settings_.modelBudgetKb_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "codewordLearnBound";
+			if (settings.count(paramName)) {
+				settings_.learnBound_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "codewordMinMod";
+			if (settings.count(paramName)) {
+				settings_.minMod_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "codewordMaxMod";
+			if (settings.count(paramName)) {
+				settings_.maxMod_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+		{
+			std::string paramName = "staleScanRows";
+			if (settings.count(paramName)) {
+				settings_.staleScanRows_ = System::throwingLexCast<std::string, int>(MapUtils::value(settings, paramName, error + paramName), lexCastError + paramName);
+				usedSettings.insert(paramName);
+			}
+		}
+
+	} catch (std::string& err) {
+		errors::throwException(err);
+	} catch (...) {
+		errors::throwException(errors::ERR_04_SETTINGS_CAN_NOT_BE_APPLIED);
+	}
+}
+
+void TiledCodeBookAlgorithm::getSettings(xml::Request::Params &settings) {
+	settings["codewordCapacity"] = boost::lexical_cast<std::string>(settings_.capacity_);
+	settings["codewordLearnBound"] = boost::lexical_cast<std::string>(settings_.learnBound_);
+	settings["codewordMinMod"] = boost::lexical_cast<std::string>(settings_.minMod_);
+	settings["codewordMaxMod"] = boost::lexical_cast<std::string>(settings_.maxMod_);
+	settings["staleScanRows"] = boost::lexical_cast<std::string>(settings_.staleScanRows_);
+	settings["modelBudgetKb"] = boost::lexical_cast<std::string>(settings_.modelBudgetKb_);
+}
+
+std::string TiledCodeBookAlgorithm::getType() {
+	return TILED_CODE_BOOK_ALGORITHM;
+}
+
+void TiledCodeBookAlgorithm::clear() {
+	size_ = cv::Size();
+	capacity_ = 0;
+	tilesPerRow_ = 0;
+	std::vector<uchar>().swap(bounds_);
+	std::vector<int>().swap(lastUpdate_);
+	std::vector<int>().swap(stale_);
+	std::vector<int>().swap(activeFrom_);
+	std::vector<uchar>().swap(counts_);
+	foreground_ = cv::Mat();
+	time_ = 0;
+	reset();
+}
+
+std::string TiledCodeBookAlgorithm::getSnapshotType() {
+	return getType();
+}
+
+u_int32_t TiledCodeBookAlgorithm::getSnapshotVersion() {
+	return 1;
+}
+
+u_int64_t TiledCodeBookAlgorithm::getSnapshotFingerprint(const cv::Size& frameSize) {
+	// только то, что определяет раскладку и содержимое кодовых слов; пороги детектирования (codewordMinMod,
+	// codewordMaxMod) и скорость удаления (staleScanRows) можно менять, не переобучая модель
+	return SnapshotFingerprint().add(frameSize).add(TILE_WIDTH).add(getCapacity(frameSize)).add(settings_.learnBound_).get();
+}
+
+bool TiledCodeBookAlgorithm::hasSnapshotState() {
+	return size_.area() > 0;
+}
+
+void TiledCodeBookAlgorithm::saveSnapshot(SnapshotWriter& writer) {
+	writer.write(size_.width);
+	writer.write(size_.height);
+	writer.write(capacity_);
+	writer.write(time_);
+	// кандидаты в фон хранят номер кадра активации относительно time_, поэтому time_ сохраняется как есть
+	writer.align();
+	writer.write(&bounds_[0], bounds_.size());
+	writer.align();
+	writer.write(&lastUpdate_[0], lastUpdate_.size() * sizeof(int));
+	writer.write(&stale_[0], stale_.size() * sizeof(int));
+	writer.write(&activeFrom_[0], activeFrom_.size() * sizeof(int));
+	writer.write(&counts_[0], counts_.size());
+}
+
+void TiledCodeBookAlgorithm::restoreSnapshot(SnapshotReader& reader) {
+	cv::Size size;
+	int capacity, time;
+	reader.read(size.width);
+	reader.read(size.height);
+	reader.read(capacity);
+	reader.read(time);
+	if (size.width <= 0 || size.height <= 0 || capacity != getCapacity(size)) {
+		errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": snapshot");
+	}
+
+	TiledCodeBookAlgorithm model(settings_);
+	u_int8_t zero = 0;
+	model.prepare(cv::Mat(size, CV_8UC3, zero));
+	reader.align();
+	reader.read(&model.bounds_[0], model.bounds_.size());
+	reader.align();
+	reader.read(&model.lastUpdate_[0], model.lastUpdate_.size() * sizeof(int));
+	reader.read(&model.stale_[0], model.stale_.size() * sizeof(int));
+	reader.read(&model.activeFrom_[0], model.activeFrom_.size() * sizeof(int));
+	reader.read(&model.counts_[0], model.counts_.size());
+	for (size_t i = 0; i < model.counts_.size(); i++) {
+		if (model.counts_[i] > capacity) {
+			errors::throwException(errors::ERR_11_INCORRECT_PARAMETER + ": snapshot");
+		}
+	}
+
+	size_ = model.size_;
+	capacity_ = model.capacity_;
+	tilesPerRow_ = model.tilesPerRow_;
+	bounds_.swap(model.bounds_);
+	lastUpdate_.swap(model.lastUpdate_);
+	stale_.swap(model.stale_);
+	activeFrom_.swap(model.activeFrom_);
+	counts_.swap(model.counts_);
+	foreground_ = model.foreground_;
+	time_ = time;
+	reset();
+	LOG_INFO("TiledCodeBookAlgorithm: model " << size_.width << "x" << size_.height << " restored at frame " << time_);
+}
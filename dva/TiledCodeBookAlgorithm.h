@@ -0,0 +1,429 @@
+#ifndef TiledCodeBookAlgorithm_h_
+#define TiledCodeBookAlgorithm_h_
+
+#include <vector>
+#include "BackgroundSeparationAlgorithm.h"
+#include "Snapshot.h"
+#include "FrameSource.h"
+
+/**
+ * Алгоритм отделения объектов от фона по кодовым книгам, хранящим кодовые слова в виде структуры массивов.
+ *
+ * Кадр делится на плитки по TILE_WIDTH соседних пикселей строки. Для каждой плитки и каждого из
+ * capacity_ мест кодового слова границы по каждому каналу хранятся подряд для всех пикселей плитки,
+ * поэтому сравнение пикселей плитки с кодовым словом выполняется одной векторной операцией (SSE2)
+ * вместо обхода списков кодовых слов каждого пикселя.
+ *
+ * В режиме классификации модель продолжает обучаться: новые кодовые слова становятся фоном не сразу,
+ * а через setLearningDelaySeconds() секунд, если всё это время они наблюдались. Поэтому оставленный
+ * предмет остаётся передним планом, пока детектор не успеет его заметить.
+ */
+class TiledCodeBookAlgorithm
+	: public BackgroundSeparationAlgorithm
+	, public Snapshotable
+{
+public:
+
+	/**
+	 * Тип алгоритма.
+	 */
+	static const std::string TILED_CODE_BOOK_ALGORITHM;
+
+	/**
+	 * Количество пикселей в плитке (ширина векторного регистра в байтах).
+	 */
+	static const int TILE_WIDTH = 16;
+
+	/**
+	 * Класс настроек алгоритма.
+	 */
+	class TiledCodeBookAlgorithmSettings {
+
+	public:
+
+		/**
+		 * Значения по умолчанию соответствующих полей.
+		 *
+		 * @{
+		 */
+		static const int CAPACITY;
+		static const int LEARN_BOUND;
+		static const int MIN_MOD;
+		static const int MAX_MOD;
+		static const int STALE_SCAN_ROWS;
+		static const int MODEL_BUDGET_KB;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Наибольшее количество кодовых слов на пиксель, от 1 до MAX_CAPACITY.
+		 */
+		int capacity_;
+
+		/**
+		 * Полуширина диапазона обучения кодового слова по каждому каналу.
+		 */
+		int learnBound_;
+
+		/**
+		 * Расширение границ кодового слова вниз и вверх при классификации.
+		 *
+		 * @{
+		 */
+		int minMod_;
+
+		int maxMod_;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Количество строк кадра, в которых за один кадр удаляются устаревшие кодовые слова после clearStaleEntries().
+		 */
+		int staleScanRows_;
+
+		/**
+		 * Наибольший объём модели одного потока (Кб), 0 - ограничен только capacity_.
+		 * Если capacity_ кодовых слов на пиксель не помещаются в бюджет, количество мест уменьшается (но не меньше одного).
+		 * По умолчанию бюджет не ограничен: модель занимает 2 + capacity_ * CODEWORD_BYTES байт на пиксель,
+		 * при capacity_ = 4 около 100 байт на пиксель (около 200 Мб для кадра 1920x1080).
+		 */
+		int modelBudgetKb_;
+
+		/**
+		 * Создаёт объект класса с параметрами по умолчанию.
+		 */
+		TiledCodeBookAlgorithmSettings();
+
+		/**
+		 * Создаёт объект класса с заданными параметрами.
+		 *
+		 * @param описание параметров смотри у описания соответствующих полей класса.
+		 */
+		TiledCodeBookAlgorithmSettings(int capacity, int learnBound, int minMod, int maxMod, int staleScanRows, int modelBudgetKb = MODEL_BUDGET_KB);
+
+	};
+
+	/**
+	 * Наибольшее допустимое значение capacity_.
+	 */
+	static const int MAX_CAPACITY = 32;
+
+	/**
+	 * Количество кадров, которые learnBulk() читает заранее и обучает одним проходом потоков.
+	 */
+	static const int BULK_BATCH_FRAMES = 32;
+
+	/**
+	 * Создаёт алгоритм с настройками по умолчанию.
+	 */
+	TiledCodeBookAlgorithm();
+
+	/**
+	 * Создаёт алгоритм с заданными настройками.
+	 */
+	TiledCodeBookAlgorithm(const TiledCodeBookAlgorithmSettings& settings);
+
+	/**
+	 * Обучает модель на кадре: все цвета кадра сразу считаются фоном.
+	 *
+	 * @param image кадр CV_8UC3.
+	 */
+	virtual void learn(const cv::Mat& image);
+
+	/**
+	 * Обучает модель на всех кадрах источника с наибольшей скоростью, например по записи с новой камеры.
+	 *
+	 * Кадры обрабатываются пачками; строки плиток делятся на полосы, которые обучаются в общем пуле потоков
+	 * (WorkStealingPool), каждая плитка обучается одной задачей в порядке кадров, поэтому модель получается
+	 * такой же, как после learn() на каждом кадре.
+	 * Чтобы живой детектор начал с этой модели, её снимок (serialize() и SnapshotFileSaver::save())
+	 * кладётся по пути snapshotPath детектора (см. пример samples/bulk_learn); должны совпадать размер кадра,
+	 * количество мест кодовых слов и codewordLearnBound, остальные настройки могут отличаться.
+	 *
+	 * @param frames источник кадров CV_8UC3.
+	 * @param threadCount наибольшее количество параллельно обучаемых полос, 0 - по количеству потоков пула.
+	 * @return количество обученных кадров.
+	 * @throw std::string если кадр не CV_8UC3.
+	 */
+	size_t learnBulk(FrameSource& frames, int threadCount = 0);
+
+	/**
+	 * Отделяет объекты от фона и дообучает модель с задержкой.
+	 *
+	 * @param image кадр CV_8UC3.
+	 * @return маска CV_8U, 255 - передний план, 0 - фон.
+	 */
+	virtual cv::Mat detect(const cv::Mat& image);
+
+	/**
+	 * Завершает этап работы: забывает оценку частоты кадров и прерывает незаконченное удаление устаревших слов.
+	 * Обученные кодовые слова сохраняются, модель целиком сбрасывает clear().
+	 */
+	virtual void reset();
+
+	/**
+	 * Назначает удаление кодовых слов, не встречавшихся дольше половины всего времени обучения.
+	 * Удаление выполняется постепенно, по staleScanRows_ строк за кадр.
+	 */
+	virtual void clearStaleEntries();
+
+	/**
+	 * Устанавливает, через сколько секунд непрерывного наблюдения новый цвет становится фоном при классификации.
+	 */
+	virtual void setLearningDelaySeconds(int seconds);
+
+	/**
+	 * Устанавливает настройки(параметры) алгоритма. Все параметры необязательны.
+	 *
+	 * @param settings параметры(настройки) алгоритма.
+	 * @param usedSettings множество используемых настроек.
+	 */
+	virtual void setSettings(const xml::Request::Params &settings, AnCommon::StrSet &usedSettings);
+
+	/**
+	 * Возвращает настройки(параметры) алгоритма.
+	 *
+	 * @param settings параметры(настройки) алгоритма.
+	 */
+	virtual void getSettings(xml::Request::Params &settings);
+
+	/**
+	 * Возвращает тип алгоритма.
+	 */
+	virtual std::string getType();
+
+	/**
+	 * Забывает модель целиком.
+	 */
+	virtual void clear();
+
+	/**
+	 * Возвращает объём памяти, занятой моделью (байт). Он не меняется, пока не изменятся размер кадра или настройки.
+	 */
+	size_t getModelFootprint() const;
+
+	/**
+	 * Возвращает количество кодовых слов в модели.
+	 */
+	size_t getCodewordCount() const;
+
+	/**
+	 * Сохранение и восстановление модели, см. Snapshotable.
+	 *
+	 * @{
+	 */
+	virtual std::string getSnapshotType();
+
+	virtual u_int32_t getSnapshotVersion();
+
+	virtual u_int64_t getSnapshotFingerprint(const cv::Size& frameSize);
+
+	virtual bool hasSnapshotState();
+
+	virtual void saveSnapshot(SnapshotWriter& writer);
+
+	virtual void restoreSnapshot(SnapshotReader& reader);
+	/**
+	 * @}
+	 */
+
+private:
+
+	/**
+	 * Смещения полей кодового слова внутри места плитки; каждое поле -- CHANNELS векторов по TILE_WIDTH байт.
+	 *
+	 * @{
+	 */
+	static const int BOX_MIN = 0;
+	static const int BOX_MAX = 3 * TILE_WIDTH;
+	static const int LEARN_MIN = 6 * TILE_WIDTH;
+	static const int LEARN_MAX = 9 * TILE_WIDTH;
+	static const int SLOT_BYTES = 12 * TILE_WIDTH;
+	/**
+	 * @}
+	 */
+
+	/**
+	 * Количество каналов кадра.
+	 */
+	static const int CHANNELS = 3;
+
+	/**
+	 * Объём памяти на одно место кодового слова одного пикселя (байт).
+	 */
+	static const int CODEWORD_BYTES = SLOT_BYTES / TILE_WIDTH + 3 * sizeof(int);
+
+	/**
+	 * Настройки алгоритма.
+	 */
+	TiledCodeBookAlgorithmSettings settings_;
+
+	/**
+	 * Размер кадра, для которого построена модель.
+	 */
+	cv::Size size_;
+
+	/**
+	 * Количество плиток в строке кадра.
+	 */
+	int tilesPerRow_;
+
+	/**
+	 * Количество мест кодовых слов на пиксель, с которым построена модель.
+	 */
+	int capacity_;
+
+	/**
+	 * Границы кодовых слов: [плитка][место][поле][канал][пиксель плитки].
+	 */
+	std::vector<uchar> bounds_;
+
+	/**
+	 * Номер кадра последнего совпадения кодового слова: [плитка][место][пиксель плитки].
+	 */
+	std::vector<int> lastUpdate_;
+
+	/**
+	 * Наибольший промежуток в кадрах между совпадениями кодового слова: [плитка][место][пиксель плитки].
+	 */
+	std::vector<int> stale_;
+
+	/**
+	 * Номер кадра, с которого кодовое слово считается фоном: [плитка][место][пиксель плитки].
+	 */
+	std::vector<int> activeFrom_;
+
+	/**
+	 * Количество кодовых слов пикселя: [плитка][пиксель плитки].
+	 */
+	std::vector<uchar> counts_;
+
+	/**
+	 * Номер текущего кадра.
+	 */
+	int time_;
+
+	/**
+	 * Задержка превращения нового цвета в фон (сек).
+	 */
+	int learningDelaySeconds_;
+
+	/**
+	 * Оценка периода кадров при классификации (мкс).
+	 */
+	double framePeriod_;
+
+	/**
+	 * Время предыдущего вызова detect().
+	 */
+	boost::posix_time::ptime lastDetectTime_;
+
+	/**
+	 * Следующая строка кадра для постепенного удаления устаревших слов, -1 если удаление не назначено.
+	 */
+	int staleSweepRow_;
+
+	/**
+	 * Кодовые слова, не встречавшиеся дольше этого количества кадров, удаляются.
+	 */
+	int staleSweepLimit_;
+
+	/**
+	 * Результат последнего detect().
+	 */
+	cv::Mat foreground_;
+
+	/**
+	 * Строит пустую модель под размер кадра, если он изменился.
+	 */
+	void prepare(const cv::Mat& image);
+
+	/**
+	 * Возвращает количество мест кодовых слов на пиксель для кадра заданного размера с учётом бюджета памяти.
+	 */
+	int getCapacity(const cv::Size& size) const;
+
+	/**
+	 * Дообучает модель строками кадра [rowBegin, rowEnd).
+	 * Обращается только к плиткам этих строк, поэтому разные строки можно обучать в разных потоках.
+	 *
+	 * @param time номер кадра.
+	 * @param activeFrom номер кадра, с которого новые кодовые слова становятся фоном.
+	 * @param candidateGap кодовые слова, ещё не ставшие фоном и не встречавшиеся дольше этого количества кадров, удаляются;
+	 *        отрицательное значение -- не удалять. Когда места кодовых слов пикселя заняты, новое слово вытесняет
+	 *        самое редко и давно встречавшееся; при candidateGap >= 0 вытесняются только кандидаты в фон
+	 *        и слова, не встречавшиеся дольше 2 * candidateGap кадров.
+	 */
+	void updateRows(const cv::Mat& image, int rowBegin, int rowEnd, int time, int activeFrom, int candidateGap);
+
+	/**
+	 * Обучает строки [rowBegin, rowEnd) на кадрах пачки, начиная с номера кадра firstTime.
+	 */
+	void learnRows(const std::vector<cv::Mat>& batch, int count, int firstTime, int rowBegin, int rowEnd);
+
+	/**
+	 * Обучает модель на пачке кадров одного размера, деля строки не более чем на threadCount полос.
+	 */
+	void learnBatch(const std::vector<cv::Mat>& batch, int count, int threadCount);
+
+	/**
+	 * Дообучает модель одной плиткой.
+	 *
+	 * @param tile номер плитки.
+	 * @param pixels значения пикселей плитки по каналам.
+	 * @param laneCount количество пикселей плитки внутри кадра.
+	 */
+	void updateTile(int tile, const uchar pixels[CHANNELS][TILE_WIDTH], int laneCount, int time, int activeFrom, int candidateGap);
+
+	/**
+	 * Отделяет передний план в одной плитке.
+	 *
+	 * @param foreground сюда записывается 255 для пикселей переднего плана.
+	 */
+	void detectTile(int tile, const uchar pixels[CHANNELS][TILE_WIDTH], int laneCount, uchar* foreground);
+
+	/**
+	 * Удаляет устаревшие кодовые слова в очередных строках, если удаление назначено clearStaleEntries().
+	 */
+	void sweepStaleEntries();
+
+	/**
+	 * Выбирает кодовое слово пикселя для вытеснения: с наибольшим промежутком между совпадениями.
+	 *
+	 * @param evictAge активные слова, совпадавшие не раньше чем @a evictAge кадров назад, не вытесняются;
+	 *        отрицательное значение -- вытесняются любые.
+	 * @return номер места или -1, если вытеснять нечего.
+	 */
+	int findEvictionSlot(int tile, int lane, int time, int evictAge) const;
+
+	/**
+	 * Удаляет кодовое слово пикселя, переставляя на его место последнее.
+	 */
+	void removeCodeword(int tile, int lane, int slot);
+
+	/**
+	 * Раскладывает пиксели плитки по каналам.
+	 */
+	void loadTile(const cv::Mat& image, int y, int tileX, uchar pixels[CHANNELS][TILE_WIDTH], int& laneCount) const;
+
+	/**
+	 * Индексы в массивах модели.
+	 *
+	 * @{
+	 */
+	uchar* slotBounds(int tile, int slot) {
+		return &bounds_[(static_cast<size_t>(tile) * capacity_ + slot) * SLOT_BYTES];
+	}
+
+	size_t slotIndex(int tile, int slot) const {
+		return (static_cast<size_t>(tile) * capacity_ + slot) * TILE_WIDTH;
+	}
+	/**
+	 * @}
+	 */
+
+};
+
+#endif // TiledCodeBookAlgorithm_h_
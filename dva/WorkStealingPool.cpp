@@ -0,0 +1,291 @@
+#include "WorkStealingPool.h"
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <opencv2/core/core.hpp>
+#include <logging/logging.hpp>
+#include "AnCommon.h"
+
+const int WorkStealingPool::WorkStealingPoolSettings::THREAD_COUNT = 0;
+const bool WorkStealingPool::WorkStealingPoolSettings::LIMIT_OPENCV_THREADS = true;
+
+const int WorkStealingPool::CHUNKS_PER_THREAD = 4;
+
+boost::thread_specific_ptr<WorkStealingPool::WorkerContext> WorkStealingPool::context_(&WorkStealingPool::releaseContext);
+
+WorkStealingPool::WorkStealingPoolSettings::WorkStealingPoolSettings()
+	: threadCount_(THREAD_COUNT)
+	, limitOpenCvThreads_(LIMIT_OPENCV_THREADS)
+{}
+
+WorkStealingPool::Job::Job()
+	: group(0)
+{}
+
+WorkStealingPool::TaskGroup::TaskGroup(WorkStealingPool& pool)
+	: pool_(pool)
+	, pending_(0)
+	, failed_(false)
+{}
+
+WorkStealingPool::TaskGroup::~TaskGroup() {
+	try {
+		wait();
+	} catch (...) {
+		// ошибку некому сообщить
+	}
+}
+
+void WorkStealingPool::TaskGroup::run(const Task& task) {
+	Job job;
+	job.task = task;
+	job.group = this;
+	{
+		boost::mutex::scoped_lock lock(pool_.mutex_);
+		pending_++;
+	}
+	pool_.push(job, pool_.getWorkerIndex());
+}
+
+void WorkStealingPool::TaskGroup::wait() {
+	int index = pool_.getWorkerIndex();
+	for (;;) {
+		{
+			boost::mutex::scoped_lock lock(pool_.mutex_);
+			if (pending_ == 0) {
+				break;
+			}
+		}
+
+		Job job;
+		if (pool_.pop(index, true, job)) {
+			pool_.execute(job);
+			continue;
+		}
+
+		// оставшиеся задачи группы выполняются другими потоками
+		boost::mutex::scoped_lock lock(pool_.mutex_);
+		while (pending_ > 0 && pool_.queuedGroupJobs_ <= 0) {
+			pool_.changed_.wait(lock);
+		}
+	}
+
+	if (failed_) {
+		std::string error;
+		error.swap(error_);
+		failed_ = false;
+		errors::throwException(error);
+	}
+}
+
+WorkStealingPool::WorkStealingPool(const WorkStealingPoolSettings& settings)
+	: settings_(settings)
+	, queuedJobs_(0)
+	, queuedGroupJobs_(0)
+	, stolenJobs_(0)
+	, stopping_(false)
+{
+	int cores = std::max(1u, boost::thread::hardware_concurrency());
+	if (settings_.threadCount_ <= 0 || settings_.threadCount_ > cores) {
+		settings_.threadCount_ = cores;
+	}
+	if (settings_.limitOpenCvThreads_) {
+		cv::setNumThreads(1);
+	}
+	for (int i = 0; i < settings_.threadCount_; i++) {
+		queues_.push_back(new WorkerQueue());
+	}
+	for (int i = 0; i < settings_.threadCount_; i++) {
+		threads_.create_thread(boost::bind(&WorkStealingPool::run, this, i));
+	}
+	LOG_INFO("WorkStealingPool: " << settings_.threadCount_ << " threads");
+}
+
+WorkStealingPool::~WorkStealingPool() {
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		stopping_ = true;
+	}
+	changed_.notify_all();
+	threads_.join_all();
+	for (size_t i = 0; i < queues_.size(); i++) {
+		delete queues_[i];
+	}
+}
+
+WorkStealingPool& WorkStealingPool::getDefault() {
+	static WorkStealingPool pool;
+	return pool;
+}
+
+void WorkStealingPool::submit(const Task& task) {
+	Job job;
+	job.task = task;
+	push(job, -1);
+}
+
+void WorkStealingPool::parallelFor(int begin, int end, int minGrain, const RangeTask& task) {
+	if (begin >= end) {
+		return;
+	}
+	int chunks = std::min((end - begin) / std::max(1, minGrain), settings_.threadCount_ * CHUNKS_PER_THREAD);
+	if (chunks <= 1 || settings_.threadCount_ <= 1) {
+		task(begin, end);
+		return;
+	}
+
+	// группа дожидается своих задач и при ошибке первой части, так как они ссылаются на данные вызывающего
+	TaskGroup group(*this);
+	for (int i = chunks - 1; i > 0; i--) {
+		group.run(boost::bind(task, begin + (end - begin) * i / chunks, begin + (end - begin) * (i + 1) / chunks));
+	}
+	task(begin, begin + (end - begin) / chunks);
+	group.wait();
+}
+
+int WorkStealingPool::getThreadCount() const {
+	return settings_.threadCount_;
+}
+
+int WorkStealingPool::getStolenTasks() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return stolenJobs_;
+}
+
+int WorkStealingPool::getWorkerIndex() const {
+	WorkerContext* context = context_.get();
+	return context && context->pool == this ? context->index : -1;
+}
+
+void WorkStealingPool::push(const Job& job, int index) {
+	if (index >= 0) {
+		WorkerQueue& queue = *queues_[index];
+		boost::mutex::scoped_lock lock(queue.mutex);
+		queue.jobs.push_back(job);
+	} else {
+		boost::mutex::scoped_lock lock(injectionQueue_.mutex);
+		if (job.group) {
+			injectionQueue_.jobs.push_front(job);
+		} else {
+			injectionQueue_.jobs.push_back(job);
+		}
+	}
+
+	boost::mutex::scoped_lock lock(mutex_);
+	queuedJobs_++;
+	if (job.group) {
+		queuedGroupJobs_++;
+		// задачу может ждать и поток, ожидающий группу
+		changed_.notify_all();
+	} else {
+		changed_.notify_one();
+	}
+}
+
+bool WorkStealingPool::popFront(WorkerQueue& queue, bool groupOnly, Job& job) {
+	boost::mutex::scoped_lock lock(queue.mutex);
+	// задачи групп в общей очереди стоят перед независимыми, в очередях потоков других нет
+	if (queue.jobs.empty() || (groupOnly && !queue.jobs.front().group)) {
+		return false;
+	}
+	std::swap(job, queue.jobs.front());
+	queue.jobs.pop_front();
+	return true;
+}
+
+bool WorkStealingPool::pop(int index, bool groupOnly, Job& job) {
+	bool found = false;
+	bool stolen = false;
+	if (index >= 0) {
+		WorkerQueue& queue = *queues_[index];
+		boost::mutex::scoped_lock lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			std::swap(job, queue.jobs.back());
+			queue.jobs.pop_back();
+			found = true;
+		}
+	}
+	if (!found) {
+		found = popFront(injectionQueue_, groupOnly, job);
+	}
+	int count = static_cast<int>(queues_.size());
+	for (int i = 1; !found && i <= count; i++) {
+		int victim = (std::max(index, 0) + i) % count;
+		if (victim != index) {
+			found = stolen = popFront(*queues_[victim], groupOnly, job);
+		}
+	}
+	if (!found) {
+		return false;
+	}
+
+	boost::mutex::scoped_lock lock(mutex_);
+	queuedJobs_--;
+	if (job.group) {
+		queuedGroupJobs_--;
+	}
+	if (stolen) {
+		stolenJobs_++;
+	}
+	return true;
+}
+
+void WorkStealingPool::execute(Job& job) {
+	bool failed = false;
+	std::string error;
+	try {
+		job.task();
+	} catch (std::string& e) {
+		failed = true;
+		error = e;
+	} catch (...) {
+		failed = true;
+		error = "unknown error";
+	}
+	// ресурсы задачи освобождаются до того, как ожидающий группу продолжит работу
+	job.task.clear();
+
+	if (!job.group) {
+		if (failed) {
+			LOG_ERROR("WorkStealingPool: task failed: " << error);
+		}
+		return;
+	}
+
+	boost::mutex::scoped_lock lock(mutex_);
+	TaskGroup& group = *job.group;
+	if (failed && !group.failed_) {
+		group.failed_ = true;
+		group.error_ = error;
+	}
+	if (--group.pending_ == 0) {
+		changed_.notify_all();
+	}
+}
+
+void WorkStealingPool::run(int index) {
+	WorkerContext context;
+	context.pool = this;
+	context.index = index;
+	context_.reset(&context);
+
+	for (;;) {
+		Job job;
+		if (pop(index, false, job)) {
+			execute(job);
+			continue;
+		}
+
+		boost::mutex::scoped_lock lock(mutex_);
+		while (queuedJobs_ <= 0 && !stopping_) {
+			changed_.wait(lock);
+		}
+		if (queuedJobs_ <= 0) {
+			break;
+		}
+	}
+
+	context_.reset(0);
+}
+
+void WorkStealingPool::releaseContext(WorkerContext*) {
+}
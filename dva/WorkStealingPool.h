@@ -0,0 +1,314 @@
+#ifndef WorkStealingPool_h_
+#define WorkStealingPool_h_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+
+/**
+ * Общий пул потоков с перехватом задач (work stealing) для анализа потоков камер и параллельной обработки частей кадра.
+ *
+ * Количество потоков не превышает количества ядер, поэтому параллельные части кадров разных камер не конкурируют
+ * за ядра друг с другом. У каждого потока своя очередь: задачи группы (TaskGroup), поставленные из потока пула,
+ * попадают в его очередь и выполняются им в обратном порядке, пока данные ещё в кэше; свободные потоки перехватывают
+ * задачи из начала чужих очередей. Независимые задачи (submit()) попадают в общую очередь и выполняются в порядке
+ * поступления, задачи групп, поставленные извне пула, -- в её начало.
+ *
+ * Ожидание группы (TaskGroup::wait()) не блокирует поток, пока есть задачи: ожидающий выполняет их сам,
+ * поэтому вложенный параллелизм (часть кадра внутри анализа кадра, который сам выполняется в пуле) не приводит
+ * к взаимной блокировке и не занимает потоки простоем.
+ */
+class WorkStealingPool
+	: boost::noncopyable
+{
+
+public:
+
+	/**
+	 * Задача пула.
+	 */
+	typedef boost::function<void ()> Task;
+
+	/**
+	 * Обработка диапазона [begin, end).
+	 */
+	typedef boost::function<void (int, int)> RangeTask;
+
+	/**
+	 * Класс настроек пула.
+	 */
+	class WorkStealingPoolSettings {
+
+	public:
+
+		/**
+		 * Значения по умолчанию соответствующих полей.
+		 *
+		 * @{
+		 */
+		static const int THREAD_COUNT;
+		static const bool LIMIT_OPENCV_THREADS;
+		/**
+		 * @}
+		 */
+
+		/**
+		 * Количество потоков, 0 -- по количеству ядер. Больше количества ядер не бывает.
+		 */
+		int threadCount_;
+
+		/**
+		 * Отключить собственные потоки OpenCV, чтобы его параллельные функции не занимали ядра в обход пула:
+		 * иначе каждый поток пула запускает ещё по потоку OpenCV на ядро. Действует на весь процесс; морфология
+		 * (MorphologyFilter, AnCommon::BitMask) сама делится на полосы в пуле, остальные функции OpenCV
+		 * (cvtColor, resize и т.п.) выполняются в вызвавшем их потоке.
+		 */
+		bool limitOpenCvThreads_;
+
+		/**
+		 * Создаёт объект класса с параметрами по умолчанию.
+		 */
+		WorkStealingPoolSettings();
+
+	};
+
+	/**
+	 * Группа задач, завершения которых можно дождаться.
+	 *
+	 * Первая ошибка (std::string) задачи группы сообщается из wait(), остальные задачи при этом всё равно выполняются.
+	 */
+	class TaskGroup
+		: boost::noncopyable
+	{
+
+	public:
+
+		/**
+		 * Создаёт пустую группу в пуле @a pool.
+		 */
+		explicit TaskGroup(WorkStealingPool& pool = WorkStealingPool::getDefault());
+
+		/**
+		 * Дожидается задач группы, ошибки при этом не сообщаются.
+		 */
+		~TaskGroup();
+
+		/**
+		 * Ставит задачу группы в очередь.
+		 */
+		void run(const Task& task);
+
+		/**
+		 * Дожидается всех задач группы, выполняя в это время задачи пула.
+		 *
+		 * @throw std::string первая ошибка задачи группы.
+		 */
+		void wait();
+
+	private:
+
+		friend class WorkStealingPool;
+
+		WorkStealingPool& pool_;
+
+		/**
+		 * Количество невыполненных задач, защищено мьютексом пула.
+		 */
+		int pending_;
+
+		/**
+		 * Задача группы завершилась ошибкой.
+		 */
+		bool failed_;
+
+		/**
+		 * Первая ошибка задачи группы.
+		 */
+		std::string error_;
+
+	};
+
+	/**
+	 * Запускает потоки пула.
+	 */
+	WorkStealingPool(const WorkStealingPoolSettings& settings = WorkStealingPoolSettings());
+
+	/**
+	 * Выполняет оставшиеся задачи и останавливает потоки.
+	 */
+	~WorkStealingPool();
+
+	/**
+	 * Возвращает общий пул с настройками по умолчанию.
+	 */
+	static WorkStealingPool& getDefault();
+
+	/**
+	 * Ставит независимую задачу в общую очередь. Ошибки задачи только записываются в журнал.
+	 */
+	void submit(const Task& task);
+
+	/**
+	 * Делит диапазон [begin, end) на части не меньше @a minGrain и обрабатывает их параллельно,
+	 * дожидаясь окончания (см. TaskGroup::wait()). Если диапазон мал, он обрабатывается в вызывающем потоке.
+	 *
+	 * @throw std::string первая ошибка обработки части.
+	 */
+	void parallelFor(int begin, int end, int minGrain, const RangeTask& task);
+
+	/**
+	 * Количество потоков.
+	 */
+	int getThreadCount() const;
+
+	/**
+	 * Количество задач, перехваченных из чужих очередей.
+	 */
+	int getStolenTasks();
+
+private:
+
+	/**
+	 * Задача в очереди.
+	 */
+	struct Job {
+
+		Task task;
+
+		/**
+		 * Группа задачи, 0 для независимых задач.
+		 */
+		TaskGroup* group;
+
+		Job();
+
+	};
+
+	/**
+	 * Очередь задач.
+	 */
+	struct WorkerQueue {
+
+		boost::mutex mutex;
+
+		std::deque<Job> jobs;
+
+	};
+
+	/**
+	 * Поток, выполняющий код, и его очередь.
+	 */
+	struct WorkerContext {
+
+		WorkStealingPool* pool;
+
+		int index;
+
+	};
+
+	/**
+	 * Количество частей диапазона parallelFor() на поток, чтобы неравномерные части перераспределялись перехватом.
+	 */
+	static const int CHUNKS_PER_THREAD;
+
+	/**
+	 * Настройки пула.
+	 */
+	WorkStealingPoolSettings settings_;
+
+	/**
+	 * Очереди потоков пула.
+	 */
+	std::vector<WorkerQueue*> queues_;
+
+	/**
+	 * Общая очередь.
+	 */
+	WorkerQueue injectionQueue_;
+
+	/**
+	 * Защищает счётчики и группы задач.
+	 */
+	boost::mutex mutex_;
+
+	/**
+	 * Сигнализирует о новой задаче, о завершении группы или об остановке.
+	 */
+	boost::condition_variable changed_;
+
+	/**
+	 * Количество задач во всех очередях.
+	 */
+	int queuedJobs_;
+
+	/**
+	 * Количество задач групп во всех очередях.
+	 */
+	int queuedGroupJobs_;
+
+	/**
+	 * Количество перехваченных задач.
+	 */
+	int stolenJobs_;
+
+	/**
+	 * Потоки должны закончить очереди и завершиться.
+	 */
+	bool stopping_;
+
+	/**
+	 * Потоки пула.
+	 */
+	boost::thread_group threads_;
+
+	/**
+	 * Контекст текущего потока, если это поток пула.
+	 */
+	static boost::thread_specific_ptr<WorkerContext> context_;
+
+	/**
+	 * Индекс очереди текущего потока в этом пуле, -1 если поток не принадлежит пулу.
+	 */
+	int getWorkerIndex() const;
+
+	/**
+	 * Ставит задачу в очередь потока @a index или в общую очередь при -1.
+	 * Задачи групп ставятся в начало общей очереди: они -- части уже начатой работы.
+	 */
+	void push(const Job& job, int index);
+
+	/**
+	 * Берёт задачу: из конца своей очереди, затем из начала общей, затем из начала чужих.
+	 *
+	 * @param index индекс очереди текущего потока, -1 если поток не принадлежит пулу.
+	 * @param groupOnly брать только задачи групп: ожидающий группу не должен надолго занимать себя независимой задачей.
+	 * @return false, если задач нет.
+	 */
+	bool pop(int index, bool groupOnly, Job& job);
+
+	/**
+	 * Берёт задачу из начала очереди @a queue.
+	 */
+	static bool popFront(WorkerQueue& queue, bool groupOnly, Job& job);
+
+	/**
+	 * Выполняет задачу и отмечает её завершение в группе.
+	 */
+	void execute(Job& job);
+
+	/**
+	 * Тело потока пула.
+	 */
+	void run(int index);
+
+	/**
+	 * Не удаляет контекст, он принадлежит стеку потока.
+	 */
+	static void releaseContext(WorkerContext* context);
+
+};
+
+#endif // WorkStealingPool_h_
@@ -1,7 +1,12 @@
 #!/bin/bash
 
+# Ролик генерируется примером samples/synthetic_video (synthetic_video_run.sh).
+
 #LD_LIBRARY_PATH="./../../../external_libs/lib64" ./background_separation ./iq720p.mp4
 
 #LD_LIBRARY_PATH="/usr/local/lib" ./background_separation /home/user/iq720p.mp4
 
-./background_separation /home/user/iq720p.mp4
+./background_separation ../../synthetic_video/synthetic720p.avi
+
+# без окон, с максимальной скоростью и итогами производительности:
+#./background_separation ../../synthetic_video/synthetic720p.avi --headless
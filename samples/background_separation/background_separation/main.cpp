@@ -9,6 +9,8 @@
 #include <iostream>
 #include <sstream>
 
+#include "../../common/sample_bench.hpp"
+
 const float PERIM_SCALE = 10.0;
 const int CLOSE_ITR = 1;
 
@@ -34,6 +36,10 @@ void processImages(char* firstFrameFilename);
 int thresh = 100;
 int levels = 3;
 
+// --headless: без окон и задержек, с итогами производительности при выходе
+bool headless = false;
+SampleBench bench;
+
 void throwError(const std::string& msg) {
     cerr << "Error: " << msg << endl;
     exit(EXIT_FAILURE);
@@ -100,7 +106,9 @@ cv::Mat connectedComponentsFilter(cv::Mat& curFrame, cv::Mat& img) {
             cv::circle(kmeans_data, pointLeft, 2, cv::Scalar(255), FILLED, LINE_AA );
             cv::circle(kmeans_data, pointRight, 2, cv::Scalar(255), FILLED, LINE_AA );
 
-            cv::imshow("kmeans_data", kmeans_data);
+            if (!headless) {
+                cv::imshow("kmeans_data", kmeans_data);
+            }
 
 
             i++;
@@ -141,16 +149,22 @@ void drawObjects(Mat& curFrame, Mat& img) {
     }*/
 
     /// Show in a window
-    imshow( "Contours", resultConnectComp);
+    if (!headless) {
+        imshow( "Contours", resultConnectComp);
+    }
 }
 
 int main(int argc, char* argv[]) {
 
+    headless = takeFlag(argc, argv, "--headless");
+
     //create GUI windows
-    namedWindow("Frame");
-    namedWindow("FG Mask MOG");
-    namedWindow("FG Mask MOG 2");
-    namedWindow( "Contours" );
+    if (!headless) {
+        namedWindow("Frame");
+        namedWindow("FG Mask MOG");
+        namedWindow("FG Mask MOG 2");
+        namedWindow( "Contours" );
+    }
 
     //create Background Subtractor objects
 
@@ -163,7 +177,7 @@ int main(int argc, char* argv[]) {
     pMOG2->setShadowValue(0);
 
     if (argc < 2) {
-        throwError("Must be one parameters - name of file");
+        throwError("Must be one parameters - name of file (and optional --headless)");
     }
 
     std::cout << "File capture: " << argv[1] << std::endl;
@@ -171,7 +185,9 @@ int main(int argc, char* argv[]) {
     processVideo(argv[1] /*"/home/sergey/iq720p.mp4"*/);
 
     //destroy GUI windows
-    destroyAllWindows();
+    if (!headless) {
+        destroyAllWindows();
+    }
     return EXIT_SUCCESS;
 }
 
@@ -187,16 +203,25 @@ void processVideo(char* videoFilename) {
     //read input data. ESC or 'q' for quitting
     while( (char)keyboard != 'q' && (char)keyboard != 27 ){
 
+        bench.beginFrame();
+
         //read the current frame
         if(!capture.read(frame)) {
+            if (headless) {
+                // весь файл обработан
+                break;
+            }
             cerr << "Unable to read next frame." << endl;
             cerr << "Exiting..." << endl;
             exit(EXIT_FAILURE);
         }
+        bench.stage("read");
 
         //update the background modelS
         pMOG->apply(frame, fgMaskMOG);
+        bench.stage("mog");
         pMOG2->apply(frame, fgMaskMOG2);
+        bench.stage("mog2");
 
         //get the frame number and write it on the current frame
         stringstream ss;
@@ -208,16 +233,27 @@ void processVideo(char* videoFilename) {
                 FONT_HERSHEY_SIMPLEX, 0.5 , cv::Scalar(0,0,0));
 
 
+        bench.stage("annotate");
+
         drawObjects(frame, fgMaskMOG2);
+        bench.stage("objects");
 
-        //show the current frame and the fg masks
-        imshow("Frame", frame);
-        imshow("FG Mask MOG", fgMaskMOG);
-        imshow("FG Mask MOG 2", fgMaskMOG2);
+        if (!headless) {
+            //show the current frame and the fg masks
+            imshow("Frame", frame);
+            imshow("FG Mask MOG", fgMaskMOG);
+            imshow("FG Mask MOG 2", fgMaskMOG2);
 
-        //get the input from the keyboard
-        keyboard = waitKey( 30 );
+            //get the input from the keyboard
+            keyboard = waitKey( 30 );
+            bench.stage("display");
+        }
+        bench.endFrame();
     }
     //delete capture object
     capture.release();
+
+    if (headless) {
+        bench.report();
+    }
 }
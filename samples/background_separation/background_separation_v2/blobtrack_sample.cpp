@@ -6,6 +6,12 @@
 
 #include <stdio.h>
 
+#include "../../common/sample_bench.hpp"
+
+/* --headless: no windows and no waiting, performance summary at exit */
+static bool headless = false;
+static SampleBench bench;
+
 /* Select appropriate case insensitive string comparison function: */
 #if defined WIN32 || defined _MSC_VER
 # define MY_STRNICMP _strnicmp
@@ -139,7 +145,7 @@ static int RunBlobTrackingAuto( CvCapture* pCap, CvBlobTrackerAuto* pTracker,cha
     //cvNamedWindow( "FG", 0 );
 
     /* Main loop: */
-    for( FrameNum=0; pCap && (key=cvWaitKey(OneFrameProcess?0:1))!=27;
+    for( FrameNum=0; pCap && (key=(headless ? -1 : cvWaitKey(OneFrameProcess?0:1)))!=27;
          FrameNum++)
     {   /* Main loop: */
         IplImage*   pImg  = NULL;
@@ -151,12 +157,15 @@ static int RunBlobTrackingAuto( CvCapture* pCap, CvBlobTrackerAuto* pTracker,cha
             if(key=='r')OneFrameProcess = 0;
         }
 
+        bench.beginFrame();
         pImg = cvQueryFrame(pCap);
         if(pImg == NULL) break;
+        bench.stage("read");
 
 
         /* Process: */
         pTracker->Process(pImg, pMask);
+        bench.stage("process");
 
         if(fgavi_name)
         if(pTracker->GetFGMask())
@@ -198,13 +207,16 @@ static int RunBlobTrackingAuto( CvCapture* pCap, CvBlobTrackerAuto* pTracker,cha
                 }   /* Next blob: */;
             }
 
-            cvNamedWindow( "FG",0);
-            cvShowImage( "FG",pI);
+            if(!headless)
+            {
+                cvNamedWindow( "FG",0);
+                cvShowImage( "FG",pI);
+            }
         }   /* Debug FG. */
 
 
         /* Draw debug info: */
-        if(pImg)
+        if(pImg && (!headless || btavi_name))
         {   /* Draw all information about test sequence: */
             char        str[1024];
             int         line_type = CV_AA;   // Change it to 8 to see non-antialiased graphics.
@@ -264,8 +276,11 @@ static int RunBlobTrackingAuto( CvCapture* pCap, CvBlobTrackerAuto* pTracker,cha
 
             }   /* Next blob. */;
 
-            cvNamedWindow( "Tracking", 0);
-            cvShowImage( "Tracking",pI );
+            if(!headless)
+            {
+                cvNamedWindow( "Tracking", 0);
+                cvShowImage( "Tracking",pI );
+            }
 
             if(btavi_name && pI)
             {   /* Save to avi file: */
@@ -283,8 +298,12 @@ static int RunBlobTrackingAuto( CvCapture* pCap, CvBlobTrackerAuto* pTracker,cha
 
             cvReleaseImage(&pI);
         }   /* Draw all information about test sequence. */
+        bench.stage("draw");
+        bench.endFrame();
     }   /*  Main loop. */
 
+    if(headless) bench.report();
+
     if(pFGAvi)cvReleaseVideoWriter( &pFGAvi );
     if(pBTAvi)cvReleaseVideoWriter( &pBTAvi );
     return 0;
@@ -402,7 +421,9 @@ int main(int argc, char* argv[])
     DefModule_BlobTrackGen*         pBTGenModule = NULL;
     DefModule_BlobTrackAnalysis*    pBTAnalysisModule = NULL;
 
-    cvInitSystem(argc, argv);
+    headless = takeFlag(argc, argv, "--headless");
+
+    if(!headless) cvInitSystem(argc, argv);
 
     if(argc < 2)
     {   /* Print help: */
@@ -417,6 +438,7 @@ int main(int argc, char* argv[])
             "          [scale=<scale val>] [noise=<noise_name>] [IVar=<IVar_name>]\n"
             "          [FGTrainFrames=<FGTrainFrames>]\n"
             "          [btavi=<avi output>] [fgavi=<avi output on FG>]\n"
+            "          [--headless]\n"
             "          <avi_file>\n");
 
         printf("  <bt_corr_way> is the method of blob position correction for the \"Blob Tracking\" module\n"
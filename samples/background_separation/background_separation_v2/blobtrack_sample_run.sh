@@ -1,8 +1,13 @@
 #!/bin/bash
 
+# Ролик генерируется примером samples/synthetic_video (synthetic_video_run.sh).
+
 #LD_LIBRARY_PATH="/usr/local/lib" ./blobtrack_sample fg=FG_1 bd=BD_Simple bt=MSFG btpp=Kalman bta=HistSS avi_name="./tree.avi" 
 #LD_LIBRARY_PATH="/usr/local/lib" ./blobtrack_sample fg=FG_1 bd=BD_Simple bt=MSFG btpp=Kalman avi_name="./tree.avi"
 #LD_LIBRARY_PATH="./../../../external_libs/lib" ./blobtrack_sample ./iq720p.mp4 fg=FG_1 bd=BD_Simple bt=MSFG
 
-LD_LIBRARY_PATH="/usr/local/lib" ./blobtrack_sample /home/user/iq720p.mp4 fg=FG_1 bd=BD_Simple bt=MSFG
+LD_LIBRARY_PATH="/usr/local/lib" ./blobtrack_sample ../../synthetic_video/synthetic720p.avi fg=FG_1 bd=BD_Simple bt=MSFG
+
 
+# без окон, с максимальной скоростью и итогами производительности:
+#LD_LIBRARY_PATH="/usr/local/lib" ./blobtrack_sample ../../synthetic_video/synthetic720p.avi fg=FG_1 bd=BD_Simple bt=MSFG --headless
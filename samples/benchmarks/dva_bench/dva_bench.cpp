@@ -0,0 +1,323 @@
+// Микробенчмарки вычислительных ядер dva (Google Benchmark).
+// BM_SmokeDetectorSequential и BM_SmokeDetectorPipeline сравнивают покадровый анализ с конвейерным (StreamPipeline).
+//
+// Аргументы бенчмарков: индекс разрешения (см. RESOLUTIONS), количество каналов кадра и
+// заполненность маски переднего плана в процентах. Результаты в JSON для сравнения между версиями:
+//   ./dva_bench --benchmark_out=dva_bench.json --benchmark_out_format=json
+
+#include <benchmark/benchmark.h>
+#include <opencv2/core/core.hpp>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "AnCommon.h"
+#include "MorphologyFilter.h"
+#include "ConnectedComponentsFilter.h"
+#include "FireDetectOnColorAlgorithm.h"
+#include "FireDetectOnDynamicAlgorithm.h"
+#include "SmokeDetectOnContrastAlgorithm.h"
+#include "SyntheticScene.h"
+#include "SmokeDetector.h"
+#include "StreamPipeline.h"
+
+namespace {
+
+struct Resolution {
+    const char* name;
+    int width;
+    int height;
+};
+
+// От CIF до 4K.
+const Resolution RESOLUTIONS[] = {
+    { "CIF", 352, 288 },
+    { "D1", 720, 576 },
+    { "720p", 1280, 720 },
+    { "1080p", 1920, 1080 },
+    { "4K", 3840, 2160 },
+};
+
+const int RESOLUTION_COUNT = sizeof(RESOLUTIONS) / sizeof(RESOLUTIONS[0]);
+
+// Постоянное зерно, чтобы все запуски обрабатывали одни и те же данные.
+const uint64 SEED = 0x5EED;
+
+// Размер блока, на которые детекторы делят кадр.
+const cv::Size BLOCK_SIZE(16, 16);
+
+cv::Size getSize(const benchmark::State& state) {
+    const Resolution& resolution = RESOLUTIONS[state.range(0)];
+    return cv::Size(resolution.width, resolution.height);
+}
+
+// Кадр с шумом.
+cv::Mat makeFrame(const cv::Size& size, int channels, uint64 seed = SEED) {
+    cv::Mat frame(size, CV_MAKETYPE(CV_8U, channels));
+    cv::RNG rng(seed);
+    rng.fill(frame, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+    return frame;
+}
+
+// Два соседних кадра синтетической сцены с огнём и дымом, которые уже появились.
+void makeSceneFrames(const cv::Size& size, cv::Mat frames[2]) {
+    SyntheticScene::SyntheticSceneSettings settings(size, static_cast<unsigned>(SEED));
+    SyntheticScene scene(settings);
+    int frameIndex = settings.frameCount_ - 2;
+    scene.render(frameIndex, frames[0]);
+    scene.render(frameIndex + 1, frames[1]);
+}
+
+// Отрезок сцены с дымом для детекторов: последние кадры сцены.
+const int CLIP_FRAMES = 16;
+
+void makeSceneClip(const cv::Size& size, std::vector<cv::Mat>& frames) {
+    SyntheticScene::SyntheticSceneSettings settings(size, static_cast<unsigned>(SEED));
+    SyntheticScene scene(settings);
+    frames.resize(CLIP_FRAMES);
+    for (int i = 0; i < CLIP_FRAMES; i++) {
+        scene.render(settings.frameCount_ - CLIP_FRAMES + i, frames[i]);
+    }
+}
+
+// Детектор дыма с результатом на каждом кадре, чтобы сериализация выполнялась всегда.
+Detector::SharedPtr makeSmokeDetector() {
+    Detector::SharedPtr detector(new SmokeDetector());
+    xml::Request::Params params = detector->getSettings();
+    params["alertTime"] = "0";
+    detector->setSettings(params);
+    detector->on();
+    return detector;
+}
+
+// Маска переднего плана из прямоугольников, покрывающих примерно densityPercent процентов кадра.
+cv::Mat makeMask(const cv::Size& size, int densityPercent) {
+    cv::Mat mask(size, CV_8U, cv::Scalar(0));
+    cv::RNG rng(SEED);
+    int side = std::max(4, std::min(size.width, size.height) / 20);
+    long target = static_cast<long>(size.area()) * densityPercent / 100;
+    long covered = 0;
+    while (covered < target) {
+        cv::Rect rect(rng.uniform(0, size.width - side), rng.uniform(0, size.height - side),
+                      rng.uniform(side / 2, side * 2), rng.uniform(side / 2, side * 2));
+        rect &= cv::Rect(0, 0, size.width, size.height);
+        mask(rect).setTo(255);
+        covered += rect.area();
+    }
+    return mask;
+}
+
+void setCounters(benchmark::State& state, const cv::Size& size, int channels) {
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size.area()) * channels);
+    state.SetLabel(RESOLUTIONS[state.range(0)].name);
+}
+
+// Аргументы: все разрешения x заполненность маски.
+void maskArgs(benchmark::internal::Benchmark* b) {
+    for (int r = 0; r < RESOLUTION_COUNT; r++) {
+        b->Args({ r, 1, 1 })->Args({ r, 1, 10 })->Args({ r, 1, 50 });
+    }
+    b->ArgNames({ "res", "ch", "density" });
+}
+
+// Аргументы: все разрешения x количество каналов.
+void frameArgs(benchmark::internal::Benchmark* b) {
+    for (int r = 0; r < RESOLUTION_COUNT; r++) {
+        b->Args({ r, 1, 0 })->Args({ r, 3, 0 });
+    }
+    b->ArgNames({ "res", "ch", "density" });
+}
+
+// Аргументы: все разрешения, цветной кадр.
+void colorFrameArgs(benchmark::internal::Benchmark* b) {
+    for (int r = 0; r < RESOLUTION_COUNT; r++) {
+        b->Args({ r, 3, 0 });
+    }
+    b->ArgNames({ "res", "ch", "density" });
+}
+
+void BM_GetBitMap(benchmark::State& state) {
+    cv::Size size = getSize(state);
+    cv::Mat mask = makeMask(size, state.range(2));
+    for (auto _ : state) {
+        cv::Mat bitmap = AnCommon::getBitMap(mask, BLOCK_SIZE, 50);
+        benchmark::DoNotOptimize(bitmap.data);
+    }
+    setCounters(state, size, 1);
+}
+BENCHMARK(BM_GetBitMap)->Apply(maskArgs);
+
+void BM_CreateObjectList(benchmark::State& state) {
+    cv::Size size = getSize(state);
+    cv::Mat mask = makeMask(size, state.range(2));
+    for (auto _ : state) {
+        std::list<AnCommon::Object> objects = AnCommon::createObjectList(mask, AnCommon::STANDARD_APPROX_LEVEL);
+        benchmark::DoNotOptimize(objects);
+    }
+    setCounters(state, size, 1);
+}
+BENCHMARK(BM_CreateObjectList)->Apply(maskArgs);
+
+void BM_RotateImageClockwise(benchmark::State& state) {
+    cv::Size size = getSize(state);
+    int channels = state.range(1);
+    cv::Mat frame = makeFrame(size, channels);
+    for (auto _ : state) {
+        cv::Mat rotated = AnCommon::rotateImageClockwise(frame, 1);
+        benchmark::DoNotOptimize(rotated.data);
+    }
+    setCounters(state, size, channels);
+}
+BENCHMARK(BM_RotateImageClockwise)->Apply(frameArgs);
+
+void BM_GetXMLBitMap(benchmark::State& state) {
+    cv::Size size = getSize(state);
+    cv::Mat bitmap = AnCommon::getBitMap(makeMask(size, state.range(2)), BLOCK_SIZE, 50);
+    for (auto _ : state) {
+        std::string xml = AnCommon::getXMLBitMap(bitmap, BLOCK_SIZE);
+        benchmark::DoNotOptimize(xml);
+    }
+    setCounters(state, size, 1);
+}
+BENCHMARK(BM_GetXMLBitMap)->Apply(maskArgs);
+
+void BM_GetXMLObjectList(benchmark::State& state) {
+    cv::Size size = getSize(state);
+    std::list<AnCommon::Object> objects = AnCommon::createObjectList(makeMask(size, state.range(2)), AnCommon::STANDARD_APPROX_LEVEL);
+    for (auto _ : state) {
+        std::string xml = AnCommon::getXMLObjectList(objects, BLOCK_SIZE);
+        benchmark::DoNotOptimize(xml);
+    }
+    setCounters(state, size, 1);
+    state.counters["objects"] = objects.size();
+}
+BENCHMARK(BM_GetXMLObjectList)->Apply(maskArgs);
+
+void BM_MorphologyFilter(benchmark::State& state) {
+    cv::Size size = getSize(state);
+    cv::Mat source = makeMask(size, state.range(2));
+    MorphologyFilter filter;
+    cv::Mat mask;
+    for (auto _ : state) {
+        // фильтр меняет маску, поэтому каждый раз берётся копия
+        state.PauseTiming();
+        source.copyTo(mask);
+        state.ResumeTiming();
+        cv::Mat result = filter(mask);
+        benchmark::DoNotOptimize(result.data);
+    }
+    setCounters(state, size, 1);
+}
+BENCHMARK(BM_MorphologyFilter)->Apply(maskArgs);
+
+void BM_ConnectedComponentsFilter(benchmark::State& state) {
+    cv::Size size = getSize(state);
+    cv::Mat source = makeMask(size, state.range(2));
+    ConnectedComponentsFilter filter;
+    cv::Mat mask;
+    for (auto _ : state) {
+        state.PauseTiming();
+        source.copyTo(mask);
+        state.ResumeTiming();
+        cv::Mat result = filter(mask);
+        benchmark::DoNotOptimize(result.data);
+    }
+    setCounters(state, size, 1);
+}
+BENCHMARK(BM_ConnectedComponentsFilter)->Apply(maskArgs);
+
+// Путь pixelIsForeground по цвету пикселя.
+void BM_FireDetectOnColor(benchmark::State& state) {
+    cv::Size size = getSize(state);
+    cv::Mat frames[2];
+    makeSceneFrames(size, frames);
+    cv::Mat frame = frames[0];
+    FireDetectOnColorAlgorithm algorithm;
+    for (auto _ : state) {
+        cv::Mat mask = algorithm.detect(frame);
+        benchmark::DoNotOptimize(mask.data);
+    }
+    setCounters(state, size, 3);
+}
+BENCHMARK(BM_FireDetectOnColor)->Apply(colorFrameArgs);
+
+// Путь pixelIsForeground по скользящему среднему; кадры чередуются, чтобы модель не застывала.
+void BM_FireDetectOnDynamic(benchmark::State& state) {
+    cv::Size size = getSize(state);
+    cv::Mat frames[2];
+    makeSceneFrames(size, frames);
+    FireDetectOnDynamicAlgorithm algorithm;
+    algorithm.detect(frames[1]);
+    int i = 0;
+    for (auto _ : state) {
+        cv::Mat mask = algorithm.detect(frames[i ^= 1]);
+        benchmark::DoNotOptimize(mask.data);
+    }
+    setCounters(state, size, 3);
+}
+BENCHMARK(BM_FireDetectOnDynamic)->Apply(colorFrameArgs);
+
+// Алгоритм работает в HSV, поэтому только цветные кадры.
+void BM_SmokeDetectOnContrast(benchmark::State& state) {
+    cv::Size size = getSize(state);
+    int channels = state.range(1);
+    cv::Mat frames[2];
+    makeSceneFrames(size, frames);
+    SmokeDetectOnContrastAlgorithm algorithm;
+    algorithm.detect(frames[1], BLOCK_SIZE);
+    int i = 0;
+    for (auto _ : state) {
+        cv::Mat mask = algorithm.detect(frames[i ^= 1], BLOCK_SIZE);
+        benchmark::DoNotOptimize(mask.data);
+    }
+    setCounters(state, size, channels);
+}
+BENCHMARK(BM_SmokeDetectOnContrast)->Apply(colorFrameArgs);
+
+// Отрезок кадров в одном потоке: подготовка, анализ и сериализация результата складываются.
+void BM_SmokeDetectorSequential(benchmark::State& state) {
+    cv::Size size = getSize(state);
+    std::vector<cv::Mat> frames;
+    makeSceneClip(size, frames);
+    Detector::SharedPtr detector = makeSmokeDetector();
+    boost::posix_time::ptime imageTime(boost::gregorian::date(2000, 1, 1));
+    std::string resultingXml;
+    for (auto _ : state) {
+        for (size_t i = 0; i < frames.size(); i++) {
+            detector->executePrepared(frames[i], detector->prepare(frames[i]), imageTime, resultingXml);
+            benchmark::DoNotOptimize(resultingXml.data());
+            imageTime += boost::posix_time::milliseconds(40);
+        }
+    }
+    setCounters(state, size, 3);
+    state.SetItemsProcessed(state.iterations() * CLIP_FRAMES);
+}
+BENCHMARK(BM_SmokeDetectorSequential)->Apply(colorFrameArgs)->UseRealTime();
+
+// Тот же отрезок через StreamPipeline: этапы перекрываются, поэтому кадров в секунду должно быть больше,
+// чем у BM_SmokeDetectorSequential, -- вплоть до скорости самого медленного этапа вместо суммы этапов.
+// Каждая итерация дожидается выдачи результатов всего отрезка, заполнение и опустошение конвейера входят в замер.
+void BM_SmokeDetectorPipeline(benchmark::State& state) {
+    cv::Size size = getSize(state);
+    std::vector<cv::Mat> frames;
+    makeSceneClip(size, frames);
+    StreamPipeline pipeline(makeSmokeDetector(), Detector::ResultCallback());
+    boost::posix_time::ptime imageTime(boost::gregorian::date(2000, 1, 1));
+    for (auto _ : state) {
+        for (size_t i = 0; i < frames.size(); i++) {
+            while (!pipeline.submit(frames[i], imageTime)) {
+                boost::this_thread::yield();
+            }
+            imageTime += boost::posix_time::milliseconds(40);
+        }
+        pipeline.wait();
+    }
+    setCounters(state, size, 3);
+    state.SetItemsProcessed(state.iterations() * CLIP_FRAMES);
+}
+BENCHMARK(BM_SmokeDetectorPipeline)->Apply(colorFrameArgs)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,6 @@
+#!/bin/bash
+
+# Результаты в JSON, для сравнения между версиями:
+# compare.py из Google Benchmark: compare.py benchmarks old.json new.json
+
+LD_LIBRARY_PATH="/usr/local/lib" ./dva_bench --benchmark_out=dva_bench.json --benchmark_out_format=json "$@"
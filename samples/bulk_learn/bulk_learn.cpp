@@ -0,0 +1,50 @@
+// Обучает фоновую модель детектора оставленных вещей по записи с камеры и сохраняет её снимок,
+// чтобы детектор на этой камере начал работу сразу с классификации, без периода обучения.
+//
+//   bulk_learn <video> <snapshot> [name=value ...]
+//
+// Настройки -- те же, с которыми будет работать детектор (область анализа, codewordCapacity,
+// modelBudgetKb, codewordLearnBound); снимок восстанавливается, только если они совпадают.
+// Детектору задаются backgroundAlgorithm=TILED_CODE_BOOK_ALGORITHM и snapshotPath=<snapshot>.
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <boost/lexical_cast.hpp>
+
+#include "LeftThingsDetector.h"
+#include "TiledCodeBookAlgorithm.h"
+#include "FrameSource.h"
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <video> <snapshot> [name=value ...]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    LeftThingsDetector detector;
+    // обязательные настройки детектора берутся по умолчанию
+    xml::Request::Params params = detector.getSettings();
+    params["backgroundAlgorithm"] = TiledCodeBookAlgorithm::TILED_CODE_BOOK_ALGORITHM;
+    params["mode"] = boost::lexical_cast<std::string>(AnCommon::IDLE);
+    for (int i = 3; i < argc; i++) {
+        const char* separator = strchr(argv[i], '=');
+        if (separator == NULL) {
+            std::cerr << "Setting must be name=value: " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+        params[std::string(argv[i], separator - argv[i])] = separator + 1;
+    }
+    params["snapshotPath"] = argv[2];
+
+    try {
+        detector.setSettings(params);
+        VideoFileFrameSource frames(argv[1]);
+        size_t learned = detector.learnFromRecording(frames);
+        std::cout << argv[2] << ": background model learned from " << learned << " frames of " << argv[1] << std::endl;
+    } catch (std::string& error) {
+        std::cerr << "Background model was not learned: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+# Обучение фоновой модели по синтетическому ролику (см. samples/synthetic_video) и сохранение снимка.
+LD_LIBRARY_PATH="/usr/local/lib" ./bulk_learn ../synthetic_video/synthetic720p.avi ./left_things.snapshot
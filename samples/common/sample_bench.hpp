@@ -0,0 +1,88 @@
+#ifndef SAMPLE_BENCH_HPP
+#define SAMPLE_BENCH_HPP
+
+// Замер производительности примеров: кадры в секунду, время по этапам и пиковое потребление памяти.
+// Используется в режиме без окон (headless), когда кадры обрабатываются с максимальной скоростью.
+
+#include <sys/resource.h>
+#include <time.h>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+class SampleBench {
+public:
+    SampleBench() : frames_(0), start_(now()), mark_(start_) {}
+
+    // Начало обработки кадра.
+    void beginFrame() {
+        mark_ = now();
+    }
+
+    // Конец этапа: время от предыдущей отметки добавляется к этапу name.
+    void stage(const char* name) {
+        double time = now();
+        std::map<std::string, double>::iterator it = seconds_.find(name);
+        if (it == seconds_.end()) {
+            order_.push_back(name);
+            seconds_[name] = time - mark_;
+        } else {
+            it->second += time - mark_;
+        }
+        mark_ = time;
+    }
+
+    // Конец обработки кадра.
+    void endFrame() {
+        frames_++;
+    }
+
+    // Печатает итоги в stderr, чтобы они не смешивались с выводом примера.
+    void report() const {
+        double total = now() - start_;
+        fprintf(stderr, "frames: %ld, time: %.3f s, fps: %.2f\n", frames_, total, total > 0 ? frames_ / total : 0.0);
+        for (size_t i = 0; i < order_.size(); i++) {
+            double seconds = seconds_.find(order_[i])->second;
+            fprintf(stderr, "  %-12s %10.3f s %8.3f ms/frame %6.1f%%\n", order_[i].c_str(), seconds,
+                    frames_ ? seconds * 1000 / frames_ : 0.0, total > 0 ? seconds * 100 / total : 0.0);
+        }
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+            // на Linux ru_maxrss измеряется в килобайтах
+            fprintf(stderr, "peak RSS: %.1f MB\n", usage.ru_maxrss / 1024.0);
+        }
+    }
+
+private:
+    // Монотонное время в секундах.
+    static double now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    long frames_;
+    double start_;
+    double mark_;
+    std::vector<std::string> order_;
+    std::map<std::string, double> seconds_;
+};
+
+// Ищет в аргументах флаг flag и убирает его, чтобы остальной разбор аргументов не изменился.
+inline bool takeFlag(int& argc, char** argv, const char* flag) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], flag) == 0) {
+            for (int j = i; j + 1 < argc; j++) {
+                argv[j] = argv[j + 1];
+            }
+            argc--;
+            argv[argc] = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif // SAMPLE_BENCH_HPP
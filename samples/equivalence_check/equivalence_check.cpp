@@ -0,0 +1,236 @@
+// Сравнивает эталонные и оптимизированные пути dva на синтетической сцене (SyntheticScene)
+// при помощи EquivalenceHarness, у каждой пары свои допуски:
+//   - FireDetectOnDynamicAlgorithm: плотный расчёт против разреженного (sparseMode_), приближённо;
+//   - MorphologyFilter: cv::Mat против упакованной маски AnCommon::BitMask, точно;
+//   - SmokeDetector: execute() против executeBatch() и prepare()/executePrepared(), точно, вплоть до xml;
+//   - LeftThingsDetector: CodeBookAlgorithm против TiledCodeBookAlgorithm, приближённо по объектам и битовой карте.
+// Кадры, вышедшие за допуски, сохраняются в <repro_dir>. Код возврата 0 - пути равнозначны.
+//
+//   equivalence_check [width height [seed [frames [repro_dir]]]]
+
+#include <cstdlib>
+#include <iostream>
+#include <boost/lexical_cast.hpp>
+
+#include "SyntheticScene.h"
+#include "EquivalenceHarness.h"
+#include "FireDetectOnDynamicAlgorithm.h"
+#include "MorphologyFilter.h"
+#include "BitMask.h"
+#include "SmokeDetector.h"
+#include "LeftThingsDetector.h"
+#include "TiledCodeBookAlgorithm.h"
+
+// Морфология по упакованной маске, приведённая к интерфейсу ImageFilter.
+class PackedMorphologyFilter : public MorphologyFilter {
+public:
+    virtual cv::Mat operator()(cv::Mat& img) {
+        mask_.assign(img);
+        MorphologyFilter::operator()(mask_);
+        return mask_.toMat(255);
+    }
+
+private:
+    AnCommon::BitMask mask_;
+};
+
+// Источник масок для фильтров: разность соседних кадров сцены.
+class SceneMaskSource : public FrameSource {
+public:
+    explicit SceneMaskSource(SyntheticScene& scene) : scene_(scene) {}
+
+    virtual bool read(cv::Mat& mask) {
+        cv::Mat frame;
+        if (!scene_.read(frame)) {
+            return false;
+        }
+        if (previous_.empty()) {
+            previous_ = frame.clone();
+        }
+        cv::Mat diff;
+        cv::absdiff(frame, previous_, diff);
+        cv::cvtColor(diff, diff, CV_BGR2GRAY);
+        mask = diff > 20;
+        frame.copyTo(previous_);
+        return true;
+    }
+
+private:
+    SyntheticScene& scene_;
+    cv::Mat previous_;
+};
+
+// Переводит оба детектора оставленных вещей из обучения в классификацию после заданного количества кадров.
+// Переключение происходит между кадрами, поэтому годится только для покадрового пути кандидата.
+class LearningSceneSource : public FrameSource {
+public:
+    LearningSceneSource(SyntheticScene& scene, int learningFrames, Detector& reference, Detector& candidate)
+        : scene_(scene), learningFrames_(learningFrames), frames_(0), reference_(reference), candidate_(candidate) {}
+
+    virtual bool read(cv::Mat& frame) {
+        if (frames_++ == learningFrames_) {
+            classify(reference_);
+            classify(candidate_);
+        }
+        return scene_.read(frame);
+    }
+
+private:
+    static void classify(Detector& detector) {
+        xml::Request::Params params = detector.getSettings();
+        params["mode"] = boost::lexical_cast<std::string>(AnCommon::CLASSIFICATION);
+        detector.setSettings(params);
+    }
+
+    SyntheticScene& scene_;
+    int learningFrames_;
+    int frames_;
+    Detector& reference_;
+    Detector& candidate_;
+};
+
+static void setUpSmokeDetector(SmokeDetector& detector) {
+    xml::Request::Params params = detector.getSettings();
+    // результат на каждом кадре, без прореживания AlertThrottle
+    params["alertTime"] = "0";
+    detector.setSettings(params);
+    detector.on();
+}
+
+static void setUpLeftThingsDetector(LeftThingsDetector& detector, const std::string& backgroundAlgorithm) {
+    xml::Request::Params params = detector.getSettings();
+    params["alertTime"] = "0";
+    params["interval"] = "2";
+    params["mode"] = boost::lexical_cast<std::string>(AnCommon::LEARNING);
+    // обучение по времени на часах сделало бы момент переключения разным у эталона и кандидата,
+    // поэтому в классификацию детекторы переводит LearningSceneSource
+    params["startingLearningTime"] = "1000000";
+    if (!backgroundAlgorithm.empty()) {
+        params["backgroundAlgorithm"] = backgroundAlgorithm;
+    }
+    detector.setSettings(params);
+    detector.on();
+}
+
+static bool report(const std::string& name, const EquivalenceHarness::Report& report) {
+    std::cout << name << ": " << report.frames << " frames, " << report.divergentFrames << " divergent";
+    if (!report.isEquivalent()) {
+        std::cout << " (first " << report.firstDivergentFrame << ")";
+    }
+    std::cout << "; worst " << report.worst.pixelDiffPercent << "% pixels, objects "
+              << report.worst.referenceObjects << "/" << report.worst.candidateObjects
+              << ", shift " << report.worst.objectShift << ", blocks " << report.worst.bitmapDiffBlocks;
+    if (report.xmlDiffFrames > 0) {
+        std::cout << ", xml differs on " << report.xmlDiffFrames << " frames";
+    }
+    std::cout << std::endl;
+    return report.isEquivalent();
+}
+
+int main(int argc, char* argv[]) {
+    SyntheticScene::SyntheticSceneSettings sceneSettings;
+    sceneSettings.frameCount_ = 250;
+    if (argc >= 3) {
+        sceneSettings.size_ = cv::Size(atoi(argv[1]), atoi(argv[2]));
+    }
+    if (argc >= 4) {
+        sceneSettings.seed_ = static_cast<unsigned>(strtoul(argv[3], NULL, 10));
+    }
+    if (argc >= 5) {
+        sceneSettings.frameCount_ = atoi(argv[4]);
+    }
+    if (sceneSettings.size_.width <= 0 || sceneSettings.size_.height <= 0 || sceneSettings.frameCount_ <= 0) {
+        std::cerr << "Usage: " << argv[0] << " [width height [seed [frames [repro_dir]]]]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // точные пути: допуски по умолчанию, то есть полное совпадение
+    EquivalenceHarness::EquivalenceHarnessSettings exactSettings;
+    if (argc >= 6) {
+        exactSettings.reproDir_ = argv[5];
+    }
+
+    // разреженный режим огня не считает динамику вдали от областей огненного цвета и прореживает фоновую
+    // статистику, поэтому отдельные пиксели на краях областей могут различаться
+    EquivalenceHarness::EquivalenceHarnessSettings sparseFireSettings = exactSettings;
+    sparseFireSettings.maxPixelDiffPercent_ = 0.5;
+    sparseFireSettings.maxObjectCountDiff_ = 1;
+    sparseFireSettings.maxObjectShift_ = 8;
+    sparseFireSettings.maxBitmapDiffBlocks_ = 4;
+
+    // мозаичная модель фона хранит кодовые слова с другой точностью, объекты могут смещаться на блок
+    EquivalenceHarness::EquivalenceHarnessSettings tiledModelSettings = exactSettings;
+    tiledModelSettings.maxObjectCountDiff_ = 1;
+    tiledModelSettings.maxObjectShift_ = 32;
+    tiledModelSettings.maxBitmapDiffBlocks_ = 8;
+    tiledModelSettings.compareXml_ = false;
+
+    bool equivalent = true;
+
+    {
+        FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings dense;
+        dense.sparseMode_ = false;
+        FireDetectOnDynamicAlgorithm::FireDetectOnDynamicAlgorithmSettings sparse;
+        sparse.sparseMode_ = true;
+        FireDetectOnDynamicAlgorithm reference(dense);
+        FireDetectOnDynamicAlgorithm candidate(sparse);
+
+        SyntheticScene scene(sceneSettings);
+        EquivalenceHarness harness(sparseFireSettings);
+        equivalent &= report("FireDetectOnDynamic dense/sparse", harness.run(reference, candidate, scene));
+    }
+
+    {
+        MorphologyFilter reference;
+        PackedMorphologyFilter candidate;
+
+        SyntheticScene scene(sceneSettings);
+        SceneMaskSource masks(scene);
+        EquivalenceHarness harness(exactSettings);
+        equivalent &= report("MorphologyFilter Mat/BitMask", harness.run(reference, candidate, masks));
+    }
+
+    try {
+        {
+            SmokeDetector reference;
+            SmokeDetector candidate;
+            setUpSmokeDetector(reference);
+            setUpSmokeDetector(candidate);
+
+            SyntheticScene scene(sceneSettings);
+            EquivalenceHarness harness(exactSettings);
+            equivalent &= report("SmokeDetector execute/executeBatch",
+                                 harness.run(reference, candidate, EquivalenceHarness::BATCH, scene, sceneSettings.fps_));
+        }
+
+        {
+            SmokeDetector reference;
+            SmokeDetector candidate;
+            setUpSmokeDetector(reference);
+            setUpSmokeDetector(candidate);
+
+            SyntheticScene scene(sceneSettings);
+            EquivalenceHarness harness(exactSettings);
+            equivalent &= report("SmokeDetector execute/executePrepared",
+                                 harness.run(reference, candidate, EquivalenceHarness::PREPARED, scene, sceneSettings.fps_));
+        }
+
+        {
+            LeftThingsDetector reference;
+            LeftThingsDetector candidate;
+            setUpLeftThingsDetector(reference, "");
+            setUpLeftThingsDetector(candidate, TiledCodeBookAlgorithm::TILED_CODE_BOOK_ALGORITHM);
+
+            SyntheticScene scene(sceneSettings);
+            LearningSceneSource frames(scene, sceneSettings.frameCount_ / 3, reference, candidate);
+            EquivalenceHarness harness(tiledModelSettings);
+            equivalent &= report("LeftThingsDetector codeBook/tiledCodeBook",
+                                 harness.run(reference, candidate, EquivalenceHarness::EXECUTE, frames, sceneSettings.fps_));
+        }
+    } catch (std::string& error) {
+        std::cerr << "Error: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return equivalent ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+# Плотный и разреженный пути на сцене 704x576 (D1), зерно 1, 500 кадров; расхождения - в ./repro.
+mkdir -p ./repro
+LD_LIBRARY_PATH="/usr/local/lib" ./equivalence_check 704 576 1 500 ./repro
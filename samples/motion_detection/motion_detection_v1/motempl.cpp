@@ -11,6 +11,8 @@
 #include <sstream>
 #include <vector>
 
+#include "../../common/sample_bench.hpp"
+
 using namespace cv;
 using namespace std;
 
@@ -48,6 +50,10 @@ IplImage *mask = 0; // valid orientation mask
 IplImage *segmask = 0; // motion segmentation map
 CvMemStorage* storage = 0; // temporary storage
 
+// --headless: без окон и задержек, с итогами производительности при выходе
+bool headless = false;
+SampleBench bench;
+
 
 void throwError(const std::string& msg) {
     cerr << "Error: " << msg << endl;
@@ -132,7 +138,9 @@ void drawObjects(Mat& curFrame, Mat& img) {
     Mat resultConnectComp = connectedComponentsFilter(curFrame, resultMorph);
 
     /// Show in a window
-    imshow( "Contours", resultConnectComp);
+    if (!headless) {
+        imshow( "Contours", resultConnectComp);
+    }
 }
 
 
@@ -290,6 +298,8 @@ int main(int argc, char** argv)
     IplImage* motion = 0;
     CvCapture* capture = 0;
 
+    headless = takeFlag(argc, argv, "--headless");
+
     if( argc == 2 ) {
         std::cout <<  "Capture file:" << argv[1] << std::endl;
         capture = cvCaptureFromFile(argv[1]);
@@ -297,19 +307,23 @@ int main(int argc, char** argv)
             std::cout << "capture is null." << std::endl;
         }
     } else {
-        std::cout << "Error there are no 2 arg." << std::endl;
+        std::cout << "Error there are no 2 arg. Usage: motempl <video file> [--headless]" << std::endl;
     }
 
     if( capture )
     {
-        cvNamedWindow( "Motion", 1 );
+        if (!headless) {
+            cvNamedWindow( "Motion", 1 );
+        }
 
         for(;;)
         {
+            bench.beginFrame();
             IplImage* image = cvQueryFrame( capture );
             if( !image ) {
                 break;
             }
+            bench.stage("read");
 
             if( !motion )
             {
@@ -320,14 +334,23 @@ int main(int argc, char** argv)
             }
 
             update_mhi( image, motion, 15 );
+            bench.stage("mhi");
+            bench.endFrame();
+            if (headless) {
+                continue;
+            }
             cvShowImage( "Motion", motion );
             cvShowImage("CurFrame", image);
             if( cvWaitKey(10) >= 0 )
                 break;
         }
         cvReleaseCapture( &capture );
-        cvDestroyWindow( "Motion" );
-        cvDestroyWindow( "CurFrame" );
+        if (headless) {
+            bench.report();
+        } else {
+            cvDestroyWindow( "Motion" );
+            cvDestroyWindow( "CurFrame" );
+        }
     }
 
     return 0;
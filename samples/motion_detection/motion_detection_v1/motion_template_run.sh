@@ -1,10 +1,15 @@
 #!/bin/bash
 
+# Ролик генерируется примером samples/synthetic_video (synthetic_video_run.sh).
+
 #LD_LIBRARY_PATH="./../../../external_libs/lib" ./motempl /home/sergey/iq720p.mp4
 
 #LD_LIBRARY_PATH="/usr/local/lib" ./motempl /home/sergey/iq720p.mp4
 
 #/home/user/Projects/computer_vision/samples/motion_detection/motion_detection_v1/motempl /home/user/iq720p.mp4
 
-LD_LIBRARY_PATH="./../../../external_libs/lib64_"  /home/user/Projects/computer_vision/samples/motion_detection/motion_detection_v1/motempl /home/user/iq720p.mp4
+LD_LIBRARY_PATH="./../../../external_libs/lib64_"  ./motempl ../../synthetic_video/synthetic720p.avi
+
 
+# без окон, с максимальной скоростью и итогами производительности:
+#./motempl ../../synthetic_video/synthetic720p.avi --headless
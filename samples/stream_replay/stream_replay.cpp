@@ -0,0 +1,131 @@
+// Записывает входной поток детектора dva в файл записи и воспроизводит его, чтобы задержки обработки
+// можно было повторять на рабочей станции.
+//
+//   stream_replay --record <video> <recording.dvar> <detector_type> [name=value ...]
+//   stream_replay <recording.dvar> [--flat-out] [--results]
+//
+// При записи кадры видеофайла подаются детектору с временем, отсчитанным по частоте кадров ролика.
+// При воспроизведении кадры подаются с исходными интервалами, а с --flat-out -- сразу друг за другом.
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/highgui/highgui_c.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "LeftThingsDetector.h"
+#include "SmokeDetector.h"
+#include "RecordingDetector.h"
+#include "StreamRecording.h"
+#include "../common/sample_bench.hpp"
+
+static Detector::SharedPtr createDetector(const std::string& type) {
+    if (type == LeftThingsDetector::LEFT_THINGS_DETECTOR) {
+        return Detector::SharedPtr(new LeftThingsDetector());
+    }
+    if (type == SmokeDetector::SMOKE_DETECTOR) {
+        return Detector::SharedPtr(new SmokeDetector());
+    }
+    return Detector::SharedPtr();
+}
+
+static int record(int argc, char* argv[]) {
+    Detector::SharedPtr detector = createDetector(argv[4]);
+    if (!detector) {
+        std::cerr << "Unknown detector type: " << argv[4] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    xml::Request::Params params;
+    for (int i = 5; i < argc; i++) {
+        const char* separator = strchr(argv[i], '=');
+        if (separator == NULL) {
+            std::cerr << "Setting must be name=value: " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+        params[std::string(argv[i], separator - argv[i])] = separator + 1;
+    }
+
+    cv::VideoCapture capture(argv[2]);
+    if (!capture.isOpened()) {
+        std::cerr << "Unable to open video file: " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+    double fps = capture.get(CV_CAP_PROP_FPS);
+    if (fps <= 0) {
+        fps = 25;
+    }
+
+    RecordingDetector recorder(detector, argv[3]);
+    if (!params.empty()) {
+        recorder.setSettings(params);
+    }
+    recorder.on();
+
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    cv::Mat frame;
+    std::string resultingXml;
+    int frames = 0;
+    while (capture.read(frame) && !frame.empty()) {
+        boost::posix_time::ptime imageTime = start + boost::posix_time::microseconds(static_cast<long>(frames * 1000000 / fps));
+        recorder.execute(frame, imageTime, resultingXml);
+        frames++;
+    }
+    recorder.off();
+
+    std::cout << argv[3] << ": " << frames << " frames of " << argv[4] << std::endl;
+    return EXIT_SUCCESS;
+}
+
+static int replay(int argc, char* argv[]) {
+    bool flatOut = takeFlag(argc, argv, "--flat-out");
+    bool printResults = takeFlag(argc, argv, "--results");
+
+    StreamReader reader(argv[1]);
+    Detector::SharedPtr detector = createDetector(reader.getDetectorType());
+    if (!detector) {
+        std::cerr << "Unknown detector type: " << reader.getDetectorType() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> results;
+    StreamReplayer replayer(reader);
+    StreamReplayer::Report report = replayer.replay(*detector, flatOut ? StreamReplayer::FLAT_OUT : StreamReplayer::ORIGINAL_PACE,
+                                                    printResults ? &results : NULL);
+    detector->off();
+
+    for (size_t i = 0; i < results.size(); i++) {
+        std::cout << results[i] << std::endl;
+    }
+    std::cout << reader.getDetectorType() << ": " << report.frames << " frames, " << report.settingsChanges << " settings changes, "
+              << report.results << " results" << std::endl;
+    if (report.frames > 0) {
+        std::cout << "execute: " << report.totalExecuteTime.total_microseconds() / report.frames / 1000.0 << " ms average, "
+                  << report.maxExecuteTime.total_microseconds() / 1000.0 << " ms max (frame " << report.slowestFrame << ")" << std::endl;
+    }
+    if (!flatOut) {
+        std::cout << "late frames: " << report.lateFrames << std::endl;
+    }
+    if (report.gaps > 0) {
+        std::cout << "recording gaps: " << report.gaps << " (" << report.droppedFrames << " frames dropped while recording)" << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        if (argc >= 5 && strcmp(argv[1], "--record") == 0) {
+            return record(argc, argv);
+        }
+        if (argc >= 2 && strncmp(argv[1], "--", 2) != 0) {
+            return replay(argc, argv);
+        }
+    } catch (std::string& error) {
+        std::cerr << "Error: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cerr << "Usage: " << argv[0] << " --record <video> <recording.dvar> <detector_type> [name=value ...]" << std::endl
+              << "       " << argv[0] << " <recording.dvar> [--flat-out] [--results]" << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+# Запись входного потока детектора оставленных вещей по синтетическому ролику и воспроизведение без пауз.
+LD_LIBRARY_PATH="/usr/local/lib" ./stream_replay --record ../synthetic_video/synthetic720p.avi ./left_things.dvar LEFT_THINGS_DETECTOR
+LD_LIBRARY_PATH="/usr/local/lib" ./stream_replay ./left_things.dvar --flat-out
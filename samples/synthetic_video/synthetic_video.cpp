@@ -0,0 +1,65 @@
+// Записывает синтетическую сцену dva (SyntheticScene) в видеофайл, чтобы примеры и замеры
+// можно было запускать без внешних записей. Одинаковые аргументы дают одинаковые кадры.
+//
+//   synthetic_video <output.avi> [width height [seed [frames]]]
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/highgui/highgui_c.h>
+#include <cstdlib>
+#include <iostream>
+
+#include "SyntheticScene.h"
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <output.avi> [width height [seed [frames]]]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    SyntheticScene::SyntheticSceneSettings settings;
+    if (argc >= 4) {
+        settings.size_ = cv::Size(atoi(argv[2]), atoi(argv[3]));
+    }
+    if (argc >= 5) {
+        settings.seed_ = static_cast<unsigned>(strtoul(argv[4], NULL, 10));
+    }
+    if (argc >= 6) {
+        settings.frameCount_ = atoi(argv[5]);
+    }
+    if (settings.size_.width <= 0 || settings.size_.height <= 0 || settings.frameCount_ <= 0) {
+        std::cerr << "Width, height and frames must be positive" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // MJPG есть почти в любой сборке OpenCV
+    cv::VideoWriter writer(argv[1], CV_FOURCC('M', 'J', 'P', 'G'), settings.fps_, settings.size_);
+    if (!writer.isOpened()) {
+        std::cerr << "Unable to open video file for writing: " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    SyntheticScene scene(settings);
+    cv::Mat frame;
+    while (scene.read(frame)) {
+        writer.write(frame);
+    }
+
+    std::cout << argv[1] << ": " << settings.frameCount_ << " frames " << settings.size_.width << "x" << settings.size_.height
+              << ", seed " << settings.seed_ << std::endl;
+    for (size_t i = 0; i < scene.getStandingObjects().size(); i++) {
+        const SyntheticScene::Event& event = scene.getStandingObjects()[i];
+        std::cout << "  standing object " << event.rect.x << "," << event.rect.y << " " << event.rect.width << "x" << event.rect.height
+                  << " from frame " << event.appearFrame << std::endl;
+    }
+    for (size_t i = 0; i < scene.getFireRegions().size(); i++) {
+        const SyntheticScene::Event& event = scene.getFireRegions()[i];
+        std::cout << "  fire " << event.rect.x << "," << event.rect.y << " " << event.rect.width << "x" << event.rect.height
+                  << " from frame " << event.appearFrame << std::endl;
+    }
+    for (size_t i = 0; i < scene.getSmokeVeils().size(); i++) {
+        const SyntheticScene::Event& event = scene.getSmokeVeils()[i];
+        std::cout << "  smoke " << event.rect.x << "," << event.rect.y << " " << event.rect.width << "x" << event.rect.height
+                  << " from frame " << event.appearFrame << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
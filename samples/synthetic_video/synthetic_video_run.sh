@@ -0,0 +1,4 @@
+#!/bin/bash
+
+# Синтетический ролик вместо /home/user/iq720p.mp4: 1280x720, зерно 1, 1500 кадров.
+LD_LIBRARY_PATH="/usr/local/lib" ./synthetic_video ./synthetic720p.avi 1280 720 1 1500